@@ -0,0 +1,236 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Minimal benchmark harness for the portable VsUI headers
+// A benchmark is a round of work (e.g. scaling a batch of images) timed
+// repeatedly until the minimum measuring time is reached. The setup of each
+// round (e.g. restoring pixels modified in place) is not timed. The results
+// are printed as JSON, with the time per unit of work (image, value, call)
+// and the throughput in millions of items (pixels, values) per second.
+// Doesn't depend on Windows.
+//-----------------------------------------------------------------------------
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace VsUI
+{
+namespace Benchmarks
+{
+    // Parameters of a measurement, printed in the order they were added
+    class CParameters
+    {
+    public:
+        CParameters& Add(const char* name, int value)
+        {
+            m_values.emplace_back(name, std::to_string(value));
+            return *this;
+        }
+
+        CParameters& Add(const char* name, const char* value)
+        {
+            m_values.emplace_back(name, Quote(value));
+            return *this;
+        }
+
+        const std::vector<std::pair<std::string, std::string>>& GetValues() const
+        {
+            return m_values;
+        }
+
+        static std::string Quote(const std::string& text)
+        {
+            std::string quoted = "\"";
+            for (char c : text)
+            {
+                if (c == '"' || c == '\\')
+                    quoted += '\\';
+                quoted += c;
+            }
+            return quoted + "\"";
+        }
+
+    private:
+        // Names and JSON values
+        std::vector<std::pair<std::string, std::string>> m_values;
+    };
+
+    // What one round of a benchmark does: unitsPerRound units (e.g. images) of itemsPerUnit items (e.g. pixels) each
+    struct Workload
+    {
+        const char* unit;
+        const char* items;
+        double unitsPerRound;
+        double itemsPerUnit;
+    };
+
+    class CBenchmarkRunner
+    {
+    public:
+        CBenchmarkRunner(double minSeconds, const std::string& filter) :
+            m_minSeconds(minSeconds), m_filter(filter)
+        {
+        }
+
+        // Returns true if the benchmarks of suite/name are selected by the filter
+        bool IsSelected(const char* suite, const char* name) const
+        {
+            return m_filter.empty() || (std::string(suite) + "/" + name).find(m_filter) != std::string::npos;
+        }
+
+        // Times body() until the minimum measuring time is reached, calling setup() untimed before each round
+        template <typename TSetup, typename TBody>
+        void Measure(const char* suite, const char* name, const CParameters& parameters, const Workload& workload, TSetup&& setup, TBody&& body)
+        {
+            if (!IsSelected(suite, name))
+                return;
+
+            // Warm up the caches and the lazily built tables (e.g. the filter taps of the image scaler)
+            setup();
+            body();
+
+            std::chrono::steady_clock::duration elapsed(0);
+            uint64_t rounds = 0;
+            do
+            {
+                setup();
+                auto start = std::chrono::steady_clock::now();
+                body();
+                elapsed += std::chrono::steady_clock::now() - start;
+                rounds++;
+            } while (std::chrono::duration<double>(elapsed).count() < m_minSeconds);
+
+            Result result;
+            result.suite = suite;
+            result.name = name;
+            result.parameters = parameters;
+            result.workload = workload;
+            result.rounds = rounds;
+            result.seconds = std::chrono::duration<double>(elapsed).count();
+            m_results.push_back(std::move(result));
+        }
+
+        template <typename TBody>
+        void Measure(const char* suite, const char* name, const CParameters& parameters, const Workload& workload, TBody&& body)
+        {
+            Measure(suite, name, parameters, workload, [] {}, body);
+        }
+
+        void WriteJson(FILE* pFile, const CParameters& context) const
+        {
+            fprintf(pFile, "{\n  \"context\": %s,\n  \"benchmarks\": [", FormatObject(context).c_str());
+            for (size_t i = 0; i < m_results.size(); i++)
+            {
+                const Result& result = m_results[i];
+                double units = result.workload.unitsPerRound * result.rounds;
+                double nsPerUnit = result.seconds * 1e9 / units;
+                double millionItemsPerSecond = units * result.workload.itemsPerUnit / result.seconds / 1e6;
+
+                fprintf(pFile, "%s\n    { \"suite\": %s, \"name\": %s, \"parameters\": %s, \"rounds\": %llu, \"nsPer%s\": %.3f, \"m%sPerSecond\": %.3f }",
+                    i == 0 ? "" : ",", CParameters::Quote(result.suite).c_str(), CParameters::Quote(result.name).c_str(),
+                    FormatObject(result.parameters).c_str(), static_cast<unsigned long long>(result.rounds),
+                    Capitalize(result.workload.unit).c_str(), nsPerUnit, result.workload.items, millionItemsPerSecond);
+            }
+            fprintf(pFile, "\n  ]\n}\n");
+        }
+
+    private:
+        struct Result
+        {
+            std::string suite;
+            std::string name;
+            CParameters parameters;
+            Workload workload;
+            uint64_t rounds;
+            double seconds;
+        };
+
+        static std::string FormatObject(const CParameters& parameters)
+        {
+            std::string text = "{";
+            for (const auto& value : parameters.GetValues())
+            {
+                text += (text.size() > 1 ? ", " : " ") + CParameters::Quote(value.first) + ": " + value.second;
+            }
+            return text + (text.size() > 1 ? " }" : "}");
+        }
+
+        static std::string Capitalize(const char* text)
+        {
+            std::string capitalized = text;
+            if (!capitalized.empty() && capitalized[0] >= 'a' && capitalized[0] <= 'z')
+                capitalized[0] = static_cast<char>(capitalized[0] - 'a' + 'A');
+            return capitalized;
+        }
+
+        double m_minSeconds;
+        std::string m_filter;
+        std::vector<Result> m_results;
+    };
+
+    // Keeps the compiler from optimizing away the work whose result is otherwise unused
+    inline void KeepResult(uint32_t value)
+    {
+        static volatile uint32_t s_sink = 0;
+        s_sink = s_sink + value;
+    }
+
+    // Deterministic 32bpp ARGB test icon: mostly opaque pixels, with antialiased (translucent) edges, transparent
+    // pixels, and about 1 pixel in 16 of one of the given key colors (e.g. the magenta of the legacy transparency key)
+    inline std::vector<uint32_t> MakeIconPixels(int width, int height, const uint32_t* pKeyColors = nullptr, unsigned int keyCount = 0)
+    {
+        std::vector<uint32_t> pixels(static_cast<size_t>(width) * height);
+        uint32_t random = 0x12345678;
+        for (size_t i = 0; i < pixels.size(); i++)
+        {
+            random = random * 1664525 + 1013904223;
+            uint32_t color = random >> 8;
+            switch (random >> 28)
+            {
+            case 0:
+                pixels[i] = keyCount != 0 ? pKeyColors[(random >> 4) % keyCount] : 0xFF000000 | color;
+                break;
+            case 1:
+                pixels[i] = 0;
+                break;
+            case 2:
+                pixels[i] = ((random & 0xFE) << 24) | color;
+                break;
+            default:
+                pixels[i] = 0xFF000000 | color;
+                break;
+            }
+        }
+        return pixels;
+    }
+
+    // Number of images of the given pixel count in a round, so that the clock is read once for at least ~64K pixels
+    inline int ImagesPerRound(int pixelCount)
+    {
+        const int k_PixelsPerRound = 64 * 1024;
+        return pixelCount >= k_PixelsPerRound ? 1 : (k_PixelsPerRound + pixelCount - 1) / pixelCount;
+    }
+
+    // The icon sizes and the display scale factors the sample converts images for
+    const int k_IconSizes[] = { 16, 24, 32, 48, 64, 128, 256 };
+    const int k_ScalePercents[] = { 100, 125, 150, 175, 200, 250, 300, 400 };
+
+    void RunPixelKernelsBenchmarks(CBenchmarkRunner& runner);
+    void RunImageScalerBenchmarks(CBenchmarkRunner& runner);
+    void RunMulDivBenchmarks(CBenchmarkRunner& runner);
+    void RunTaskPoolBenchmarks(CBenchmarkRunner& runner);
+#ifdef VSUI_GDIPLUS_BENCHMARKS
+    void RunGdiplusBenchmarks(CBenchmarkRunner& runner);
+#endif
+
+} // namespace
+} // namespace
@@ -0,0 +1,88 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Benchmarks of the portable image conversion code, printed as JSON
+// Usage: VsUIBenchmarks [--quick] [--min-time=<seconds>] [--filter=<suite/name substring>]
+// --quick only checks that every benchmark runs (used by the CTest smoke test).
+//-----------------------------------------------------------------------------
+#include "VsUIBenchmark.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include "VsUIMulDiv.h"
+#include "VsUIPixelKernels.h"
+
+using namespace VsUI::Benchmarks;
+
+namespace
+{
+    const char* GetPixelKernelsInstructionSet()
+    {
+#if defined(VSUI_PIXELS_AVX2)
+        return "AVX2";
+#elif defined(VSUI_PIXELS_SSE2)
+        return "SSE2";
+#elif defined(VSUI_PIXELS_NEON)
+        return "NEON";
+#else
+        return "scalar";
+#endif
+    }
+
+    const char* GetMulDivInstructionSet()
+    {
+#if defined(VSUI_MULDIV_SSE2)
+        return "SSE2";
+#else
+        return "scalar";
+#endif
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    double minSeconds = 0.1;
+    std::string filter;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--quick") == 0)
+        {
+            minSeconds = 0;
+        }
+        else if (strncmp(argv[i], "--min-time=", 11) == 0)
+        {
+            minSeconds = atof(argv[i] + 11);
+        }
+        else if (strncmp(argv[i], "--filter=", 9) == 0)
+        {
+            filter = argv[i] + 9;
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--quick] [--min-time=<seconds>] [--filter=<suite/name substring>]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    CBenchmarkRunner runner(minSeconds, filter);
+    RunPixelKernelsBenchmarks(runner);
+    RunImageScalerBenchmarks(runner);
+    RunMulDivBenchmarks(runner);
+    RunTaskPoolBenchmarks(runner);
+#ifdef VSUI_GDIPLUS_BENCHMARKS
+    RunGdiplusBenchmarks(runner);
+#endif
+
+    CParameters context;
+    context.Add("hardwareThreads", static_cast<int>(std::thread::hardware_concurrency()))
+        .Add("pixelKernels", GetPixelKernelsInstructionSet())
+        .Add("mulDiv", GetMulDivInstructionSet());
+    runner.WriteJson(stdout, context);
+    return 0;
+}
@@ -0,0 +1,80 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Benchmarks of the GDI+ session lifetime of GdiplusImage: a temporary image
+// created, filled with icon pixels and destroyed, with the IdleTimeout lifetime
+// and a timeout of 0 (GDI+ shut down with the last image and started again by
+// the next one, the behavior before the Process lifetime), and with the
+// default Process lifetime that keeps GDI+ running across the images.
+// Windows only, built when the benchmarks are built for Windows.
+//-----------------------------------------------------------------------------
+#include "VsUIBenchmark.h"
+
+#include <windows.h>
+#include <objidl.h>
+#include <cstring>
+#include "VsUIGdiplusImage.h"
+
+using namespace VsUI::Benchmarks;
+
+namespace
+{
+    const char* const k_Suite = "Gdiplus";
+
+    // Creates a temporary image of the icon pixels and reads one pixel back, as the temporary images of CDpiHelper do
+    uint32_t UseTemporaryImage(const std::vector<uint32_t>& pixels, int size)
+    {
+        VsUI::GdiplusImage image;
+        image.Create(size, size);
+        if (!image.IsLoaded())
+            return 0;
+
+        const uint32_t* pSourceRow = pixels.data();
+        VsUI::GdiplusImage::ProcessBitmapRows(image.GetBitmap(), [&](Gdiplus::ARGB* pRow, UINT width)
+        {
+            memcpy(pRow, pSourceRow, width * sizeof(Gdiplus::ARGB));
+            pSourceRow += width;
+        });
+
+        Gdiplus::Color color;
+        image.GetBitmap()->GetPixel(size - 1, size - 1, &color);
+        return color.GetValue();
+    }
+}
+
+void VsUI::Benchmarks::RunGdiplusBenchmarks(CBenchmarkRunner& runner)
+{
+    for (int size : { 16, 32, 64 })
+    {
+        std::vector<uint32_t> pixels = MakeIconPixels(size, size);
+        const int images = 16;
+        Workload workload = { "image", "images", static_cast<double>(images), 1 };
+        CParameters parameters;
+        parameters.Add("size", size);
+
+        // Every image starts GDI+ and shuts it down when destroyed
+        VsUI::GdiplusImage::SetGdiplusLifetime(VsUI::GdiplusImage::GdiplusLifetime::IdleTimeout, 0);
+        runner.Measure(k_Suite, "IdleTimeoutZero", parameters, workload, [&]
+        {
+            for (int i = 0; i < images; i++)
+            {
+                KeepResult(UseTemporaryImage(pixels, size));
+            }
+        });
+
+        // The first image starts GDI+, and the others reuse it
+        VsUI::GdiplusImage::SetGdiplusLifetime(VsUI::GdiplusImage::GdiplusLifetime::Process);
+        runner.Measure(k_Suite, "ProcessLifetime", parameters, workload, [&]
+        {
+            for (int i = 0; i < images; i++)
+            {
+                KeepResult(UseTemporaryImage(pixels, size));
+            }
+        });
+        VsUI::GdiplusImage::ShutdownGdiplus();
+    }
+}
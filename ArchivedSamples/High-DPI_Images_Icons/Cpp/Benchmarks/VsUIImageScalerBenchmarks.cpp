@@ -0,0 +1,373 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Benchmarks of CImageScaler for every scaling mode of CDpiHelper
+// Each logical icon size is scaled to the device size of each display scale
+// factor, as CDpiHelper::LogicalToDeviceUnits does. BorderOnly draws the icon
+// unscaled in the middle of the device image. The throughput counts the
+// destination pixels.
+// The integer factors of nearest neighbor scaling are also compared with the
+// per pixel lookups of the generic path, and with a memcpy of the destination
+// image (the memory bandwidth bound), and the polyphase filtered scaling with
+// the scaler computing the taps of every destination pixel on every call.
+//-----------------------------------------------------------------------------
+#include "VsUIBenchmark.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "VsUIImageScaler.h"
+#include "VsUIMulDiv.h"
+
+using namespace VsUI;
+using namespace VsUI::Benchmarks;
+
+namespace
+{
+    const char* const k_Suite = "ImageScaler";
+
+    struct ScalingMode
+    {
+        const char* name;
+        CImageScaler::Filter filter;
+        bool fBorderOnly;
+    };
+
+    const ScalingMode k_ScalingModes[] =
+    {
+        { "NearestNeighbor", CImageScaler::Filter::NearestNeighbor, false },
+        { "Bilinear", CImageScaler::Filter::Bilinear, false },
+        { "Bicubic", CImageScaler::Filter::Bicubic, false },
+        { "HighQualityBilinear", CImageScaler::Filter::HighQualityBilinear, false },
+        { "HighQualityBicubic", CImageScaler::Filter::HighQualityBicubic, false },
+        { "BorderOnly", CImageScaler::Filter::NearestNeighbor, true },
+    };
+
+    // Scaling code of CImageScaler before its fast paths, as the baseline of the benchmarks
+    class CReferenceScaler : public CImageScaler
+    {
+    public:
+        // Nearest neighbor scaling looking up the source pixel of every destination pixel, for any ratio
+        static void ScaleNearestNeighborPerPixel(const PixelBuffer& source, const PixelBuffer& destination, uint32_t background)
+        {
+            std::vector<int> sourceX(destination.width);
+            for (int x = 0; x < destination.width; x++)
+            {
+                sourceX[x] = NearestSourcePixel(x, source.width, destination.width);
+            }
+
+            for (int y = 0; y < destination.height; y++)
+            {
+                const uint32_t* pSourceRow = source.Row(NearestSourcePixel(y, source.height, destination.height));
+                uint32_t* pDestinationRow = destination.Row(y);
+                for (int x = 0; x < destination.width; x++)
+                {
+                    pDestinationRow[x] = ComposeStraight(pSourceRow[sourceX[x]], background);
+                }
+            }
+        }
+
+        // Filtered scaling computing the taps of each destination pixel on every call, with scalar loops
+        static void ScaleFilteredPerPixelTaps(const PixelBuffer& source, const PixelBuffer& destination, Filter filter, uint32_t background)
+        {
+            PerPixelTaps horizontalTaps;
+            PerPixelTaps verticalTaps;
+            ComputePerPixelTaps(source.width, destination.width, filter, &horizontalTaps);
+            ComputePerPixelTaps(source.height, destination.height, filter, &verticalTaps);
+
+            std::vector<uint32_t> premultipliedRow(source.width);
+            std::vector<int16_t> intermediate(static_cast<size_t>(source.height) * destination.width * 4);
+            for (int y = 0; y < source.height; y++)
+            {
+                const uint32_t* pSourceRow = source.Row(y);
+                for (int x = 0; x < source.width; x++)
+                {
+                    premultipliedRow[x] = Premultiply(pSourceRow[x]);
+                }
+
+                int16_t* pIntermediateRow = &intermediate[static_cast<size_t>(y) * destination.width * 4];
+                for (int x = 0; x < destination.width; x++)
+                {
+                    const int16_t* pWeights = &horizontalTaps.weights[static_cast<size_t>(x) * horizontalTaps.taps];
+                    ConvolveRowScalar(&premultipliedRow[horizontalTaps.first[x]], pWeights, horizontalTaps.taps, pIntermediateRow + 4 * x);
+                }
+            }
+
+            uint32_t premultipliedBackground = Premultiply(background);
+            ptrdiff_t intermediateStride = static_cast<ptrdiff_t>(destination.width) * 4;
+            for (int y = 0; y < destination.height; y++)
+            {
+                const int16_t* pWeights = &verticalTaps.weights[static_cast<size_t>(y) * verticalTaps.taps];
+                const int16_t* pIntermediate = &intermediate[static_cast<size_t>(verticalTaps.first[y]) * intermediateStride];
+                uint32_t* pDestinationRow = destination.Row(y);
+                for (int x = 0; x < destination.width; x++)
+                {
+                    uint32_t pixel = ComposePremultiplied(ConvolveColumnScalar(pIntermediate + 4 * x, intermediateStride, pWeights, verticalTaps.taps), premultipliedBackground);
+                    pDestinationRow[x] = ((pixel >> 24) == 0) ? background : Unpremultiply(pixel);
+                }
+            }
+        }
+
+    private:
+        // Taps of each destination pixel, clamped to the source: the samples outside the image are folded onto the edge pixels
+        struct PerPixelTaps
+        {
+            int taps;
+            std::vector<int> first;
+            std::vector<int16_t> weights;
+        };
+
+        static void ComputePerPixelTaps(int sourceSize, int destinationSize, Filter filter, PerPixelTaps* pTaps)
+        {
+            double scale = static_cast<double>(destinationSize) / sourceSize;
+            double filterScale = (IsHighQuality(filter) && scale < 1.0) ? 1.0 / scale : 1.0;
+            double support = FilterRadius(filter) * filterScale;
+
+            std::vector<int> low(destinationSize);
+            std::vector<int> high(destinationSize);
+            int maxCount = 1;
+            for (int i = 0; i < destinationSize; i++)
+            {
+                double center = FilterCenter(i, sourceSize, destinationSize);
+                low[i] = static_cast<int>(std::ceil(center - support - 0.5));
+                high[i] = static_cast<int>(std::floor(center + support - 0.5));
+                maxCount = std::max(maxCount, high[i] - low[i] + 1);
+            }
+
+            int taps = std::min(maxCount, sourceSize);
+            pTaps->taps = taps;
+            pTaps->first.assign(destinationSize, 0);
+            pTaps->weights.assign(static_cast<size_t>(destinationSize) * taps, 0);
+
+            std::vector<double> weights(taps);
+            for (int i = 0; i < destinationSize; i++)
+            {
+                double center = FilterCenter(i, sourceSize, destinationSize);
+                int first = std::max(0, std::min(low[i], sourceSize - taps));
+                pTaps->first[i] = first;
+
+                std::fill(weights.begin(), weights.end(), 0.0);
+                double total = 0.0;
+                for (int j = low[i]; j <= high[i]; j++)
+                {
+                    double weight = FilterWeight(filter, (j + 0.5 - center) / filterScale);
+                    weights[std::max(0, std::min(j, sourceSize - 1)) - first] += weight;
+                    total += weight;
+                }
+
+                int16_t* pWeights = &pTaps->weights[static_cast<size_t>(i) * taps];
+                int fixedTotal = 0;
+                int largest = 0;
+                for (int k = 0; k < taps; k++)
+                {
+                    pWeights[k] = static_cast<int16_t>(std::floor(weights[k] / total * k_WeightOne + 0.5));
+                    fixedTotal += pWeights[k];
+                    if (pWeights[k] > pWeights[largest])
+                        largest = k;
+                }
+                pWeights[largest] = static_cast<int16_t>(pWeights[largest] + k_WeightOne - fixedTotal);
+            }
+        }
+
+        static void ConvolveRowScalar(const uint32_t* pPixels, const int16_t* pWeights, int taps, int16_t* pResult)
+        {
+            const int shift = k_WeightBits - k_IntermediateBits;
+            int sum[4] = { 1 << (shift - 1), 1 << (shift - 1), 1 << (shift - 1), 1 << (shift - 1) };
+            for (int k = 0; k < taps; k++)
+            {
+                uint32_t pixel = pPixels[k];
+                int weight = pWeights[k];
+                sum[0] += weight * static_cast<int>(pixel & 0xFF);
+                sum[1] += weight * static_cast<int>((pixel >> 8) & 0xFF);
+                sum[2] += weight * static_cast<int>((pixel >> 16) & 0xFF);
+                sum[3] += weight * static_cast<int>(pixel >> 24);
+            }
+
+            for (int c = 0; c < 4; c++)
+            {
+                pResult[c] = static_cast<int16_t>(sum[c] >> shift);
+            }
+        }
+
+        static uint32_t ConvolveColumnScalar(const int16_t* pPixels, ptrdiff_t intermediateStride, const int16_t* pWeights, int taps)
+        {
+            const int shift = k_WeightBits + k_IntermediateBits;
+            int sum[4] = { 1 << (shift - 1), 1 << (shift - 1), 1 << (shift - 1), 1 << (shift - 1) };
+            for (int k = 0; k < taps; k++)
+            {
+                const int16_t* pPixel = pPixels + k * intermediateStride;
+                for (int c = 0; c < 4; c++)
+                {
+                    sum[c] += pWeights[k] * pPixel[c];
+                }
+            }
+
+            int alpha = ClampChannel(sum[3] >> shift, 255);
+            uint32_t result = static_cast<uint32_t>(alpha) << 24;
+            for (int c = 0; c < 3; c++)
+            {
+                result |= static_cast<uint32_t>(ClampChannel(sum[c] >> shift, alpha)) << (8 * c);
+            }
+            return result;
+        }
+    };
+
+    void RunFilteredBenchmarks(CBenchmarkRunner& runner)
+    {
+        const char* const name = "Polyphase";
+        if (!runner.IsSelected(k_Suite, name))
+            return;
+
+        const int percents[] = { 125, 150, 175 };
+        for (int size : k_IconSizes)
+        {
+            std::vector<uint32_t> sourcePixels = MakeIconPixels(size, size);
+            CImageScaler::PixelBuffer source = { sourcePixels.data(), size, size, static_cast<ptrdiff_t>(size) * 4 };
+
+            for (int percent : percents)
+            {
+                int deviceSize = MulDivReference(size, percent, 100);
+                std::vector<uint32_t> destinationPixels(static_cast<size_t>(deviceSize) * deviceSize);
+                CImageScaler::PixelBuffer destination = { destinationPixels.data(), deviceSize, deviceSize, static_cast<ptrdiff_t>(deviceSize) * 4 };
+
+                int images = ImagesPerRound(deviceSize * deviceSize);
+                Workload workload = { "image", "pixels", static_cast<double>(images), static_cast<double>(deviceSize) * deviceSize };
+                CParameters parameters;
+                parameters.Add("mode", "HighQualityBicubic").Add("size", size).Add("scalePercent", percent);
+
+                CParameters perPixelParameters = parameters;
+                perPixelParameters.Add("implementation", "PerPixelTaps");
+                runner.Measure(k_Suite, name, perPixelParameters, workload, [&]
+                {
+                    for (int i = 0; i < images; i++)
+                    {
+                        CReferenceScaler::ScaleFilteredPerPixelTaps(source, destination, CImageScaler::Filter::HighQualityBicubic, 0);
+                    }
+                    KeepResult(destinationPixels[0]);
+                });
+
+                CParameters scaleParameters = parameters;
+                scaleParameters.Add("implementation", "Scale");
+                runner.Measure(k_Suite, name, scaleParameters, workload, [&]
+                {
+                    for (int i = 0; i < images; i++)
+                    {
+                        CImageScaler::Scale(source, destination, CImageScaler::Filter::HighQualityBicubic, 0);
+                    }
+                    KeepResult(destinationPixels[0]);
+                });
+            }
+        }
+    }
+
+    void RunNearestNeighborIntegralBenchmarks(CBenchmarkRunner& runner)
+    {
+        const char* const name = "NearestNeighborIntegral";
+        if (!runner.IsSelected(k_Suite, name))
+            return;
+
+        const int percents[] = { 200, 300, 400 };
+        for (int size : k_IconSizes)
+        {
+            std::vector<uint32_t> sourcePixels = MakeIconPixels(size, size);
+            CImageScaler::PixelBuffer source = { sourcePixels.data(), size, size, static_cast<ptrdiff_t>(size) * 4 };
+
+            for (int percent : percents)
+            {
+                int deviceSize = size * percent / 100;
+                std::vector<uint32_t> destinationPixels(static_cast<size_t>(deviceSize) * deviceSize);
+                CImageScaler::PixelBuffer destination = { destinationPixels.data(), deviceSize, deviceSize, static_cast<ptrdiff_t>(deviceSize) * 4 };
+                std::vector<uint32_t> copiedPixels(destinationPixels.size());
+
+                int images = ImagesPerRound(deviceSize * deviceSize);
+                Workload workload = { "image", "pixels", static_cast<double>(images), static_cast<double>(deviceSize) * deviceSize };
+                CParameters parameters;
+                parameters.Add("size", size).Add("scalePercent", percent);
+
+                CParameters perPixelParameters = parameters;
+                perPixelParameters.Add("implementation", "PerPixel");
+                runner.Measure(k_Suite, name, perPixelParameters, workload, [&]
+                {
+                    for (int i = 0; i < images; i++)
+                    {
+                        CReferenceScaler::ScaleNearestNeighborPerPixel(source, destination, 0);
+                    }
+                    KeepResult(destinationPixels[0]);
+                });
+
+                CParameters scaleParameters = parameters;
+                scaleParameters.Add("implementation", "Scale");
+                runner.Measure(k_Suite, name, scaleParameters, workload, [&]
+                {
+                    for (int i = 0; i < images; i++)
+                    {
+                        CImageScaler::Scale(source, destination, CImageScaler::Filter::NearestNeighbor, 0);
+                    }
+                    KeepResult(destinationPixels[0]);
+                });
+
+                CParameters memcpyParameters = parameters;
+                memcpyParameters.Add("implementation", "Memcpy");
+                runner.Measure(k_Suite, name, memcpyParameters, workload, [&]
+                {
+                    for (int i = 0; i < images; i++)
+                    {
+                        memcpy(copiedPixels.data(), destinationPixels.data(), destinationPixels.size() * sizeof(uint32_t));
+                        KeepResult(copiedPixels[i % copiedPixels.size()]);
+                    }
+                });
+            }
+        }
+    }
+}
+
+void VsUI::Benchmarks::RunImageScalerBenchmarks(CBenchmarkRunner& runner)
+{
+    for (const ScalingMode& mode : k_ScalingModes)
+    {
+        const char* name = mode.fBorderOnly ? "DrawCentered" : "Scale";
+        if (!runner.IsSelected(k_Suite, name))
+            continue;
+
+        for (int size : k_IconSizes)
+        {
+            std::vector<uint32_t> sourcePixels = MakeIconPixels(size, size);
+            CImageScaler::PixelBuffer source = { sourcePixels.data(), size, size, static_cast<ptrdiff_t>(size) * 4 };
+
+            for (int percent : k_ScalePercents)
+            {
+                int deviceSize = MulDivReference(size, percent, 100);
+                std::vector<uint32_t> destinationPixels(static_cast<size_t>(deviceSize) * deviceSize);
+                CImageScaler::PixelBuffer destination = { destinationPixels.data(), deviceSize, deviceSize, static_cast<ptrdiff_t>(deviceSize) * 4 };
+
+                int images = ImagesPerRound(deviceSize * deviceSize);
+                Workload workload = { "image", "pixels", static_cast<double>(images), static_cast<double>(deviceSize) * deviceSize };
+                CParameters parameters;
+                parameters.Add("mode", mode.name).Add("size", size).Add("scalePercent", percent);
+                runner.Measure(k_Suite, name, parameters, workload, [&]
+                {
+                    for (int i = 0; i < images; i++)
+                    {
+                        if (mode.fBorderOnly)
+                        {
+                            CImageScaler::DrawCentered(source, destination, 0);
+                        }
+                        else
+                        {
+                            CImageScaler::Scale(source, destination, mode.filter, 0);
+                        }
+                    }
+                    KeepResult(destinationPixels[0]);
+                });
+            }
+        }
+    }
+
+    RunNearestNeighborIntegralBenchmarks(runner);
+    RunFilteredBenchmarks(runner);
+}
@@ -0,0 +1,95 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Benchmarks of the DPI unit conversions: MulDivReference (the cost of a
+// Win32 MulDiv call), CMulDivFactor, TMulDivConstant, and the conversion of
+// coordinate arrays with CMulDivFactor::ApplyToPairs.
+//-----------------------------------------------------------------------------
+#include "VsUIBenchmark.h"
+
+#include "VsUIMulDiv.h"
+
+using namespace VsUI;
+using namespace VsUI::Benchmarks;
+
+namespace
+{
+    const char* const k_Suite = "MulDiv";
+
+    // Coordinates of a typical layout: mostly small positive values, some negative ones
+    const size_t k_ValueCount = 4096;
+
+    std::vector<int> MakeCoordinates()
+    {
+        std::vector<int> values(k_ValueCount);
+        uint32_t random = 0x2545F491;
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            random = random * 1664525 + 1013904223;
+            values[i] = static_cast<int>(random >> 20) - 512;
+        }
+        return values;
+    }
+
+    template <int From, int To>
+    void MeasureConversions(CBenchmarkRunner& runner, const std::vector<int>& values)
+    {
+        CParameters parameters;
+        parameters.Add("fromDpi", From).Add("toDpi", To);
+        Workload workload = { "value", "values", static_cast<double>(values.size()), 1 };
+        std::vector<int> results(values.size());
+
+        // Read through volatile variables, so the reference isn't compiled as a division by a known constant
+        volatile int numerator = To;
+        volatile int denominator = From;
+        runner.Measure(k_Suite, "MulDivReference", parameters, workload, [&]
+        {
+            int n = numerator;
+            int d = denominator;
+            for (size_t i = 0; i < values.size(); i++)
+            {
+                results[i] = MulDivReference(values[i], n, d);
+            }
+            KeepResult(static_cast<uint32_t>(results.back()));
+        });
+
+        CMulDivFactor factor(numerator, denominator);
+        runner.Measure(k_Suite, "CMulDivFactor::Apply", parameters, workload, [&]
+        {
+            for (size_t i = 0; i < values.size(); i++)
+            {
+                results[i] = factor.Apply(values[i]);
+            }
+            KeepResult(static_cast<uint32_t>(results.back()));
+        });
+
+        runner.Measure(k_Suite, "TMulDivConstant::Apply", parameters, workload, [&]
+        {
+            for (size_t i = 0; i < values.size(); i++)
+            {
+                results[i] = TMulDivConstant<From, To>::Apply(values[i]);
+            }
+            KeepResult(static_cast<uint32_t>(results.back()));
+        });
+
+        // The values are (x, y) pairs, converted in place; they are restored before each round
+        runner.Measure(k_Suite, "CMulDivFactor::ApplyToPairs", parameters, workload, [&] { results = values; }, [&]
+        {
+            CMulDivFactor::ApplyToPairs(results.data(), results.size() / 2, factor, factor);
+            KeepResult(static_cast<uint32_t>(results.back()));
+        });
+    }
+}
+
+void VsUI::Benchmarks::RunMulDivBenchmarks(CBenchmarkRunner& runner)
+{
+    std::vector<int> values = MakeCoordinates();
+    MeasureConversions<96, 120>(runner, values);
+    MeasureConversions<96, 144>(runner, values);
+    MeasureConversions<96, 192>(runner, values);
+    MeasureConversions<144, 96>(runner, values);
+}
@@ -0,0 +1,284 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Benchmarks of the CPixelKernels loops, on batches of icons of each size
+// The kernels that modify the pixels in place run on a fresh copy of the
+// icons in every round, so they always find the same pixels to replace.
+//-----------------------------------------------------------------------------
+#include "VsUIBenchmark.h"
+
+#include <cstring>
+#include <functional>
+
+#include "VsUIPixelKernels.h"
+
+using namespace VsUI;
+using namespace VsUI::Benchmarks;
+
+namespace
+{
+    const char* const k_Suite = "PixelKernels";
+
+    // Same values as MagentaColor, NearGreenColor, TransparentColor and TransparentHaloColor of the sample
+    const uint32_t k_Magenta = 0xFFFF00FF;
+    const uint32_t k_NearGreen = 0xFF00FE00;
+    const uint32_t k_Transparent = 0x00FFFFFF;
+    const uint32_t k_TransparentHalo = 0x00F6F6F6;
+
+    // How ProcessBitmapBits called the pixel processors before CPixelKernels: through a std::function, for each pixel
+    void ProcessPixelsWithFunction(uint32_t* pPixels, unsigned int width, unsigned int height, std::function<void (uint32_t* pPixel)> pixelProcessor)
+    {
+        for (size_t i = 0; i < static_cast<size_t>(width) * height; i++)
+        {
+            pixelProcessor(&pPixels[i]);
+        }
+    }
+
+    // Batch of copies of one icon, restored from the original before each round
+    class CIconBatch
+    {
+    public:
+        CIconBatch(int size, const uint32_t* pKeyColors, unsigned int keyCount) :
+            m_size(size), m_count(ImagesPerRound(size * size)), m_original(MakeIconPixels(size, size, pKeyColors, keyCount)),
+            m_pixels(m_original.size() * m_count)
+        {
+        }
+
+        void Restore()
+        {
+            for (int i = 0; i < m_count; i++)
+            {
+                memcpy(GetImage(i), m_original.data(), m_original.size() * sizeof(uint32_t));
+            }
+        }
+
+        uint32_t* GetImage(int index)
+        {
+            return &m_pixels[m_original.size() * index];
+        }
+
+        int GetSize() const
+        {
+            return m_size;
+        }
+
+        int GetCount() const
+        {
+            return m_count;
+        }
+
+        Workload GetWorkload() const
+        {
+            Workload workload = { "image", "pixels", static_cast<double>(m_count), static_cast<double>(m_size) * m_size };
+            return workload;
+        }
+
+    private:
+        int m_size;
+        int m_count;
+        std::vector<uint32_t> m_original;
+        std::vector<uint32_t> m_pixels;
+    };
+}
+
+void VsUI::Benchmarks::RunPixelKernelsBenchmarks(CBenchmarkRunner& runner)
+{
+    const uint32_t keyColors[] = { k_Magenta, k_NearGreen, 0xFF808080 };
+
+    for (int size : k_IconSizes)
+    {
+        CIconBatch batch(size, keyColors, 3);
+        CParameters parameters;
+        parameters.Add("size", size);
+        ptrdiff_t stride = static_cast<ptrdiff_t>(size) * sizeof(uint32_t);
+
+        // Generic per-pixel loop, as used by the GdiplusImage pixel operations without a dedicated kernel
+        runner.Measure(k_Suite, "ForEachPixel", parameters, batch.GetWorkload(), [&] { batch.Restore(); }, [&]
+        {
+            for (int i = 0; i < batch.GetCount(); i++)
+            {
+                CPixelKernels::ForEachPixel<uint32_t>(batch.GetImage(i), stride, size, size, [](uint32_t* pPixel)
+                {
+                    if (*pPixel == k_Magenta)
+                        *pPixel = k_Transparent;
+                });
+            }
+        });
+
+        // MakeTransparent replaces one key color, the halo removal of the device images replaces up to three
+        for (unsigned int keyCount : { 1u, 3u })
+        {
+            CParameters keyParameters = parameters;
+            keyParameters.Add("keyColors", static_cast<int>(keyCount));
+            runner.Measure(k_Suite, "ReplaceKeyColors", keyParameters, batch.GetWorkload(), [&] { batch.Restore(); }, [&]
+            {
+                uint32_t found = 0;
+                for (int i = 0; i < batch.GetCount(); i++)
+                {
+                    CPixelKernels::ForEachRow<uint32_t>(batch.GetImage(i), stride, size, size, [&](uint32_t* pRow, unsigned int width)
+                    {
+                        found |= CPixelKernels::ReplaceKeyColors(pRow, width, keyColors, keyCount, k_Transparent);
+                    });
+                }
+                KeepResult(found);
+            });
+        }
+
+        // MakeTransparent and the halo pass of CreateDeviceFromLogicalImage(HBITMAP), as they were before CPixelKernels (the pixel
+        // processor called through a std::function), with the same branches inlined (what the compiler makes of the scalar loop),
+        // and with ReplaceKeyColors
+        CParameters beforeParameters = parameters;
+        beforeParameters.Add("implementation", "StdFunction");
+        CParameters scalarParameters = parameters;
+        scalarParameters.Add("implementation", "Scalar");
+        CParameters kernelParameters = parameters;
+        kernelParameters.Add("implementation", "ReplaceKeyColors");
+
+        runner.Measure(k_Suite, "MakeTransparent", beforeParameters, batch.GetWorkload(), [&] { batch.Restore(); }, [&]
+        {
+            for (int i = 0; i < batch.GetCount(); i++)
+            {
+                ProcessPixelsWithFunction(batch.GetImage(i), size, size, [](uint32_t* pPixel)
+                {
+                    if (*pPixel == k_Magenta)
+                    {
+                        *pPixel = k_Transparent;
+                    }
+                });
+            }
+        });
+
+        runner.Measure(k_Suite, "MakeTransparent", scalarParameters, batch.GetWorkload(), [&] { batch.Restore(); }, [&]
+        {
+            for (int i = 0; i < batch.GetCount(); i++)
+            {
+                uint32_t* pPixels = batch.GetImage(i);
+                for (int j = 0; j < size * size; j++)
+                {
+                    if (pPixels[j] == k_Magenta)
+                    {
+                        pPixels[j] = k_Transparent;
+                    }
+                }
+            }
+        });
+
+        runner.Measure(k_Suite, "MakeTransparent", kernelParameters, batch.GetWorkload(), [&] { batch.Restore(); }, [&]
+        {
+            for (int i = 0; i < batch.GetCount(); i++)
+            {
+                CPixelKernels::ForEachRow<uint32_t>(batch.GetImage(i), stride, size, size, [](uint32_t* pRow, unsigned int width)
+                {
+                    CPixelKernels::ReplaceKeyColors(pRow, width, &k_Magenta, 1, k_Transparent);
+                });
+            }
+        });
+
+        // The halo pass looks for magenta and near green, and remembers which one it found
+        runner.Measure(k_Suite, "HaloKeyColors", beforeParameters, batch.GetWorkload(), [&] { batch.Restore(); }, [&]
+        {
+            const uint32_t* pActualBackground = &k_Transparent;
+            for (int i = 0; i < batch.GetCount(); i++)
+            {
+                ProcessPixelsWithFunction(batch.GetImage(i), size, size, [&](uint32_t* pPixel)
+                {
+                    if (*pPixel == k_Magenta)
+                    {
+                        *pPixel = k_TransparentHalo;
+                        pActualBackground = &k_Magenta;
+                    }
+                    else if (*pPixel == k_NearGreen)
+                    {
+                        *pPixel = k_TransparentHalo;
+                        pActualBackground = &k_Magenta;
+                    }
+                });
+            }
+            KeepResult(*pActualBackground);
+        });
+
+        runner.Measure(k_Suite, "HaloKeyColors", scalarParameters, batch.GetWorkload(), [&] { batch.Restore(); }, [&]
+        {
+            const uint32_t* pActualBackground = &k_Transparent;
+            for (int i = 0; i < batch.GetCount(); i++)
+            {
+                uint32_t* pPixels = batch.GetImage(i);
+                for (int j = 0; j < size * size; j++)
+                {
+                    if (pPixels[j] == k_Magenta || pPixels[j] == k_NearGreen)
+                    {
+                        pPixels[j] = k_TransparentHalo;
+                        pActualBackground = &k_Magenta;
+                    }
+                }
+            }
+            KeepResult(*pActualBackground);
+        });
+
+        runner.Measure(k_Suite, "HaloKeyColors", kernelParameters, batch.GetWorkload(), [&] { batch.Restore(); }, [&]
+        {
+            unsigned int foundKeys = 0;
+            for (int i = 0; i < batch.GetCount(); i++)
+            {
+                CPixelKernels::ForEachRow<uint32_t>(batch.GetImage(i), stride, size, size, [&](uint32_t* pRow, unsigned int width)
+                {
+                    foundKeys |= CPixelKernels::ReplaceKeyColors(pRow, width, keyColors, 2, k_TransparentHalo);
+                });
+            }
+            KeepResult(foundKeys != 0 ? k_Magenta : k_Transparent);
+        });
+
+        runner.Measure(k_Suite, "ReplaceNonOpaquePixels", parameters, batch.GetWorkload(), [&] { batch.Restore(); }, [&]
+        {
+            for (int i = 0; i < batch.GetCount(); i++)
+            {
+                CPixelKernels::ForEachRow<uint32_t>(batch.GetImage(i), stride, size, size, [](uint32_t* pRow, unsigned int width)
+                {
+                    CPixelKernels::ReplaceNonOpaquePixels<uint32_t>(pRow, width, k_Magenta, 0x00FFFFFF, 0);
+                });
+            }
+        });
+
+        runner.Measure(k_Suite, "MaskPixels", parameters, batch.GetWorkload(), [&] { batch.Restore(); }, [&]
+        {
+            for (int i = 0; i < batch.GetCount(); i++)
+            {
+                CPixelKernels::ForEachRow<uint32_t>(batch.GetImage(i), stride, size, size, [](uint32_t* pRow, unsigned int width)
+                {
+                    CPixelKernels::MaskPixels<uint32_t>(pRow, width, 0x00FFFFFF, 0);
+                });
+            }
+        });
+
+        // Integral nearest neighbor enlargement: each source row is replicated once, then copied to the other destination rows
+        for (unsigned int factor : { 2u, 3u, 4u })
+        {
+            CParameters factorParameters = parameters;
+            factorParameters.Add("factor", static_cast<int>(factor));
+            size_t destinationWidth = static_cast<size_t>(size) * factor;
+            std::vector<uint32_t> destination(destinationWidth * destinationWidth);
+            Workload workload = { "image", "pixels", static_cast<double>(batch.GetCount()), static_cast<double>(destination.size()) };
+            runner.Measure(k_Suite, "ReplicatePixels", factorParameters, workload, [&]
+            {
+                for (int i = 0; i < batch.GetCount(); i++)
+                {
+                    const uint32_t* pSource = batch.GetImage(i);
+                    for (int y = 0; y < size; y++)
+                    {
+                        uint32_t* pRow = &destination[y * factor * destinationWidth];
+                        CPixelKernels::ReplicatePixels(pSource + static_cast<size_t>(y) * size, size, factor, pRow);
+                        for (unsigned int copy = 1; copy < factor; copy++)
+                        {
+                            memcpy(pRow + copy * destinationWidth, pRow, destinationWidth * sizeof(uint32_t));
+                        }
+                    }
+                }
+                KeepResult(destination.back());
+            });
+        }
+    }
+}
@@ -0,0 +1,123 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Benchmarks of CTaskPool: the cost of a ParallelFor call with a trivial body,
+// i.e. waking the pool threads, splitting the range and waiting for them,
+// and the scaling of a batch of icons on pools of 1 to N threads, as
+// CDpiHelper does for image lists and icon variants.
+//-----------------------------------------------------------------------------
+#include "VsUIBenchmark.h"
+
+#include <algorithm>
+#include <thread>
+
+#include "VsUIImageScaler.h"
+#include "VsUIMulDiv.h"
+#include "VsUITaskPool.h"
+
+using namespace VsUI;
+using namespace VsUI::Benchmarks;
+
+namespace
+{
+    const char* const k_Suite = "TaskPool";
+
+    // Icons of one size scaled to one device size, each to its own destination image
+    class CScalingBatch
+    {
+    public:
+        CScalingBatch(int size, int deviceSize, int count) :
+            m_size(size),
+            m_deviceSize(deviceSize),
+            m_sourcePixels(MakeIconPixels(size, size)),
+            m_destinationPixels(count)
+        {
+            for (std::vector<uint32_t>& pixels : m_destinationPixels)
+            {
+                pixels.resize(static_cast<size_t>(deviceSize) * deviceSize);
+            }
+        }
+
+        size_t GetCount() const
+        {
+            return m_destinationPixels.size();
+        }
+
+        void Scale(size_t index)
+        {
+            CImageScaler::PixelBuffer source = { m_sourcePixels.data(), m_size, m_size, static_cast<ptrdiff_t>(m_size) * 4 };
+            CImageScaler::PixelBuffer destination = { m_destinationPixels[index].data(), m_deviceSize, m_deviceSize, static_cast<ptrdiff_t>(m_deviceSize) * 4 };
+            CImageScaler::Scale(source, destination, CImageScaler::Filter::HighQualityBicubic, 0);
+        }
+
+        uint32_t GetResult() const
+        {
+            return m_destinationPixels.back()[0];
+        }
+
+    private:
+        int m_size;
+        int m_deviceSize;
+        std::vector<uint32_t> m_sourcePixels;
+        std::vector<std::vector<uint32_t>> m_destinationPixels;
+    };
+
+    void RunBatchScalingBenchmarks(CBenchmarkRunner& runner)
+    {
+        const char* const name = "ScaleBatch";
+        if (!runner.IsSelected(k_Suite, name))
+            return;
+
+        // At least up to 4 threads, so the overhead of the pool shows on machines with fewer cores
+        unsigned int maxThreads = std::max(4u, std::thread::hardware_concurrency());
+        for (unsigned int threads = 1; threads <= maxThreads; threads *= 2)
+        {
+            CTaskPool pool(threads - 1);
+            for (int size : { 16, 32, 64 })
+            {
+                const int count = 64;
+                int deviceSize = MulDivReference(size, 150, 100);
+                CScalingBatch batch(size, deviceSize, count);
+
+                CParameters parameters;
+                parameters.Add("size", size).Add("scalePercent", 150).Add("count", count).Add("threads", static_cast<int>(threads));
+                Workload workload = { "batch", "images", 1, static_cast<double>(count) };
+                runner.Measure(k_Suite, name, parameters, workload, [&]
+                {
+                    pool.ParallelFor(batch.GetCount(), [&](size_t index)
+                    {
+                        batch.Scale(index);
+                    });
+                    KeepResult(batch.GetResult());
+                });
+            }
+        }
+    }
+}
+
+void VsUI::Benchmarks::RunTaskPoolBenchmarks(CBenchmarkRunner& runner)
+{
+    CTaskPool& pool = CTaskPool::GetInstance();
+
+    for (int count : { 1, 16, 256, 4096 })
+    {
+        std::vector<uint32_t> results(count);
+        CParameters parameters;
+        parameters.Add("count", count).Add("threads", static_cast<int>(pool.GetThreadCount()));
+        Workload workload = { "call", "indices", 1, static_cast<double>(count) };
+        runner.Measure(k_Suite, "ParallelFor", parameters, workload, [&]
+        {
+            pool.ParallelFor(results.size(), [&](size_t index)
+            {
+                results[index] = static_cast<uint32_t>(index);
+            });
+            KeepResult(results.back());
+        });
+    }
+
+    RunBatchScalingBenchmarks(runner);
+}
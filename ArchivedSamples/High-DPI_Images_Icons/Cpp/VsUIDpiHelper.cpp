@@ -8,8 +8,12 @@
 #include "VsUIDpiHelper.h"
 #include "vsassert.h"
 #include "ScopeGuard.h"
+#include "VsUIIconDirectory.h"
+#include "VsUIIconMetadataCache.h"
 #include "atlgdi.h"
 #include <map>
+#include <algorithm>
+#include <atomic>
 #include <atlstr.h>
 #include <atlpath.h>
 
@@ -30,7 +34,10 @@ namespace VsUI
 {
 
 CDpiHelper::CDpiHelper(int iDeviceDpiX, int iDeviceDpiY, int iLogicalDpiX, int iLogicalDpiY) :
-    m_DeviceDpiX(iDeviceDpiX), m_DeviceDpiY(iDeviceDpiY), m_LogicalDpiX(iLogicalDpiX), m_LogicalDpiY(iLogicalDpiY), m_PreferredScalingMode(ImageScalingMode::Default)
+    m_DeviceDpiX(iDeviceDpiX), m_DeviceDpiY(iDeviceDpiY), m_LogicalDpiX(iLogicalDpiX), m_LogicalDpiY(iLogicalDpiY),
+    m_LogicalToDeviceX(iDeviceDpiX, iLogicalDpiX), m_LogicalToDeviceY(iDeviceDpiY, iLogicalDpiY),
+    m_DeviceToLogicalX(iLogicalDpiX, iDeviceDpiX), m_DeviceToLogicalY(iLogicalDpiY, iDeviceDpiY),
+    m_PointsToDevice(iDeviceDpiY, 72), m_PreferredScalingMode(ImageScalingMode::Default)
 {
 }
 
@@ -65,44 +72,44 @@ bool CDpiHelper::IsScalingRequired() const
 // Return horizontal and vertical scaling factors
 double CDpiHelper::DeviceToLogicalUnitsScalingFactorX() const
 {
-    return (double)m_LogicalDpiX / m_DeviceDpiX;
+    return m_DeviceToLogicalX.GetScale();
 }
 
 double CDpiHelper::DeviceToLogicalUnitsScalingFactorY() const
 {
-    return (double)m_LogicalDpiY / m_DeviceDpiY;
+    return m_DeviceToLogicalY.GetScale();
 }
 
 double CDpiHelper::LogicalToDeviceUnitsScalingFactorX() const
 {
-    return (double)m_DeviceDpiX / m_LogicalDpiX;
+    return m_LogicalToDeviceX.GetScale();
 }
 
 double CDpiHelper::LogicalToDeviceUnitsScalingFactorY() const
 {
-    return (double)m_DeviceDpiY / m_LogicalDpiY;
+    return m_LogicalToDeviceY.GetScale();
 }
 
 // Converts between logical and device units.
 int CDpiHelper::LogicalToDeviceUnitsX(int x) const 
 { 
-    return MulDiv(x, m_DeviceDpiX, m_LogicalDpiX); 
+    return m_LogicalToDeviceX.Apply(x); 
 }
 
 int CDpiHelper::LogicalToDeviceUnitsY(int y) const
 { 
-    return MulDiv(y, m_DeviceDpiY, m_LogicalDpiY); 
+    return m_LogicalToDeviceY.Apply(y); 
 }
 
 // Converts between device and logical units.
 int CDpiHelper::DeviceToLogicalUnitsX(int x) const 
 { 
-    return MulDiv(x, m_LogicalDpiX, m_DeviceDpiX); 
+    return m_DeviceToLogicalX.Apply(x); 
 }
 
 int CDpiHelper::DeviceToLogicalUnitsY(int y) const 
 { 
-    return MulDiv(y, m_LogicalDpiY, m_DeviceDpiY); 
+    return m_DeviceToLogicalY.Apply(y); 
 }
 
 // Converts from logical units to device units.
@@ -147,10 +154,61 @@ void CDpiHelper::DeviceToLogicalUnits(_Inout_ POINT * pPoint) const
     }
 }
 
+// Converts arrays from logical units to device units.
+void CDpiHelper::LogicalToDeviceUnits(_Inout_updates_(count) POINT * pPoints, size_t count) const
+{
+    if (pPoints != nullptr)
+    {
+        // POINT, RECT and SIZE are made of LONG (x, y) pairs, so the arrays are converted as arrays of pairs
+        CMulDivFactor::ApplyToPairs(reinterpret_cast<LONG*>(pPoints), count, m_LogicalToDeviceX, m_LogicalToDeviceY);
+    }
+}
+
+void CDpiHelper::LogicalToDeviceUnits(_Inout_updates_(count) RECT * pRects, size_t count) const
+{
+    if (pRects != nullptr)
+    {
+        CMulDivFactor::ApplyToPairs(reinterpret_cast<LONG*>(pRects), 2 * count, m_LogicalToDeviceX, m_LogicalToDeviceY);
+    }
+}
+
+void CDpiHelper::LogicalToDeviceUnits(_Inout_updates_(count) SIZE * pSizes, size_t count) const
+{
+    if (pSizes != nullptr)
+    {
+        CMulDivFactor::ApplyToPairs(reinterpret_cast<LONG*>(pSizes), count, m_LogicalToDeviceX, m_LogicalToDeviceY);
+    }
+}
+
+// Converts arrays from device units to logical units.
+void CDpiHelper::DeviceToLogicalUnits(_Inout_updates_(count) POINT * pPoints, size_t count) const
+{
+    if (pPoints != nullptr)
+    {
+        CMulDivFactor::ApplyToPairs(reinterpret_cast<LONG*>(pPoints), count, m_DeviceToLogicalX, m_DeviceToLogicalY);
+    }
+}
+
+void CDpiHelper::DeviceToLogicalUnits(_Inout_updates_(count) RECT * pRects, size_t count) const
+{
+    if (pRects != nullptr)
+    {
+        CMulDivFactor::ApplyToPairs(reinterpret_cast<LONG*>(pRects), 2 * count, m_DeviceToLogicalX, m_DeviceToLogicalY);
+    }
+}
+
+void CDpiHelper::DeviceToLogicalUnits(_Inout_updates_(count) SIZE * pSizes, size_t count) const
+{
+    if (pSizes != nullptr)
+    {
+        CMulDivFactor::ApplyToPairs(reinterpret_cast<LONG*>(pSizes), count, m_DeviceToLogicalX, m_DeviceToLogicalY);
+    }
+}
+
 // Convert a point size (1/72 of an inch) to raw pixels.
 int CDpiHelper::PointsToDeviceUnits(int pt) const
 { 
-    return MulDiv(pt, m_DeviceDpiY, 72); 
+    return m_PointsToDevice.Apply(pt); 
 }
 
 // Determine the screen dimensions in logical units.
@@ -279,6 +337,44 @@ InterpolationMode CDpiHelper::GetInterpolationMode(_In_ ImageScalingMode scaling
     }
 }
 
+// Gets the native scaler filter for the specified (actual) scaling mode
+CImageScaler::Filter CDpiHelper::GetScalerFilter(_In_ ImageScalingMode scalingMode)
+{
+    switch (scalingMode)
+    {
+    case ImageScalingMode::Bilinear:
+        {
+            return CImageScaler::Filter::Bilinear;
+        }
+    case ImageScalingMode::Bicubic:
+        {
+            return CImageScaler::Filter::Bicubic;
+        }
+    case ImageScalingMode::HighQualityBilinear:
+        {
+            return CImageScaler::Filter::HighQualityBilinear;
+        }
+    case ImageScalingMode::HighQualityBicubic: 
+        {
+            return CImageScaler::Filter::HighQualityBicubic;
+        }
+    case ImageScalingMode::BorderOnly: __fallthrough;
+    case ImageScalingMode::NearestNeighbor: 
+        {
+            return CImageScaler::Filter::NearestNeighbor;
+        }
+    default:
+        {
+            VSFAIL("Unknown scaling mode, please add an explicit case. Falling back to use default interpolation.");
+            __fallthrough;
+        }
+    case ImageScalingMode::Default:
+        {
+            return GetScalerFilter(GetPreferredScalingMode()); 
+        }
+    }
+}
+
 // Gets the actual scaling mode to be used from the suggested scaling mode
 ImageScalingMode CDpiHelper::GetActualScalingMode(_In_ ImageScalingMode scalingMode)
 {
@@ -292,6 +388,9 @@ ImageScalingMode CDpiHelper::GetActualScalingMode(_In_ ImageScalingMode scalingM
     return GetPreferredScalingMode();
 }
 
+// Preferred scaling modes already resolved, by DPI scale percent
+std::atomic<ImageScalingMode> CDpiHelper::s_preferredScalingModes[CDpiHelper::k_ScalingModeTableSize];
+
 // Returns the preferred scaling mode for current DPI zoom level (either shell preferred mode, or a user-override)
 ImageScalingMode CDpiHelper::GetPreferredScalingMode()
 {
@@ -300,10 +399,26 @@ ImageScalingMode CDpiHelper::GetPreferredScalingMode()
     {
         // Get the current zoom level
         int dpiScalePercent = (int)(LogicalToDeviceUnitsScalingFactorX() * 100);
-        // Get the shell preferred scaling mode depending on the zoom level
-        ImageScalingMode defaultScalingMode = GetDefaultScalingMode(dpiScalePercent);
-        // Allow the user to override
-        m_PreferredScalingMode = GetUserScalingMode(dpiScalePercent, defaultScalingMode);
+
+        // Another helper may have resolved the mode for this zoom level already
+        bool fInTable = (dpiScalePercent >= 0 && dpiScalePercent < k_ScalingModeTableSize);
+        if (fInTable)
+        {
+            m_PreferredScalingMode = s_preferredScalingModes[dpiScalePercent].load(memory_order_relaxed);
+        }
+
+        if (m_PreferredScalingMode == ImageScalingMode::Default)
+        {
+            // Get the shell preferred scaling mode depending on the zoom level
+            ImageScalingMode defaultScalingMode = GetDefaultScalingMode(dpiScalePercent);
+            // Allow the user to override
+            m_PreferredScalingMode = GetUserScalingMode(dpiScalePercent, defaultScalingMode);
+
+            if (fInTable)
+            {
+                s_preferredScalingModes[dpiScalePercent].store(m_PreferredScalingMode, memory_order_relaxed);
+            }
+        }
     }
 
     return m_PreferredScalingMode;
@@ -320,12 +435,12 @@ void CDpiHelper::LogicalToDeviceUnits(_Inout_ VsUI::GdiplusImage * pImage, Image
         return;
 
     // Create the new image for the device, cloning the current one if necessary
-    unique_ptr<VsUI::GdiplusImage> pDeviceImage = CreateDeviceFromLogicalImage(pImage, scalingMode, clrBackground);
+    VsUI::GdiplusImage deviceImage = CreateDeviceFromLogicalImage(*pImage, scalingMode, clrBackground);
     // If we failed to create the new image, return
-    IfNullAssertRet(pDeviceImage.get(), "Failed to create scaled image");
+    IfNullAssertRet(deviceImage.GetBitmap(), "Failed to create scaled image");
     
-    // Finally, replace the original image with the device image. Our pointer will take ownership and will release the original GDI+ Bitmap
-    *pImage = *pDeviceImage;
+    // Finally, replace the original image with the device image. The device image takes the original GDI+ Bitmap and releases it
+    *pImage = std::move(deviceImage);
 }
  
 // Creates new GdiplusImage from logical to device units
@@ -333,29 +448,876 @@ unique_ptr<VsUI::GdiplusImage> CDpiHelper::CreateDeviceFromLogicalImage(_In_ VsU
 {
     IfNullAssertRetNull(pImage, "No image given to convert");
 
+    VsUI::GdiplusImage deviceImage = CreateDeviceFromLogicalImage(*pImage, scalingMode, clrBackground);
+    if (!deviceImage.IsLoaded())
+        return nullptr;
+
+    return unique_ptr<VsUI::GdiplusImage>(new VsUI::GdiplusImage(std::move(deviceImage)));
+}
+
+// Creates new GdiplusImage from logical to device units, returned by value
+VsUI::GdiplusImage CDpiHelper::CreateDeviceFromLogicalImage(VsUI::GdiplusImage& image, ImageScalingMode scalingMode, Color clrBackground)
+{
     // Get the original/logical bitmap
-    Bitmap* pBitmap = pImage->GetBitmap();
-    IfNullAssertRetNull(pBitmap, "No image given to convert");
-    
+    Bitmap* pBitmap = image.GetBitmap();
+    if (pBitmap == nullptr)
+    {
+        VSFAIL("No image given to convert");
+        return VsUI::GdiplusImage();
+    }
+
+    CImageConversionStats::CScope stats(CImageConversionStats::EntryPoint::GdiplusImage);
+    VsUI::GdiplusImage deviceImage = GetOrScaleLogicalImage(pBitmap, scalingMode, clrBackground);
+    if (deviceImage.IsLoaded())
+    {
+        if (stats.IsEnabled())
+        {
+            uint64_t pixels = static_cast<uint64_t>(deviceImage.GetWidth()) * deviceImage.GetHeight();
+            stats.SetResult(static_cast<int>(GetActualScalingMode(scalingMode)), pixels, pixels * sizeof(ARGB));
+        }
+
+        NotifyConversionSink(CImageConversionStats::EntryPoint::GdiplusImage, &image, &deviceImage);
+    }
+
+    return deviceImage;
+}
+
+// Returns the device image of the logical bitmap, copied from the scaled images cache or scaled and added to the cache
+VsUI::GdiplusImage CDpiHelper::GetOrScaleLogicalImage(_In_ Bitmap* pBitmap, ImageScalingMode scalingMode, Color clrBackground)
+{
+    // Images with the same pixels are scaled to the same device image, so look for it in the cache first.
+    // Hashing and comparing the logical pixels is much cheaper than scaling them.
+    CScaledImageCache::Key cacheKey = GetScaledImageCacheKey(pBitmap->GetWidth(), pBitmap->GetHeight(), pBitmap->GetPixelFormat(), scalingMode, clrBackground);
+    // The logical pixels are read in 32bpp ARGB format, so the cache can compare them with the cached image's on a hit
+    TScratchBuffer<ARGB> logicalPixels;
+    bool fAllocated = logicalPixels.Allocate(static_cast<size_t>(cacheKey.logicalWidth) * cacheKey.logicalHeight);
+    CImageScaler::PixelBuffer logicalBuffer = { logicalPixels.data(), cacheKey.logicalWidth, cacheKey.logicalHeight, static_cast<ptrdiff_t>(cacheKey.logicalWidth) * sizeof(ARGB) };
+    if (!fAllocated || !ReadBitmapPixels(pBitmap, PixelFormat32bppARGB, logicalBuffer))
+    {
+        return ScaleLogicalImage(pBitmap, scalingMode, clrBackground);
+    }
+
+    CScaledImageCache::LogicalPixels logicalView = { logicalBuffer.pBits, logicalBuffer.width, logicalBuffer.height, logicalBuffer.stride };
+    cacheKey.contentHash = CScaledImageCache::HashPixels(logicalView.pBits, logicalView.width, logicalView.height, logicalView.stride);
+    shared_ptr<const CScaledImageCache::Image> spCachedImage = CScaledImageCache::GetInstance().Find(cacheKey, &logicalView);
+    if (spCachedImage.get() != nullptr)
+    {
+        VsUI::GdiplusImage cachedDeviceImage;
+        cachedDeviceImage.Create( spCachedImage->width, spCachedImage->height, pBitmap->GetPixelFormat() );
+        if (cachedDeviceImage.IsLoaded() && CopyCachedImage(*spCachedImage, cachedDeviceImage.GetBitmap()))
+            return cachedDeviceImage;
+    }
+
+    VsUI::GdiplusImage deviceImage = ScaleLogicalImage(pBitmap, scalingMode, clrBackground);
+    if (deviceImage.IsLoaded())
+    {
+        CScaledImageCache::GetInstance().Insert(cacheKey, CreateCachedImage(deviceImage.GetBitmap()), &logicalView);
+    }
+
+    return deviceImage;
+}
+
+// Creates new GdiplusImage from logical to device units, scaling the logical bitmap
+VsUI::GdiplusImage CDpiHelper::ScaleLogicalImage(_In_ Bitmap* pBitmap, ImageScalingMode scalingMode, Color clrBackground)
+{
     // Create a memory image scaled for size
     int deviceWidth = LogicalToDeviceUnitsX(pBitmap->GetWidth());
     int deviceHeight = LogicalToDeviceUnitsY(pBitmap->GetHeight());
     
-    unique_ptr<VsUI::GdiplusImage> pDeviceImage(new VsUI::GdiplusImage());
-    pDeviceImage->Create( deviceWidth, deviceHeight, pBitmap->GetPixelFormat() );
+    VsUI::GdiplusImage deviceImage;
+    deviceImage.Create( deviceWidth, deviceHeight, pBitmap->GetPixelFormat() );
        
-    if (!pDeviceImage->IsLoaded())
+    if (!deviceImage.IsLoaded())
     {
         VSFAIL("Failed to create scaled image, out of memory?");
-        return nullptr;
+        return deviceImage;
+    }
+    
+    // Paint the scaled bitmap in the device image
+    if (!DrawScaledBitmap(pBitmap, deviceImage.GetBitmap(), scalingMode, clrBackground))
+    {
+        deviceImage.Release();
     }
     
+    // Return the new image
+    return deviceImage;
+}
+
+// Creates the device images of a batch of logical images, like CreateDeviceFromLogicalImage does for each of them.
+// The GDI+ objects are created and locked on the calling thread, and the pixels of all the images are hashed and scaled in parallel.
+// maxThreads limits the number of threads used (0 uses all the processors); the results don't depend on it.
+vector<unique_ptr<VsUI::GdiplusImage>> CDpiHelper::CreateDeviceFromLogicalImages(_In_reads_(count) VsUI::GdiplusImage* const * ppImages, size_t count, ImageScalingMode scalingMode, Color clrBackground, unsigned int maxThreads)
+{
+    // Pixel work for one image
+    struct ScaleJob
+    {
+        Bitmap* pSource;
+        Bitmap* pDestination;
+        BitmapData sourceData;
+        BitmapData destinationData;
+        CImageScaler::PixelBuffer source;
+        CImageScaler::PixelBuffer destination;
+        CScaledImageCache::Key cacheKey;
+        bool fLocked;
+        bool fCached;
+        bool fScaled;
+    };
+
+    // The batch is measured as one GdiplusImage conversion; the serial fallbacks below are nested in it, so they're not counted again
+    CImageConversionStats::CScope stats(CImageConversionStats::EntryPoint::GdiplusImage);
+
+    vector<unique_ptr<VsUI::GdiplusImage>> deviceImages;
+    vector<ScaleJob> jobs;
+    try
+    {
+        deviceImages.resize(count);
+        jobs.resize(count);
+    }
+    catch (const bad_alloc&)
+    {
+        return vector<unique_ptr<VsUI::GdiplusImage>>();
+    }
+
+    ImageScalingMode actualScalingMode = GetActualScalingMode(scalingMode);
+    CImageScaler::Filter filter = GetScalerFilter(actualScalingMode);
+
+    // Create the device images and lock the bits of the source and device bitmaps
+    for (size_t i = 0; i < count; i++)
+    {
+        ScaleJob& job = jobs[i];
+        job.fLocked = false;
+        job.fCached = false;
+        job.fScaled = false;
+
+        Bitmap* pBitmap = (ppImages[i] != nullptr) ? ppImages[i]->GetBitmap() : nullptr;
+        if (pBitmap == nullptr)
+            continue;
+
+        deviceImages[i].reset(new VsUI::GdiplusImage());
+        deviceImages[i]->Create( LogicalToDeviceUnitsX(pBitmap->GetWidth()), LogicalToDeviceUnitsY(pBitmap->GetHeight()), pBitmap->GetPixelFormat() );
+        if (!deviceImages[i]->IsLoaded())
+            continue;
+
+        job.pSource = pBitmap;
+        job.pDestination = deviceImages[i]->GetBitmap();
+        job.cacheKey = GetScaledImageCacheKey(pBitmap->GetWidth(), pBitmap->GetHeight(), pBitmap->GetPixelFormat(), scalingMode, clrBackground);
+
+        Rect rectSource(0, 0, job.pSource->GetWidth(), job.pSource->GetHeight());
+        if (job.pSource->LockBits(&rectSource, ImageLockModeRead, PixelFormat32bppARGB, &job.sourceData) != Ok)
+            continue;
+
+        Rect rectDestination(0, 0, job.pDestination->GetWidth(), job.pDestination->GetHeight());
+        if (job.pDestination->LockBits(&rectDestination, ImageLockModeWrite, PixelFormat32bppARGB, &job.destinationData) != Ok)
+        {
+            job.pSource->UnlockBits(&job.sourceData);
+            continue;
+        }
+
+        CImageScaler::PixelBuffer source = { static_cast<uint32_t*>(job.sourceData.Scan0), rectSource.Width, rectSource.Height, job.sourceData.Stride };
+        CImageScaler::PixelBuffer destination = { static_cast<uint32_t*>(job.destinationData.Scan0), rectDestination.Width, rectDestination.Height, job.destinationData.Stride };
+        job.source = source;
+        job.destination = destination;
+        job.fLocked = true;
+    }
+
+    // Hash the logical pixels, and copy the device pixels from the cache or scale them
+    CTaskPool::GetInstance().ParallelFor(count, [&](size_t i)
+    {
+        ScaleJob& job = jobs[i];
+        if (!job.fLocked)
+            return;
+
+        CScaledImageCache::LogicalPixels logicalView = { job.source.pBits, job.source.width, job.source.height, job.source.stride };
+        job.cacheKey.contentHash = CScaledImageCache::HashPixels(job.source.pBits, job.source.width, job.source.height, job.source.stride);
+        shared_ptr<const CScaledImageCache::Image> spCachedImage = CScaledImageCache::GetInstance().Find(job.cacheKey, &logicalView);
+        if (spCachedImage.get() != nullptr && spCachedImage->width == job.destination.width && spCachedImage->height == job.destination.height)
+        {
+            for (int y = 0; y < job.destination.height; y++)
+            {
+                memcpy(job.destination.Row(y), &spCachedImage->pixels[static_cast<size_t>(y) * spCachedImage->width], spCachedImage->width * sizeof(ARGB));
+            }
+            job.fCached = true;
+            job.fScaled = true;
+            return;
+        }
+
+        job.fScaled = DrawScaledPixels(job.source, job.destination, actualScalingMode, filter, clrBackground.GetValue());
+    }, maxThreads);
+
+    // Unlock the bitmaps, cache the new device images with the logical pixels still locked, and fall back to the serial conversion
+    // for the images that could not be scaled natively
+    for (size_t i = 0; i < count; i++)
+    {
+        ScaleJob& job = jobs[i];
+        if (job.fLocked)
+        {
+            job.pDestination->UnlockBits(&job.destinationData);
+            if (job.fScaled && !job.fCached)
+            {
+                CScaledImageCache::LogicalPixels logicalView = { job.source.pBits, job.source.width, job.source.height, job.source.stride };
+                CScaledImageCache::GetInstance().Insert(job.cacheKey, CreateCachedImage(job.pDestination), &logicalView);
+            }
+            job.pSource->UnlockBits(&job.sourceData);
+        }
+
+        if (!job.fScaled && ppImages[i] != nullptr && ppImages[i]->GetBitmap() != nullptr)
+        {
+            deviceImages[i] = CreateDeviceFromLogicalImage(ppImages[i], scalingMode, clrBackground);
+        }
+    }
+
+    // The batch fails if one of the images could not be converted
+    if (stats.IsEnabled())
+    {
+        uint64_t pixels = 0;
+        bool fSucceeded = true;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (deviceImages[i].get() != nullptr && deviceImages[i]->IsLoaded())
+            {
+                pixels += static_cast<uint64_t>(deviceImages[i]->GetWidth()) * deviceImages[i]->GetHeight();
+            }
+            else if (ppImages[i] != nullptr && ppImages[i]->GetBitmap() != nullptr)
+            {
+                fSucceeded = false;
+            }
+        }
+
+        if (fSucceeded)
+        {
+            stats.SetResult(static_cast<int>(actualScalingMode), pixels, pixels * sizeof(ARGB));
+        }
+    }
+
+    return deviceImages;
+}
+
+CDeviceImageSet::CDeviceImageSet() :
+    m_pSelectedImage(nullptr), m_SelectedDpi(0)
+{
+}
+
+VsUI::GdiplusImage* CDeviceImageSet::GetImage(int dpi) const
+{
+    auto imageIter = m_images.find(dpi);
+    return (imageIter != m_images.end()) ? imageIter->second.get() : nullptr;
+}
+
+bool CDeviceImageSet::HasImage(int dpi) const
+{
+    return GetImage(dpi) != nullptr;
+}
+
+VsUI::GdiplusImage* CDeviceImageSet::SelectDpi(int dpi)
+{
+    VsUI::GdiplusImage* pImage = GetImage(dpi);
+    IfNullRetNull(pImage);
+
+    m_pSelectedImage = pImage;
+    m_SelectedDpi = dpi;
+    return pImage;
+}
+
+VsUI::GdiplusImage* CDeviceImageSet::GetSelectedImage() const
+{
+    return m_pSelectedImage;
+}
+
+int CDeviceImageSet::GetSelectedDpi() const
+{
+    return m_SelectedDpi;
+}
+
+bool CDeviceImageSet::SetImage(int dpi, unique_ptr<VsUI::GdiplusImage> pImage)
+{
+    IfNullRetX(pImage.get(), false);
+
+    try
+    {
+        unique_ptr<VsUI::GdiplusImage>& pSetImage = m_images[dpi];
+        if (m_SelectedDpi == dpi)
+        {
+            m_pSelectedImage = pImage.get();
+        }
+        pSetImage = move(pImage);
+    }
+    catch (const bad_alloc&)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+// Creates the device images of the logical image for several device DPI values. The logical bitmap is locked, hashed and premultiplied once,
+// and each device image is either copied from the scaled images cache or scaled from the shared premultiplied pixels, in parallel.
+unique_ptr<CDeviceImageSet> CDpiHelper::CreateDeviceImageSet(_In_ VsUI::GdiplusImage* pImage, _In_reads_(count) const int * pDeviceDpis, size_t count, ImageScalingMode scalingMode, Color clrBackground)
+{
+    IfNullAssertRetNull(pImage, "No image given to convert");
+
+    Bitmap* pBitmap = pImage->GetBitmap();
+    IfNullAssertRetNull(pBitmap, "No image given to convert");
+
+    // Pixel work for the device image of one DPI
+    struct ScaleVariant
+    {
+        int dpi;
+        CDpiHelper* pHelper;
+        unique_ptr<CDpiHelper> spOwnedHelper;
+        unique_ptr<VsUI::GdiplusImage> pDeviceImage;
+        BitmapData destinationData;
+        CImageScaler::PixelBuffer destination;
+        CScaledImageCache::Key cacheKey;
+        ImageScalingMode actualScalingMode;
+        CImageScaler::Filter filter;
+        bool fLocked;
+        bool fCached;
+        bool fScaled;
+    };
+
+    unique_ptr<CDeviceImageSet> pImageSet;
+    vector<ScaleVariant> variants;
+    try
+    {
+        pImageSet.reset(new CDeviceImageSet());
+        variants.reserve(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            // Monitors with the same DPI share the device image
+            int dpi = pDeviceDpis[i];
+            VSASSERT(dpi > 0, "Invalid device DPI");
+            if (dpi <= 0 || any_of(variants.begin(), variants.end(), [dpi](const ScaleVariant& variant) { return variant.dpi == dpi; }))
+                continue;
+
+            ScaleVariant variant = ScaleVariant();
+            variant.dpi = dpi;
+            if (dpi == m_DeviceDpiX && dpi == m_DeviceDpiY)
+            {
+                variant.pHelper = this;
+            }
+            else
+            {
+                // The preferred scaling mode of the new helper comes from the table shared by the helpers, once resolved for its zoom level
+                variant.spOwnedHelper.reset(new CDpiHelper(dpi, dpi, m_LogicalDpiX, m_LogicalDpiY));
+                variant.pHelper = variant.spOwnedHelper.get();
+            }
+            variants.push_back(move(variant));
+        }
+    }
+    catch (const bad_alloc&)
+    {
+        return nullptr;
+    }
+
+    // Lock and hash the logical pixels once for all the device images
+    BitmapData sourceData = {0};
+    Rect rectSource(0, 0, pBitmap->GetWidth(), pBitmap->GetHeight());
+    bool fSourceLocked = (pBitmap->LockBits(&rectSource, ImageLockModeRead, PixelFormat32bppARGB, &sourceData) == Ok);
+    CImageScaler::PixelBuffer source = { static_cast<uint32_t*>(sourceData.Scan0), rectSource.Width, rectSource.Height, sourceData.Stride };
+    CScaledImageCache::LogicalPixels logicalView = { source.pBits, source.width, source.height, source.stride };
+    uint64_t contentHash = fSourceLocked ? CScaledImageCache::HashPixels(source.pBits, source.width, source.height, source.stride) : 0;
+
+    // Create the device images, copy the ones found in the cache, and lock the bits of the others
+    for (size_t i = 0; fSourceLocked && i < variants.size(); i++)
+    {
+        ScaleVariant& variant = variants[i];
+        CDpiHelper* pHelper = variant.pHelper;
+        variant.actualScalingMode = pHelper->GetActualScalingMode(scalingMode);
+        variant.filter = pHelper->GetScalerFilter(variant.actualScalingMode);
+        variant.cacheKey = pHelper->GetScaledImageCacheKey(rectSource.Width, rectSource.Height, pBitmap->GetPixelFormat(), scalingMode, clrBackground);
+        variant.cacheKey.contentHash = contentHash;
+
+        variant.pDeviceImage.reset(new VsUI::GdiplusImage());
+        variant.pDeviceImage->Create( pHelper->LogicalToDeviceUnitsX(rectSource.Width), pHelper->LogicalToDeviceUnitsY(rectSource.Height), pBitmap->GetPixelFormat() );
+        if (!variant.pDeviceImage->IsLoaded())
+            continue;
+
+        Bitmap* pDestination = variant.pDeviceImage->GetBitmap();
+        shared_ptr<const CScaledImageCache::Image> spCachedImage = CScaledImageCache::GetInstance().Find(variant.cacheKey, &logicalView);
+        if (spCachedImage.get() != nullptr && spCachedImage->width == (int)pDestination->GetWidth() && spCachedImage->height == (int)pDestination->GetHeight() &&
+            CopyCachedImage(*spCachedImage, pDestination))
+        {
+            variant.fCached = true;
+            variant.fScaled = true;
+            continue;
+        }
+
+        Rect rectDestination(0, 0, pDestination->GetWidth(), pDestination->GetHeight());
+        if (pDestination->LockBits(&rectDestination, ImageLockModeWrite, PixelFormat32bppARGB, &variant.destinationData) != Ok)
+            continue;
+
+        CImageScaler::PixelBuffer destination = { static_cast<uint32_t*>(variant.destinationData.Scan0), rectDestination.Width, rectDestination.Height, variant.destinationData.Stride };
+        variant.destination = destination;
+        variant.fLocked = true;
+    }
+
+    // Premultiply the logical pixels once, padded for all the device images scaled with a filter. If this fails the images are scaled separately.
+    CImageScaler::PremultipliedSource premultiplied;
+    bool fPremultiplied = false;
+    try
+    {
+        vector<CImageScaler::PixelBuffer> filteredDestinations;
+        vector<CImageScaler::Filter> filters;
+        for (const ScaleVariant& variant : variants)
+        {
+            if (variant.fLocked && variant.filter != CImageScaler::Filter::NearestNeighbor)
+            {
+                filteredDestinations.push_back(variant.destination);
+                filters.push_back(variant.filter);
+            }
+        }
+
+        if (!filteredDestinations.empty())
+        {
+            fPremultiplied = CImageScaler::PremultiplySource(source, filteredDestinations.data(), filters.data(), filteredDestinations.size(), &premultiplied);
+        }
+    }
+    catch (const bad_alloc&)
+    {
+        fPremultiplied = false;
+    }
+
+    CTaskPool::GetInstance().ParallelFor(variants.size(), [&](size_t i)
+    {
+        ScaleVariant& variant = variants[i];
+        if (!variant.fLocked)
+            return;
+
+        if (fPremultiplied && variant.filter != CImageScaler::Filter::NearestNeighbor)
+        {
+            variant.fScaled = CImageScaler::ScalePremultiplied(premultiplied, variant.destination, variant.filter, clrBackground.GetValue());
+        }
+        else
+        {
+            variant.fScaled = DrawScaledPixels(source, variant.destination, variant.actualScalingMode, variant.filter, clrBackground.GetValue());
+        }
+    });
+
+    // Cache the new device images while the logical pixels are still locked
+    for (ScaleVariant& variant : variants)
+    {
+        if (variant.fLocked)
+        {
+            variant.pDeviceImage->GetBitmap()->UnlockBits(&variant.destinationData);
+            if (variant.fScaled)
+            {
+                CScaledImageCache::GetInstance().Insert(variant.cacheKey, CreateCachedImage(variant.pDeviceImage->GetBitmap()), &logicalView);
+            }
+        }
+    }
+
+    if (fSourceLocked)
+    {
+        pBitmap->UnlockBits(&sourceData);
+    }
+
+    // Fall back to the single image conversion for the images that could not be scaled natively, and fill the set
+    for (ScaleVariant& variant : variants)
+    {
+        if (!variant.fScaled)
+        {
+            variant.pDeviceImage = variant.pHelper->CreateDeviceFromLogicalImage(pImage, scalingMode, clrBackground);
+        }
+
+        if (variant.pDeviceImage.get() != nullptr && !pImageSet->SetImage(variant.dpi, move(variant.pDeviceImage)))
+            return nullptr;
+    }
+
+    // The set fails if the device image of one of the DPI values could not be created
+    if (stats.IsEnabled())
+    {
+        uint64_t pixels = 0;
+        bool fSucceeded = true;
+        for (const ScaleVariant& variant : variants)
+        {
+            VsUI::GdiplusImage* pDeviceImage = pImageSet->GetImage(variant.dpi);
+            if (pDeviceImage != nullptr && pDeviceImage->IsLoaded())
+            {
+                pixels += static_cast<uint64_t>(pDeviceImage->GetWidth()) * pDeviceImage->GetHeight();
+            }
+            else
+            {
+                fSucceeded = false;
+            }
+        }
+
+        if (fSucceeded)
+        {
+            stats.SetResult(static_cast<int>(GetActualScalingMode(scalingMode)), pixels, pixels * sizeof(ARGB));
+        }
+    }
+
+    return pImageSet;
+}
+
+// Loads the image from resources and returns the device image, scaled or found in the scaled images cache
+shared_ptr<const CScaledImageCache::Image> CDpiHelper::GetSharedDeviceImage(HINSTANCE hInstance, UINT nIDResource, ImageScalingMode scalingMode, Color clrBackground)
+{
+    // Resources don't change while their module is loaded, so the module and resource id identify the logical image
+    // without loading it. The logical size is not known yet, and the device image is always 32bpp ARGB.
+    CScaledImageCache::Key cacheKey = GetScaledImageCacheKey(0, 0, PixelFormat32bppARGB, scalingMode, clrBackground);
+    cacheKey.pModule = hInstance;
+    cacheKey.resourceId = nIDResource;
+
+    shared_ptr<const CScaledImageCache::Image> spCachedImage = CScaledImageCache::GetInstance().Find(cacheKey);
+    if (spCachedImage.get() != nullptr)
+        return spCachedImage;
+
+    // Then in the images cached on disk by an earlier run, which is much cheaper than decoding and scaling the image again
+    shared_ptr<CPersistentImageCache> spPersistentCache = atomic_load(&s_spPersistentImageCache);
+    CPersistentImageCache::Key persistentKey;
+    if (spPersistentCache.get() != nullptr && !GetPersistentImageCacheKey(hInstance, nIDResource, scalingMode, clrBackground, &persistentKey))
+    {
+        spPersistentCache.reset();
+    }
+    if (spPersistentCache.get() != nullptr)
+    {
+        spCachedImage = spPersistentCache->Load(persistentKey);
+        if (spCachedImage.get() != nullptr)
+            return CScaledImageCache::GetInstance().Insert(cacheKey, spCachedImage);
+    }
+
+    VsUI::GdiplusImage logicalImage;
+    if (FAILED(logicalImage.LoadFromPngOrBmp(hInstance, nIDResource)))
+        return nullptr;
+
+    shared_ptr<const CScaledImageCache::Image> spDeviceImage;
+    if (IsScalingRequired())
+    {
+        VsUI::GdiplusImage deviceImage = ScaleLogicalImage(logicalImage.GetBitmap(), scalingMode, clrBackground);
+        IfNullAssertRetNull(deviceImage.GetBitmap(), "Failed to create scaled image");
+        spDeviceImage = CreateCachedImage(deviceImage.GetBitmap());
+    }
+    else
+    {
+        spDeviceImage = CreateCachedImage(logicalImage.GetBitmap());
+    }
+    IfNullRetNull(spDeviceImage.get());
+
+    if (spPersistentCache.get() != nullptr)
+    {
+        // Not cached on disk is not an error: the image is scaled again next run
+        spPersistentCache->Store(persistentKey, *spDeviceImage);
+    }
+
+    return CScaledImageCache::GetInstance().Insert(cacheKey, spDeviceImage);
+}
+
+// Loads the image from resources and returns a copy of the device image
+unique_ptr<VsUI::GdiplusImage> CDpiHelper::LoadDeviceImage(HINSTANCE hInstance, UINT nIDResource, ImageScalingMode scalingMode, Color clrBackground)
+{
+    shared_ptr<const CScaledImageCache::Image> spDeviceImage = GetSharedDeviceImage(hInstance, nIDResource, scalingMode, clrBackground);
+    IfNullRetNull(spDeviceImage.get());
+
+    unique_ptr<VsUI::GdiplusImage> pDeviceImage(new VsUI::GdiplusImage());
+    pDeviceImage->Create( spDeviceImage->width, spDeviceImage->height, PixelFormat32bppARGB );
+    if (!pDeviceImage->IsLoaded())
+    {
+        VSFAIL("Failed to create device image, out of memory?");
+        return nullptr;
+    }
+
+    if (!CopyCachedImage(*spDeviceImage, pDeviceImage->GetBitmap()))
+        return nullptr;
+
+    return pDeviceImage;
+}
+
+// Loads the icon resource in device units from the closest pre-authored frame, without probing with CopyImage
+HICON CDpiHelper::LoadDeviceIcon(HINSTANCE hInstance, UINT nIDResource, const SIZE& logicalSize, ImageScalingMode scalingMode)
+{
+    CImageConversionStats::CScope stats(CImageConversionStats::EntryPoint::Icon);
+    int cxIcon = LogicalToDeviceUnitsX(logicalSize.cx);
+    int cyIcon = LogicalToDeviceUnitsY(logicalSize.cy);
+
+    int scalingModeUsed = -1;
+    HICON hIcon = LoadIconResourceFrame(hInstance, nIDResource, cxIcon, cyIcon, scalingMode, &scalingModeUsed);
+    IfNullRetNull(hIcon);
+
+    // The icon has a color bitmap and a monochrome mask, like the icons scaled by CreateDeviceImageOrReuseIcon
+    uint64_t pixels = static_cast<uint64_t>(cxIcon) * cyIcon;
+    stats.SetResult(scalingModeUsed, pixels, pixels * sizeof(ARGB) + ((cxIcon + 15) / 16) * 2 * cyIcon);
+    return hIcon;
+}
+
+// Creates the cxIcon x cyIcon icon from the frame of the icon resource selected by CIconResourceIndex. pScalingModeUsed receives the
+// scaling mode of the native scaler, or -1 if the icon was created by USER32.
+HICON CDpiHelper::LoadIconResourceFrame(HINSTANCE hInstance, UINT nIDResource, int cxIcon, int cyIcon, ImageScalingMode scalingMode, _Out_ int * pScalingModeUsed)
+{
+    *pScalingModeUsed = -1;
+
+    CIconDirectory::Frame frame;
+    bool fFoundFrame = CIconResourceIndex::GetInstance().SelectFrame(hInstance, nIDResource, cxIcon, cyIcon, &frame, [hInstance, nIDResource](const void** ppData, size_t* pcb)
+    {
+        return GetResourceBytes(hInstance, MAKEINTRESOURCE(nIDResource), RT_GROUP_ICON, ppData, pcb);
+    });
+    if (!fFoundFrame)
+        return NULL;
+
+    const void* pFrameBits = nullptr;
+    size_t cbFrame = 0;
+    if (!GetResourceBytes(hInstance, MAKEINTRESOURCE(frame.location), RT_ICON, &pFrameBits, &cbFrame))
+        return NULL;
+
+    // Frames at or above the device size are used as authored or scaled down by USER32, like LoadImage does. Smaller frames
+    // with an alpha channel are created at their own size and scaled up with the native scaler, instead of being stretched.
+    bool fScaleUp = (frame.width < cxIcon || frame.height < cyIcon) && frame.bitCount == 32;
+    HICON hIcon = CreateIconFromResourceEx(static_cast<PBYTE>(const_cast<void*>(pFrameBits)), static_cast<DWORD>(cbFrame), TRUE /*fIcon*/, 0x00030000 /*dwVer*/,
+        fScaleUp ? frame.width : cxIcon, fScaleUp ? frame.height : cyIcon, LR_DEFAULTCOLOR);
+    IfNullRetNull(hIcon);
+
+    if (fScaleUp)
+    {
+        HICON hDeviceIcon = ScaleIconPixels(hIcon, cxIcon, cyIcon, scalingMode);
+        if (hDeviceIcon != NULL)
+        {
+            ::DestroyIcon(hIcon);
+            hIcon = hDeviceIcon;
+            *pScalingModeUsed = static_cast<int>(GetActualScalingMode(scalingMode));
+        }
+        else
+        {
+            // Couldn't scale the pixels, stretch the frame like CopyImage does for icons not loaded from resources
+            HICON hStretchedIcon = static_cast<HICON>(::CopyImage(hIcon, IMAGE_ICON, cxIcon, cyIcon, LR_COPYDELETEORG));
+            if (hStretchedIcon == NULL)
+            {
+                ::DestroyIcon(hIcon);
+            }
+            hIcon = hStretchedIcon;
+        }
+    }
+
+    return hIcon;
+}
+
+// Scales a 32bpp icon to the device size with the native scaler, and returns the new icon
+HICON CDpiHelper::ScaleIconPixels(_In_ HICON hIcon, int cxDevice, int cyDevice, ImageScalingMode scalingMode)
+{
+    ICONINFO iconInfo = {0};
+    if (!GetIconInfo(hIcon, &iconInfo))
+        return NULL;
+
+    // GetIconInfo returns copies of the icon bitmaps
+    CWinManagedBitmap bmpColor;
+    bmpColor.Attach(iconInfo.hbmColor);
+    CWinManagedBitmap bmpMask;
+    bmpMask.Attach(iconInfo.hbmMask);
+
+    BITMAP bmColor = {0};
+    if (iconInfo.hbmColor == NULL || !::GetObject(iconInfo.hbmColor, sizeof(bmColor), &bmColor) || bmColor.bmBitsPixel != 32)
+        return NULL;
+
+    TScratchBuffer<ARGB> sourceBits;
+    if (!sourceBits.Allocate(static_cast<size_t>(bmColor.bmWidth) * bmColor.bmHeight))
+        return NULL;
+
+    BITMAPINFO bmi = {0};
+    bmi.bmiHeader.biSize = sizeof(bmi.bmiHeader);
+    bmi.bmiHeader.biWidth = bmColor.bmWidth;
+    bmi.bmiHeader.biHeight = -bmColor.bmHeight;
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    CWinClientDC dcScreen(NULL);
+    IfNullRetNull(dcScreen);
+    if (GetDIBits(dcScreen, iconInfo.hbmColor, 0, bmColor.bmHeight, sourceBits.data(), &bmi, DIB_RGB_COLORS) != bmColor.bmHeight)
+        return NULL;
+
+    CImageScaler::PixelBuffer source = { reinterpret_cast<uint32_t*>(sourceBits.data()), bmColor.bmWidth, bmColor.bmHeight, static_cast<ptrdiff_t>(bmColor.bmWidth) * 4 };
+
+    void* pDeviceBits = nullptr;
+    CWinManagedBitmap bmpDevice;
+    bmpDevice.Attach(CreateDeviceDIB(cxDevice, cyDevice, &pDeviceBits));
+    IfNullRetNull(bmpDevice);
+
+    CImageScaler::PixelBuffer destination = { static_cast<uint32_t*>(pDeviceBits), cxDevice, cyDevice, static_cast<ptrdiff_t>(cxDevice) * 4 };
+    ImageScalingMode actualScalingMode = GetActualScalingMode(scalingMode);
+    if (!DrawScaledPixels(source, destination, actualScalingMode, GetScalerFilter(actualScalingMode), TransparentColor.GetValue()))
+        return NULL;
+
+    CWinManagedBitmap bmpDeviceMask;
+    bmpDeviceMask.Attach(CreateAlphaMask(destination));
+    IfNullRetNull(bmpDeviceMask);
+
+    // CreateIconIndirect copies the bitmaps
+    ICONINFO deviceIconInfo = {0};
+    deviceIconInfo.fIcon = TRUE;
+    deviceIconInfo.hbmMask = bmpDeviceMask;
+    deviceIconInfo.hbmColor = bmpDevice;
+    return CreateIconIndirect(&deviceIconInfo);
+}
+
+// Returns the bytes of a resource of the module. Resources stay mapped while their module is loaded, so nothing needs to be freed.
+bool CDpiHelper::GetResourceBytes(HINSTANCE hInstance, LPCTSTR pszName, LPCTSTR pszType, _Outptr_ const void ** ppData, _Out_ size_t * pcb)
+{
+    *ppData = nullptr;
+    *pcb = 0;
+
+    HRSRC hResource = FindResource(hInstance, pszName, pszType);
+    IfNullRetX(hResource, false);
+
+    HGLOBAL hResourceData = LoadResource(hInstance, hResource);
+    IfNullRetX(hResourceData, false);
+
+    *ppData = LockResource(hResourceData);
+    IfNullRetX(*ppData, false);
+
+    *pcb = SizeofResource(hInstance, hResource);
+    return true;
+}
+
+// Returns the cache key for images scaled by this helper. The caller fills in the identity of the logical image.
+CScaledImageCache::Key CDpiHelper::GetScaledImageCacheKey(int logicalWidth, int logicalHeight, PixelFormat format, ImageScalingMode scalingMode, Color clrBackground)
+{
+    CScaledImageCache::Key cacheKey = {0};
+    cacheKey.pixelFormat = format;
+    cacheKey.logicalWidth = logicalWidth;
+    cacheKey.logicalHeight = logicalHeight;
+    cacheKey.deviceDpiX = m_DeviceDpiX;
+    cacheKey.deviceDpiY = m_DeviceDpiY;
+    cacheKey.logicalDpiX = m_LogicalDpiX;
+    cacheKey.logicalDpiY = m_LogicalDpiY;
+    // Default resolves to the preferred mode, which the user can override, so the key uses the actual mode
+    cacheKey.scalingMode = static_cast<int>(GetActualScalingMode(scalingMode));
+    cacheKey.background = clrBackground.GetValue();
+    return cacheKey;
+}
+
+// Copies the bitmap pixels into a new image that can be cached, or returns nullptr if we run out of memory
+shared_ptr<const CScaledImageCache::Image> CDpiHelper::CreateCachedImage(_In_ Bitmap* pBitmap)
+{
+    shared_ptr<CScaledImageCache::Image> spImage;
+    try
+    {
+        spImage = make_shared<CScaledImageCache::Image>();
+        spImage->width = pBitmap->GetWidth();
+        spImage->height = pBitmap->GetHeight();
+        spImage->pixels.resize(static_cast<size_t>(spImage->width) * spImage->height);
+    }
+    catch (const bad_alloc&)
+    {
+        return nullptr;
+    }
+
+    // Let GDI+ convert the pixels straight into the image buffer
+    BitmapData bitmapData = {0};
+    bitmapData.Width = spImage->width;
+    bitmapData.Height = spImage->height;
+    bitmapData.Stride = spImage->width * sizeof(ARGB);
+    bitmapData.PixelFormat = PixelFormat32bppARGB;
+    bitmapData.Scan0 = spImage->pixels.data();
+
+    Rect rect(0, 0, spImage->width, spImage->height);
+    if (pBitmap->LockBits(&rect, ImageLockModeRead | ImageLockModeUserInputBuf, PixelFormat32bppARGB, &bitmapData) != Ok)
+        return nullptr;
+    pBitmap->UnlockBits(&bitmapData);
+
+    return spImage;
+}
+
+// Copies the cached image pixels into the bitmap, which must have the same size
+bool CDpiHelper::CopyCachedImage(const CScaledImageCache::Image& image, _Inout_ Bitmap* pBitmap)
+{
+    VSASSERT(pBitmap->GetWidth() == (UINT)image.width && pBitmap->GetHeight() == (UINT)image.height, "The cached image has a different size");
+
+    BitmapData bitmapData;
+    Rect rect(0, 0, image.width, image.height);
+    if (pBitmap->LockBits(&rect, ImageLockModeWrite, PixelFormat32bppARGB, &bitmapData) != Ok)
+        return false;
+
+    for (int y = 0; y < image.height; y++)
+    {
+        memcpy(static_cast<BYTE*>(bitmapData.Scan0) + y * bitmapData.Stride, &image.pixels[static_cast<size_t>(y) * image.width], image.width * sizeof(ARGB));
+    }
+
+    pBitmap->UnlockBits(&bitmapData);
+    return true;
+}
+
+// Scales the source bitmap into the whole destination bitmap (or centers it, for BorderOnly scaling)
+bool CDpiHelper::DrawScaledBitmap(_In_ Bitmap* pSource, _Inout_ Bitmap* pDestination, ImageScalingMode scalingMode, Color clrBackground)
+{
+    // Use the native scaler, and fall back to GDI+ if the bitmap bits can't be accessed or the scaler runs out of memory
+    if (DrawScaledBitmapNative(pSource, pDestination, scalingMode, clrBackground))
+        return true;
+
+    return DrawScaledBitmapGdiplus(pSource, pDestination, scalingMode, clrBackground);
+}
+
+// Scales the bitmap with CImageScaler, working directly on the 32bpp ARGB bits of the source and destination
+bool CDpiHelper::DrawScaledBitmapNative(_In_ Bitmap* pSource, _Inout_ Bitmap* pDestination, ImageScalingMode scalingMode, Color clrBackground)
+{
+    BitmapData sourceData;
+    Rect rectSource(0, 0, pSource->GetWidth(), pSource->GetHeight());
+    if (pSource->LockBits(&rectSource, ImageLockModeRead, PixelFormat32bppARGB, &sourceData) != Ok)
+        return false;
+
+    BitmapData destinationData;
+    Rect rectDestination(0, 0, pDestination->GetWidth(), pDestination->GetHeight());
+    if (pDestination->LockBits(&rectDestination, ImageLockModeWrite, PixelFormat32bppARGB, &destinationData) != Ok)
+    {
+        pSource->UnlockBits(&sourceData);
+        return false;
+    }
+
+    CImageScaler::PixelBuffer source = { static_cast<uint32_t*>(sourceData.Scan0), rectSource.Width, rectSource.Height, sourceData.Stride };
+    CImageScaler::PixelBuffer destination = { static_cast<uint32_t*>(destinationData.Scan0), rectDestination.Width, rectDestination.Height, destinationData.Stride };
+
+    bool fScaled = DrawScaledCells(source, destination, 1, scalingMode, clrBackground);
+
+    pDestination->UnlockBits(&destinationData);
+    pSource->UnlockBits(&sourceData);
+    return fScaled;
+}
+
+// Scales the count images laid out side by side in the source strip into the cells of the destination strip.
+// Each image is scaled as if it was alone in a bitmap, so the pixels of neighbor images never get mixed.
+bool CDpiHelper::DrawScaledCells(const CImageScaler::PixelBuffer& source, const CImageScaler::PixelBuffer& destination, int count, ImageScalingMode scalingMode, Color clrBackground)
+{
+    ImageScalingMode actualScalingMode = GetActualScalingMode(scalingMode);
+    CImageScaler::Filter filter = GetScalerFilter(actualScalingMode);
+    int sourceWidth = source.width / count;
+    int destinationWidth = destination.width / count;
+
+    // The cells are independent, so they can be scaled in parallel with the same results
+    atomic<bool> fFailed(false);
+    CTaskPool::GetInstance().ParallelFor(count, [&](size_t iCell)
+    {
+        int x = static_cast<int>(iCell);
+        CImageScaler::PixelBuffer sourceCell = source.Columns(x * sourceWidth, sourceWidth);
+        CImageScaler::PixelBuffer destinationCell = destination.Columns(x * destinationWidth, destinationWidth);
+
+        if (!DrawScaledPixels(sourceCell, destinationCell, actualScalingMode, filter, clrBackground.GetValue()))
+            fFailed = true;
+    });
+
+    return !fFailed;
+}
+
+// Scales the pixels with the native scaler. Doesn't use the helper state, so it can be called from any thread.
+bool CDpiHelper::DrawScaledPixels(const CImageScaler::PixelBuffer& source, const CImageScaler::PixelBuffer& destination, ImageScalingMode actualScalingMode, CImageScaler::Filter filter, ARGB clrBackground)
+{
+    if (actualScalingMode == ImageScalingMode::BorderOnly)
+    {
+        return CImageScaler::DrawCentered(source, destination, clrBackground);
+    }
+
+    return CImageScaler::Scale(source, destination, filter, clrBackground);
+}
+
+// Scales the bitmap with GDI+ DrawImage
+bool CDpiHelper::DrawScaledBitmapGdiplus(_In_ Bitmap* pSource, _Inout_ Bitmap* pDestination, ImageScalingMode scalingMode, Color clrBackground)
+{
+    int deviceWidth = pDestination->GetWidth();
+    int deviceHeight = pDestination->GetHeight();
+
     // Get a Graphics object for the device image on which we can paint 
-    unique_ptr<Graphics> pGraphics(pDeviceImage->GetGraphics());
+    unique_ptr<Graphics> pGraphics(Graphics::FromImage(pDestination));
     if (pGraphics.get() == nullptr)
     {
         VSFAIL("Failed to obtain image Graphics");
-        return nullptr;
+        return false;
     }
     
     // Set the interpolation mode. 
@@ -369,12 +1331,12 @@ unique_ptr<VsUI::GdiplusImage> CDpiHelper::CreateDeviceFromLogicalImage(_In_ VsU
     RectF rectD(0, 0, (float)deviceWidth, (float)deviceHeight);
     if (scalingMode == ImageScalingMode::BorderOnly || (scalingMode == ImageScalingMode::Default && m_PreferredScalingMode == ImageScalingMode::BorderOnly))
     {
-        rectD = RectF(0, 0, (float)pBitmap->GetWidth(), (float)pBitmap->GetHeight());
-        rectD.Offset( (float)((deviceWidth - pBitmap->GetWidth()) / 2),  (float)((deviceHeight - pBitmap->GetHeight())/ 2) );
+        rectD = RectF(0, 0, (float)pSource->GetWidth(), (float)pSource->GetHeight());
+        rectD.Offset( (float)((deviceWidth - (int)pSource->GetWidth()) / 2),  (float)((deviceHeight - (int)pSource->GetHeight())/ 2) );
     }
 
     // Define the source rectangle
-    RectF rectS(0, 0, (float)pBitmap->GetWidth(), (float)pBitmap->GetHeight());
+    RectF rectS(0, 0, (float)pSource->GetWidth(), (float)pSource->GetHeight());
    
     // Specify a source rectangle shifted by half of pixel to account for GDI+ considering the source origin the center of top-left pixel
     // Failing to do so will result in the right and bottom of the bitmap lines being interpolated with the graphics' background color,
@@ -385,10 +1347,7 @@ unique_ptr<VsUI::GdiplusImage> CDpiHelper::CreateDeviceFromLogicalImage(_In_ VsU
     rectS.Offset(-0.5f, -0.5f);
     
     // Draw the scaled bitmap in the device image
-    pGraphics->DrawImage(pBitmap, rectD, rectS.X, rectS.Y, rectS.Width, rectS.Height, UnitPixel);
-    
-    // Return the new image
-    return pDeviceImage;
+    return pGraphics->DrawImage(pSource, rectD, rectS.X, rectS.Y, rectS.Width, rectS.Height, UnitPixel) == Ok;
 }
 
 void CDpiHelper::LogicalToDeviceUnits(_Inout_ HBITMAP * pImage, ImageScalingMode scalingMode, Color clrBackground)
@@ -409,43 +1368,361 @@ void CDpiHelper::LogicalToDeviceUnits(_Inout_ HBITMAP * pImage, ImageScalingMode
     *pImage = hDeviceImage;
 }
 
-HBITMAP CDpiHelper::CreateDeviceFromLogicalImage(HBITMAP _In_ hImage, ImageScalingMode scalingMode, Color clrBackground)
-{
-    IfNullAssertRetNull(hImage, "No image given to convert");
+HBITMAP CDpiHelper::CreateDeviceFromLogicalImage(HBITMAP _In_ hImage, ImageScalingMode scalingMode, Color clrBackground)
+{
+    IfNullAssertRetNull(hImage, "No image given to convert");
+
+    // Instead of doing HBITMAP resizing with StretchBlt from one memory DC into other memory DC and HALFTONE StretchBltMode
+    // which uses nearest neighbor resize algorithm (fast but results in pixelation), we'll use a GdiPlus image to do the resize, 
+    // which allows specifying the interpolation mode for the resize resulting in smoother result.
+    VsUI::GdiplusImage gdiplusImage;
+
+    // Attaching the bitmap uses Bitmap.FromHBITMAP which does not take ownership of the HBITMAP passed as argument.
+    // DeleteObject still needs to be used on the hImage but that should happen after the Bitmap object is deleted or goes out of scope.
+    // The caller will have to DeleteObject both the HBITMAP they passed in this function and the new HBITMAP we'll be returning when we detach the GDI+ Bitmap
+    gdiplusImage.Attach(hImage);
+
+    Bitmap* pBitmap = gdiplusImage.GetBitmap();
+    IfNullAssertRetNull(pBitmap, "Failed to attach the image to convert");
+
+    // The multi-pass conversion replaces the bitmap of gdiplusImage, so get the logical size first
+    CImageConversionStats::CScope stats(CImageConversionStats::EntryPoint::Bitmap);
+    UINT width = pBitmap->GetWidth();
+    UINT height = pBitmap->GetHeight();
+
+    // Use the fused pipeline when its output matches the multi-pass conversion, otherwise fall back to the latter
+    HBITMAP hBmpResult = NULL;
+    if (CanCreateDeviceBitmapFused(pBitmap->GetPixelFormat(), scalingMode, clrBackground))
+    {
+        hBmpResult = CreateDeviceBitmapFused(pBitmap, scalingMode, clrBackground);
+    }
+    else
+    {
+        hBmpResult = CreateDeviceBitmapMultiPass(gdiplusImage, scalingMode, clrBackground);
+    }
+
+    if (hBmpResult != NULL)
+    {
+        if (stats.IsEnabled())
+        {
+            uint64_t pixels = static_cast<uint64_t>(LogicalToDeviceUnitsX(width)) * LogicalToDeviceUnitsY(height);
+            stats.SetResult(static_cast<int>(GetActualScalingMode(scalingMode)), pixels, pixels * sizeof(ARGB));
+        }
+
+        NotifyConversionSink(CImageConversionStats::EntryPoint::Bitmap, hImage, hBmpResult);
+    }
+
+    // Return the created image
+    return hBmpResult;
+}
+
+// Converts the bitmap without the key colors substitution: the logical pixels are converted once by GDI+ to premultiplied ARGB (or straight
+// ARGB when that is what the result needs), filtered directly into the bits of the returned DIB section, and the partially transparent
+// edges are kept. This skips the keying and restoring passes of the default conversion.
+HBITMAP CDpiHelper::CreateDeviceFromLogicalImage(HBITMAP _In_ hImage, CImageScaler::AlphaFormat alphaFormat, ImageScalingMode scalingMode, _Out_opt_ HBITMAP * phMask)
+{
+    if (phMask != nullptr)
+    {
+        *phMask = NULL;
+    }
+
+    IfNullAssertRetNull(hImage, "No image given to convert");
+
+    VsUI::GdiplusImage gdiplusImage;
+    gdiplusImage.Attach(hImage);
+
+    Bitmap* pBitmap = gdiplusImage.GetBitmap();
+    IfNullAssertRetNull(pBitmap, "Failed to attach the image to convert");
+
+    CImageConversionStats::CScope stats(CImageConversionStats::EntryPoint::Bitmap);
+    int width = pBitmap->GetWidth();
+    int height = pBitmap->GetHeight();
+    int deviceWidth = LogicalToDeviceUnitsX(width);
+    int deviceHeight = LogicalToDeviceUnitsY(height);
+    ImageScalingMode actualScalingMode = GetActualScalingMode(scalingMode);
+    CImageScaler::Filter filter = GetScalerFilter(actualScalingMode);
+
+    void* pDeviceBits = nullptr;
+    HBITMAP hBmpResult = CreateDeviceDIB(deviceWidth, deviceHeight, &pDeviceBits);
+    IfNullRetNull(hBmpResult);
+
+    bool fResultComplete = false;
+    SCOPE_GUARD({
+        if (!fResultComplete)
+            DeleteObject(hBmpResult);
+    });
+
+    CImageScaler::PixelBuffer destination = { static_cast<uint32_t*>(pDeviceBits), deviceWidth, deviceHeight, static_cast<ptrdiff_t>(deviceWidth) * 4 };
+    if (alphaFormat == CImageScaler::AlphaFormat::Premultiplied && filter != CImageScaler::Filter::NearestNeighbor)
+    {
+        // GDI+ premultiplies the pixels while converting them into the padded rows the filter reads
+        CImageScaler::PremultipliedSource premultiplied;
+        if (!CImageScaler::AllocatePremultipliedSource(width, height, &destination, &filter, 1, &premultiplied))
+            return NULL;
+        if (!ReadBitmapPixels(pBitmap, PixelFormat32bppPARGB, premultiplied.Pixels()))
+            return NULL;
+        CImageScaler::PadPremultipliedSource(&premultiplied);
+
+        if (!CImageScaler::ScalePremultiplied(premultiplied, destination, filter, TransparentColor.GetValue(), alphaFormat))
+            return NULL;
+    }
+    else
+    {
+        // Straight results are filtered in premultiplied space by the scaler itself. Nearest neighbor and border only scaling copy
+        // the pixels unchanged on a transparent background, so they work on premultiplied pixels too.
+        PixelFormat sourceFormat = (alphaFormat == CImageScaler::AlphaFormat::Premultiplied) ? PixelFormat32bppPARGB : PixelFormat32bppARGB;
+        TScratchBuffer<ARGB> sourceBits;
+        if (!sourceBits.Allocate(static_cast<size_t>(width) * height))
+            return NULL;
+
+        CImageScaler::PixelBuffer source = { reinterpret_cast<uint32_t*>(sourceBits.data()), width, height, static_cast<ptrdiff_t>(width) * 4 };
+        if (!ReadBitmapPixels(pBitmap, sourceFormat, source))
+            return NULL;
+
+        if (!DrawScaledPixels(source, destination, actualScalingMode, filter, TransparentColor.GetValue()))
+            return NULL;
+    }
+
+    if (phMask != nullptr)
+    {
+        *phMask = CreateAlphaMask(destination);
+        IfNullRetNull(*phMask);
+    }
+
+    uint64_t pixels = static_cast<uint64_t>(deviceWidth) * deviceHeight;
+    stats.SetResult(static_cast<int>(actualScalingMode), pixels, pixels * sizeof(ARGB));
+    NotifyConversionSink(CImageConversionStats::EntryPoint::Bitmap, hImage, hBmpResult);
+
+    fResultComplete = true;
+    return hBmpResult;
+}
+
+// Copies the bitmap pixels into the buffer, converted by GDI+ to the 32bpp format
+bool CDpiHelper::ReadBitmapPixels(_In_ Bitmap* pBitmap, PixelFormat format, const CImageScaler::PixelBuffer& pixels)
+{
+    BitmapData bitmapData = {0};
+    bitmapData.Width = pixels.width;
+    bitmapData.Height = pixels.height;
+    bitmapData.Stride = static_cast<INT>(pixels.stride);
+    bitmapData.PixelFormat = format;
+    bitmapData.Scan0 = pixels.pBits;
+
+    Rect rect(0, 0, pixels.width, pixels.height);
+    if (pBitmap->LockBits(&rect, ImageLockModeRead | ImageLockModeUserInputBuf, format, &bitmapData) != Ok)
+        return false;
+
+    pBitmap->UnlockBits(&bitmapData);
+    return true;
+}
+
+// Creates a monochrome mask of the pixels: the bits of the pixels less than half opaque are set, like the AND mask of an icon
+HBITMAP CDpiHelper::CreateAlphaMask(const CImageScaler::PixelBuffer& pixels)
+{
+    // Monochrome bitmap rows are aligned on WORD boundaries
+    size_t cbMaskRow = ((static_cast<size_t>(pixels.width) + 15) / 16) * 2;
+    vector<BYTE> maskBits;
+    try
+    {
+        maskBits.resize(cbMaskRow * pixels.height);
+    }
+    catch (const bad_alloc&)
+    {
+        return NULL;
+    }
+
+    for (int y = 0; y < pixels.height; y++)
+    {
+        const uint32_t* pRow = pixels.Row(y);
+        BYTE* pMaskRow = &maskBits[y * cbMaskRow];
+        for (int x = 0; x < pixels.width; x++)
+        {
+            if ((pRow[x] >> 24) < 0x80)
+            {
+                pMaskRow[x / 8] |= static_cast<BYTE>(0x80 >> (x % 8));
+            }
+        }
+    }
+
+    return CreateBitmap(pixels.width, pixels.height, 1 /*planes*/, 1 /*bitsPerPixel*/, maskBits.data());
+}
+
+// Fills pKeyColors with the colors to be made transparent before filtering, and returns their count
+UINT CDpiHelper::GetHaloKeyColors(Color clrBackground, _Out_writes_to_(CPixelKernels::k_MaxKeyColors, return) ARGB * pKeyColors)
+{
+    UINT keyCount = 0;
+    if (clrBackground.GetValue() != TransparentColor.GetValue())
+    {
+        pKeyColors[keyCount++] = clrBackground.GetValue();
+    }
+    else
+    {
+        pKeyColors[keyCount++] = MagentaColor.GetValue();
+        pKeyColors[keyCount++] = NearGreenColor.GetValue();
+    }
+
+    return keyCount;
+}
+
+// Returns whether the fused pipeline produces the same HBITMAP as the multi-pass conversion for the given source format.
+// The multi-pass conversion relies on GDI+ to convert the result back to the source format and to compose it on TransparentColor,
+// which the fused pipeline only reproduces for the common 24bpp and 32bpp formats and for fully opaque or fully transparent backgrounds.
+bool CDpiHelper::CanCreateDeviceBitmapFused(PixelFormat format, ImageScalingMode scalingMode, Color clrBackground)
+{
+    if (format != PixelFormat24bppRGB && format != PixelFormat32bppRGB && format != PixelFormat32bppARGB)
+        return false;
+
+    if (clrBackground.GetAlpha() != 0xFF && clrBackground.GetValue() != TransparentColor.GetValue())
+        return false;
+
+    // Without the key/restore passes partially transparent pixels of ARGB images would be composed by GDI+
+    if (format == PixelFormat32bppARGB && GetActualScalingMode(scalingMode) == ImageScalingMode::NearestNeighbor)
+        return false;
+
+    return true;
+}
+
+// Creates a 32bpp top-down DIB section that can be used both by GDI and as the pixel buffer of a Gdiplus::Bitmap
+HBITMAP CDpiHelper::CreateDeviceDIB(int width, int height, _Outptr_ void ** ppBits)
+{
+    BITMAPINFO bmi = {0};
+    bmi.bmiHeader.biSize = sizeof(bmi.bmiHeader);
+    bmi.bmiHeader.biWidth = width;
+    bmi.bmiHeader.biHeight = -height;
+    bmi.bmiHeader.biPlanes = 1;
+    bmi.bmiHeader.biBitCount = 32;
+    bmi.bmiHeader.biCompression = BI_RGB;
+
+    return CreateDIBSection(NULL, &bmi, DIB_RGB_COLORS, ppBits, NULL /*hSection*/, 0 /*offset*/);
+}
+
+// Converts the bitmap in two passes over the pixels: the source rows are expanded to 32bpp ARGB and keyed while they're hot in the cache,
+// and after scaling, each destination row gets its opacity restored and is packed for the source format. The scaled image is drawn
+// directly in the bits of the DIB section that will be returned, so no GDI+ format conversions or GetHBITMAP copies are needed.
+HBITMAP CDpiHelper::CreateDeviceBitmapFused(_In_ Bitmap* pBitmap, ImageScalingMode scalingMode, Color clrBackground)
+{
+    PixelFormat format = pBitmap->GetPixelFormat();
+    UINT width = pBitmap->GetWidth();
+    UINT height = pBitmap->GetHeight();
+    INT stride = static_cast<INT>(width * sizeof(ARGB));
+    const Color *pclrActualBackground = &clrBackground; 
+    bool fKeyColors = (GetActualScalingMode(scalingMode) != ImageScalingMode::NearestNeighbor);
+
+    Bitmap* pSource = pBitmap;
+    // The source bitmap wraps the scratch bits, so it must be destroyed first
+    TScratchBuffer<ARGB> sourceBits;
+    unique_ptr<Bitmap> spSourceBitmap;
+
+    if (fKeyColors)
+    {
+        if (!sourceBits.Allocate(static_cast<size_t>(width) * height))
+            return NULL;
+
+        ARGB keyColors[CPixelKernels::k_MaxKeyColors];
+        UINT keyCount = GetHaloKeyColors(clrBackground, keyColors);
+        UINT foundKeys = 0;
+
+        // Let GDI+ expand the source directly into our buffer, a band of rows at a time, and key each band while it's still in the cache
+        const UINT cbBand = 16 * 1024;
+        UINT bandHeight = max(1u, cbBand / static_cast<UINT>(stride));
+        for (UINT y = 0; y < height; y += bandHeight)
+        {
+            UINT rows = min(bandHeight, height - y);
+            ARGB* pBandBits = sourceBits.data() + y * width;
+
+            BitmapData bandData = {0};
+            bandData.Width = width;
+            bandData.Height = rows;
+            bandData.Stride = stride;
+            bandData.PixelFormat = PixelFormat32bppARGB;
+            bandData.Scan0 = pBandBits;
+
+            Rect rectBand(0, y, width, rows);
+            if (pBitmap->LockBits(&rectBand, ImageLockModeRead | ImageLockModeUserInputBuf, PixelFormat32bppARGB, &bandData) != Ok)
+                return NULL;
+            pBitmap->UnlockBits(&bandData);
+
+            CPixelKernels::ForEachRow<ARGB>(pBandBits, stride, width, rows, [&](ARGB * pRow, UINT rowWidth)
+            {
+                foundKeys |= CPixelKernels::ReplaceKeyColors(pRow, rowWidth, keyColors, keyCount, TransparentHaloColor.GetValue());
+            });
+        }
+
+        if (foundKeys != 0)
+        {
+            pclrActualBackground = (clrBackground.GetValue() != TransparentColor.GetValue()) ? &clrBackground : &MagentaColor;
+        }
 
-    // Instead of doing HBITMAP resizing with StretchBlt from one memory DC into other memory DC and HALFTONE StretchBltMode
-    // which uses nearest neighbor resize algorithm (fast but results in pixelation), we'll use a GdiPlus image to do the resize, 
-    // which allows specifying the interpolation mode for the resize resulting in smoother result.
-    VsUI::GdiplusImage gdiplusImage;
+#pragma push_macro("new")
+#undef new
+        spSourceBitmap.reset(new Bitmap(width, height, stride, PixelFormat32bppARGB, reinterpret_cast<BYTE*>(sourceBits.data())));
+#pragma pop_macro("new")
+        IfNullRetNull(spSourceBitmap.get());
+        pSource = spSourceBitmap.get();
+    }
 
-    // Attaching the bitmap uses Bitmap.FromHBITMAP which does not take ownership of the HBITMAP passed as argument.
-    // DeleteObject still needs to be used on the hImage but that should happen after the Bitmap object is deleted or goes out of scope.
-    // The caller will have to DeleteObject both the HBITMAP they passed in this function and the new HBITMAP we'll be returning when we detach the GDI+ Bitmap
-    gdiplusImage.Attach(hImage);
+    // Create the result DIB and scale the image directly in its bits
+    int deviceWidth = LogicalToDeviceUnitsX(width);
+    int deviceHeight = LogicalToDeviceUnitsY(height);
+    INT deviceStride = deviceWidth * static_cast<INT>(sizeof(ARGB));
 
-#ifdef DEBUG
-    static bool fDebugDPIHelperScaling = false;
-    WCHAR rgTempFolder[MAX_PATH];
-    static int imgIndex = 1;
-    CStringW strFileName;
-    CPath pathTempFile;
+    void* pDeviceBits = nullptr;
+    HBITMAP hBmpResult = CreateDeviceDIB(deviceWidth, deviceHeight, &pDeviceBits);
+    IfNullRetNull(hBmpResult);
+
+    bool fResultComplete = false;
+    SCOPE_GUARD({
+        if (!fResultComplete)
+            DeleteObject(hBmpResult);
+    });
 
-    if (fDebugDPIHelperScaling)
     {
-        if (!GetTempPath(_countof(rgTempFolder), rgTempFolder))
-            *rgTempFolder = '\0';
-    
-        strFileName.Format(_T("DPIHelper_%05d_Before.png"), imgIndex);
+        Bitmap deviceBitmap(deviceWidth, deviceHeight, deviceStride, PixelFormat32bppARGB, static_cast<BYTE*>(pDeviceBits));
+        if (deviceBitmap.GetLastStatus() != Ok)
+            return NULL;
+
+        if (!DrawScaledBitmap(pSource, &deviceBitmap, scalingMode, TransparentHaloColor))
+            return NULL;
+    }
 
-        pathTempFile.Combine(rgTempFolder, strFileName);
-        gdiplusImage.Save(pathTempFile);
+    // Match what converting back to the source format and GetHBITMAP produce: 24bpp images come back opaque, 
+    // and 32bpp RGB images must have zero alpha bytes to be usable with ImageList_AddMasked (see CreateDeviceBitmapMultiPass)
+    ARGB andMask = 0xFFFFFFFF;
+    ARGB orMask = 0;
+    if (format == PixelFormat24bppRGB)
+    {
+        orMask = ALPHA_MASK;
     }
-#endif
+    else if (format == PixelFormat32bppRGB)
+    {
+        andMask = ~ALPHA_MASK;
+    }
+
+    // Now that the bitmap is scaled up, convert back the pixels and pack them in the same pass.
+    // Anything that is not fully opaque, make it clrActualBackground
+    ARGB clrActualBackground = pclrActualBackground->GetValue();
+    CPixelKernels::ForEachRow<ARGB>(pDeviceBits, deviceStride, deviceWidth, deviceHeight, [&](ARGB * pRow, UINT rowWidth)
+    {
+        if (fKeyColors)
+        {
+            CPixelKernels::ReplaceNonOpaquePixels(pRow, rowWidth, clrActualBackground, andMask, orMask);
+        }
+        else
+        {
+            CPixelKernels::MaskPixels(pRow, rowWidth, andMask, orMask);
+        }
+    });
+
+    fResultComplete = true;
+    return hBmpResult;
+}
 
+// Converts the bitmap by converting its format, keying, scaling, restoring and converting back in separate passes.
+// Used for the pixel formats the fused pipeline can't reproduce exactly.
+HBITMAP CDpiHelper::CreateDeviceBitmapMultiPass(_Inout_ VsUI::GdiplusImage& gdiplusImage, ImageScalingMode scalingMode, Color clrBackground)
+{
     Bitmap* pBitmap = gdiplusImage.GetBitmap();
     PixelFormat format = pBitmap->GetPixelFormat();
     const Color *pclrActualBackground = &clrBackground; 
-    InterpolationMode interpolationMode = GetInterpolationMode(scalingMode);
     ImageScalingMode actualScalingMode = GetActualScalingMode(scalingMode);
 
     if (actualScalingMode != ImageScalingMode::NearestNeighbor)
@@ -458,30 +1735,20 @@ HBITMAP CDpiHelper::CreateDeviceFromLogicalImage(HBITMAP _In_ hImage, ImageScali
 
         // Now that we have 32bpp image, let's play with the pixels
         // Detect magenta or near-green in the image and use that as background
-        VsUI::GdiplusImage::ProcessBitmapBits(pBitmap, [&](ARGB * pPixelData) 
+        ARGB keyColors[CPixelKernels::k_MaxKeyColors];
+        UINT keyCount = GetHaloKeyColors(clrBackground, keyColors);
+
+        // All the keys are replaced in one pass; the returned mask tells whether any of them was present
+        UINT foundKeys = 0;
+        VsUI::GdiplusImage::ProcessBitmapRows(pBitmap, [&](ARGB * pRow, UINT width) 
         {
-            if (clrBackground.GetValue() != TransparentColor.GetValue())
-            {
-                if (*pPixelData == clrBackground.GetValue())
-                {
-                    *pPixelData = TransparentHaloColor.GetValue();
-                    pclrActualBackground = &clrBackground;
-                }
-            }
-            else
-            {
-                if (*pPixelData == MagentaColor.GetValue())
-                {
-                    *pPixelData = TransparentHaloColor.GetValue();
-                    pclrActualBackground = &MagentaColor;
-                }
-                else if (*pPixelData == NearGreenColor.GetValue())
-                {
-                    *pPixelData = TransparentHaloColor.GetValue();
-                    pclrActualBackground = &MagentaColor;
-                }
-            }
+            foundKeys |= CPixelKernels::ReplaceKeyColors(pRow, width, keyColors, keyCount, TransparentHaloColor.GetValue());
         });
+
+        if (foundKeys != 0)
+        {
+            pclrActualBackground = (clrBackground.GetValue() != TransparentColor.GetValue()) ? &clrBackground : &MagentaColor;
+        }
     }
 
     // Convert the GdiPlus image if necessary
@@ -494,12 +1761,10 @@ HBITMAP CDpiHelper::CreateDeviceFromLogicalImage(HBITMAP _In_ hImage, ImageScali
     {
         // Now that the bitmap is scaled up, convert back the pixels. 
         // Anything that is not fully opaque, make it clrActualBackground
-        VsUI::GdiplusImage::ProcessBitmapBits(pBitmap, [&](ARGB * pPixelData) 
+        ARGB clrActualBackground = pclrActualBackground->GetValue();
+        VsUI::GdiplusImage::ProcessBitmapRows(pBitmap, [&](ARGB * pRow, UINT width) 
         {
-            if ((*pPixelData & ALPHA_MASK) != 0xFF000000)
-            {
-                *pPixelData = pclrActualBackground->GetValue();
-            }
+            CPixelKernels::ReplaceNonOpaquePixels(pRow, width, clrActualBackground, ARGB(0xFFFFFFFF), ARGB(0));
         });
 
         // Convert back to original format
@@ -509,15 +1774,6 @@ HBITMAP CDpiHelper::CreateDeviceFromLogicalImage(HBITMAP _In_ hImage, ImageScali
         }
     }
 
-#ifdef DEBUG
-    if (fDebugDPIHelperScaling)
-    {
-        strFileName.Format(_T("DPIHelper_%05d_After.png"), imgIndex++);
-        pathTempFile.Combine(rgTempFolder, strFileName);
-        gdiplusImage.Save(pathTempFile);
-    }
-#endif
-  
     // Get the converted image handle - this returns a new HBITMAP that will need to be deleted when no longer needed
     // Detach using TransparentColor (transparent-black). If the result bitmap is to be used with AlphaBlend, that function 
     // keeps the background if the transparent pixels are black
@@ -543,7 +1799,6 @@ HBITMAP CDpiHelper::CreateDeviceFromLogicalImage(HBITMAP _In_ hImage, ImageScali
         }
     }
 
-    // Return the created image
     return hBmpResult;
 }
 
@@ -569,9 +1824,18 @@ HIMAGELIST CDpiHelper::CreateDeviceFromLogicalImage(HIMAGELIST _In_ hImageList,
 {
     IfNullAssertRetNull(hImageList, "No imagelist given to convert");
 
+    CImageConversionStats::CScope stats(CImageConversionStats::EntryPoint::ImageList);
+
     // If no scaling is required, return an image copy
     if (!IsScalingRequired())
-        return ImageList_Duplicate(hImageList);
+    {
+        HIMAGELIST hDuplicate = ImageList_Duplicate(hImageList);
+        if (hDuplicate != NULL)
+        {
+            stats.SetResult(-1, 0, 0);
+        }
+        return hDuplicate;
+    }
 
     int nCount = ImageList_GetImageCount(hImageList);
 
@@ -595,102 +1859,172 @@ HIMAGELIST CDpiHelper::CreateDeviceFromLogicalImage(HIMAGELIST _In_ hImageList,
 
     ImageList_SetBkColor(hImageListDevice, ImageList_GetBkColor(hImageList));
     
-    if (nCount != 0)
+    // Convert the images in strips: all the images of a strip are drawn in one bitmap, scaled cell by cell, and added with one call
+    for (int iFirstImage = 0; iFirstImage < nCount; iFirstImage += k_MaxImageStripCount)
     {
-        CWinClientDC dcScreen(NULL);
-        IfNullRetNull(dcScreen);
+        int stripCount = min(k_MaxImageStripCount, nCount - iFirstImage);
 
-        CWinManagedDC dcMemoryLogical(CreateCompatibleDC(dcScreen));
-        IfNullRetNull(dcMemoryLogical);
+        HBITMAP hbmpStrip = CreateDeviceImageStrip(hImageList, iFirstImage, stripCount, scalingMode);
+        IfNullRetNull(hbmpStrip);
+        SCOPE_GUARD( DeleteObject(hbmpStrip); );
 
-        HIMAGELIST hImageListNoTransparency = NULL;
-        SCOPE_GUARD({ 
-            if (hImageListNoTransparency)
-               ImageList_Destroy(hImageListNoTransparency);
-        });
+        // The imagelist splits the strip in stripCount images of the device size
+        if (ImageList_AddMasked(hImageListDevice, hbmpStrip, MagentaColor.ToCOLORREF()) == -1)
+            return NULL;
+    }
+
+    uint64_t pixels = static_cast<uint64_t>(cxImageDevice) * cyImageDevice * nCount;
+    stats.SetResult(static_cast<int>(GetActualScalingMode(scalingMode)), pixels, pixels * sizeof(ARGB));
+
+    // Flag that scop guard should not delete the image we'll be returning
+    fImageListComplete = true;
+    return hImageListDevice;
+}
+
+// Returns a strip with the images [iFirstImage, iFirstImage + count) of the imagelist, scaled to device units, 
+// on Magenta background and ready to be added with ImageList_AddMasked.
+// Each image is converted as LogicalToDeviceUnits(HBITMAP*, scalingMode, MagentaColor) would convert it if drawn alone in a bitmap,
+// and the cells are scaled independently so the edge pixels of neighbor images don't bleed into each other.
+HBITMAP CDpiHelper::CreateDeviceImageStrip(HIMAGELIST hImageList, int iFirstImage, int count, ImageScalingMode scalingMode)
+{
+    int cxImage = 0;
+    int cyImage = 0;
+    IfFailRetNull( ImageList_GetIconSize(hImageList, &cxImage, &cyImage) );
+
+    int cxImageDevice = LogicalToDeviceUnitsX(cxImage);
+    int cyImageDevice = LogicalToDeviceUnitsY(cyImage);
+
+    CWinClientDC dcScreen(NULL);
+    IfNullRetNull(dcScreen);
+
+    CWinManagedDC dcMemoryLogical(CreateCompatibleDC(dcScreen));
+    IfNullRetNull(dcMemoryLogical);
+
+    // If the source imagelist uses ILC_COLOR32, the color bitmap may have partial transparent pixels
+    // If we were to paint them on a Magenta background for our ILC_COLOR24 output bitmap, those pixels 
+    // would get a magenta tint. To get rid of the partial transparency, we draw the images on Halo color background
+    // (which is used for interpolation of partial transparent pixels), and use the imagelist mask to make
+    // the transparent pixels Magenta.
+    bool fAlphaImages = false;
+    IMAGEINFO imageInfo = {0};
+    if (ImageList_GetImageInfo(hImageList, 0, &imageInfo))
+    {
+        BITMAPINFO bi = {0};
+        bi.bmiHeader.biSize = sizeof(bi.bmiHeader);
         
-        // If the source imagelist uses ILC_COLOR32, the color bitmap may have partial transparent pixels
-        // If we were to paint them on a Magenta background for our ILC_COLOR24 output bitmap, those pixels 
-        // would get a magenta tint. To get rid of the partial transparency, we'll create first a 24bpp 
-        // Imagelist with background of Halo color, and we'll copy the images from the original list.
-        // The imagelist background color is used for interpolation of partial transparent pixels.
-
-        IMAGEINFO imageInfo = {0};
-        if (ImageList_GetImageInfo(hImageList, 0, &imageInfo))
-        {
-            BITMAPINFO bi = {0};
-            bi.bmiHeader.biSize = sizeof(bi.bmiHeader);
-            
-            // Call GetDIBits without the underlying array to determine bitmap attributes
-            if (GetDIBits(dcScreen, imageInfo.hbmImage, /* uStartScan */ 0, /* cScanLines */ 0, /* lpvBits */ nullptr, &bi, DIB_RGB_COLORS))
-            {
-                if (bi.bmiHeader.biBitCount == 32)
-                {
-                    VSASSERT(imageInfo.hbmMask != NULL, "The imagelist contains 32bpp image with no mask, not supported yet. The results will be incorrect.");
-                    hImageListNoTransparency = ImageList_Create(cxImage, cyImage, ILC_COLOR24 | ILC_MASK, nCount /*cInitial*/, 0 /*cGrow*/);
-                    IfNullRetNull(hImageListNoTransparency);
-
-                    ImageList_SetBkColor(hImageListNoTransparency, HaloColor.ToCOLORREF());
-                    
-                    for (int iImage = 0; iImage < nCount; iImage++)
-                    {
-                        // Unfortunately ImageList_Copy can only copy within same imagelist, 
-                        // so we have to extract icons one by one and add into the other imagelist
-                        HICON hIcon = ImageList_GetIcon(hImageList, iImage, 0);
-                        IfNullRetNull(hIcon);
-                        SCOPE_GUARD( DestroyIcon(hIcon); );
-
-                        if (ImageList_AddIcon(hImageListNoTransparency, hIcon) == -1) 
-                            return NULL;
-                    }                    
-
-                    // Set the background color, so further draw operations will use the mask
-                    ImageList_SetBkColor(hImageListNoTransparency, CLR_NONE);
-                }
-            }
+        // Call GetDIBits without the underlying array to determine bitmap attributes
+        if (GetDIBits(dcScreen, imageInfo.hbmImage, /* uStartScan */ 0, /* cScanLines */ 0, /* lpvBits */ nullptr, &bi, DIB_RGB_COLORS))
+        {
+            fAlphaImages = (bi.bmiHeader.biBitCount == 32);
+            VSASSERT(!fAlphaImages || imageInfo.hbmMask != NULL, "The imagelist contains 32bpp image with no mask, not supported yet. The results will be incorrect.");
         }
+    }
+
+    // Use Magenta for transparency
+    const Color& clrTransparency = MagentaColor;
 
-        HIMAGELIST hImageListToDraw = hImageListNoTransparency ? hImageListNoTransparency : hImageList;
+    int cxStrip = cxImage * count;
+    INT stride = cxStrip * static_cast<INT>(sizeof(ARGB));
+    RECT rcStrip = { 0, 0, cxStrip, cyImage };
 
-        // Use Magenta for transparency
-        const Color& clrTransparency = MagentaColor;
+    CWinManagedBrush brBackground;
+    brBackground.CreateSolidBrush(fAlphaImages ? HaloColor.ToCOLORREF() : clrTransparency.ToCOLORREF());
+    IfNullRetNull(brBackground);
+
+    // Draw the images side by side in the logical strip
+    void* pLogicalBits = nullptr;
+    CWinManagedBitmap bmpLogical;
+    bmpLogical.Attach(CreateDeviceDIB(cxStrip, cyImage, &pLogicalBits));
+    IfNullRetNull(bmpLogical);
+
+    dcMemoryLogical.SelectBitmap(bmpLogical);
+    bool fDrawn = (dcMemoryLogical.FillRect(&rcStrip, brBackground) != FALSE);
+    for (int iImage = 0; fDrawn && iImage < count; iImage++)
+    {
+        fDrawn = (ImageList_Draw(hImageList, iFirstImage + iImage, dcMemoryLogical, iImage * cxImage, 0, ILD_NORMAL) != FALSE);
+    }
 
-        CWinManagedBrush brTransparent;
-        brTransparent.CreateSolidBrush(clrTransparency.ToCOLORREF());
-        IfNullRetNull(brTransparent);
+    // The imagelist mask of 32bpp images is drawn in a second strip: white where the images are transparent, black elsewhere
+    void* pMaskBits = nullptr;
+    CWinManagedBitmap bmpMask;
+    if (fDrawn && fAlphaImages)
+    {
+        bmpMask.Attach(CreateDeviceDIB(cxStrip, cyImage, &pMaskBits));
+        fDrawn = (bmpMask != NULL);
+        if (fDrawn)
+        {
+            dcMemoryLogical.SelectBitmap(bmpMask);
+            for (int iImage = 0; fDrawn && iImage < count; iImage++)
+            {
+                fDrawn = (ImageList_Draw(hImageList, iFirstImage + iImage, dcMemoryLogical, iImage * cxImage, 0, ILD_MASK) != FALSE);
+            }
+        }
+    }
 
-        RECT rcImage = { 0, 0, cxImage, cyImage};
+    // Restore the original bitmap in the DC, and make sure GDI is done drawing before accessing the bits directly
+    dcMemoryLogical.SelectBitmap(dcMemoryLogical.m_hOriginalBitmap);
+    GdiFlush();
+    if (!fDrawn)
+        return NULL;
+
+    // The strip has no alpha channel, like the 32bpp RGB bitmaps the images are converted from one by one.
+    // Make it opaque, then key the transparent pixels, unless scaling with NearestNeighbor (see CreateDeviceBitmapFused)
+    bool fKeyColors = (GetActualScalingMode(scalingMode) != ImageScalingMode::NearestNeighbor);
+    ARGB keyColor = clrTransparency.GetValue();
+    for (int y = 0; y < cyImage; y++)
+    {
+        ARGB* pRow = reinterpret_cast<ARGB*>(static_cast<BYTE*>(pLogicalBits) + y * stride);
+        if (pMaskBits != nullptr)
+        {
+            const ARGB* pMaskRow = reinterpret_cast<const ARGB*>(static_cast<const BYTE*>(pMaskBits) + y * stride);
+            for (int x = 0; x < cxStrip; x++)
+            {
+                if ((pMaskRow[x] & ~ALPHA_MASK) != 0)
+                    pRow[x] = keyColor;
+            }
+        }
 
-        for (int iImage = 0; iImage < nCount; iImage++)
+        CPixelKernels::MaskPixels(pRow, cxStrip, ARGB(0xFFFFFFFF), ARGB(ALPHA_MASK));
+        if (fKeyColors)
         {
-            CWinManagedBitmap bmpMemory;
-            bmpMemory.CreateCompatibleBitmap(dcScreen, cxImage, cyImage);
-            IfNullRetNull(bmpMemory);
+            CPixelKernels::ReplaceKeyColors(pRow, cxStrip, &keyColor, 1, TransparentHaloColor.GetValue());
+        }
+    }
 
-            // Select the logical bitmap
-            dcMemoryLogical.SelectBitmap(bmpMemory);
+    // Scale the images in the device strip
+    int cxDeviceStrip = cxImageDevice * count;
+    INT deviceStride = cxDeviceStrip * static_cast<INT>(sizeof(ARGB));
 
-            // Draw image by image in dcMemoryLogical
-            IfFailRetNull( dcMemoryLogical.FillRect(&rcImage, brTransparent) );
-            IfFailRetNull( ImageList_Draw(hImageListToDraw, iImage, dcMemoryLogical, 0, 0, ILD_NORMAL) );
+    void* pDeviceBits = nullptr;
+    HBITMAP hBmpResult = CreateDeviceDIB(cxDeviceStrip, cyImageDevice, &pDeviceBits);
+    IfNullRetNull(hBmpResult);
 
-            // Restore the original bitmap in the DC
-            dcMemoryLogical.SelectBitmap(dcMemoryLogical.m_hOriginalBitmap);
+    bool fResultComplete = false;
+    SCOPE_GUARD({
+        if (!fResultComplete)
+            DeleteObject(hBmpResult);
+    });
 
-            // Now scale the image according with the current DPI 
-            HBITMAP hbmp = bmpMemory.Detach();
-            LogicalToDeviceUnits(&hbmp, scalingMode, clrTransparency);
-            bmpMemory.Attach(hbmp);
+    CImageScaler::PixelBuffer source = { static_cast<uint32_t*>(pLogicalBits), cxStrip, cyImage, stride };
+    CImageScaler::PixelBuffer destination = { static_cast<uint32_t*>(pDeviceBits), cxDeviceStrip, cyImageDevice, deviceStride };
+    if (!DrawScaledCells(source, destination, count, scalingMode, TransparentHaloColor))
+        return NULL;
 
-            // Add the device image to the new imagelist
-            if (ImageList_AddMasked(hImageListDevice, bmpMemory, clrTransparency.ToCOLORREF()) == -1)
-                return NULL;
+    // Anything that is not fully opaque, make it Magenta, and clear the alpha bytes so ImageList_AddMasked matches the Magenta pixels
+    CPixelKernels::ForEachRow<ARGB>(pDeviceBits, deviceStride, cxDeviceStrip, cyImageDevice, [&](ARGB * pRow, UINT rowWidth)
+    {
+        if (fKeyColors)
+        {
+            CPixelKernels::ReplaceNonOpaquePixels(pRow, rowWidth, keyColor, ARGB(~ALPHA_MASK), ARGB(0));
         }
-    }
+        else
+        {
+            CPixelKernels::MaskPixels(pRow, rowWidth, ARGB(~ALPHA_MASK), ARGB(0));
+        }
+    });
 
-    // Flag that scop guard should not delete the image we'll be returning
-    fImageListComplete = true;
-    return hImageListDevice;
+    fResultComplete = true;
+    return hBmpResult;
 }
 
 void CDpiHelper::LogicalToDeviceUnits(_Inout_ HICON * pIcon, _In_opt_ const SIZE * pLogicalSize) const
@@ -701,65 +2035,115 @@ void CDpiHelper::LogicalToDeviceUnits(_Inout_ HICON * pIcon, _In_opt_ const SIZE
     if (!IsScalingRequired())
         return;
 
+    // Figure out the resource the icon was loaded from, and the image size if not given
+    CIconMetadataCache::Metadata metadata = {0};
+    bool fGotMetadata = GetIconMetadata(*pIcon, &metadata);
     SIZE iconSize = {0};
     if (!pLogicalSize)
     {
-        // First, figure out the image size
-        pLogicalSize = &iconSize;
-        if (!GetIconSize(*pIcon, &iconSize))
-        {
+        if (!fGotMetadata)
             return;
-        }
+
+        iconSize.cx = metadata.width;
+        iconSize.cy = metadata.height;
+        pLogicalSize = &iconSize;
     }
 
-    *pIcon = CreateDeviceImageOrReuseIcon(*pIcon, false /*fAlwaysCreate*/, pLogicalSize);
+    *pIcon = CreateDeviceImageOrReuseIcon(*pIcon, false /*fAlwaysCreate*/, pLogicalSize, metadata);
 }
 
 HICON CDpiHelper::CreateDeviceFromLogicalImage(_In_ HICON hIcon, _In_opt_ const SIZE * pLogicalSize) const
 {
     IfNullAssertRetNull(hIcon, "No icon given to convert");
 
+    // Figure out the resource the icon was loaded from, and the image size if not given
+    CIconMetadataCache::Metadata metadata = {0};
+    bool fGotMetadata = GetIconMetadata(hIcon, &metadata);
     SIZE iconSize = {0};
     if (!pLogicalSize)
     {
-        // First, figure out the image size
-        pLogicalSize = &iconSize;
-        if (!GetIconSize(hIcon, &iconSize))
-        {
+        if (!fGotMetadata)
             return DuplicateIcon(NULL, hIcon);
-        }
+
+        iconSize.cx = metadata.width;
+        iconSize.cy = metadata.height;
+        pLogicalSize = &iconSize;
     }
 
-    return CreateDeviceImageOrReuseIcon(hIcon, true /*fAlwaysCreate*/, pLogicalSize);
+    return CreateDeviceImageOrReuseIcon(hIcon, true /*fAlwaysCreate*/, pLogicalSize, metadata);
 }
 
-bool CDpiHelper::GetIconSize(_In_ HICON hIcon, _Out_ SIZE * pSize) const
+// Gets the size of the icon and the icon resource it was loaded from, with a single GetIconInfoEx call
+bool CDpiHelper::GetIconMetadata(_In_ HICON hIcon, _Out_ CIconMetadataCache::Metadata * pMetadata) const
 {
-    bool fGotSize  = false;
-
-    ICONINFO iconInfo = {0};
-    if (GetIconInfo(hIcon, &iconInfo))
+    // GetIconInfoEx returns copies of the icon bitmaps, so the metadata is cached when the application enabled the cache
+    // (see DpiHelper::EnableIconMetadataCache); otherwise every call gets the bitmaps
+    return CIconMetadataCache::GetInstance().GetMetadata(HandleToULong(hIcon), pMetadata, [hIcon](CIconMetadataCache::Metadata* pIconMetadata)
     {
-        BITMAP bmIconsBitmap = {0};
-        if ( ::GetObject(iconInfo.hbmColor,sizeof(bmIconsBitmap), &bmIconsBitmap) )
+        bool fGotMetadata = false;
+
+        ICONINFOEXW iconInfo = {0};
+        iconInfo.cbSize = sizeof(iconInfo);
+        if (GetIconInfoExW(hIcon, &iconInfo))
         {
-            pSize->cx = bmIconsBitmap.bmWidth;
-            pSize->cy = bmIconsBitmap.bmHeight;
-            fGotSize = true;
-        }
+            BITMAP bmIconsBitmap = {0};
+            if ( ::GetObject(iconInfo.hbmColor,sizeof(bmIconsBitmap), &bmIconsBitmap) )
+            {
+                pIconMetadata->width = bmIconsBitmap.bmWidth;
+                pIconMetadata->height = bmIconsBitmap.bmHeight;
+                pIconMetadata->bitsPerPixel = bmIconsBitmap.bmBitsPixel;
+                fGotMetadata = true;
+            }
 
-        ::DeleteObject(iconInfo.hbmMask);
-        ::DeleteObject(iconInfo.hbmColor);
-    }
+            // Icons loaded from an integer resource of a module that is still loaded can be loaded again at the device size.
+            // Icons with a named resource are left to CopyImage.
+            pIconMetadata->pModule = nullptr;
+            pIconMetadata->resourceId = 0;
+            HMODULE hModule = (iconInfo.wResID != 0 && iconInfo.szModName[0] != L'\0') ? GetModuleHandleW(iconInfo.szModName) : NULL;
+            if (hModule != NULL)
+            {
+                pIconMetadata->pModule = hModule;
+                pIconMetadata->resourceId = iconInfo.wResID;
+            }
+
+            ::DeleteObject(iconInfo.hbmMask);
+            ::DeleteObject(iconInfo.hbmColor);
+        }
 
-    return fGotSize;
+        return fGotMetadata;
+    });
 }
 
-HICON CDpiHelper::CreateDeviceImageOrReuseIcon(_In_ HICON hIcon, bool fAlwaysCreate, const SIZE * pIconSize) const
+HICON CDpiHelper::CreateDeviceImageOrReuseIcon(_In_ HICON hIcon, bool fAlwaysCreate, const SIZE * pIconSize, const CIconMetadataCache::Metadata& metadata) const
 {
+    CImageConversionStats::CScope stats(CImageConversionStats::EntryPoint::Icon);
     int cxIcon = LogicalToDeviceUnitsX(pIconSize->cx);
     int cyIcon = LogicalToDeviceUnitsX(pIconSize->cy);
 
+    // Icons loaded from an integer resource are created from the frame CIconResourceIndex selects for the device size, like
+    // LoadDeviceIcon does, instead of probing the resource with CopyImage. Resolving the preferred scaling mode, for the frames
+    // scaled up, is the only change this makes to the helper.
+    if (metadata.pModule != nullptr)
+    {
+        HINSTANCE hInstance = static_cast<HINSTANCE>(const_cast<void*>(metadata.pModule));
+        int scalingModeUsed = -1;
+        HICON hDeviceIcon = const_cast<CDpiHelper*>(this)->LoadIconResourceFrame(hInstance, metadata.resourceId, cxIcon, cyIcon, ImageScalingMode::Default, &scalingModeUsed);
+        if (hDeviceIcon != NULL)
+        {
+            if (!fAlwaysCreate)
+            {
+                // Same as LR_COPYDELETEORG below
+                ::DestroyIcon(hIcon);
+                CIconMetadataCache::GetInstance().Invalidate(HandleToULong(hIcon));
+            }
+
+            uint64_t pixels = static_cast<uint64_t>(cxIcon) * cyIcon;
+            stats.SetResult(scalingModeUsed, pixels, pixels * sizeof(ARGB) + ((cxIcon + 15) / 16) * 2 * cyIcon);
+            return hDeviceIcon;
+        }
+    }
+
+    // Other icons are reloaded by USER32 if they come from a resource it can find, or stretched
     UINT flags = fAlwaysCreate ? 0 : (LR_COPYDELETEORG | LR_COPYRETURNORG);
 
     HICON hDeviceIcon = static_cast<HICON>(::CopyImage(hIcon, IMAGE_ICON, cxIcon, cyIcon, flags | LR_COPYFROMRESOURCE));
@@ -769,13 +2153,146 @@ HICON CDpiHelper::CreateDeviceImageOrReuseIcon(_In_ HICON hIcon, bool fAlwaysCre
         hDeviceIcon = static_cast<HICON>(::CopyImage(hIcon, IMAGE_ICON, cxIcon, cyIcon, flags));
         if (hDeviceIcon == NULL)
         {
-            hDeviceIcon = fAlwaysCreate ? DuplicateIcon(NULL, hIcon) : hIcon;
+            // Counted as a failed conversion: the icon keeps its logical size
+            return fAlwaysCreate ? DuplicateIcon(NULL, hIcon) : hIcon;
         }
     }
 
+    if (!fAlwaysCreate && hDeviceIcon != hIcon)
+    {
+        // LR_COPYDELETEORG destroyed the logical icon
+        CIconMetadataCache::GetInstance().Invalidate(HandleToULong(hIcon));
+    }
+
+    // Icons are scaled by USER32, without a scaling mode. They have a color bitmap and a monochrome mask.
+    uint64_t pixels = static_cast<uint64_t>(cxIcon) * cyIcon;
+    stats.SetResult(-1, pixels, pixels * sizeof(ARGB) + ((cxIcon + 15) / 16) * 2 * cyIcon);
     return hDeviceIcon;
 }
 
+// On-disk cache of the images loaded from resources, if any
+std::shared_ptr<CPersistentImageCache> CDpiHelper::s_spPersistentImageCache;
+
+void CDpiHelper::SetPersistentImageCacheDirectory(_In_opt_ LPCWSTR pszDirectory)
+{
+    shared_ptr<CPersistentImageCache> spCache;
+    if (pszDirectory != nullptr)
+    {
+        try
+        {
+            spCache = make_shared<CPersistentImageCache>(pszDirectory);
+        }
+        catch (const bad_alloc&)
+        {
+            VSFAIL("Out of memory, the persistent image cache is off");
+        }
+    }
+
+    // Loads running meanwhile keep the cache they started with
+    atomic_store(&s_spPersistentImageCache, spCache);
+}
+
+// Returns the key of the resource image in the on-disk cache, or false if the module can't be identified across runs
+bool CDpiHelper::GetPersistentImageCacheKey(HINSTANCE hInstance, UINT nIDResource, ImageScalingMode scalingMode, Color clrBackground, _Out_ CPersistentImageCache::Key * pKey)
+{
+    // Modules loaded as data files or image resources (the low bits of the handle are set) don't have usable headers
+    if (hInstance == NULL || (reinterpret_cast<UINT_PTR>(hInstance) & 3) != 0)
+        return false;
+
+    WCHAR szModulePath[MAX_PATH];
+    DWORD cchModulePath = GetModuleFileNameW(hInstance, szModulePath, _countof(szModulePath));
+    if (cchModulePath == 0 || cchModulePath >= _countof(szModulePath))
+        return false;
+
+    // The link timestamp and the size of the image change when the module is rebuilt, which is when its resources may change
+    const IMAGE_DOS_HEADER* pDosHeader = reinterpret_cast<const IMAGE_DOS_HEADER*>(hInstance);
+    if (pDosHeader->e_magic != IMAGE_DOS_SIGNATURE)
+        return false;
+    const IMAGE_NT_HEADERS* pNtHeaders = reinterpret_cast<const IMAGE_NT_HEADERS*>(reinterpret_cast<const BYTE*>(hInstance) + pDosHeader->e_lfanew);
+    if (pNtHeaders->Signature != IMAGE_NT_SIGNATURE)
+        return false;
+
+    int cbModulePath = WideCharToMultiByte(CP_UTF8, 0, szModulePath, cchModulePath, nullptr, 0, nullptr, nullptr);
+    if (cbModulePath <= 0)
+        return false;
+
+    try
+    {
+        pKey->moduleIdentity.resize(cbModulePath);
+    }
+    catch (const bad_alloc&)
+    {
+        return false;
+    }
+    WideCharToMultiByte(CP_UTF8, 0, szModulePath, cchModulePath, &pKey->moduleIdentity[0], cbModulePath, nullptr, nullptr);
+
+    pKey->moduleStamp = (static_cast<uint64_t>(pNtHeaders->FileHeader.TimeDateStamp) << 32) | pNtHeaders->OptionalHeader.SizeOfImage;
+    pKey->resourceId = nIDResource;
+    pKey->logicalDpiX = m_LogicalDpiX;
+    pKey->logicalDpiY = m_LogicalDpiY;
+    pKey->deviceDpiX = m_DeviceDpiX;
+    pKey->deviceDpiY = m_DeviceDpiY;
+    pKey->scalingMode = static_cast<int>(GetActualScalingMode(scalingMode));
+    pKey->background = clrBackground.GetValue();
+    return true;
+}
+
+// Sink receiving the images of the conversions, if any
+std::atomic<IImageConversionSink*> CDpiHelper::s_pConversionSink(nullptr);
+
+void CDpiHelper::SetConversionSink(_In_opt_ IImageConversionSink* pSink)
+{
+    s_pConversionSink.store(pSink);
+}
+
+void CDpiHelper::NotifyConversionSink(CImageConversionStats::EntryPoint entryPoint, _In_ VsUI::GdiplusImage* pLogicalImage, _In_ VsUI::GdiplusImage* pDeviceImage)
+{
+    IImageConversionSink* pSink = s_pConversionSink.load(memory_order_acquire);
+    IfNullRet(pSink);
+
+    pSink->OnImageConverted(entryPoint, pLogicalImage, pDeviceImage);
+}
+
+void CDpiHelper::NotifyConversionSink(CImageConversionStats::EntryPoint entryPoint, HBITMAP hLogicalImage, HBITMAP hDeviceImage)
+{
+    // Attaching the bitmaps is only worth it when there is a sink. Neither bitmap is owned by the images attached to them.
+    IImageConversionSink* pSink = s_pConversionSink.load(memory_order_acquire);
+    IfNullRet(pSink);
+
+    VsUI::GdiplusImage logicalImage;
+    logicalImage.Attach(hLogicalImage);
+    VsUI::GdiplusImage deviceImage;
+    deviceImage.Attach(hDeviceImage);
+    if (logicalImage.IsLoaded() && deviceImage.IsLoaded())
+    {
+        pSink->OnImageConverted(entryPoint, &logicalImage, &deviceImage);
+    }
+}
+
+CPngDumpSink::CPngDumpSink() :
+    m_imageIndex(1)
+{
+}
+
+void CPngDumpSink::OnImageConverted(CImageConversionStats::EntryPoint /*entryPoint*/, _In_ VsUI::GdiplusImage* pLogicalImage, _In_ VsUI::GdiplusImage* pDeviceImage)
+{
+    WCHAR rgTempFolder[MAX_PATH];
+    if (!GetTempPath(_countof(rgTempFolder), rgTempFolder))
+        *rgTempFolder = '\0';
+
+    int imgIndex = m_imageIndex++;
+    CStringW strFileName;
+    CPath pathTempFile;
+
+    strFileName.Format(_T("DPIHelper_%05d_Before.png"), imgIndex);
+    pathTempFile.Combine(rgTempFolder, strFileName);
+    pLogicalImage->Save(pathTempFile);
+
+    strFileName.Format(_T("DPIHelper_%05d_After.png"), imgIndex);
+    pathTempFile.Combine(rgTempFolder, strFileName);
+    pDeviceImage->Save(pathTempFile);
+}
+
 bool DpiHelper::m_fInitialized = false;
 int  DpiHelper::m_DeviceDpiX = k_DefaultLogicalDpi;
 int  DpiHelper::m_DeviceDpiY = k_DefaultLogicalDpi;
@@ -802,21 +2319,31 @@ void DpiHelper::Initialize()
 
 CDpiHelper* DpiHelper::GetDefaultHelper()
 {
-    static CDpiHelper* s_pDefaultHelper = nullptr;
-    if (s_pDefaultHelper == nullptr)
-    {
-        s_pDefaultHelper = GetHelper(100);
-        VSASSERT(s_pDefaultHelper != nullptr, "Cannot create DPI scaling helper for default 96dpi");
-    }
-    return s_pDefaultHelper;
+    // The helper is published in the table once created, so this is usually a single load
+    CDpiHelper* pHelper = GetHelper(k_DefaultZoomPercents);
+    VSASSERT(pHelper != nullptr, "Cannot create DPI scaling helper for default 96dpi");
+    return pHelper;
 }
 
-// Thread protection on accessing the DPI Helpers map
+// Thread protection on creating the DPI Helpers
 CComAutoCriticalSection DpiHelper::s_critSection;
 
+// Helpers for the zoom factors below k_HelperTableSize, indexed by zoom factor. Written once under the critical section
+std::atomic<CDpiHelper*> DpiHelper::s_helperTable[DpiHelper::k_HelperTableSize];
+
 // Returns a CDpiHelper that can scale images created for the specified DPI zoom factor, or nullptr if we run out of memory
 CDpiHelper* DpiHelper::GetHelper(int zoomPercents)
 {
+    // Fast path: helpers are never destroyed or replaced once published, so readers don't need the lock.
+    // The acquire load pairs with the release store below, so the helper is seen fully constructed.
+    bool fInTable = (zoomPercents > 0 && zoomPercents < k_HelperTableSize);
+    if (fInTable)
+    {
+        CDpiHelper* pHelper = s_helperTable[zoomPercents].load(memory_order_acquire);
+        if (pHelper != nullptr)
+            return pHelper;
+    }
+
     // Protect multi-threaded access to the helpers map
     CComCritSecLock<CComCriticalSection> lock(s_critSection);
 
@@ -840,6 +2367,11 @@ CDpiHelper* DpiHelper::GetHelper(int zoomPercents)
         {
             return nullptr;
         }
+
+        if (fInTable)
+        {
+            s_helperTable[zoomPercents].store(mapIter->second.get(), memory_order_release);
+        }
     }
 
     return mapIter->second.get();
@@ -849,195 +2381,349 @@ CDpiHelper* DpiHelper::GetHelper(int zoomPercents)
 // Get device DPI.
 int DpiHelper::GetDeviceDpiX() 
 { 
-    IfNullRetX(GetDefaultHelper(), m_DeviceDpiY);
-    return GetDefaultHelper()->GetDeviceDpiX();
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRetX(pHelper, m_DeviceDpiY);
+    return pHelper->GetDeviceDpiX();
 }
 
 int DpiHelper::GetDeviceDpiY() 
 { 
-    IfNullRetX(GetDefaultHelper(), m_DeviceDpiY);
-    return GetDefaultHelper()->GetDeviceDpiY();
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRetX(pHelper, m_DeviceDpiY);
+    return pHelper->GetDeviceDpiY();
 }
 
 // Get logical DPI.
 int DpiHelper::GetLogicalDpiX() 
 { 
-    IfNullRetX(GetDefaultHelper(), m_DeviceDpiX);
-    return GetDefaultHelper()->GetLogicalDpiX();
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRetX(pHelper, m_DeviceDpiX);
+    return pHelper->GetLogicalDpiX();
 }
 
 int DpiHelper::GetLogicalDpiY() 
 { 
-    IfNullRetX(GetDefaultHelper(), m_DeviceDpiY);
-    return GetDefaultHelper()->GetLogicalDpiY();
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRetX(pHelper, m_DeviceDpiY);
+    return pHelper->GetLogicalDpiY();
 }
 
 // Return whether scaling is required
 bool DpiHelper::IsScalingRequired()
 {
-    IfNullRetX(GetDefaultHelper(), false);
-    return GetDefaultHelper()->IsScalingRequired();
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRetX(pHelper, false);
+    return pHelper->IsScalingRequired();
 }
 
 // Return horizontal and vertical scaling factors
 double DpiHelper::DeviceToLogicalUnitsScalingFactorX()
 {
-    IfNullRetX(GetDefaultHelper(), 1);
-    return GetDefaultHelper()->DeviceToLogicalUnitsScalingFactorX();
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRetX(pHelper, 1);
+    return pHelper->DeviceToLogicalUnitsScalingFactorX();
 }
 
 double DpiHelper::DeviceToLogicalUnitsScalingFactorY()
 {
-    IfNullRetX(GetDefaultHelper(), 1);
-    return GetDefaultHelper()->DeviceToLogicalUnitsScalingFactorY();
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRetX(pHelper, 1);
+    return pHelper->DeviceToLogicalUnitsScalingFactorY();
 }
 
 double DpiHelper::LogicalToDeviceUnitsScalingFactorX()
 {
-    IfNullRetX(GetDefaultHelper(), 1);
-    return GetDefaultHelper()->LogicalToDeviceUnitsScalingFactorX();
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRetX(pHelper, 1);
+    return pHelper->LogicalToDeviceUnitsScalingFactorX();
 }
 
 double DpiHelper::LogicalToDeviceUnitsScalingFactorY()
 {
-    IfNullRetX(GetDefaultHelper(), 1);
-    return GetDefaultHelper()->LogicalToDeviceUnitsScalingFactorY();
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRetX(pHelper, 1);
+    return pHelper->LogicalToDeviceUnitsScalingFactorY();
 }
 
 // Converts between logical and device units.
 int DpiHelper::LogicalToDeviceUnitsX(int x) 
 { 
-    IfNullRetX(GetDefaultHelper(), x);
-    return GetDefaultHelper()->LogicalToDeviceUnitsX(x);
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRetX(pHelper, x);
+    return pHelper->LogicalToDeviceUnitsX(x);
 }
 
 int DpiHelper::LogicalToDeviceUnitsY(int y) 
 { 
-    IfNullRetX(GetDefaultHelper(), y);
-    return GetDefaultHelper()->LogicalToDeviceUnitsY(y);
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRetX(pHelper, y);
+    return pHelper->LogicalToDeviceUnitsY(y);
 }
 
 // Converts between device and logical units.
 int DpiHelper::DeviceToLogicalUnitsX(int x) 
 { 
-    IfNullRetX(GetDefaultHelper(), x);
-    return GetDefaultHelper()->DeviceToLogicalUnitsX(x);
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRetX(pHelper, x);
+    return pHelper->DeviceToLogicalUnitsX(x);
 }
 
 int DpiHelper::DeviceToLogicalUnitsY(int y) 
 { 
-    IfNullRetX(GetDefaultHelper(), y);
-    return GetDefaultHelper()->DeviceToLogicalUnitsY(y);
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRetX(pHelper, y);
+    return pHelper->DeviceToLogicalUnitsY(y);
 }
 
 // Converts from logical units to device units.
 void DpiHelper::LogicalToDeviceUnits(_Inout_ RECT * pRect)
 {
-    IfNullRet(GetDefaultHelper());
-    return GetDefaultHelper()->LogicalToDeviceUnits(pRect);
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRet(pHelper);
+    return pHelper->LogicalToDeviceUnits(pRect);
 }
 
 void DpiHelper::LogicalToDeviceUnits(_Inout_ POINT * pPoint)
 {
-    IfNullRet(GetDefaultHelper());
-    return GetDefaultHelper()->LogicalToDeviceUnits(pPoint);
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRet(pHelper);
+    return pHelper->LogicalToDeviceUnits(pPoint);
 }
 
 // Converts from device units to logical units.
 void DpiHelper::DeviceToLogicalUnits(_Inout_ RECT * pRect)
 {
-    IfNullRet(GetDefaultHelper());
-    return GetDefaultHelper()->DeviceToLogicalUnits(pRect);
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRet(pHelper);
+    return pHelper->DeviceToLogicalUnits(pRect);
 }
 
 void DpiHelper::DeviceToLogicalUnits(_Inout_ POINT * pPoint)
 {
-    IfNullRet(GetDefaultHelper());
-    return GetDefaultHelper()->DeviceToLogicalUnits(pPoint);
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRet(pHelper);
+    return pHelper->DeviceToLogicalUnits(pPoint);
+}
+
+// Converts arrays between logical and device units.
+void DpiHelper::LogicalToDeviceUnits(_Inout_updates_(count) POINT * pPoints, size_t count)
+{
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRet(pHelper);
+    return pHelper->LogicalToDeviceUnits(pPoints, count);
+}
+
+void DpiHelper::LogicalToDeviceUnits(_Inout_updates_(count) RECT * pRects, size_t count)
+{
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRet(pHelper);
+    return pHelper->LogicalToDeviceUnits(pRects, count);
+}
+
+void DpiHelper::LogicalToDeviceUnits(_Inout_updates_(count) SIZE * pSizes, size_t count)
+{
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRet(pHelper);
+    return pHelper->LogicalToDeviceUnits(pSizes, count);
+}
+
+void DpiHelper::DeviceToLogicalUnits(_Inout_updates_(count) POINT * pPoints, size_t count)
+{
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRet(pHelper);
+    return pHelper->DeviceToLogicalUnits(pPoints, count);
+}
+
+void DpiHelper::DeviceToLogicalUnits(_Inout_updates_(count) RECT * pRects, size_t count)
+{
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRet(pHelper);
+    return pHelper->DeviceToLogicalUnits(pRects, count);
+}
+
+void DpiHelper::DeviceToLogicalUnits(_Inout_updates_(count) SIZE * pSizes, size_t count)
+{
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRet(pHelper);
+    return pHelper->DeviceToLogicalUnits(pSizes, count);
 }
 
 // Convert a point size (1/72 of an inch) to raw pixels.
 int DpiHelper::PointsToDeviceUnits(int pt) 
 { 
-    IfNullRetX(GetDefaultHelper(), 0);
-    return GetDefaultHelper()->PointsToDeviceUnits(pt);
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRetX(pHelper, 0);
+    return pHelper->PointsToDeviceUnits(pt);
 }
 
 // Determine the screen dimensions in logical units.
 int DpiHelper::LogicalScreenWidth() 
 { 
-    IfNullRetX(GetDefaultHelper(), 0);
-    return GetDefaultHelper()->LogicalScreenWidth();
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRetX(pHelper, 0);
+    return pHelper->LogicalScreenWidth();
 }
 
 int DpiHelper::LogicalScreenHeight() 
 { 
-    IfNullRetX(GetDefaultHelper(), 0);
-    return GetDefaultHelper()->LogicalScreenHeight();
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRetX(pHelper, 0);
+    return pHelper->LogicalScreenHeight();
 }
 
 // Determine if screen resolution meets minimum requirements in logical pixels.
 bool DpiHelper::IsResolutionAtLeast(int cxMin, int cyMin)
 { 
-    IfNullRetX(GetDefaultHelper(), false);
-    return GetDefaultHelper()->IsResolutionAtLeast(cxMin, cyMin);
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRetX(pHelper, false);
+    return pHelper->IsResolutionAtLeast(cxMin, cyMin);
 }
 
 // Return the monitor information in logical units
 BOOL DpiHelper::GetLogicalMonitorInfo(_In_ HMONITOR hMonitor, _Out_ LPMONITORINFO lpmi)
 {
-    IfNullRetX(GetDefaultHelper(), FALSE);
-    return GetDefaultHelper()->GetLogicalMonitorInfo(hMonitor, lpmi);
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRetX(pHelper, FALSE);
+    return pHelper->GetLogicalMonitorInfo(hMonitor, lpmi);
 }
 
 // Convert GdiplusImage from logical to device units
 void DpiHelper::LogicalToDeviceUnits(_Inout_ VsUI::GdiplusImage * pImage, ImageScalingMode scalingMode, Color clrBackground)
 {
-    IfNullRet(GetDefaultHelper());
-    return GetDefaultHelper()->LogicalToDeviceUnits(pImage, scalingMode, clrBackground);
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRet(pHelper);
+    return pHelper->LogicalToDeviceUnits(pImage, scalingMode, clrBackground);
 }
  
 // Creates new GdiplusImage from logical to device units
 unique_ptr<VsUI::GdiplusImage> DpiHelper::CreateDeviceFromLogicalImage(_In_ VsUI::GdiplusImage* pImage, ImageScalingMode scalingMode, Color clrBackground)
 {
-    IfNullRetNull(GetDefaultHelper());
-    return GetDefaultHelper()->CreateDeviceFromLogicalImage(pImage, scalingMode, clrBackground);
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRetNull(pHelper);
+    return pHelper->CreateDeviceFromLogicalImage(pImage, scalingMode, clrBackground);
+}
+
+VsUI::GdiplusImage DpiHelper::CreateDeviceFromLogicalImage(VsUI::GdiplusImage& image, ImageScalingMode scalingMode, Color clrBackground)
+{
+    CDpiHelper* pHelper = GetDefaultHelper();
+    if (pHelper == nullptr)
+        return VsUI::GdiplusImage();
+    return pHelper->CreateDeviceFromLogicalImage(image, scalingMode, clrBackground);
 }
 
 void DpiHelper::LogicalToDeviceUnits(_Inout_ HBITMAP * pImage, ImageScalingMode scalingMode, Color clrBackground)
 {
-    IfNullRet(GetDefaultHelper());
-    return GetDefaultHelper()->LogicalToDeviceUnits(pImage, scalingMode, clrBackground);
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRet(pHelper);
+    return pHelper->LogicalToDeviceUnits(pImage, scalingMode, clrBackground);
 }
 
 HBITMAP DpiHelper::CreateDeviceFromLogicalImage(HBITMAP _In_ hImage, ImageScalingMode scalingMode, Color clrBackground)
 {
-    IfNullRetNull(GetDefaultHelper());
-    return GetDefaultHelper()->CreateDeviceFromLogicalImage(hImage, scalingMode, clrBackground);
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRetNull(pHelper);
+    return pHelper->CreateDeviceFromLogicalImage(hImage, scalingMode, clrBackground);
+}
+
+HBITMAP DpiHelper::CreateDeviceFromLogicalImage(HBITMAP _In_ hImage, CImageScaler::AlphaFormat alphaFormat, ImageScalingMode scalingMode, _Out_opt_ HBITMAP * phMask)
+{
+    if (phMask != nullptr)
+    {
+        *phMask = NULL;
+    }
+
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRetNull(pHelper);
+    return pHelper->CreateDeviceFromLogicalImage(hImage, alphaFormat, scalingMode, phMask);
 }
 
 void DpiHelper::LogicalToDeviceUnits(_Inout_ HIMAGELIST * pImageList, ImageScalingMode scalingMode)
 {
-    IfNullRet(GetDefaultHelper());
-    return GetDefaultHelper()->LogicalToDeviceUnits(pImageList, scalingMode);
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRet(pHelper);
+    return pHelper->LogicalToDeviceUnits(pImageList, scalingMode);
 }
 
 HIMAGELIST DpiHelper::CreateDeviceFromLogicalImage(HIMAGELIST _In_ hImageList, ImageScalingMode scalingMode)
 {
-    IfNullRetNull(GetDefaultHelper());
-    return GetDefaultHelper()->CreateDeviceFromLogicalImage(hImageList, scalingMode);
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRetNull(pHelper);
+    return pHelper->CreateDeviceFromLogicalImage(hImageList, scalingMode);
 }
 
 void DpiHelper::LogicalToDeviceUnits(_Inout_ HICON * pIcon, _In_opt_ const SIZE * pLogicalSize)
 {
-    IfNullRet(GetDefaultHelper());
-    return GetDefaultHelper()->LogicalToDeviceUnits(pIcon, pLogicalSize);
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRet(pHelper);
+    return pHelper->LogicalToDeviceUnits(pIcon, pLogicalSize);
 }
 
 HICON DpiHelper::CreateDeviceFromLogicalImage(_In_ HICON hIcon, _In_opt_ const SIZE * pLogicalSize)
 {
-    IfNullRetNull(GetDefaultHelper());
-    return GetDefaultHelper()->CreateDeviceFromLogicalImage(hIcon, pLogicalSize);
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRetNull(pHelper);
+    return pHelper->CreateDeviceFromLogicalImage(hIcon, pLogicalSize);
+}
+
+void DpiHelper::EnableIconMetadataCache(bool enable)
+{
+    CIconMetadataCache::GetInstance().Enable(enable);
+}
+
+BOOL DpiHelper::DestroyIcon(_In_ HICON hIcon)
+{
+    // Invalidate after destroying the icon, so a conversion running meanwhile can't cache its size again. A new icon getting
+    // the same handle in between is only removed from the cache.
+    BOOL fDestroyed = ::DestroyIcon(hIcon);
+    OnIconDestroyed(hIcon);
+    return fDestroyed;
+}
+
+void DpiHelper::OnIconDestroyed(_In_ HICON hIcon)
+{
+    CIconMetadataCache::GetInstance().Invalidate(HandleToULong(hIcon));
+}
+
+void DpiHelper::OnModuleUnloading(HINSTANCE hInstance)
+{
+    CIconMetadataCache::GetInstance().RemoveModule(hInstance);
+    CIconResourceIndex::GetInstance().RemoveModule(hInstance);
+    CScaledImageCache::GetInstance().RemoveModule(hInstance);
+}
+
+shared_ptr<const CScaledImageCache::Image> DpiHelper::GetSharedDeviceImage(HINSTANCE hInstance, UINT nIDResource, ImageScalingMode scalingMode, Color clrBackground)
+{
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRetNull(pHelper);
+    return pHelper->GetSharedDeviceImage(hInstance, nIDResource, scalingMode, clrBackground);
+}
+
+vector<unique_ptr<VsUI::GdiplusImage>> DpiHelper::CreateDeviceFromLogicalImages(_In_reads_(count) VsUI::GdiplusImage* const * ppImages, size_t count, ImageScalingMode scalingMode, Color clrBackground, unsigned int maxThreads)
+{
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRetX(pHelper, vector<unique_ptr<VsUI::GdiplusImage>>());
+    return pHelper->CreateDeviceFromLogicalImages(ppImages, count, scalingMode, clrBackground, maxThreads);
+}
+
+unique_ptr<CDeviceImageSet> DpiHelper::CreateDeviceImageSet(_In_ VsUI::GdiplusImage* pImage, _In_reads_(count) const int * pDeviceDpis, size_t count, ImageScalingMode scalingMode, Color clrBackground)
+{
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRetNull(pHelper);
+    return pHelper->CreateDeviceImageSet(pImage, pDeviceDpis, count, scalingMode, clrBackground);
+}
+
+unique_ptr<VsUI::GdiplusImage> DpiHelper::LoadDeviceImage(HINSTANCE hInstance, UINT nIDResource, ImageScalingMode scalingMode, Color clrBackground)
+{
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRetNull(pHelper);
+    return pHelper->LoadDeviceImage(hInstance, nIDResource, scalingMode, clrBackground);
+}
+
+HICON DpiHelper::LoadDeviceIcon(HINSTANCE hInstance, UINT nIDResource, const SIZE& logicalSize, ImageScalingMode scalingMode)
+{
+    CDpiHelper* pHelper = GetDefaultHelper();
+    IfNullRetNull(pHelper);
+    return pHelper->LoadDeviceIcon(hInstance, nIDResource, logicalSize, scalingMode);
 }
 
 } // namespace
\ No newline at end of file
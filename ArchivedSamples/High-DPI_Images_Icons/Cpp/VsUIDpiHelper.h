@@ -7,7 +7,17 @@
 #pragma once
 
 #include "VsUIGdiplusImage.h"
+#include "VsUIIconMetadataCache.h"
+#include "VsUIImageConversionStats.h"
+#include "VsUIImageScaler.h"
+#include "VsUIMulDiv.h"
+#include "VsUIPersistentImageCache.h"
+#include "VsUIScaledImageCache.h"
+#include "VsUITaskPool.h"
+#include <atomic>
 #include <memory>
+#include <unordered_map>
+#include <vector>
 
 namespace VsUI
 {
@@ -27,6 +37,54 @@ namespace VsUI
         HighQualityBicubic  = 6, // Smooth results, without distorsions, but fuzzy. Some overshooting/oversharpening-like artifacts may be present (GDI+ InterpolationModeHighQualityBicubic)
     };
 
+    // Receives the logical and device images of the GdiplusImage and HBITMAP conversions, on the converting thread (see CDpiHelper::SetConversionSink).
+    // The images must not be modified.
+    class IImageConversionSink
+    {
+    public:
+        virtual void OnImageConverted(CImageConversionStats::EntryPoint entryPoint, _In_ VsUI::GdiplusImage* pLogicalImage, _In_ VsUI::GdiplusImage* pDeviceImage) = 0;
+
+    protected:
+        ~IImageConversionSink() {}
+    };
+
+    // Saves the images of each conversion in the temp folder, as DPIHelper_<index>_Before.png and DPIHelper_<index>_After.png, to debug the scaling
+    class CPngDumpSink : public IImageConversionSink
+    {
+    public:
+        CPngDumpSink();
+        virtual void OnImageConverted(CImageConversionStats::EntryPoint entryPoint, _In_ VsUI::GdiplusImage* pLogicalImage, _In_ VsUI::GdiplusImage* pDeviceImage) override;
+
+    private:
+        std::atomic<int> m_imageIndex;
+    };
+
+    // The device images of one logical image for several DPI values (e.g. one for each monitor a per-monitor DPI aware window can be on),
+    // created by CDpiHelper::CreateDeviceImageSet. Switching to the image for another DPI is a lookup, with no decoding or scaling.
+    class CDeviceImageSet
+    {
+    public:
+        CDeviceImageSet();
+
+        // Returns the image for the DPI, or nullptr if the set has no image for it
+        VsUI::GdiplusImage* HDPIAPI GetImage(int dpi) const;
+        bool HDPIAPI HasImage(int dpi) const;
+
+        // Selects the image for the new DPI of the window (e.g. when handling WM_DPICHANGED), and returns it.
+        // Returns nullptr, and keeps the current selection, if the set has no image for the DPI.
+        VsUI::GdiplusImage* HDPIAPI SelectDpi(int dpi);
+        VsUI::GdiplusImage* HDPIAPI GetSelectedImage() const;
+        int HDPIAPI GetSelectedDpi() const;
+
+        // Adds the image for the DPI, replacing the previous one. Returns false if we run out of memory.
+        bool HDPIAPI SetImage(int dpi, std::unique_ptr<VsUI::GdiplusImage> pImage);
+
+    private:
+        std::unordered_map<int, std::unique_ptr<VsUI::GdiplusImage>> m_images;
+        VsUI::GdiplusImage* m_pSelectedImage;
+        int m_SelectedDpi;
+    };
+
     class CDpiHelper
     {
     public:
@@ -65,6 +123,14 @@ namespace VsUI
         // Converts from device units to logical units.
         void HDPIAPI DeviceToLogicalUnits(_Inout_ POINT * pPoint) const;
         void HDPIAPI DeviceToLogicalUnits(_Inout_ RECT * pRect) const;
+
+        // Converts arrays of points, rectangles and sizes, with the same results as converting each one separately.
+        void HDPIAPI LogicalToDeviceUnits(_Inout_updates_(count) POINT * pPoints, size_t count) const;
+        void HDPIAPI LogicalToDeviceUnits(_Inout_updates_(count) RECT * pRects, size_t count) const;
+        void HDPIAPI LogicalToDeviceUnits(_Inout_updates_(count) SIZE * pSizes, size_t count) const;
+        void HDPIAPI DeviceToLogicalUnits(_Inout_updates_(count) POINT * pPoints, size_t count) const;
+        void HDPIAPI DeviceToLogicalUnits(_Inout_updates_(count) RECT * pRects, size_t count) const;
+        void HDPIAPI DeviceToLogicalUnits(_Inout_updates_(count) SIZE * pSizes, size_t count) const;
         
         // Converts (if necessary) the image from logical to device pixels. By default we use interpolation that gives smoother results when scaling up.
         // The functions will return the original image if no scaling is required due to high DPI modes.
@@ -76,10 +142,49 @@ namespace VsUI
 
         // Creates and returns a new image suitable for display on device units. A clone image will be created when scaling is not necessary. The caller is reponsible of the lifetime of the returned image.
         std::unique_ptr<VsUI::GdiplusImage> HDPIAPI CreateDeviceFromLogicalImage(_In_ VsUI::GdiplusImage* pImage, ImageScalingMode scalingMode = ImageScalingMode::Default, Gdiplus::Color clrBackground = TransparentColor);
+        // Same as above, returning the new image by value instead of allocating it. The returned image isn't loaded if the conversion failed.
+        VsUI::GdiplusImage HDPIAPI CreateDeviceFromLogicalImage(VsUI::GdiplusImage& image, ImageScalingMode scalingMode = ImageScalingMode::Default, Gdiplus::Color clrBackground = TransparentColor);
         HBITMAP HDPIAPI CreateDeviceFromLogicalImage(_In_ HBITMAP hImage, ImageScalingMode scalingMode = ImageScalingMode::Default, Gdiplus::Color clrBackground = TransparentColor);
         HIMAGELIST HDPIAPI CreateDeviceFromLogicalImage(_In_ HIMAGELIST hImageList, ImageScalingMode scalingMode = ImageScalingMode::Default);
         HICON HDPIAPI CreateDeviceFromLogicalImage(_In_ HICON hIcon, _In_opt_ const SIZE * pLogicalSize = nullptr) const;
 
+        // Creates a 32bpp device bitmap that keeps the transparency of the image, instead of keying the transparent pixels to a background color:
+        // the image is filtered in premultiplied space, and returned premultiplied (e.g. for AlphaBlend with AC_SRC_ALPHA) or with straight alpha.
+        // phMask optionally receives a monochrome mask with the bits of the pixels less than half opaque set. The caller owns both bitmaps.
+        HBITMAP HDPIAPI CreateDeviceFromLogicalImage(_In_ HBITMAP hImage, CImageScaler::AlphaFormat alphaFormat, ImageScalingMode scalingMode = ImageScalingMode::Default, _Out_opt_ HBITMAP * phMask = nullptr);
+
+        // Creates the device images for a batch of logical images, scaling them in parallel. The results are the same as calling CreateDeviceFromLogicalImage for each image,
+        // and are nullptr for the images that could not be converted. maxThreads limits the number of threads used (0 uses all the processors).
+        std::vector<std::unique_ptr<VsUI::GdiplusImage>> HDPIAPI CreateDeviceFromLogicalImages(_In_reads_(count) VsUI::GdiplusImage* const * ppImages, size_t count, ImageScalingMode scalingMode = ImageScalingMode::Default, Gdiplus::Color clrBackground = TransparentColor, unsigned int maxThreads = 0);
+
+        // Creates the device images of the logical image for each of the device DPI values (e.g. the DPI of each monitor), reading, hashing and premultiplying
+        // the logical pixels once for all of them, and scaling them in parallel. Each image is the same as the one CreateDeviceFromLogicalImage creates
+        // for a helper with that device DPI and the logical DPI of this helper. Returns nullptr if the image is invalid or we run out of memory.
+        std::unique_ptr<CDeviceImageSet> HDPIAPI CreateDeviceImageSet(_In_ VsUI::GdiplusImage* pImage, _In_reads_(count) const int * pDeviceDpis, size_t count, ImageScalingMode scalingMode = ImageScalingMode::Default, Gdiplus::Color clrBackground = TransparentColor);
+
+        // Loads the image from resources (PNG or BMP, like GdiplusImage::LoadFromPngOrBmp) and returns it in device units.
+        // The device images are cached process-wide (see CScaledImageCache), so loading the same resource again is cheap. The shared image must not be modified.
+        // Call DpiHelper::OnModuleUnloading before a module whose images were cached is unloaded. With SetPersistentImageCacheDirectory, the device
+        // images are also cached on disk.
+        std::shared_ptr<const CScaledImageCache::Image> HDPIAPI GetSharedDeviceImage(HINSTANCE hInstance, UINT nIDResource, ImageScalingMode scalingMode = ImageScalingMode::Default, Gdiplus::Color clrBackground = TransparentColor);
+        // Same as GetSharedDeviceImage, but returns a copy of the device image. The caller is reponsible of the lifetime of the returned image.
+        std::unique_ptr<VsUI::GdiplusImage> HDPIAPI LoadDeviceImage(HINSTANCE hInstance, UINT nIDResource, ImageScalingMode scalingMode = ImageScalingMode::Default, Gdiplus::Color clrBackground = TransparentColor);
+
+        // Loads the icon resource (RT_GROUP_ICON) in device units for the given logical size, from the smallest frame at or above the device size.
+        // That frame is used as authored or scaled down; when all the frames are smaller, the largest one is scaled up with the native scaler.
+        // The directories of the icon resources are indexed process-wide (see CIconResourceIndex): call DpiHelper::OnModuleUnloading before the module is unloaded.
+        // The HICON conversions (LogicalToDeviceUnits, CreateDeviceFromLogicalImage) load icons from integer resources the same way.
+        // The caller is reponsible of the lifetime of the returned icon.
+        HICON HDPIAPI LoadDeviceIcon(HINSTANCE hInstance, UINT nIDResource, const SIZE& logicalSize, ImageScalingMode scalingMode = ImageScalingMode::Default);
+
+        // Sets the sink receiving the images of the conversions, or removes it when pSink is nullptr. The sink must stay valid until it is removed
+        // and the conversions that may be using it are done. The conversions are measured in CImageConversionStats::GetInstance() when it's enabled.
+        static void HDPIAPI SetConversionSink(_In_opt_ IImageConversionSink* pSink);
+
+        // Sets the directory of the on-disk cache of the images loaded by GetSharedDeviceImage, so later runs load them without decoding and
+        // scaling them (see CPersistentImageCache), or turns the on-disk cache off when pszDirectory is nullptr. The directory must exist.
+        static void HDPIAPI SetPersistentImageCacheDirectory(_In_opt_ LPCWSTR pszDirectory);
+
         // Convert a point size (1/72 of an inch) to device units.
         int HDPIAPI PointsToDeviceUnits(int pt) const;
 
@@ -94,11 +199,61 @@ namespace VsUI
         bool HDPIAPI IsResolutionAtLeast(int cxMin, int cyMin) const;
 
     protected:
-        bool GetIconSize(_In_ HICON hIcon, _Out_ SIZE * pSize) const;
-        HICON CreateDeviceImageOrReuseIcon(_In_ HICON hIcon, bool fAlwaysCreate, _In_ const SIZE * pIconSize) const;
+        // Gets the size of the icon and the integer resource it was loaded from, if any
+        bool GetIconMetadata(_In_ HICON hIcon, _Out_ CIconMetadataCache::Metadata * pMetadata) const;
+        HICON CreateDeviceImageOrReuseIcon(_In_ HICON hIcon, bool fAlwaysCreate, _In_ const SIZE * pIconSize, const CIconMetadataCache::Metadata& metadata) const;
+        // Creates the icon of the given device size from the frame of the icon resource selected by CIconResourceIndex. Returns NULL on failure.
+        HICON LoadIconResourceFrame(HINSTANCE hInstance, UINT nIDResource, int cxIcon, int cyIcon, ImageScalingMode scalingMode, _Out_ int * pScalingModeUsed);
+        // Scales a 32bpp icon to the device size with the native scaler. Returns NULL if the icon has no alpha channel.
+        HICON ScaleIconPixels(_In_ HICON hIcon, int cxDevice, int cyDevice, ImageScalingMode scalingMode);
+        // Returns the bytes of a resource, valid while the module is loaded
+        static bool GetResourceBytes(HINSTANCE hInstance, LPCTSTR pszName, LPCTSTR pszType, _Outptr_ const void ** ppData, _Out_ size_t * pcb);
+
+        // Returns the device image from the scaled images cache, or scales it and adds it to the cache
+        VsUI::GdiplusImage GetOrScaleLogicalImage(_In_ Gdiplus::Bitmap* pBitmap, ImageScalingMode scalingMode, Gdiplus::Color clrBackground);
+        // Creates the device image without looking in the scaled images cache
+        VsUI::GdiplusImage ScaleLogicalImage(_In_ Gdiplus::Bitmap* pBitmap, ImageScalingMode scalingMode, Gdiplus::Color clrBackground);
+
+        // Scaled images cache support
+        CScaledImageCache::Key GetScaledImageCacheKey(int logicalWidth, int logicalHeight, Gdiplus::PixelFormat format, ImageScalingMode scalingMode, Gdiplus::Color clrBackground);
+        static std::shared_ptr<const CScaledImageCache::Image> CreateCachedImage(_In_ Gdiplus::Bitmap* pBitmap);
+        static bool CopyCachedImage(const CScaledImageCache::Image& image, _Inout_ Gdiplus::Bitmap* pBitmap);
+
+        // Scales the source bitmap into the destination bitmap, with the native scaler or GDI+ as a fallback
+        bool DrawScaledBitmap(_In_ Gdiplus::Bitmap* pSource, _Inout_ Gdiplus::Bitmap* pDestination, ImageScalingMode scalingMode, Gdiplus::Color clrBackground);
+        bool DrawScaledBitmapNative(_In_ Gdiplus::Bitmap* pSource, _Inout_ Gdiplus::Bitmap* pDestination, ImageScalingMode scalingMode, Gdiplus::Color clrBackground);
+        bool DrawScaledBitmapGdiplus(_In_ Gdiplus::Bitmap* pSource, _Inout_ Gdiplus::Bitmap* pDestination, ImageScalingMode scalingMode, Gdiplus::Color clrBackground);
+        // Scales a strip of count images of the same size with the native scaler, scaling the cells in parallel
+        bool DrawScaledCells(const CImageScaler::PixelBuffer& source, const CImageScaler::PixelBuffer& destination, int count, ImageScalingMode scalingMode, Gdiplus::Color clrBackground);
+        static bool DrawScaledPixels(const CImageScaler::PixelBuffer& source, const CImageScaler::PixelBuffer& destination, ImageScalingMode actualScalingMode, CImageScaler::Filter filter, Gdiplus::ARGB clrBackground);
+
+        // HIMAGELIST conversion: returns a strip of imagelist images converted to device units, to be added with ImageList_AddMasked
+        HBITMAP CreateDeviceImageStrip(HIMAGELIST hImageList, int iFirstImage, int count, ImageScalingMode scalingMode);
+        // Maximum number of images converted in one strip, to bound the size of the strip bitmaps
+        static const int k_MaxImageStripCount = 256;
+
+        // HBITMAP conversion pipelines: the fused one makes 2 passes over the pixels, the multi-pass one handles any pixel format
+        bool CanCreateDeviceBitmapFused(Gdiplus::PixelFormat format, ImageScalingMode scalingMode, Gdiplus::Color clrBackground);
+        HBITMAP CreateDeviceBitmapFused(_In_ Gdiplus::Bitmap* pBitmap, ImageScalingMode scalingMode, Gdiplus::Color clrBackground);
+        HBITMAP CreateDeviceBitmapMultiPass(_Inout_ VsUI::GdiplusImage& gdiplusImage, ImageScalingMode scalingMode, Gdiplus::Color clrBackground);
+        static UINT GetHaloKeyColors(Gdiplus::Color clrBackground, _Out_writes_to_(CPixelKernels::k_MaxKeyColors, return) Gdiplus::ARGB * pKeyColors);
+        static HBITMAP CreateDeviceDIB(int width, int height, _Outptr_ void ** ppBits);
+        static bool ReadBitmapPixels(_In_ Gdiplus::Bitmap* pBitmap, Gdiplus::PixelFormat format, const CImageScaler::PixelBuffer& pixels);
+        static HBITMAP CreateAlphaMask(const CImageScaler::PixelBuffer& pixels);
+
+        // Conversion instrumentation: passes the images to the sink, if any
+        static void NotifyConversionSink(CImageConversionStats::EntryPoint entryPoint, _In_ VsUI::GdiplusImage* pLogicalImage, _In_ VsUI::GdiplusImage* pDeviceImage);
+        static void NotifyConversionSink(CImageConversionStats::EntryPoint entryPoint, HBITMAP hLogicalImage, HBITMAP hDeviceImage);
+        static std::atomic<IImageConversionSink*> s_pConversionSink;
+
+        // On-disk cache of the resource images, if any
+        bool GetPersistentImageCacheKey(HINSTANCE hInstance, UINT nIDResource, ImageScalingMode scalingMode, Gdiplus::Color clrBackground, _Out_ CPersistentImageCache::Key * pKey);
+        static std::shared_ptr<CPersistentImageCache> s_spPersistentImageCache;
 
         // Gets the interpolation mode from the specified scaling mode
         Gdiplus::InterpolationMode GetInterpolationMode(_In_ ImageScalingMode scalingMode);
+        // Gets the native scaler filter from the specified scaling mode
+        CImageScaler::Filter GetScalerFilter(_In_ ImageScalingMode scalingMode);
         // Gets the actual scaling mode to be used from the suggested scaling mode
         ImageScalingMode GetActualScalingMode(_In_ ImageScalingMode scalingMode);
         // Get the scaling mode for the specified dpi zom factor
@@ -113,8 +268,20 @@ namespace VsUI
         int m_LogicalDpiX;
         int m_LogicalDpiY;
 
+        // Conversion factors precomputed from the DPI values, with the same results as MulDiv
+        CMulDivFactor m_LogicalToDeviceX;
+        CMulDivFactor m_LogicalToDeviceY;
+        CMulDivFactor m_DeviceToLogicalX;
+        CMulDivFactor m_DeviceToLogicalY;
+        CMulDivFactor m_PointsToDevice;
+
         // The shell preferred image scaling mode for current DPI zoom level
         ImageScalingMode m_PreferredScalingMode;
+
+        // Preferred scaling modes indexed by DPI scale percent, Default until resolved. They're shared by all the helpers, so the helpers
+        // created for other device DPI values (e.g. by CreateDeviceImageSet) don't read the registry again.
+        static const int k_ScalingModeTableSize = 1024;
+        static std::atomic<ImageScalingMode> s_preferredScalingModes[k_ScalingModeTableSize];
     };
 
     // The static functions in the DpiHelper class delegate the calls to the default CDpiHelper for 96dpi.
@@ -158,6 +325,14 @@ namespace VsUI
         // Converts from device units to logical units.
         static void HDPIAPI DeviceToLogicalUnits(_Inout_ POINT * pPoint);
         static void HDPIAPI DeviceToLogicalUnits(_Inout_ RECT * pRect);
+
+        // Converts arrays of points, rectangles and sizes, with the same results as converting each one separately.
+        static void HDPIAPI LogicalToDeviceUnits(_Inout_updates_(count) POINT * pPoints, size_t count);
+        static void HDPIAPI LogicalToDeviceUnits(_Inout_updates_(count) RECT * pRects, size_t count);
+        static void HDPIAPI LogicalToDeviceUnits(_Inout_updates_(count) SIZE * pSizes, size_t count);
+        static void HDPIAPI DeviceToLogicalUnits(_Inout_updates_(count) POINT * pPoints, size_t count);
+        static void HDPIAPI DeviceToLogicalUnits(_Inout_updates_(count) RECT * pRects, size_t count);
+        static void HDPIAPI DeviceToLogicalUnits(_Inout_updates_(count) SIZE * pSizes, size_t count);
         
         // Converts (if necessary) the image from logical to device pixels. By default we use interpolation that gives smoother results when scaling up.
         // The functions will return the original image if no scaling is required due to high DPI modes.
@@ -170,10 +345,35 @@ namespace VsUI
 
         // Creates and returns a new image suitable for display on device units. A clone image will be created when scaling is not necessary. The caller is reponsible of the lifetime of the returned image.
         static std::unique_ptr<VsUI::GdiplusImage> HDPIAPI CreateDeviceFromLogicalImage(_In_ VsUI::GdiplusImage* pImage, ImageScalingMode scalingMode = ImageScalingMode::Default, Gdiplus::Color clrBackground = TransparentColor);
+        static VsUI::GdiplusImage HDPIAPI CreateDeviceFromLogicalImage(VsUI::GdiplusImage& image, ImageScalingMode scalingMode = ImageScalingMode::Default, Gdiplus::Color clrBackground = TransparentColor);
         static HBITMAP HDPIAPI CreateDeviceFromLogicalImage(_In_ HBITMAP hImage, ImageScalingMode scalingMode = ImageScalingMode::Default, Gdiplus::Color clrBackground = TransparentColor);
+        static HBITMAP HDPIAPI CreateDeviceFromLogicalImage(_In_ HBITMAP hImage, CImageScaler::AlphaFormat alphaFormat, ImageScalingMode scalingMode = ImageScalingMode::Default, _Out_opt_ HBITMAP * phMask = nullptr);
         static HIMAGELIST HDPIAPI CreateDeviceFromLogicalImage(_In_ HIMAGELIST hImageList, ImageScalingMode scalingMode = ImageScalingMode::Default);
         static HICON HDPIAPI CreateDeviceFromLogicalImage(_In_ HICON hIcon, _In_opt_ const SIZE * pLogicalSize = nullptr);
 
+        // Turns on (or off) caching the size of the icons converted without a logical size, so converting the same icon again
+        // doesn't copy its bitmaps to read the size. The cache is opt-in only: it's only correct if every icon is destroyed with
+        // DestroyIcon below, or OnIconDestroyed is called for it, which the helper can't ensure even for the icons it creates (their
+        // callers destroy them). Until it's turned on, each conversion without a logical size calls GetIconInfo.
+        static void HDPIAPI EnableIconMetadataCache(bool enable);
+        // Destroys the icon like ::DestroyIcon, removing its cached size first
+        static BOOL HDPIAPI DestroyIcon(_In_ HICON hIcon);
+        // Removes the cached size of an icon destroyed without DestroyIcon above
+        static void HDPIAPI OnIconDestroyed(_In_ HICON hIcon);
+
+        // Removes the indexed icon directories and the cached images of a module, before the module is unloaded
+        static void HDPIAPI OnModuleUnloading(HINSTANCE hInstance);
+
+        // Creates the device images of a batch of logical images, scaling their pixels in parallel. maxThreads limits the threads used (0 uses all the processors).
+        static std::vector<std::unique_ptr<VsUI::GdiplusImage>> HDPIAPI CreateDeviceFromLogicalImages(_In_reads_(count) VsUI::GdiplusImage* const * ppImages, size_t count, ImageScalingMode scalingMode = ImageScalingMode::Default, Gdiplus::Color clrBackground = TransparentColor, unsigned int maxThreads = 0);
+        // Creates the device images of a logical image for several device DPI values (e.g. one per monitor), reading the logical pixels once.
+        static std::unique_ptr<CDeviceImageSet> HDPIAPI CreateDeviceImageSet(_In_ VsUI::GdiplusImage* pImage, _In_reads_(count) const int * pDeviceDpis, size_t count, ImageScalingMode scalingMode = ImageScalingMode::Default, Gdiplus::Color clrBackground = TransparentColor);
+
+        // Loads the image from resources and returns it in device units, shared from the scaled images cache or as a copy owned by the caller.
+        static std::shared_ptr<const CScaledImageCache::Image> HDPIAPI GetSharedDeviceImage(HINSTANCE hInstance, UINT nIDResource, ImageScalingMode scalingMode = ImageScalingMode::Default, Gdiplus::Color clrBackground = TransparentColor);
+        static std::unique_ptr<VsUI::GdiplusImage> HDPIAPI LoadDeviceImage(HINSTANCE hInstance, UINT nIDResource, ImageScalingMode scalingMode = ImageScalingMode::Default, Gdiplus::Color clrBackground = TransparentColor);
+        static HICON HDPIAPI LoadDeviceIcon(HINSTANCE hInstance, UINT nIDResource, const SIZE& logicalSize, ImageScalingMode scalingMode = ImageScalingMode::Default);
+
         // Convert a point size (1/72 of an inch) to device units.
         static int HDPIAPI PointsToDeviceUnits(int pt);
 
@@ -192,6 +392,11 @@ namespace VsUI
         static CDpiHelper* GetDefaultHelper();
         static CComAutoCriticalSection s_critSection;
 
+        // Lock-free lookup table of the helpers for the common zoom factors; other zoom factors are only in the map
+        static const int k_HelperTableSize = 512;
+        static const int k_DefaultZoomPercents = 100;
+        alignas(64) static std::atomic<CDpiHelper*> s_helperTable[k_HelperTableSize];
+
         static void Initialize();
 
         static bool m_fInitialized;
@@ -6,6 +6,9 @@
 
 #include "StdAfx.h"
 #include "VsUIGdiplusImage.h"
+#include "VsUIMemoryStream.h"
+#include "VsUITaskPool.h"
+#include <new>
 
 namespace VsUI
 {
@@ -31,18 +34,34 @@ namespace VsUI
 
     GdiplusImage::GdiplusImage()
     {
-        s_initGDIPlus.Init();
-        s_initGDIPlus.IncreaseImageCount();
+        s_initGDIPlus.AddImage();
     }
 
     GdiplusImage::~GdiplusImage()
     {
         Release(); // must delete the bitmap before uninitializing GDI+
-        s_initGDIPlus.DecreaseImageCount();
+        s_initGDIPlus.ReleaseImage();
+    }
+
+    GdiplusImage::GdiplusImage(GdiplusImage&& rhs) noexcept
+    {
+        // GDI+ is already running for rhs, so this only counts the image
+        s_initGDIPlus.AddImage();
+        m_pBitmap.Attach( rhs.m_pBitmap.Detach() );
+    }
+
+    /*static*/ void GdiplusImage::SetGdiplusLifetime( GdiplusLifetime lifetime, DWORD idleTimeoutMs )
+    {
+        s_initGDIPlus.SetLifetime( lifetime, idleTimeoutMs );
+    }
+
+    /*static*/ bool GdiplusImage::ShutdownGdiplus()
+    {
+        return s_initGDIPlus.Shutdown();
     }
         
     // Exchange the content of the 2 images
-    GdiplusImage& GdiplusImage::operator=(GdiplusImage&& rhs)
+    GdiplusImage& GdiplusImage::operator=(GdiplusImage&& rhs) noexcept
     {
         std::swap(m_pBitmap, rhs.m_pBitmap);
         return *this;
@@ -314,50 +333,140 @@ namespace VsUI
     }
     
     //-----------------------------------------------------------------
-    // Save to the given file in the specified format
+    // Save each image to its stream, encoding the images in parallel
     //-----------------------------------------------------------------
-    HRESULT GdiplusImage::SaveBitmap(const GUID& format, std::function< Gdiplus::Status (_In_ const CLSID * clsidEncoder) > saveFunction )
+    HRESULT GdiplusImage::Save( _In_reads_(count) GdiplusImage* const * ppImages, _In_reads_(count) IStream* const * ppStreams, size_t count, const GUID& format, _Out_writes_opt_(count) HRESULT* phrResults )
     {
-        if( !IsLoaded() )
+        if( (!ppImages || !ppStreams) && count != 0 )
         {
-            return E_FAIL;
+            return E_INVALIDARG;
         }
 
-        UINT nEncoders;
-        UINT nBytes;
-        if( Gdiplus::Ok != Gdiplus::GetImageEncodersSize( &nEncoders, &nBytes ) )
+        // Look up the encoder once, so the threads don't contend on the encoders lock
+        CLSID clsidEncoder;
+        if( !s_initGDIPlus.GetEncoderClsid( format, &clsidEncoder ) )
         {
             return E_FAIL;
         }
 
-        USES_ATL_SAFE_ALLOCA;
-        Gdiplus::ImageCodecInfo* pCodecs = static_cast< Gdiplus::ImageCodecInfo* >( _ATL_SAFE_ALLOCA(nBytes, _ATL_SAFE_ALLOCA_DEF_THRESHOLD) );
-        if( pCodecs == NULL )
+        std::vector< CComPtr< IStream > > buffers;
+        try
+        {
+            buffers.resize( count );
+        }
+        catch( const std::bad_alloc& )
         {
             return E_OUTOFMEMORY;
         }
 
-        if( Gdiplus::Ok != Gdiplus::GetImageEncoders( nEncoders, nBytes, pCodecs ) )
+        // GDI+ can encode different bitmaps on different threads. The caller's streams may belong to its COM apartment, which the pool
+        // threads are not in, so each image is encoded into a memory stream of its own, copied to the caller's stream on this thread.
+        CTaskPool::GetInstance().ParallelFor( count, [&]( size_t i )
         {
-            return E_FAIL;
-        }
+            if( !ppImages[i] || !ppImages[i]->IsLoaded() || !ppStreams[i] )
+            {
+                return;
+            }
+
+            CComPtr< IStream > spBuffer;
+            if( SUCCEEDED(::CreateStreamOnHGlobal( NULL /*create new*/, TRUE /*free on close*/, &spBuffer )) &&
+                ppImages[i]->m_pBitmap->Save( spBuffer, &clsidEncoder, NULL ) == Gdiplus::Ok )
+            {
+                buffers[i].Attach( spBuffer.Detach() );
+            }
+        });
 
-        for( UINT n = 0; n != nEncoders; ++n )
+        LONG cFailed = 0;
+        for( size_t i = 0; i != count; ++i )
         {
-            if( pCodecs[n].FormatID == format )
+            HRESULT hr = E_INVALIDARG;
+            if( ppImages[i] && ppImages[i]->IsLoaded() && ppStreams[i] )
             {
-                if( Gdiplus::Ok != saveFunction( &(pCodecs[n].Clsid) ) )
-                {
-                    return E_FAIL;
-                }
+                hr = buffers[i] ? CopyEncodedImage( buffers[i], ppStreams[i] ) : E_FAIL;
+            }
 
-                return S_OK;
+            if( phrResults )
+            {
+                phrResults[i] = hr;
+            }
+
+            if( FAILED(hr) )
+            {
+                cFailed++;
             }
         }
 
-        return E_FAIL;
+        return (cFailed == 0) ? S_OK : E_FAIL;
     }
-    
+
+    //-----------------------------------------------------------------
+    // Writes the image encoded in the memory stream to the destination stream
+    //-----------------------------------------------------------------
+    /*static*/ HRESULT GdiplusImage::CopyEncodedImage( _In_ IStream* pBuffer, _In_ IStream* pStream )
+    {
+        // The memory stream is positioned at the end of the encoded image
+        ULARGE_INTEGER cbEncoded;
+        LARGE_INTEGER liZero = { 0 };
+        HRESULT hr = pBuffer->Seek( liZero, STREAM_SEEK_CUR, &cbEncoded );
+        if( FAILED(hr) )
+        {
+            return hr;
+        }
+
+        // Write takes a 32-bit size
+        if( cbEncoded.HighPart != 0 )
+        {
+            return E_OUTOFMEMORY;
+        }
+
+        HGLOBAL hGlobal = NULL;
+        hr = ::GetHGlobalFromStream( pBuffer, &hGlobal );
+        if( FAILED(hr) )
+        {
+            return hr;
+        }
+
+        const void* pEncoded = ::GlobalLock( hGlobal );
+        if( !pEncoded )
+        {
+            return E_OUTOFMEMORY;
+        }
+
+        ULONG cbWritten = 0;
+        hr = pStream->Write( pEncoded, cbEncoded.LowPart, &cbWritten );
+        ::GlobalUnlock( hGlobal );
+
+        if( SUCCEEDED(hr) && cbWritten != cbEncoded.LowPart )
+        {
+            hr = STG_E_MEDIUMFULL;
+        }
+        return FAILED(hr) ? hr : S_OK;
+    }
+
+    //-----------------------------------------------------------------
+    // Save to the given file in the specified format
+    //-----------------------------------------------------------------
+    HRESULT GdiplusImage::SaveBitmap(const GUID& format, std::function< Gdiplus::Status (_In_ const CLSID * clsidEncoder) > saveFunction )
+    {
+        if( !IsLoaded() )
+        {
+            return E_FAIL;
+        }
+
+        CLSID clsidEncoder;
+        if( !s_initGDIPlus.GetEncoderClsid( format, &clsidEncoder ) )
+        {
+            return E_FAIL;
+        }
+
+        if( Gdiplus::Ok != saveFunction( &clsidEncoder ) )
+        {
+            return E_FAIL;
+        }
+
+        return S_OK;
+    }
+
     //-----------------------------------------------------------------
     // Converts the bitmap to 32bpp ARGB if necessary and converts all pixels of clrTransparency color to be fully transparent.
     //-----------------------------------------------------------------
@@ -378,12 +487,10 @@ namespace VsUI
         }
         
         // Now that we have 32bpp image, let's make the pixels transparent
-        ProcessBitmapBits(m_pBitmap, [&](Gdiplus::ARGB * pPixelData) 
+        const Gdiplus::ARGB keyColor = clrTransparency.GetValue();
+        ProcessBitmapRows(m_pBitmap, [&](Gdiplus::ARGB * pRow, UINT width) 
         {
-            if (*pPixelData == clrTransparency.GetValue())
-            {
-                *pPixelData = TransparentColor.GetValue();
-            }
+            CPixelKernels::ReplaceKeyColors(pRow, width, &keyColor, 1, TransparentColor.GetValue());
         });
         
         return S_OK;
@@ -393,34 +500,242 @@ namespace VsUI
     // Apply a processor function to all bitmap pixels 
     //-----------------------------------------------------------------
     void GdiplusImage::ProcessBitmapBits(_In_ Gdiplus::Bitmap * pBitmap, std::function<void (_Inout_ Gdiplus::ARGB* pPixelData)> pixelProcessor)
+    {
+        // Call the row API explicitly; calling ProcessBitmapBits with the std::function would resolve back to this overload
+        ProcessBitmapRows(pBitmap, [&](Gdiplus::ARGB * pRow, UINT width)
+        {
+            CPixelKernels::ForEachPixel(pRow, width, pixelProcessor);
+        });
+    }
+
+    //-----------------------------------------------------------------
+    // Lock all the bitmap pixels for read/write access in 32bpp ARGB format
+    //-----------------------------------------------------------------
+    bool GdiplusImage::LockBitmapBits(_In_ Gdiplus::Bitmap * pBitmap, _Out_ Gdiplus::BitmapData * pLockedBitmapData)
     {
         if (!pBitmap)
-            return;
+            return false;
 
-        Gdiplus::BitmapData lockedBitmapData;
-        UINT bitmapWidth = pBitmap->GetWidth();
-        UINT bitmapHeight = pBitmap->GetHeight();
+        Gdiplus::Rect rectImage(0, 0, pBitmap->GetWidth(), pBitmap->GetHeight());
+        return pBitmap->LockBits(&rectImage, Gdiplus::ImageLockModeRead | Gdiplus::ImageLockModeWrite, PixelFormat32bppARGB, pLockedBitmapData) == Gdiplus::Ok;
+    }
 
-        // Figure out what is the transparency color. Make Magenta/NearGreen pixels transparent-Halo
-        Gdiplus::Rect rectImage(0, 0, bitmapWidth, bitmapHeight);
-        if (pBitmap->LockBits(&rectImage, Gdiplus::ImageLockModeRead | Gdiplus::ImageLockModeWrite, PixelFormat32bppARGB, &lockedBitmapData) == Gdiplus::Ok)
+    //---------------------------------------------------------------
+    // Read-only IStream over the memory of a module resource
+    // Serves Read/Seek/Stat directly from the LockResource pointer.
+    // GDI+ may keep the stream and decode the image later, so the
+    // stream holds a reference on the module containing the resource.
+    //---------------------------------------------------------------
+    class CResourceStream : public IStream
+    {
+    public:
+        // Creates the stream, or fails if the module containing the data can't be referenced (e.g. loaded as a data file)
+        static HRESULT Create( const void* pData, ULONGLONG cbData, ULONGLONG position, _Out_ IStream** ppStream )
+        {
+            *ppStream = NULL;
+
+            HMODULE hModule = NULL;
+            if( !::GetModuleHandleExW( GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS, static_cast<LPCWSTR>(pData), &hModule ) )
+            {
+                return HRESULT_FROM_WIN32(::GetLastError());
+            }
+
+            CResourceStream* pStream = new (std::nothrow) CResourceStream( hModule, pData, cbData );
+            if( !pStream )
+            {
+                ::FreeLibrary(hModule);
+                return E_OUTOFMEMORY;
+            }
+
+            pStream->m_stream.Seek( static_cast<int64_t>(position), CReadOnlyMemoryStream::SeekOrigin::Begin, nullptr );
+            *ppStream = pStream;
+            return S_OK;
+        }
+
+        // IUnknown
+        STDMETHODIMP QueryInterface( REFIID riid, _COM_Outptr_ void** ppvObject )
         {
-            BYTE * pData = reinterpret_cast<BYTE*>(lockedBitmapData.Scan0);
-            for (UINT y = 0; y < bitmapHeight; y++, pData += lockedBitmapData.Stride)
+            if( !ppvObject )
+            {
+                return E_POINTER;
+            }
+
+            if( riid == __uuidof(IUnknown) || riid == __uuidof(ISequentialStream) || riid == __uuidof(IStream) )
             {
-                BYTE * pPixelData = pData;
-                for (UINT x = 0; x < bitmapWidth; x++, pPixelData += 4)
+                *ppvObject = static_cast<IStream*>(this);
+                AddRef();
+                return S_OK;
+            }
+
+            *ppvObject = NULL;
+            return E_NOINTERFACE;
+        }
+
+        STDMETHODIMP_(ULONG) AddRef()
+        {
+            return ::InterlockedIncrement(&m_cRef);
+        }
+
+        STDMETHODIMP_(ULONG) Release()
+        {
+            ULONG cRef = ::InterlockedDecrement(&m_cRef);
+            if( cRef == 0 )
+            {
+                delete this;
+            }
+            return cRef;
+        }
+
+        // ISequentialStream
+        STDMETHODIMP Read( _Out_writes_bytes_to_(cb, *pcbRead) void* pv, ULONG cb, _Out_opt_ ULONG* pcbRead )
+        {
+            if( !pv )
+            {
+                return STG_E_INVALIDPOINTER;
+            }
+
+            ULONG cbRead = static_cast<ULONG>(m_stream.Read( pv, cb ));
+            if( pcbRead )
+            {
+                *pcbRead = cbRead;
+            }
+            return (cbRead == cb) ? S_OK : S_FALSE;
+        }
+
+        STDMETHODIMP Write( _In_reads_bytes_(cb) const void* /*pv*/, ULONG /*cb*/, _Out_opt_ ULONG* pcbWritten )
+        {
+            if( pcbWritten )
+            {
+                *pcbWritten = 0;
+            }
+            return STG_E_ACCESSDENIED;
+        }
+
+        // IStream
+        STDMETHODIMP Seek( LARGE_INTEGER dlibMove, DWORD dwOrigin, _Out_opt_ ULARGE_INTEGER* plibNewPosition )
+        {
+            if( dwOrigin > STREAM_SEEK_END )
+            {
+                return STG_E_INVALIDFUNCTION;
+            }
+
+            uint64_t newPosition = 0;
+            if( !m_stream.Seek( dlibMove.QuadPart, static_cast<CReadOnlyMemoryStream::SeekOrigin>(dwOrigin), &newPosition ) )
+            {
+                return STG_E_INVALIDFUNCTION;
+            }
+
+            if( plibNewPosition )
+            {
+                plibNewPosition->QuadPart = newPosition;
+            }
+            return S_OK;
+        }
+
+        STDMETHODIMP SetSize( ULARGE_INTEGER /*libNewSize*/ )
+        {
+            return STG_E_ACCESSDENIED;
+        }
+
+        STDMETHODIMP CopyTo( _In_ IStream* pstm, ULARGE_INTEGER cb, _Out_opt_ ULARGE_INTEGER* pcbRead, _Out_opt_ ULARGE_INTEGER* pcbWritten )
+        {
+            if( !pstm )
+            {
+                return STG_E_INVALIDPOINTER;
+            }
+
+            // Write straight from the resource memory, in chunks that fit in a ULONG
+            uint64_t cbAvailable = 0;
+            const BYTE* pData = static_cast<const BYTE*>(m_stream.Skip( cb.QuadPart, &cbAvailable ));
+            uint64_t cbTotalWritten = 0;
+            HRESULT hr = S_OK;
+            while( cbTotalWritten < cbAvailable && SUCCEEDED(hr) )
+            {
+                ULONG cbChunk = static_cast<ULONG>(std::min<uint64_t>( cbAvailable - cbTotalWritten, ULONG_MAX ));
+                ULONG cbWritten = 0;
+                hr = pstm->Write( pData + cbTotalWritten, cbChunk, &cbWritten );
+                cbTotalWritten += cbWritten;
+                if( cbWritten != cbChunk )
                 {
-                    pixelProcessor(reinterpret_cast<Gdiplus::ARGB*>(pPixelData));
+                    break;
                 }
             }
 
-            pBitmap->UnlockBits(&lockedBitmapData);
+            if( pcbRead )
+            {
+                pcbRead->QuadPart = cbAvailable;
+            }
+            if( pcbWritten )
+            {
+                pcbWritten->QuadPart = cbTotalWritten;
+            }
+            return FAILED(hr) ? hr : S_OK;
         }
-    }
+
+        STDMETHODIMP Commit( DWORD /*grfCommitFlags*/ )
+        {
+            // Nothing to commit, the stream is not transacted
+            return S_OK;
+        }
+
+        STDMETHODIMP Revert()
+        {
+            return S_OK;
+        }
+
+        STDMETHODIMP LockRegion( ULARGE_INTEGER /*libOffset*/, ULARGE_INTEGER /*cb*/, DWORD /*dwLockType*/ )
+        {
+            return STG_E_INVALIDFUNCTION;
+        }
+
+        STDMETHODIMP UnlockRegion( ULARGE_INTEGER /*libOffset*/, ULARGE_INTEGER /*cb*/, DWORD /*dwLockType*/ )
+        {
+            return STG_E_INVALIDFUNCTION;
+        }
+
+        STDMETHODIMP Stat( _Out_ STATSTG* pstatstg, DWORD /*grfStatFlag*/ )
+        {
+            if( !pstatstg )
+            {
+                return STG_E_INVALIDPOINTER;
+            }
+
+            // The stream has no name, so STATFLAG_NONAME or not, pwcsName is NULL
+            ZeroMemory( pstatstg, sizeof(*pstatstg) );
+            pstatstg->type = STGTY_STREAM;
+            pstatstg->cbSize.QuadPart = m_stream.GetSize();
+            pstatstg->grfMode = STGM_READ | STGM_SHARE_DENY_WRITE;
+            return S_OK;
+        }
+
+        STDMETHODIMP Clone( _COM_Outptr_ IStream** ppstm )
+        {
+            if( !ppstm )
+            {
+                return STG_E_INVALIDPOINTER;
+            }
+
+            return Create( m_stream.GetData(), m_stream.GetSize(), m_stream.GetPosition(), ppstm );
+        }
+
+    private:
+        CResourceStream( HMODULE hModule, const void* pData, ULONGLONG cbData ) :
+            m_cRef(1), m_hModule(hModule), m_stream(pData, cbData)
+        {
+        }
+
+        ~CResourceStream()
+        {
+            ::FreeLibrary(m_hModule);
+        }
+
+        volatile LONG m_cRef;
+        HMODULE m_hModule;
+        CReadOnlyMemoryStream m_stream;
+    };
 
     //---------------------------------------------------------------
-    // Create an in-memory stream over a resource.
+    // Create a read-only stream over a resource.
     // The resource must have been found via FindResource
     //---------------------------------------------------------------
     HRESULT GdiplusImage::CreateStreamOnResource( HINSTANCE hInst, HRSRC hResource, IStream** ppStream )
@@ -441,20 +756,33 @@ namespace VsUI
             return E_INVALIDARG;
         }
 
-        // It would be nice if we could just call CreateStreamOnHGlobal on hGlob.
-        // Unfortunately that doesn't work because the HGLOBAL we have here came
-        // from LoadResource and not GlobalAlloc.
-        // Instead, create a new stream (pass NULL for the HGLOBAL) and write
-        // the resource into that stream.
+        const void* pData = ::LockResource(hGlob);
+        DWORD cbData = ::SizeofResource(hInst, hResource);
+        if( !pData )
+        {
+            return E_INVALIDARG;
+        }
+
+        // Serve the resource directly from the module memory, without copying it
+        HRESULT hr = CResourceStream::Create( pData, cbData, 0 /*position*/, ppStream );
+        if( SUCCEEDED(hr) )
+        {
+            return hr;
+        }
+
+        // The module could not be referenced to keep the resource memory alive as long as the stream.
+        // CreateStreamOnHGlobal can't use hGlob either, because the HGLOBAL we have here came from
+        // LoadResource and not GlobalAlloc. Instead, create a new stream (pass NULL for the HGLOBAL)
+        // and write the resource into that stream.
         CComPtr< IStream > spStream;
-        HRESULT hr = ::CreateStreamOnHGlobal(NULL /*create new*/, TRUE /*free on close*/, &spStream );
+        hr = ::CreateStreamOnHGlobal(NULL /*create new*/, TRUE /*free on close*/, &spStream );
         if( FAILED(hr) )
         {
             return hr;
         }
 
         ULONG cbWritten = 0;
-        hr = spStream->Write( ::LockResource(hGlob), ::SizeofResource(hInst, hResource), &cbWritten );
+        hr = spStream->Write( pData, cbData, &cbWritten );
         if( FAILED(hr) )
         {
             return hr;
@@ -500,73 +828,260 @@ namespace VsUI
 #pragma pop_macro("new")
     }
 
+    GdiplusImage::CInitGDIPlus::~CInitGDIPlus()
+    {
+        // Static destruction runs in DLL_PROCESS_DETACH when we're built into a DLL, under the loader lock, where GDI+ must not be
+        // shut down and thread pool callbacks must not be waited for. The process exit releases the GDI+ session; a DLL unloaded
+        // before the process exits calls ShutdownGdiplus first.
+        if( m_pIdleTimer != NULL )
+        {
+            SetThreadpoolTimer( m_pIdleTimer, NULL, 0, 0 );
+        }
+    }
+
     //---------------------------------------------------------------
-    // Initializes GDI+ if not already initialized
+    // Counts a new image, starting GDI+ if not already started
     //---------------------------------------------------------------
-    bool GdiplusImage::CInitGDIPlus::Init()
+    bool GdiplusImage::CInitGDIPlus::AddImage()
     {
+        ATL::CComCritSecLock<ATL::CComCriticalSection> lock(m_lock);
+
+        if( m_GdiplusImageObjects++ == 0 )
+        {
+            CancelIdleTimerLocked();
+        }
+
         if( m_GdiplusToken != 0 )
         {
-            // Already initialized
+            // Already started
             return true;
         }
 
         ULONG_PTR token = 0;
         Gdiplus::GdiplusStartupInput input;
-        Gdiplus::Status status = Gdiplus::GdiplusStartup( &token, &input, NULL );
-        if( status != Gdiplus::Ok )
+        if( Gdiplus::GdiplusStartup( &token, &input, NULL ) != Gdiplus::Ok )
         {
             return false;
         }
 
-        if( InterlockedExchangeToken(token) != 0 )
+        m_GdiplusToken = token;
+        return true;
+    }
+
+    //---------------------------------------------------------------
+    // Counts an image destroyed, and applies the lifetime policy if it was the last one
+    //---------------------------------------------------------------
+    void GdiplusImage::CInitGDIPlus::ReleaseImage()
+    {
+        ATL::CComCritSecLock<ATL::CComCriticalSection> lock(m_lock);
+
+        if( --m_GdiplusImageObjects != 0 )
+        {
+            return;
+        }
+
+        if( m_fShutdownPending || (m_lifetime == GdiplusLifetime::IdleTimeout && m_idleTimeoutMs == 0) )
+        {
+            ShutdownLocked();
+        }
+        else if( m_lifetime == GdiplusLifetime::IdleTimeout )
+        {
+            StartIdleTimerLocked();
+        }
+    }
+
+    //---------------------------------------------------------------
+    // Sets the lifetime policy, applying it right away if GDI+ is idle
+    //---------------------------------------------------------------
+    void GdiplusImage::CInitGDIPlus::SetLifetime( GdiplusLifetime lifetime, DWORD idleTimeoutMs )
+    {
+        ATL::CComCritSecLock<ATL::CComCriticalSection> lock(m_lock);
+
+        m_lifetime = lifetime;
+        m_idleTimeoutMs = idleTimeoutMs;
+
+        CancelIdleTimerLocked();
+        if( m_GdiplusImageObjects == 0 && m_lifetime == GdiplusLifetime::IdleTimeout )
+        {
+            StartIdleTimerLocked();
+        }
+    }
+
+    //---------------------------------------------------------------
+    // Shuts GDI+ down now if no image is alive, or when the last image is destroyed
+    //---------------------------------------------------------------
+    bool GdiplusImage::CInitGDIPlus::Shutdown()
+    {
+        PTP_TIMER pIdleTimer = NULL;
         {
-            // Initialized by another thread
-            Gdiplus::GdiplusShutdown(token);
+            ATL::CComCritSecLock<ATL::CComCriticalSection> lock(m_lock);
+
+            if( m_GdiplusImageObjects != 0 )
+            {
+                m_fShutdownPending = true;
+                return false;
+            }
+
+            ShutdownLocked();
+
+            // Close the timer, so no callback runs after a DLL unloads. It's created again if GDI+ becomes idle again.
+            pIdleTimer = m_pIdleTimer;
+            m_pIdleTimer = NULL;
+        }
+
+        if( pIdleTimer != NULL )
+        {
+            // Outside the lock, which a running callback is waiting for. That callback then finds GDI+ already shut down.
+            SetThreadpoolTimer( pIdleTimer, NULL, 0, 0 );
+            WaitForThreadpoolTimerCallbacks( pIdleTimer, TRUE );
+            CloseThreadpoolTimer( pIdleTimer );
         }
 
         return true;
     }
 
     //---------------------------------------------------------------
-    // Releases GDI+ if this is the last user
+    // Shuts GDI+ down if started. Must be called with the lock held and no image alive
     //---------------------------------------------------------------
-    void GdiplusImage::CInitGDIPlus::ReleaseGDIPlus()
+    void GdiplusImage::CInitGDIPlus::ShutdownLocked()
     {
-        ULONG_PTR token = InterlockedExchangeToken(0);
-        if( token != 0 )
+        m_fShutdownPending = false;
+
+        ULONG_PTR token = m_GdiplusToken;
+        if( token == 0 )
+        {
+            return;
+        }
+
+        m_GdiplusToken = 0;
+
+        // The encoders are enumerated again in the next GDI+ session
         {
-            Gdiplus::GdiplusShutdown( token );
+            ATL::CComCritSecLock<ATL::CComCriticalSection> lock(m_encodersLock);
+            m_encoders.clear();
+            m_fEncodersLoaded = false;
         }
+
+        Gdiplus::GdiplusShutdown( token );
     }
 
     //---------------------------------------------------------------
-    // Increases image use count
+    // Schedules the shutdown of GDI+ after the idle timeout. Must be called with the lock held
     //---------------------------------------------------------------
-    void GdiplusImage::CInitGDIPlus::IncreaseImageCount()
+    void GdiplusImage::CInitGDIPlus::StartIdleTimerLocked()
     {
-        _InterlockedIncrement(&m_GdiplusImageObjects);
+        if( m_GdiplusToken == 0 )
+        {
+            return;
+        }
+
+        if( m_pIdleTimer == NULL )
+        {
+            m_pIdleTimer = CreateThreadpoolTimer( IdleTimerCallback, this, NULL );
+            if( m_pIdleTimer == NULL )
+            {
+                // Without a timer, shut down now rather than never
+                ShutdownLocked();
+                return;
+            }
+        }
+
+        // Negative due times are relative, in 100ns units
+        ULARGE_INTEGER dueTime;
+        dueTime.QuadPart = static_cast<ULONGLONG>( -static_cast<LONGLONG>(m_idleTimeoutMs) * 10000 );
+        FILETIME ftDueTime = { dueTime.LowPart, dueTime.HighPart };
+        SetThreadpoolTimer( m_pIdleTimer, &ftDueTime, 0, 0 );
     }
 
     //---------------------------------------------------------------
-    // Decreases image use count, releases GDI+ if this is the last image
+    // Cancels the pending idle shutdown. Must be called with the lock held
     //---------------------------------------------------------------
-    void GdiplusImage::CInitGDIPlus::DecreaseImageCount()
+    void GdiplusImage::CInitGDIPlus::CancelIdleTimerLocked()
+    {
+        // A callback already running waits for the lock, then finds images alive or the policy changed
+        if( m_pIdleTimer != NULL )
+        {
+            SetThreadpoolTimer( m_pIdleTimer, NULL, 0, 0 );
+        }
+    }
+
+    /*static*/ VOID CALLBACK GdiplusImage::CInitGDIPlus::IdleTimerCallback( PTP_CALLBACK_INSTANCE /*pInstance*/, PVOID pContext, PTP_TIMER /*pTimer*/ )
     {
-        if( _InterlockedDecrement(&m_GdiplusImageObjects) == 0 )
+        CInitGDIPlus* pThis = static_cast<CInitGDIPlus*>(pContext);
+        ATL::CComCritSecLock<ATL::CComCriticalSection> lock(pThis->m_lock);
+
+        if( pThis->m_GdiplusImageObjects == 0 && pThis->m_lifetime == GdiplusLifetime::IdleTimeout )
         {
-            ReleaseGDIPlus();
+            pThis->ShutdownLocked();
         }
     }
 
-    ULONG_PTR GdiplusImage::CInitGDIPlus::InterlockedExchangeToken( ULONG_PTR token )
+    //---------------------------------------------------------------
+    // Finds the CLSID of the encoder for the image format
+    //---------------------------------------------------------------
+    bool GdiplusImage::CInitGDIPlus::GetEncoderClsid( const GUID& format, _Out_ CLSID* pClsid )
     {
-#if !defined(_InterlockedExchangePointer) && defined(_M_IX86)
-        return _InterlockedExchange( reinterpret_cast< long volatile* >(&m_GdiplusToken), token );
-#else
-        return reinterpret_cast<ULONG_PTR>(
-               _InterlockedExchangePointer( reinterpret_cast< void * volatile* >(&m_GdiplusToken), reinterpret_cast<void*>(token) ) );
-#endif // !defined(_InterlockedExchangePointer) && defined(_M_IX86)
+        ATL::CComCritSecLock<ATL::CComCriticalSection> lock(m_encodersLock);
+
+        if( !m_fEncodersLoaded && !LoadEncoders() )
+        {
+            return false;
+        }
+
+        // There are only a handful of encoders
+        for( size_t n = 0; n != m_encoders.size(); ++n )
+        {
+            if( m_encoders[n].formatID == format )
+            {
+                *pClsid = m_encoders[n].clsid;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    //---------------------------------------------------------------
+    // Enumerates the GDI+ encoders. Must be called with the encoders lock held
+    //---------------------------------------------------------------
+    bool GdiplusImage::CInitGDIPlus::LoadEncoders()
+    {
+        UINT nEncoders;
+        UINT nBytes;
+        if( Gdiplus::Ok != Gdiplus::GetImageEncodersSize( &nEncoders, &nBytes ) )
+        {
+            return false;
+        }
+
+        USES_ATL_SAFE_ALLOCA;
+        Gdiplus::ImageCodecInfo* pCodecs = static_cast< Gdiplus::ImageCodecInfo* >( _ATL_SAFE_ALLOCA(nBytes, _ATL_SAFE_ALLOCA_DEF_THRESHOLD) );
+        if( pCodecs == NULL )
+        {
+            return false;
+        }
+
+        if( Gdiplus::Ok != Gdiplus::GetImageEncoders( nEncoders, nBytes, pCodecs ) )
+        {
+            return false;
+        }
+
+        try
+        {
+            m_encoders.clear();
+            for( UINT n = 0; n != nEncoders; ++n )
+            {
+                EncoderInfo encoder = { pCodecs[n].FormatID, pCodecs[n].Clsid };
+                m_encoders.push_back( encoder );
+            }
+        }
+        catch( const std::bad_alloc& )
+        {
+            m_encoders.clear();
+            return false;
+        }
+
+        m_fEncodersLoaded = true;
+        return true;
     }
 
 };  // namespace VsUI
\ No newline at end of file
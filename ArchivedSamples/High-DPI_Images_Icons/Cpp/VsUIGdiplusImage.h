@@ -10,6 +10,12 @@
 // Note: Some of this is copied from ATL::CImage (particularly the CInitGDIPlus
 // helper). The key difference is that we store the image as Gdiplus::Bitmap
 // internally.
+// GDI+ is started by the first image and, by default, kept running until the
+// process exits or ShutdownGdiplus is called, so short-lived images don't pay
+// for a GDI+ startup each. SetGdiplusLifetime can shut it down instead once no
+// image has been alive for a while. GDI+ is not shut down at static destruction
+// (it can't be from DllMain): when these files are built into a DLL that is
+// unloaded before the process exits, call ShutdownGdiplus before unloading it.
 //-----------------------------------------------------------------------------
 #pragma once
 
@@ -36,6 +42,8 @@
 #include <atlbase.h>
 #include <algorithm>
 #include <functional>
+#include <vector>
+#include "VsUIPixelKernels.h"
 
 namespace VsUI
 {
@@ -47,28 +55,69 @@ namespace VsUI
 
     class GdiplusImage
     {
+    public:
+        // When GDI+ is shut down after the first image started it
+        enum class GdiplusLifetime
+        {
+            // When the process exits, or when ShutdownGdiplus is called (default)
+            Process,
+            // When no image has been alive for the idle timeout. A timeout of 0 shuts GDI+ down as soon as the last image is destroyed.
+            IdleTimeout,
+        };
+
     private:
         class CInitGDIPlus
         {
         public:
-            CInitGDIPlus() : m_GdiplusToken(0), m_GdiplusImageObjects(0)
+            CInitGDIPlus() : m_GdiplusToken(0), m_GdiplusImageObjects(0), m_lifetime(GdiplusLifetime::Process), m_idleTimeoutMs(0),
+                m_fShutdownPending(false), m_pIdleTimer(NULL), m_fEncodersLoaded(false)
             {
             }
 
-            ~CInitGDIPlus()
-            {
-                ReleaseGDIPlus();
-            }
+            ~CInitGDIPlus();
 
-            bool Init();
-            void ReleaseGDIPlus();
-            void IncreaseImageCount();
-            void DecreaseImageCount();
+            // Counts a new image, starting GDI+ if needed. Returns false if GDI+ couldn't be started; the image is counted anyway.
+            bool AddImage();
+            // Counts an image destroyed, shutting GDI+ down according to the lifetime policy if it was the last one
+            void ReleaseImage();
+
+            void SetLifetime( GdiplusLifetime lifetime, DWORD idleTimeoutMs );
+            bool Shutdown();
+
+            // Finds the CLSID of the encoder for the image format. The encoders are enumerated once per GDI+ session.
+            bool GetEncoderClsid( const GUID& format, _Out_ CLSID* pClsid );
 
         private:
-            ULONG_PTR InterlockedExchangeToken( ULONG_PTR token );
-            volatile ULONG_PTR m_GdiplusToken;
+            // Must be called with m_lock held
+            void ShutdownLocked();
+            void StartIdleTimerLocked();
+            void CancelIdleTimerLocked();
+            static VOID CALLBACK IdleTimerCallback( PTP_CALLBACK_INSTANCE pInstance, PVOID pContext, PTP_TIMER pTimer );
+
+            bool LoadEncoders();
+
+            // Guards the GDI+ session: the token, the image count and the lifetime policy, so an image can't be created while
+            // another thread shuts GDI+ down
+            ATL::CComAutoCriticalSection m_lock;
+            ULONG_PTR m_GdiplusToken;
             LONG m_GdiplusImageObjects;
+            GdiplusLifetime m_lifetime;
+            DWORD m_idleTimeoutMs;
+            // ShutdownGdiplus was called while images were alive: shut down when the last one is destroyed
+            bool m_fShutdownPending;
+            // Created the first time GDI+ becomes idle with the IdleTimeout policy
+            PTP_TIMER m_pIdleTimer;
+
+            struct EncoderInfo
+            {
+                GUID formatID;
+                CLSID clsid;
+            };
+
+            // Encoders of the current GDI+ session, cleared when GDI+ is released
+            ATL::CComAutoCriticalSection m_encodersLock;
+            std::vector<EncoderInfo> m_encoders;
+            bool m_fEncodersLoaded;
         };
 
     public:
@@ -89,9 +138,20 @@ namespace VsUI
 
         GdiplusImage();
         ~GdiplusImage();
+
+        // Takes the bitmap of rhs, leaving rhs without an image
+        GdiplusImage(GdiplusImage&& rhs) noexcept;
+
+        // Sets when GDI+ is shut down once no image is alive. With the IdleTimeout policy, GDI+ is shut down on a thread pool thread.
+        static void SetGdiplusLifetime( GdiplusLifetime lifetime, DWORD idleTimeoutMs = 0 );
+
+        // Shuts GDI+ down now if no image is alive, and returns true. Otherwise GDI+ is shut down when the last image is destroyed,
+        // and the function returns false. The next image created starts GDI+ again.
+        // A DLL containing these files must call it, with no image alive, before it's unloaded (e.g. before FreeLibrary, not from DllMain).
+        static bool ShutdownGdiplus();
         
         // Exchange the content of the 2 images
-        GdiplusImage& operator=(GdiplusImage&& rhs);
+        GdiplusImage& operator=(GdiplusImage&& rhs) noexcept;
 
         bool IsLoaded() const
         {
@@ -148,15 +208,46 @@ namespace VsUI
         // Save to the given file in the specified format
         HRESULT Save( _In_z_ LPCWSTR wszFilename, const GUID& format = Gdiplus::ImageFormatPNG );
 
+        // Save each image to the stream with the same index, encoding the images in parallel. Returns S_OK if all the images were saved,
+        // and the result of each save in phrResults if specified. The images are encoded in memory on the pool threads, and written to the
+        // streams on the calling thread, so the streams may belong to its COM apartment.
+        static HRESULT Save( _In_reads_(count) GdiplusImage* const * ppImages, _In_reads_(count) IStream* const * ppStreams, size_t count, const GUID& format = Gdiplus::ImageFormatPNG, _Out_writes_opt_(count) HRESULT* phrResults = nullptr );
+
         // Converts the bitmap to 32bpp ARGB if necessary and converts all pixels of clrTransparency color to be fully transparent.
         HRESULT MakeTransparent(const Gdiplus::Color& clrTransparency = MagentaColor);
         
         // Apply a processor function to all bitmap pixels 
         static void ProcessBitmapBits(_In_ Gdiplus::Bitmap * pBitmap, std::function<void (_Inout_ Gdiplus::ARGB* pPixelData)> pixelProcessor);
 
+        // Apply a processor callable to all bitmap pixels. Unlike the std::function overload, the callable is inlined in the pixel loop.
+        template <typename TPixelProcessor>
+        static void ProcessBitmapBits(_In_ Gdiplus::Bitmap * pBitmap, TPixelProcessor&& pixelProcessor)
+        {
+            ProcessBitmapRows(pBitmap, [&](Gdiplus::ARGB* pRow, UINT width)
+            {
+                CPixelKernels::ForEachPixel(pRow, width, pixelProcessor);
+            });
+        }
+
+        // Apply a row processor to all bitmap rows. The processor is called with the first pixel of each row and the row width.
+        template <typename TRowProcessor>
+        static void ProcessBitmapRows(_In_ Gdiplus::Bitmap * pBitmap, TRowProcessor&& rowProcessor)
+        {
+            Gdiplus::BitmapData lockedBitmapData;
+            if (!LockBitmapBits(pBitmap, &lockedBitmapData))
+                return;
+
+            CPixelKernels::ForEachRow<Gdiplus::ARGB>(lockedBitmapData.Scan0, lockedBitmapData.Stride, lockedBitmapData.Width, lockedBitmapData.Height, rowProcessor);
+
+            pBitmap->UnlockBits(&lockedBitmapData);
+        }
+
     private:
 
-        // Create an in-memory stream over a resource. The resource must have been found via FindResource
+        // Lock all the bitmap pixels for read/write access in 32bpp ARGB format
+        static bool LockBitmapBits(_In_ Gdiplus::Bitmap * pBitmap, _Out_ Gdiplus::BitmapData * pLockedBitmapData);
+
+        // Create a read-only stream over a resource, without copying it. The resource must have been found via FindResource
         static HRESULT CreateStreamOnResource( HINSTANCE hInst, HRSRC hResource, _Out_ IStream** ppStream );
 
         // Create a 32bpp ARGB Gdiplus::Bitmap from a DIBSECTION
@@ -167,6 +258,8 @@ namespace VsUI
 
         // Locates the codec for the specified format and calls the save function to save the bitmap
         HRESULT SaveBitmap(const GUID& format, std::function< Gdiplus::Status (_In_ const CLSID * clsidEncoder) > saveFunction );
+        // Writes the image encoded in the memory stream (created by CreateStreamOnHGlobal, and positioned at the end of the image) to the stream
+        static HRESULT CopyEncodedImage( _In_ IStream* pBuffer, _In_ IStream* pStream );
 
     private:
         static CInitGDIPlus s_initGDIPlus;
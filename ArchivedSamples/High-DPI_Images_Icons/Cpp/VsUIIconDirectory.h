@@ -0,0 +1,253 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Directory of the frames of an icon, parsed from an RT_GROUP_ICON resource or
+// from the header of a .ico file
+// Both start with the same 6-byte header (reserved 0, type 1, frame count),
+// followed by 14-byte entries in resources (ending with the RT_ICON id of the
+// frame) and 16-byte entries in files (ending with the file offset of the
+// frame). SelectFrame picks the frame to create a device icon from: the
+// smallest frame at or above the device size, so the icon is either used as
+// authored or scaled down, and only scaled up when no frame is large enough.
+// CIconResourceIndex keeps the parsed directories of the icon resources of
+// each module, so a resource is only parsed the first time it's loaded.
+// Doesn't depend on Windows: the resource bytes are provided by the caller.
+//-----------------------------------------------------------------------------
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace VsUI
+{
+    class CIconDirectory
+    {
+    public:
+        enum class Format
+        {
+            Resource,   // RT_GROUP_ICON resource
+            File,       // .ico file
+        };
+
+        struct Frame
+        {
+            int width;
+            int height;
+            int bitCount;       // 0 if neither the bit count nor the color count of the frame are set
+            uint32_t bytes;     // Size of the frame image (DIB or PNG)
+            uint32_t location;  // RT_ICON resource id for resources, offset in the file for files
+        };
+
+        // Parses the directory, replacing the current frames. Returns false if the bytes are not a valid icon directory.
+        // For files, the frames must be within the cb bytes given.
+        bool Parse(const void* pData, size_t cb, Format format)
+        {
+            m_frames.clear();
+
+            const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+            if (pBytes == nullptr || cb < k_HeaderSize)
+                return false;
+
+            // Cursors (type 2) use a different entry layout in resources
+            if (ReadUInt16(pBytes) != 0 || ReadUInt16(pBytes + 2) != 1)
+                return false;
+
+            size_t count = ReadUInt16(pBytes + 4);
+            size_t entrySize = (format == Format::Resource) ? k_ResourceEntrySize : k_FileEntrySize;
+            if (count == 0 || cb < k_HeaderSize + count * entrySize)
+                return false;
+
+            try
+            {
+                m_frames.reserve(count);
+            }
+            catch (const std::bad_alloc&)
+            {
+                return false;
+            }
+
+            for (size_t i = 0; i < count; i++)
+            {
+                const uint8_t* pEntry = pBytes + k_HeaderSize + i * entrySize;
+
+                Frame frame;
+                // A width or height of 0 means 256
+                frame.width = (pEntry[0] != 0) ? pEntry[0] : 256;
+                frame.height = (pEntry[1] != 0) ? pEntry[1] : 256;
+                frame.bitCount = ReadUInt16(pEntry + 6);
+                if (frame.bitCount == 0)
+                {
+                    frame.bitCount = GetBitCountFromColorCount(pEntry[2]);
+                }
+                frame.bytes = ReadUInt32(pEntry + 8);
+                frame.location = (format == Format::Resource) ? ReadUInt16(pEntry + 12) : ReadUInt32(pEntry + 12);
+
+                if (format == Format::File && (frame.location > cb || frame.bytes > cb - frame.location))
+                {
+                    m_frames.clear();
+                    return false;
+                }
+
+                m_frames.push_back(frame);
+            }
+
+            return true;
+        }
+
+        const std::vector<Frame>& GetFrames() const
+        {
+            return m_frames;
+        }
+
+        // Returns the index of the frame to create a width x height icon from, or -1 if there are no frames: the smallest frame
+        // at or above the size, otherwise the largest frame. Frames of the same size are ordered by bit count, the deepest first.
+        int SelectFrame(int width, int height) const
+        {
+            int best = -1;
+            for (size_t i = 0; i < m_frames.size(); i++)
+            {
+                if (best < 0 || IsBetterFrame(m_frames[i], m_frames[best], width, height))
+                {
+                    best = static_cast<int>(i);
+                }
+            }
+
+            return best;
+        }
+
+    private:
+        static const size_t k_HeaderSize = 6;
+        static const size_t k_ResourceEntrySize = 14;
+        static const size_t k_FileEntrySize = 16;
+
+        static uint16_t ReadUInt16(const uint8_t* p)
+        {
+            return static_cast<uint16_t>(p[0] | (p[1] << 8));
+        }
+
+        static uint32_t ReadUInt32(const uint8_t* p)
+        {
+            return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+        }
+
+        // Palette frames may only set their color count (0 meaning 256 or more colors, which leaves the bit count unknown)
+        static int GetBitCountFromColorCount(int colorCount)
+        {
+            int bitCount = 0;
+            while (colorCount != 0 && (1 << bitCount) < colorCount)
+            {
+                bitCount++;
+            }
+            return bitCount;
+        }
+
+        static bool IsBetterFrame(const Frame& frame, const Frame& best, int width, int height)
+        {
+            bool fLargeEnough = frame.width >= width && frame.height >= height;
+            bool fBestLargeEnough = best.width >= width && best.height >= height;
+            if (fLargeEnough != fBestLargeEnough)
+                return fLargeEnough;
+
+            int64_t area = static_cast<int64_t>(frame.width) * frame.height;
+            int64_t bestArea = static_cast<int64_t>(best.width) * best.height;
+            if (area != bestArea)
+            {
+                // The smallest of the frames large enough, or the largest of the frames too small
+                return fLargeEnough ? (area < bestArea) : (area > bestArea);
+            }
+
+            return frame.bitCount > best.bitCount;
+        }
+
+        std::vector<Frame> m_frames;
+    };
+
+    // Parsed directories of icon resources, keyed by module and resource id. Thread safe.
+    // The directories of a module must be removed (or all of them cleared) when the module is unloaded.
+    class CIconResourceIndex
+    {
+    public:
+        // Returns the index shared by the process
+        static CIconResourceIndex& GetInstance()
+        {
+            static CIconResourceIndex s_instance;
+            return s_instance;
+        }
+
+        // Selects the frame to create a width x height icon from (see CIconDirectory::SelectFrame). The first time the resource is used,
+        // loadDirectory(&pData, &cb) is called to get the bytes of its RT_GROUP_ICON resource; it returns false if the resource is not found.
+        // Returns false if the resource can't be loaded or parsed.
+        template <typename TLoadDirectory>
+        bool SelectFrame(const void* pModule, uint32_t resourceId, int width, int height, CIconDirectory::Frame* pFrame, TLoadDirectory&& loadDirectory)
+        {
+            Key key(pModule, resourceId);
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                auto it = m_directories.find(key);
+                if (it != m_directories.end())
+                    return SelectFrame(it->second, width, height, pFrame);
+            }
+
+            // Parse outside the lock; if another thread parses the same resource meanwhile, both get the same directory
+            const void* pData = nullptr;
+            size_t cb = 0;
+            CIconDirectory directory;
+            if (!loadDirectory(&pData, &cb) || !directory.Parse(pData, cb, CIconDirectory::Format::Resource))
+                return false;
+
+            if (!SelectFrame(directory, width, height, pFrame))
+                return false;
+
+            try
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_directories.insert(std::make_pair(key, std::move(directory)));
+            }
+            catch (const std::bad_alloc&)
+            {
+                // Not indexed: the resource is parsed again next time
+            }
+
+            return true;
+        }
+
+        // Removes the directories of the module (e.g. before it's unloaded)
+        void RemoveModule(const void* pModule)
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_directories.erase(m_directories.lower_bound(Key(pModule, 0)), m_directories.upper_bound(Key(pModule, UINT32_MAX)));
+        }
+
+        void Clear()
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_directories.clear();
+        }
+
+    private:
+        typedef std::pair<const void*, uint32_t> Key;
+
+        static bool SelectFrame(const CIconDirectory& directory, int width, int height, CIconDirectory::Frame* pFrame)
+        {
+            int frame = directory.SelectFrame(width, height);
+            if (frame < 0)
+                return false;
+
+            *pFrame = directory.GetFrames()[frame];
+            return true;
+        }
+
+        std::mutex m_lock;
+        std::map<Key, CIconDirectory> m_directories;
+    };
+
+} // namespace
@@ -0,0 +1,313 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Tests of CIconDirectory (parsing RT_GROUP_ICON resources and .ico headers,
+// and selecting the frame for a device size) and of CIconResourceIndex
+//-----------------------------------------------------------------------------
+#include "VsUIIconDirectory.h"
+
+#include "VsUITests.h"
+
+using namespace VsUI;
+
+namespace
+{
+    typedef CIconDirectory::Format Format;
+
+    struct FrameDescription
+    {
+        int width;          // 256 is written as 0
+        int height;
+        int colorCount;
+        int bitCount;
+    };
+
+    const size_t k_FrameImageSize = 40;
+
+    void WriteUInt16(std::vector<uint8_t>* pBytes, uint32_t value)
+    {
+        pBytes->push_back(static_cast<uint8_t>(value));
+        pBytes->push_back(static_cast<uint8_t>(value >> 8));
+    }
+
+    void WriteUInt32(std::vector<uint8_t>* pBytes, uint32_t value)
+    {
+        WriteUInt16(pBytes, value & 0xFFFF);
+        WriteUInt16(pBytes, value >> 16);
+    }
+
+    // Builds an icon directory: the resource entries have the RT_ICON ids 1, 2..., the file entries are followed by the frame images
+    std::vector<uint8_t> MakeDirectory(Format format, const std::vector<FrameDescription>& frames, uint16_t type = 1)
+    {
+        std::vector<uint8_t> bytes;
+        WriteUInt16(&bytes, 0);
+        WriteUInt16(&bytes, type);
+        WriteUInt16(&bytes, static_cast<uint32_t>(frames.size()));
+
+        uint32_t offset = static_cast<uint32_t>(6 + frames.size() * 16);
+        uint32_t id = 1;
+        for (const FrameDescription& frame : frames)
+        {
+            bytes.push_back(static_cast<uint8_t>(frame.width & 0xFF));
+            bytes.push_back(static_cast<uint8_t>(frame.height & 0xFF));
+            bytes.push_back(static_cast<uint8_t>(frame.colorCount));
+            bytes.push_back(0);
+            WriteUInt16(&bytes, 1);
+            WriteUInt16(&bytes, frame.bitCount);
+            WriteUInt32(&bytes, k_FrameImageSize);
+            if (format == Format::File)
+            {
+                WriteUInt32(&bytes, offset);
+                offset += k_FrameImageSize;
+            }
+            else
+            {
+                WriteUInt16(&bytes, id++);
+            }
+        }
+
+        if (format == Format::File)
+        {
+            bytes.resize(bytes.size() + k_FrameImageSize * frames.size());
+        }
+        return bytes;
+    }
+
+    // 16x16 and 32x32 32bpp, a 16-color 32x32 frame that only sets its color count, 48x48 8bpp, and 256x256 32bpp
+    const std::vector<FrameDescription> k_Frames =
+    {
+        { 16, 16, 0, 32 }, { 32, 32, 0, 32 }, { 32, 32, 16, 0 }, { 48, 48, 0, 8 }, { 256, 256, 0, 32 },
+    };
+
+    const CIconDirectory::Frame& Select(const CIconDirectory& directory, int size)
+    {
+        static const CIconDirectory::Frame s_none = {};
+        int index = directory.SelectFrame(size, size);
+        return index >= 0 ? directory.GetFrames()[index] : s_none;
+    }
+}
+
+VSUI_TEST(ParsesResourcesAndFiles)
+{
+    for (Format format : { Format::Resource, Format::File })
+    {
+        std::vector<uint8_t> bytes = MakeDirectory(format, k_Frames);
+        CIconDirectory directory;
+        VSUI_CHECK(directory.Parse(bytes.data(), bytes.size(), format));
+
+        const std::vector<CIconDirectory::Frame>& frames = directory.GetFrames();
+        if (!VSUI_CHECK_EQUAL(k_Frames.size(), frames.size()))
+            continue;
+
+        VSUI_CHECK_EQUAL(16, frames[0].width);
+        VSUI_CHECK_EQUAL(32, frames[0].bitCount);
+        VSUI_CHECK_EQUAL(k_FrameImageSize, frames[0].bytes);
+        VSUI_CHECK_EQUAL(4, frames[2].bitCount);
+        VSUI_CHECK_EQUAL(8, frames[3].bitCount);
+        VSUI_CHECK_EQUAL(256, frames[4].width);
+        VSUI_CHECK_EQUAL(256, frames[4].height);
+
+        if (format == Format::Resource)
+        {
+            VSUI_CHECK_EQUAL(1u, frames[0].location);
+            VSUI_CHECK_EQUAL(5u, frames[4].location);
+        }
+        else
+        {
+            VSUI_CHECK_EQUAL(6 + 16 * k_Frames.size(), frames[0].location);
+            VSUI_CHECK_EQUAL(6 + 16 * k_Frames.size() + 4 * k_FrameImageSize, frames[4].location);
+        }
+    }
+}
+
+VSUI_TEST(ColorCountGivesTheBitCount)
+{
+    const int colorCounts[] = { 2, 16, 0 };
+    const int bitCounts[] = { 1, 4, 0 };
+    for (size_t i = 0; i < 3; i++)
+    {
+        std::vector<uint8_t> bytes = MakeDirectory(Format::Resource, { { 32, 32, colorCounts[i], 0 } });
+        CIconDirectory directory;
+        VSUI_CHECK(directory.Parse(bytes.data(), bytes.size(), Format::Resource));
+        VSUI_CHECK_EQUAL(bitCounts[i], directory.GetFrames()[0].bitCount);
+    }
+}
+
+VSUI_TEST(InvalidDirectoriesAreRejected)
+{
+    CIconDirectory directory;
+    std::vector<uint8_t> bytes = MakeDirectory(Format::Resource, k_Frames);
+    VSUI_CHECK(directory.Parse(bytes.data(), bytes.size(), Format::Resource));
+
+    // Each failure also removes the frames of the previous directory
+    VSUI_CHECK(!directory.Parse(nullptr, 0, Format::Resource));
+    VSUI_CHECK(directory.GetFrames().empty());
+
+    VSUI_CHECK(!directory.Parse(bytes.data(), 5, Format::Resource));
+    VSUI_CHECK(!directory.Parse(bytes.data(), bytes.size() - 1, Format::Resource));
+    VSUI_CHECK(directory.GetFrames().empty());
+
+    std::vector<uint8_t> cursor = MakeDirectory(Format::Resource, k_Frames, 2);
+    VSUI_CHECK(!directory.Parse(cursor.data(), cursor.size(), Format::Resource));
+
+    std::vector<uint8_t> reserved = bytes;
+    reserved[0] = 1;
+    VSUI_CHECK(!directory.Parse(reserved.data(), reserved.size(), Format::Resource));
+
+    std::vector<uint8_t> empty = MakeDirectory(Format::Resource, {});
+    VSUI_CHECK(!directory.Parse(empty.data(), empty.size(), Format::Resource));
+    VSUI_CHECK(directory.GetFrames().empty());
+}
+
+VSUI_TEST(FileFramesMustBeInTheFile)
+{
+    CIconDirectory directory;
+    std::vector<uint8_t> bytes = MakeDirectory(Format::File, k_Frames);
+
+    // Missing the last byte of the last frame image
+    VSUI_CHECK(!directory.Parse(bytes.data(), bytes.size() - 1, Format::File));
+    VSUI_CHECK(directory.GetFrames().empty());
+
+    // Offset past the end, and a size that overflows the offset
+    std::vector<uint8_t> badOffset = bytes;
+    badOffset[6 + 12 + 3] = 0xFF;
+    VSUI_CHECK(!directory.Parse(badOffset.data(), badOffset.size(), Format::File));
+
+    std::vector<uint8_t> badSize = bytes;
+    badSize[6 + 8 + 3] = 0xFF;
+    VSUI_CHECK(!directory.Parse(badSize.data(), badSize.size(), Format::File));
+    VSUI_CHECK(directory.GetFrames().empty());
+}
+
+VSUI_TEST(SelectsTheSmallestFrameLargeEnough)
+{
+    std::vector<uint8_t> bytes = MakeDirectory(Format::Resource, k_Frames);
+    CIconDirectory directory;
+    VSUI_CHECK(directory.Parse(bytes.data(), bytes.size(), Format::Resource));
+
+    VSUI_CHECK_EQUAL(16, Select(directory, 16).width);
+    VSUI_CHECK_EQUAL(32, Select(directory, 20).width);
+    VSUI_CHECK_EQUAL(48, Select(directory, 40).width);
+    VSUI_CHECK_EQUAL(256, Select(directory, 64).width);
+
+    // Frames of the same size: the deepest one
+    VSUI_CHECK_EQUAL(32, Select(directory, 32).width);
+    VSUI_CHECK_EQUAL(32, Select(directory, 32).bitCount);
+    VSUI_CHECK_EQUAL(2u, Select(directory, 32).location);
+}
+
+VSUI_TEST(SelectsTheLargestFrameWhenNoneIsLargeEnough)
+{
+    std::vector<uint8_t> bytes = MakeDirectory(Format::Resource, { { 16, 16, 0, 32 }, { 48, 48, 0, 8 }, { 32, 32, 0, 32 } });
+    CIconDirectory directory;
+    VSUI_CHECK(directory.Parse(bytes.data(), bytes.size(), Format::Resource));
+
+    VSUI_CHECK_EQUAL(48, Select(directory, 64).width);
+    VSUI_CHECK_EQUAL(16, Select(directory, 8).width);
+
+    // Both dimensions must be large enough
+    VSUI_CHECK_EQUAL(48, directory.GetFrames()[directory.SelectFrame(16, 40)].width);
+}
+
+VSUI_TEST(SelectFrameOfEmptyDirectory)
+{
+    CIconDirectory directory;
+    VSUI_CHECK_EQUAL(-1, directory.SelectFrame(32, 32));
+}
+
+VSUI_TEST(IndexParsesEachResourceOnce)
+{
+    CIconResourceIndex index;
+    std::vector<uint8_t> bytes = MakeDirectory(Format::Resource, k_Frames);
+    int loads = 0;
+    auto load = [&](const void** ppData, size_t* pcb)
+    {
+        loads++;
+        *ppData = bytes.data();
+        *pcb = bytes.size();
+        return true;
+    };
+
+    int module = 0;
+    CIconDirectory::Frame frame = {};
+    VSUI_CHECK(index.SelectFrame(&module, 5, 24, 24, &frame, load));
+    VSUI_CHECK_EQUAL(32, frame.width);
+    VSUI_CHECK_EQUAL(2u, frame.location);
+
+    VSUI_CHECK(index.SelectFrame(&module, 5, 48, 48, &frame, load));
+    VSUI_CHECK_EQUAL(48, frame.width);
+    VSUI_CHECK_EQUAL(4u, frame.location);
+    VSUI_CHECK_EQUAL(1, loads);
+
+    // Other resources of the module, and the same resource id in other modules, are parsed separately
+    int otherModule = 0;
+    VSUI_CHECK(index.SelectFrame(&module, 6, 16, 16, &frame, load));
+    VSUI_CHECK(index.SelectFrame(&otherModule, 5, 16, 16, &frame, load));
+    VSUI_CHECK_EQUAL(3, loads);
+}
+
+VSUI_TEST(IndexRemovesTheResourcesOfAModule)
+{
+    CIconResourceIndex index;
+    std::vector<uint8_t> bytes = MakeDirectory(Format::Resource, k_Frames);
+    int loads = 0;
+    auto load = [&](const void** ppData, size_t* pcb)
+    {
+        loads++;
+        *ppData = bytes.data();
+        *pcb = bytes.size();
+        return true;
+    };
+
+    int module = 0;
+    int otherModule = 0;
+    CIconDirectory::Frame frame = {};
+    index.SelectFrame(&module, 1, 16, 16, &frame, load);
+    index.SelectFrame(&module, UINT32_MAX, 16, 16, &frame, load);
+    index.SelectFrame(&otherModule, 1, 16, 16, &frame, load);
+    VSUI_CHECK_EQUAL(3, loads);
+
+    index.RemoveModule(&module);
+    index.SelectFrame(&otherModule, 1, 16, 16, &frame, load);
+    VSUI_CHECK_EQUAL(3, loads);
+    index.SelectFrame(&module, 1, 16, 16, &frame, load);
+    index.SelectFrame(&module, UINT32_MAX, 16, 16, &frame, load);
+    VSUI_CHECK_EQUAL(5, loads);
+
+    index.Clear();
+    index.SelectFrame(&otherModule, 1, 16, 16, &frame, load);
+    VSUI_CHECK_EQUAL(6, loads);
+}
+
+VSUI_TEST(IndexDoesNotKeepFailures)
+{
+    CIconResourceIndex index;
+    std::vector<uint8_t> bytes = MakeDirectory(Format::Resource, k_Frames, 2);
+    int loads = 0;
+    auto loadCursor = [&](const void** ppData, size_t* pcb)
+    {
+        loads++;
+        *ppData = bytes.data();
+        *pcb = bytes.size();
+        return true;
+    };
+    auto loadMissing = [&](const void**, size_t*)
+    {
+        loads++;
+        return false;
+    };
+
+    int module = 0;
+    CIconDirectory::Frame frame = {};
+    VSUI_CHECK(!index.SelectFrame(&module, 1, 16, 16, &frame, loadCursor));
+    VSUI_CHECK(!index.SelectFrame(&module, 1, 16, 16, &frame, loadCursor));
+    VSUI_CHECK(!index.SelectFrame(&module, 2, 16, 16, &frame, loadMissing));
+    VSUI_CHECK(!index.SelectFrame(&module, 2, 16, 16, &frame, loadMissing));
+    VSUI_CHECK_EQUAL(4, loads);
+}
+
+VSUI_TEST_MAIN()
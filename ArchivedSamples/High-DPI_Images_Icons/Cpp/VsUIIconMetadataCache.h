@@ -0,0 +1,269 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Cache of the size and bit depth of icons, and of the icon resource they were
+// loaded from, for the icon conversions that would otherwise get them with
+// GetIconInfoEx (which creates copies of the color and mask bitmaps of the
+// icon every time)
+// Icons are identified by the 32 significant bits of their handle, like
+// windows. Each cache slot is a pair of 64-bit atomics holding the icon with
+// its size, and the icon with its resource, so lookups from any thread don't
+// take a lock. The modules of the resources are kept in a table of
+// k_MaxModules entries, each set once to a module address. Icons larger
+// than k_MaxCachedSize, deeper than 255 bits per pixel, with a resource id
+// above k_MaxCachedResourceId, or from a module past the table, are not cached.
+// The owner of the icons must invalidate the cache when an icon is destroyed,
+// since its handle may be reused by a new icon, so the cache starts disabled
+// and is only enabled by applications that can do so.
+// Doesn't depend on Windows: the metadata of an icon is provided by the caller.
+//-----------------------------------------------------------------------------
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace VsUI
+{
+    class CIconMetadataCache
+    {
+    public:
+        struct Metadata
+        {
+            int width;
+            int height;
+            int bitsPerPixel;
+            // Module and integer id of the icon resource the icon was loaded from, or nullptr and 0
+            const void* pModule;
+            uint32_t resourceId;
+        };
+
+        // Largest width and height cached
+        static const int k_MaxCachedSize = 0xFFF;
+        // Largest resource id cached (resource ids are 16-bit)
+        static const uint32_t k_MaxCachedResourceId = 0xFFFF;
+        // Number of modules whose icons can be cached
+        static const uint32_t k_MaxModules = 64;
+
+        CIconMetadataCache() :
+            m_fEnabled(false), m_invalidations(0)
+        {
+            for (auto& entry : m_entries)
+            {
+                entry.store(0, std::memory_order_relaxed);
+            }
+            for (auto& entry : m_resources)
+            {
+                entry.store(0, std::memory_order_relaxed);
+            }
+            for (auto& module : m_modules)
+            {
+                module.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+
+        // Returns the cache shared by the process
+        static CIconMetadataCache& GetInstance()
+        {
+            static CIconMetadataCache s_instance;
+            return s_instance;
+        }
+
+        // The cache starts disabled. Disabling it also removes all the cached values.
+        void Enable(bool fEnable)
+        {
+            m_fEnabled.store(fEnable);
+            if (!fEnable)
+            {
+                InvalidateAll();
+            }
+        }
+
+        bool IsEnabled() const
+        {
+            return m_fEnabled.load(std::memory_order_relaxed);
+        }
+
+        // Gets the metadata of the icon, calling getMetadata(pMetadata) to get it when it's not cached or when the cache is disabled.
+        // getMetadata returns false if it fails; failures are not cached. Returns the result of getMetadata, or true if cached.
+        template <typename TGetMetadata>
+        bool GetMetadata(uint32_t icon, Metadata* pMetadata, TGetMetadata&& getMetadata)
+        {
+            if (icon == 0 || !IsEnabled())
+                return getMetadata(pMetadata);
+
+            // Both halves are stored for the icon, and both are removed when it's invalidated
+            uint32_t slot = GetSlot(icon);
+            uint64_t value = m_entries[slot].load(std::memory_order_acquire);
+            uint64_t resource = m_resources[slot].load(std::memory_order_acquire);
+            if (static_cast<uint32_t>(value >> 32) == icon && static_cast<uint32_t>(resource >> 32) == icon)
+            {
+                Unpack(static_cast<uint32_t>(value), static_cast<uint32_t>(resource), pMetadata);
+                return true;
+            }
+
+            // Same protocol as CWindowDpiCache: an icon invalidated while we get its metadata either changes the count we check
+            // below, or removes the values we add
+            uint32_t invalidations = m_invalidations.load();
+            if (!getMetadata(pMetadata))
+                return false;
+
+            uint32_t packed;
+            uint32_t packedResource;
+            if (!Pack(*pMetadata, &packed) || !PackResource(*pMetadata, &packedResource))
+                return true;
+
+            uint64_t newValue = (static_cast<uint64_t>(icon) << 32) | packed;
+            uint64_t newResource = (static_cast<uint64_t>(icon) << 32) | packedResource;
+            m_entries[slot].store(newValue);
+            m_resources[slot].store(newResource);
+            if (m_invalidations.load() != invalidations)
+            {
+                m_entries[slot].compare_exchange_strong(newValue, 0);
+                m_resources[slot].compare_exchange_strong(newResource, 0);
+            }
+
+            return true;
+        }
+
+        // Removes the cached metadata of the icon (e.g. when the icon is destroyed)
+        void Invalidate(uint32_t icon)
+        {
+            m_invalidations++;
+
+            uint32_t slot = GetSlot(icon);
+            RemoveEntry(m_entries[slot], icon);
+            RemoveEntry(m_resources[slot], icon);
+        }
+
+        // Removes the cached values of the icons loaded from the module's resources (e.g. before the module is unloaded)
+        void RemoveModule(const void* pModule)
+        {
+            m_invalidations++;
+
+            for (uint32_t module = 0; module < k_MaxModules; module++)
+            {
+                if (m_modules[module].load() != pModule)
+                    continue;
+
+                // The index stays assigned to the module address, which is still correct if another module is loaded there
+                for (auto& entry : m_resources)
+                {
+                    uint64_t value = entry.load();
+                    while ((static_cast<uint32_t>(value) >> 16) == module + 1 && !entry.compare_exchange_weak(value, 0))
+                    {
+                    }
+                }
+            }
+        }
+
+        // Removes all the cached values
+        void InvalidateAll()
+        {
+            m_invalidations++;
+
+            for (auto& entry : m_entries)
+            {
+                entry.store(0);
+            }
+            for (auto& entry : m_resources)
+            {
+                entry.store(0);
+            }
+        }
+
+    private:
+        // Number of icons cached; more icons than this still work, but evict each other
+        static const uint32_t k_SlotBits = 8;
+        static const uint32_t k_SlotCount = 1u << k_SlotBits;
+
+        static uint32_t GetSlot(uint32_t icon)
+        {
+            // Icon handles are multiples of 2 or 4, so mix the bits before taking the slot from the top bits
+            return (icon * 0x9E3779B1u) >> (32 - k_SlotBits);
+        }
+
+        // The low 32 bits of an entry hold the width (12 bits), the height (12 bits) and the bit depth (8 bits)
+        static bool Pack(const Metadata& metadata, uint32_t* pPacked)
+        {
+            if (metadata.width < 0 || metadata.width > k_MaxCachedSize || metadata.height < 0 || metadata.height > k_MaxCachedSize ||
+                metadata.bitsPerPixel < 0 || metadata.bitsPerPixel > 0xFF)
+                return false;
+
+            *pPacked = (static_cast<uint32_t>(metadata.width) << 20) | (static_cast<uint32_t>(metadata.height) << 8) | static_cast<uint32_t>(metadata.bitsPerPixel);
+            return true;
+        }
+
+        // The low 32 bits of a resource entry hold the module index plus one (16 bits) and the resource id (16 bits), or 0 if the icon
+        // wasn't loaded from a resource
+        bool PackResource(const Metadata& metadata, uint32_t* pPacked)
+        {
+            *pPacked = 0;
+            if (metadata.pModule == nullptr)
+                return true;
+
+            uint32_t module = 0;
+            if (metadata.resourceId == 0 || metadata.resourceId > k_MaxCachedResourceId || !GetModuleIndex(metadata.pModule, &module))
+                return false;
+
+            *pPacked = ((module + 1) << 16) | metadata.resourceId;
+            return true;
+        }
+
+        void Unpack(uint32_t packed, uint32_t packedResource, Metadata* pMetadata) const
+        {
+            pMetadata->width = static_cast<int>(packed >> 20);
+            pMetadata->height = static_cast<int>((packed >> 8) & 0xFFF);
+            pMetadata->bitsPerPixel = static_cast<int>(packed & 0xFF);
+            pMetadata->pModule = nullptr;
+            pMetadata->resourceId = 0;
+            if (packedResource != 0)
+            {
+                pMetadata->pModule = m_modules[(packedResource >> 16) - 1].load();
+                pMetadata->resourceId = packedResource & 0xFFFF;
+            }
+        }
+
+        // Returns the index of the module in the module table, adding it to the table if needed. Returns false if the table is full.
+        bool GetModuleIndex(const void* pModule, uint32_t* pIndex)
+        {
+            for (uint32_t module = 0; module < k_MaxModules; module++)
+            {
+                const void* pTableModule = m_modules[module].load();
+                if (pTableModule == nullptr && m_modules[module].compare_exchange_strong(pTableModule, pModule))
+                {
+                    pTableModule = pModule;
+                }
+
+                if (pTableModule == pModule)
+                {
+                    *pIndex = module;
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        static void RemoveEntry(std::atomic<uint64_t>& entry, uint32_t icon)
+        {
+            uint64_t value = entry.load();
+            while (static_cast<uint32_t>(value >> 32) == icon && !entry.compare_exchange_weak(value, 0))
+            {
+            }
+        }
+
+        // Each entry has the icon in the high 32 bits and its packed metadata in the low 32 bits, or 0 when empty
+        std::atomic<uint64_t> m_entries[k_SlotCount];
+        // Same, with the packed resource of the icon
+        std::atomic<uint64_t> m_resources[k_SlotCount];
+        // Modules of the cached resources; entries are only ever set once
+        std::atomic<const void*> m_modules[k_MaxModules];
+        std::atomic<bool> m_fEnabled;
+        std::atomic<uint32_t> m_invalidations;
+    };
+
+} // namespace
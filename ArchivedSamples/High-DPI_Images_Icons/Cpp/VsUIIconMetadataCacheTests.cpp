@@ -0,0 +1,421 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Tests of CIconMetadataCache: what is cached (and the metadata too large to
+// be packed), the resources the icons were loaded from, the pass-through when
+// disabled, and the invalidation of the cached values, including invalidations
+// racing with lookups
+//-----------------------------------------------------------------------------
+#include "VsUIIconMetadataCache.h"
+
+#include <thread>
+#include <vector>
+
+#include "VsUITests.h"
+
+using namespace VsUI;
+
+namespace
+{
+    // Metadata of fake icons, whose handles are multiples of 4, and the number of times it was asked for
+    class CFakeIcons
+    {
+    public:
+        static const uint32_t k_IconCount = 4096;
+
+        CFakeIcons() : m_calls(0)
+        {
+            SetAllSizes(16);
+        }
+
+        void SetSize(uint32_t icon, int size)
+        {
+            m_sizes[icon / 4 % k_IconCount].store(size);
+        }
+
+        void SetAllSizes(int size)
+        {
+            for (auto& iconSize : m_sizes)
+            {
+                iconSize.store(size);
+            }
+        }
+
+        // Returns the width of the icon, or 0 if getting its metadata failed. The icons are twice as high as wide, in 32bpp.
+        int GetWidth(CIconMetadataCache& cache, uint32_t icon)
+        {
+            CIconMetadataCache::Metadata metadata = { 0, 0, 0, nullptr, 0 };
+            bool fGotMetadata = cache.GetMetadata(icon, &metadata, [this, icon](CIconMetadataCache::Metadata* pMetadata)
+            {
+                m_calls++;
+                int size = m_sizes[icon / 4 % k_IconCount].load();
+                pMetadata->width = size;
+                pMetadata->height = 2 * size;
+                pMetadata->bitsPerPixel = 32;
+                return size != 0;
+            });
+
+            if (!fGotMetadata)
+                return 0;
+
+            VSUI_CHECK_EQUAL(2 * metadata.width, metadata.height);
+            VSUI_CHECK_EQUAL(32, metadata.bitsPerPixel);
+            return metadata.width;
+        }
+
+        long GetCalls() const
+        {
+            return m_calls.load();
+        }
+
+    private:
+        std::atomic<int> m_sizes[k_IconCount];
+        std::atomic<long> m_calls;
+    };
+
+    // Gets the metadata of the icon from the cache, or from the given metadata
+    bool GetMetadata(CIconMetadataCache& cache, uint32_t icon, const CIconMetadataCache::Metadata& metadata, CIconMetadataCache::Metadata* pResult, int* pCalls)
+    {
+        return cache.GetMetadata(icon, pResult, [&](CIconMetadataCache::Metadata* pMetadata)
+        {
+            (*pCalls)++;
+            *pMetadata = metadata;
+            return true;
+        });
+    }
+
+    // Icon handles are multiples of 4
+    const uint32_t k_Icon = 0x20004;
+    const uint32_t k_OtherIcon = 0x20008;
+
+    // Modules of icon resources, identified by their address
+    const char k_Module = 0;
+    const char k_OtherModule = 0;
+}
+
+VSUI_TEST(DisabledCachePassesEveryLookupThrough)
+{
+    CIconMetadataCache cache;
+    CFakeIcons icons;
+
+    VSUI_CHECK(!cache.IsEnabled());
+    VSUI_CHECK_EQUAL(16, icons.GetWidth(cache, k_Icon));
+    icons.SetSize(k_Icon, 32);
+    VSUI_CHECK_EQUAL(32, icons.GetWidth(cache, k_Icon));
+    VSUI_CHECK_EQUAL(2, icons.GetCalls());
+
+    // Failures are returned as they are
+    icons.SetSize(k_Icon, 0);
+    VSUI_CHECK_EQUAL(0, icons.GetWidth(cache, k_Icon));
+}
+
+VSUI_TEST(EnabledCacheGetsTheMetadataOnce)
+{
+    CIconMetadataCache cache;
+    CFakeIcons icons;
+    cache.Enable(true);
+
+    VSUI_CHECK(cache.IsEnabled());
+    VSUI_CHECK_EQUAL(16, icons.GetWidth(cache, k_Icon));
+    icons.SetSize(k_Icon, 32);
+    VSUI_CHECK_EQUAL(16, icons.GetWidth(cache, k_Icon));
+    VSUI_CHECK_EQUAL(1, icons.GetCalls());
+}
+
+VSUI_TEST(LargestPackedValuesAreCached)
+{
+    CIconMetadataCache cache;
+    cache.Enable(true);
+
+    const CIconMetadataCache::Metadata largest = { CIconMetadataCache::k_MaxCachedSize, CIconMetadataCache::k_MaxCachedSize, 255, nullptr, 0 };
+    const CIconMetadataCache::Metadata smallest = { 0, 0, 0, nullptr, 0 };
+    int calls = 0;
+    CIconMetadataCache::Metadata result = { 0, 0, 0, nullptr, 0 };
+    for (int pass = 0; pass < 2; pass++)
+    {
+        VSUI_CHECK(GetMetadata(cache, k_Icon, largest, &result, &calls));
+        VSUI_CHECK_EQUAL(0xFFF, result.width);
+        VSUI_CHECK_EQUAL(0xFFF, result.height);
+        VSUI_CHECK_EQUAL(255, result.bitsPerPixel);
+
+        VSUI_CHECK(GetMetadata(cache, k_OtherIcon, smallest, &result, &calls));
+        VSUI_CHECK_EQUAL(0, result.width);
+        VSUI_CHECK_EQUAL(0, result.height);
+        VSUI_CHECK_EQUAL(0, result.bitsPerPixel);
+    }
+    VSUI_CHECK_EQUAL(2, calls);
+}
+
+VSUI_TEST(MetadataTooLargeToPackIsNotCached)
+{
+    CIconMetadataCache cache;
+    cache.Enable(true);
+
+    // Each of these is returned as it is, but asked for again on every lookup
+    const CIconMetadataCache::Metadata tooLarge[] =
+    {
+        { CIconMetadataCache::k_MaxCachedSize + 1, 16, 32, nullptr, 0 },
+        { 16, CIconMetadataCache::k_MaxCachedSize + 1, 32, nullptr, 0 },
+        { 16, 16, 256, nullptr, 0 },
+        { -1, 16, 32, nullptr, 0 },
+        { 16, 16, 32, &k_Module, CIconMetadataCache::k_MaxCachedResourceId + 1 },
+        { 16, 16, 32, &k_Module, 0 },
+    };
+    for (const CIconMetadataCache::Metadata& metadata : tooLarge)
+    {
+        int calls = 0;
+        for (int pass = 0; pass < 2; pass++)
+        {
+            CIconMetadataCache::Metadata result = { 0, 0, 0, nullptr, 0 };
+            VSUI_CHECK(GetMetadata(cache, k_Icon, metadata, &result, &calls));
+            VSUI_CHECK_EQUAL(metadata.width, result.width);
+            VSUI_CHECK_EQUAL(metadata.height, result.height);
+            VSUI_CHECK_EQUAL(metadata.bitsPerPixel, result.bitsPerPixel);
+            VSUI_CHECK(metadata.pModule == result.pModule);
+            VSUI_CHECK_EQUAL(metadata.resourceId, result.resourceId);
+        }
+        VSUI_CHECK_EQUAL(2, calls);
+    }
+}
+
+VSUI_TEST(ResourcesAreCachedWithTheSize)
+{
+    CIconMetadataCache cache;
+    cache.Enable(true);
+
+    const CIconMetadataCache::Metadata fromResource = { 32, 32, 32, &k_Module, CIconMetadataCache::k_MaxCachedResourceId };
+    const CIconMetadataCache::Metadata fromOtherResource = { 16, 16, 8, &k_OtherModule, 1 };
+    int calls = 0;
+    CIconMetadataCache::Metadata result = { 0, 0, 0, nullptr, 0 };
+    for (int pass = 0; pass < 2; pass++)
+    {
+        VSUI_CHECK(GetMetadata(cache, k_Icon, fromResource, &result, &calls));
+        VSUI_CHECK(result.pModule == &k_Module);
+        VSUI_CHECK_EQUAL(0xFFFFu, result.resourceId);
+        VSUI_CHECK_EQUAL(32, result.width);
+
+        VSUI_CHECK(GetMetadata(cache, k_OtherIcon, fromOtherResource, &result, &calls));
+        VSUI_CHECK(result.pModule == &k_OtherModule);
+        VSUI_CHECK_EQUAL(1u, result.resourceId);
+        VSUI_CHECK_EQUAL(8, result.bitsPerPixel);
+    }
+    VSUI_CHECK_EQUAL(2, calls);
+}
+
+VSUI_TEST(RemoveModuleRemovesOnlyItsIcons)
+{
+    CIconMetadataCache cache;
+    cache.Enable(true);
+
+    const CIconMetadataCache::Metadata fromResource = { 32, 32, 32, &k_Module, 100 };
+    const CIconMetadataCache::Metadata fromOtherResource = { 32, 32, 32, &k_OtherModule, 100 };
+    const CIconMetadataCache::Metadata notFromResource = { 32, 32, 32, nullptr, 0 };
+    const uint32_t k_ThirdIcon = 0x2000C;
+    int calls = 0;
+    CIconMetadataCache::Metadata result = { 0, 0, 0, nullptr, 0 };
+    GetMetadata(cache, k_Icon, fromResource, &result, &calls);
+    GetMetadata(cache, k_OtherIcon, fromOtherResource, &result, &calls);
+    GetMetadata(cache, k_ThirdIcon, notFromResource, &result, &calls);
+
+    cache.RemoveModule(&k_Module);
+    GetMetadata(cache, k_OtherIcon, fromOtherResource, &result, &calls);
+    VSUI_CHECK(result.pModule == &k_OtherModule);
+    GetMetadata(cache, k_ThirdIcon, notFromResource, &result, &calls);
+    VSUI_CHECK(result.pModule == nullptr);
+    VSUI_CHECK_EQUAL(3, calls);
+
+    // A module loaded at the same address afterwards is cached again
+    GetMetadata(cache, k_Icon, fromResource, &result, &calls);
+    GetMetadata(cache, k_Icon, fromResource, &result, &calls);
+    VSUI_CHECK(result.pModule == &k_Module);
+    VSUI_CHECK_EQUAL(100u, result.resourceId);
+    VSUI_CHECK_EQUAL(4, calls);
+}
+
+VSUI_TEST(ModulesPastTheTableAreNotCached)
+{
+    CIconMetadataCache cache;
+    cache.Enable(true);
+
+    // Icons of k_MaxModules different modules fill the table; the icons of one more module are asked for every time
+    std::vector<char> modules(CIconMetadataCache::k_MaxModules + 1);
+    int calls = 0;
+    CIconMetadataCache::Metadata result = { 0, 0, 0, nullptr, 0 };
+    for (uint32_t module = 0; module <= CIconMetadataCache::k_MaxModules; module++)
+    {
+        const CIconMetadataCache::Metadata metadata = { 16, 16, 32, &modules[module], module + 1 };
+        uint32_t icon = 4 * (module + 1);
+        for (int pass = 0; pass < 2; pass++)
+        {
+            VSUI_CHECK(GetMetadata(cache, icon, metadata, &result, &calls));
+            VSUI_CHECK(result.pModule == &modules[module]);
+            VSUI_CHECK_EQUAL(module + 1, result.resourceId);
+        }
+    }
+    VSUI_CHECK_EQUAL(static_cast<int>(CIconMetadataCache::k_MaxModules + 2), calls);
+}
+
+VSUI_TEST(InvalidateRemovesOnlyTheIcon)
+{
+    CIconMetadataCache cache;
+    CFakeIcons icons;
+    cache.Enable(true);
+    icons.GetWidth(cache, k_Icon);
+    icons.GetWidth(cache, k_OtherIcon);
+
+    icons.SetSize(k_Icon, 24);
+    icons.SetSize(k_OtherIcon, 24);
+    cache.Invalidate(k_Icon);
+
+    VSUI_CHECK_EQUAL(24, icons.GetWidth(cache, k_Icon));
+    VSUI_CHECK_EQUAL(16, icons.GetWidth(cache, k_OtherIcon));
+    VSUI_CHECK_EQUAL(3, icons.GetCalls());
+}
+
+VSUI_TEST(DisablingRemovesEveryIcon)
+{
+    CIconMetadataCache cache;
+    CFakeIcons icons;
+    cache.Enable(true);
+    for (uint32_t icon = 4; icon <= 64; icon += 4)
+    {
+        icons.GetWidth(cache, icon);
+    }
+
+    icons.SetAllSizes(48);
+    cache.Enable(false);
+    cache.Enable(true);
+    for (uint32_t icon = 4; icon <= 64; icon += 4)
+    {
+        VSUI_CHECK_EQUAL(48, icons.GetWidth(cache, icon));
+    }
+    VSUI_CHECK_EQUAL(32, icons.GetCalls());
+}
+
+VSUI_TEST(FailuresAndNullIconsAreNotCached)
+{
+    CIconMetadataCache cache;
+    CFakeIcons icons;
+    cache.Enable(true);
+
+    icons.SetSize(k_Icon, 0);
+    VSUI_CHECK_EQUAL(0, icons.GetWidth(cache, k_Icon));
+    icons.SetSize(k_Icon, 20);
+    VSUI_CHECK_EQUAL(20, icons.GetWidth(cache, k_Icon));
+    VSUI_CHECK_EQUAL(20, icons.GetWidth(cache, k_Icon));
+    VSUI_CHECK_EQUAL(2, icons.GetCalls());
+
+    icons.GetWidth(cache, 0);
+    icons.GetWidth(cache, 0);
+    VSUI_CHECK_EQUAL(4, icons.GetCalls());
+}
+
+VSUI_TEST(IconsSharingASlotGetTheirOwnMetadata)
+{
+    // More icons than slots: they evict each other, but each lookup still returns the metadata of its icon
+    CIconMetadataCache cache;
+    CFakeIcons icons;
+    cache.Enable(true);
+    for (uint32_t icon = 4; icon < 4 * CFakeIcons::k_IconCount; icon += 4)
+    {
+        icons.SetSize(icon, 1 + icon % 1000);
+    }
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (uint32_t icon = 4; icon < 4 * CFakeIcons::k_IconCount; icon += 4)
+        {
+            if (!VSUI_CHECK_EQUAL(static_cast<int>(1 + icon % 1000), icons.GetWidth(cache, icon)))
+                return;
+        }
+    }
+}
+
+VSUI_TEST(InvalidationDuringFillIsNotLost)
+{
+    // The icon is destroyed, and its handle reused, while the cache is getting the metadata of the old icon: it must not stay cached
+    CIconMetadataCache cache;
+    cache.Enable(true);
+    const CIconMetadataCache::Metadata newIcon = { 32, 32, 32, nullptr, 0 };
+    int calls = 0;
+    CIconMetadataCache::Metadata result = { 0, 0, 0, nullptr, 0 };
+
+    VSUI_CHECK(cache.GetMetadata(k_Icon, &result, [&](CIconMetadataCache::Metadata* pMetadata)
+    {
+        pMetadata->width = pMetadata->height = 16;
+        pMetadata->bitsPerPixel = 32;
+        cache.Invalidate(k_Icon);
+        return true;
+    }));
+    VSUI_CHECK_EQUAL(16, result.width);
+    VSUI_CHECK(GetMetadata(cache, k_Icon, newIcon, &result, &calls));
+    VSUI_CHECK_EQUAL(32, result.width);
+    VSUI_CHECK_EQUAL(1, calls);
+
+    VSUI_CHECK(cache.GetMetadata(k_OtherIcon, &result, [&](CIconMetadataCache::Metadata* pMetadata)
+    {
+        pMetadata->width = pMetadata->height = 16;
+        pMetadata->bitsPerPixel = 32;
+        cache.InvalidateAll();
+        return true;
+    }));
+    VSUI_CHECK(GetMetadata(cache, k_OtherIcon, newIcon, &result, &calls));
+    VSUI_CHECK_EQUAL(32, result.width);
+    VSUI_CHECK_EQUAL(2, calls);
+}
+
+VSUI_TEST(ConcurrentLookupsSeeInvalidations)
+{
+    // Readers keep looking up icons while they're replaced: once an icon is invalidated, every lookup returns the new metadata
+    CIconMetadataCache cache;
+    CFakeIcons icons;
+    cache.Enable(true);
+
+    std::atomic<bool> fStop(false);
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; i++)
+    {
+        readers.emplace_back([&]
+        {
+            while (!fStop.load())
+            {
+                for (uint32_t icon = 4; icon < 2400; icon += 4)
+                {
+                    icons.GetWidth(cache, icon);
+                }
+            }
+        });
+    }
+
+    for (int round = 0; round < 200; round++)
+    {
+        int size = 16 + round;
+        icons.SetAllSizes(size);
+        cache.InvalidateAll();
+        for (uint32_t icon = 4; icon < 2400; icon += 4)
+        {
+            if (!VSUI_CHECK_EQUAL(size, icons.GetWidth(cache, icon)))
+                break;
+        }
+    }
+
+    for (uint32_t round = 0; round < 2000; round++)
+    {
+        uint32_t icon = 4 * (1 + round % 599);
+        icons.SetSize(icon, static_cast<int>(1000 + round % 1000));
+        cache.Invalidate(icon);
+        VSUI_CHECK_EQUAL(static_cast<int>(1000 + round % 1000), icons.GetWidth(cache, icon));
+    }
+
+    fStop.store(true);
+    for (auto& reader : readers)
+    {
+        reader.join();
+    }
+}
+
+VSUI_TEST_MAIN()
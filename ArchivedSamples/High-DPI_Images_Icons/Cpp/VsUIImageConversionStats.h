@@ -0,0 +1,290 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Counters for the image conversions of CDpiHelper
+// For each entry point (GdiplusImage, HBITMAP, HIMAGELIST and HICON
+// conversions) counts the calls and failures, the scaling modes used, the
+// device pixels produced and the bytes allocated for them, and keeps a
+// histogram of the latencies. Counters are relaxed atomics, so conversions on
+// any thread record without a lock; snapshots are consistent per counter only.
+// Recording starts disabled, and a disabled scope costs a single atomic load.
+// Conversions made while another conversion is measured on the same thread
+// (e.g. the HBITMAP conversion going through a GdiplusImage) are not counted
+// again.
+// Doesn't depend on Windows.
+//-----------------------------------------------------------------------------
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace VsUI
+{
+    class CImageConversionStats
+    {
+    public:
+        enum class EntryPoint
+        {
+            GdiplusImage = 0,
+            Bitmap       = 1,
+            ImageList    = 2,
+            Icon         = 3,
+        };
+
+        static const size_t k_EntryPointCount = 4;
+        // Number of ImageScalingMode values
+        static const size_t k_ScalingModeCount = 7;
+        // Bucket 0 counts the conversions under 1us, bucket i those in [2^(i-1), 2^i) us, and the last one all the longer ones
+        static const size_t k_LatencyBucketCount = 24;
+
+        struct EntryPointSnapshot
+        {
+            uint64_t calls;
+            uint64_t failures;
+            uint64_t pixels;
+            uint64_t bytesAllocated;
+            uint64_t totalMicroseconds;
+            uint64_t scalingModes[k_ScalingModeCount];
+            uint64_t latencyHistogram[k_LatencyBucketCount];
+        };
+
+        struct Snapshot
+        {
+            EntryPointSnapshot entryPoints[k_EntryPointCount];
+        };
+
+        // Measures one conversion, from construction to destruction. Conversions without a result are counted as failures.
+        class CScope
+        {
+        public:
+            explicit CScope(EntryPoint entryPoint, CImageConversionStats& stats = GetInstance()) :
+                m_pStats(nullptr), m_fNested(false), m_entryPoint(entryPoint), m_fSucceeded(false), m_scalingMode(-1), m_pixels(0), m_bytesAllocated(0)
+            {
+                if (!stats.IsEnabled())
+                    return;
+
+                m_fNested = true;
+                if (NestingDepth()++ != 0)
+                    return;
+
+                m_pStats = &stats;
+                m_start = std::chrono::steady_clock::now();
+            }
+
+            ~CScope()
+            {
+                if (!m_fNested)
+                    return;
+
+                NestingDepth()--;
+                if (m_pStats == nullptr)
+                    return;
+
+                uint64_t microseconds = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_start).count());
+                m_pStats->Record(m_entryPoint, m_fSucceeded, m_scalingMode, m_pixels, m_bytesAllocated, microseconds);
+            }
+
+            bool IsEnabled() const
+            {
+                return m_pStats != nullptr;
+            }
+
+            // Sets the result of the conversion. scalingMode is the ImageScalingMode actually used, or -1 if none applies.
+            void SetResult(int scalingMode, uint64_t pixels, uint64_t bytesAllocated)
+            {
+                m_fSucceeded = true;
+                m_scalingMode = scalingMode;
+                m_pixels = pixels;
+                m_bytesAllocated = bytesAllocated;
+            }
+
+        private:
+            CScope(const CScope&);
+            CScope& operator=(const CScope&);
+
+            // Only the outermost measured conversion of each thread is recorded. Scopes created while recording is disabled don't nest.
+            static unsigned int& NestingDepth()
+            {
+                thread_local unsigned int t_depth = 0;
+                return t_depth;
+            }
+
+            // Recording instance, or nullptr when disabled or nested in another scope
+            CImageConversionStats* m_pStats;
+            // Whether the scope counts in the nesting depth of the thread
+            bool m_fNested;
+            EntryPoint m_entryPoint;
+            bool m_fSucceeded;
+            int m_scalingMode;
+            uint64_t m_pixels;
+            uint64_t m_bytesAllocated;
+            std::chrono::steady_clock::time_point m_start;
+        };
+
+        CImageConversionStats() :
+            m_fEnabled(false)
+        {
+            Reset();
+        }
+
+        // Returns the counters shared by the process
+        static CImageConversionStats& GetInstance()
+        {
+            static CImageConversionStats s_instance;
+            return s_instance;
+        }
+
+        // Recording starts disabled. Disabling it keeps the counters.
+        void Enable(bool fEnable)
+        {
+            m_fEnabled.store(fEnable, std::memory_order_relaxed);
+        }
+
+        bool IsEnabled() const
+        {
+            return m_fEnabled.load(std::memory_order_relaxed);
+        }
+
+        void Record(EntryPoint entryPoint, bool fSucceeded, int scalingMode, uint64_t pixels, uint64_t bytesAllocated, uint64_t microseconds)
+        {
+            Counters& counters = m_entryPoints[static_cast<size_t>(entryPoint)];
+            counters.calls.fetch_add(1, std::memory_order_relaxed);
+            if (!fSucceeded)
+            {
+                counters.failures.fetch_add(1, std::memory_order_relaxed);
+            }
+            if (scalingMode >= 0 && static_cast<size_t>(scalingMode) < k_ScalingModeCount)
+            {
+                counters.scalingModes[scalingMode].fetch_add(1, std::memory_order_relaxed);
+            }
+            counters.pixels.fetch_add(pixels, std::memory_order_relaxed);
+            counters.bytesAllocated.fetch_add(bytesAllocated, std::memory_order_relaxed);
+            counters.totalMicroseconds.fetch_add(microseconds, std::memory_order_relaxed);
+            counters.latencyHistogram[GetLatencyBucket(microseconds)].fetch_add(1, std::memory_order_relaxed);
+        }
+
+        Snapshot GetSnapshot() const
+        {
+            Snapshot snapshot;
+            for (size_t i = 0; i < k_EntryPointCount; i++)
+            {
+                const Counters& counters = m_entryPoints[i];
+                EntryPointSnapshot& entryPoint = snapshot.entryPoints[i];
+                entryPoint.calls = counters.calls.load(std::memory_order_relaxed);
+                entryPoint.failures = counters.failures.load(std::memory_order_relaxed);
+                entryPoint.pixels = counters.pixels.load(std::memory_order_relaxed);
+                entryPoint.bytesAllocated = counters.bytesAllocated.load(std::memory_order_relaxed);
+                entryPoint.totalMicroseconds = counters.totalMicroseconds.load(std::memory_order_relaxed);
+                for (size_t mode = 0; mode < k_ScalingModeCount; mode++)
+                {
+                    entryPoint.scalingModes[mode] = counters.scalingModes[mode].load(std::memory_order_relaxed);
+                }
+                for (size_t bucket = 0; bucket < k_LatencyBucketCount; bucket++)
+                {
+                    entryPoint.latencyHistogram[bucket] = counters.latencyHistogram[bucket].load(std::memory_order_relaxed);
+                }
+            }
+            return snapshot;
+        }
+
+        void Reset()
+        {
+            for (Counters& counters : m_entryPoints)
+            {
+                counters.calls.store(0, std::memory_order_relaxed);
+                counters.failures.store(0, std::memory_order_relaxed);
+                counters.pixels.store(0, std::memory_order_relaxed);
+                counters.bytesAllocated.store(0, std::memory_order_relaxed);
+                counters.totalMicroseconds.store(0, std::memory_order_relaxed);
+                for (auto& count : counters.scalingModes)
+                {
+                    count.store(0, std::memory_order_relaxed);
+                }
+                for (auto& count : counters.latencyHistogram)
+                {
+                    count.store(0, std::memory_order_relaxed);
+                }
+            }
+        }
+
+        static const char* GetEntryPointName(EntryPoint entryPoint)
+        {
+            static const char* const s_names[k_EntryPointCount] = { "GdiplusImage", "HBITMAP", "HIMAGELIST", "HICON" };
+            return s_names[static_cast<size_t>(entryPoint)];
+        }
+
+        // Formats the snapshot as a JSON object with one member per entry point, e.g. to write it in a log
+        static std::string FormatJson(const Snapshot& snapshot)
+        {
+            std::string json = "{";
+            for (size_t i = 0; i < k_EntryPointCount; i++)
+            {
+                const EntryPointSnapshot& entryPoint = snapshot.entryPoints[i];
+                char buffer[256];
+                snprintf(buffer, sizeof(buffer), "%s\"%s\":{\"calls\":%llu,\"failures\":%llu,\"pixels\":%llu,\"bytesAllocated\":%llu,\"totalMicroseconds\":%llu",
+                    (i == 0) ? "" : ",", GetEntryPointName(static_cast<EntryPoint>(i)),
+                    static_cast<unsigned long long>(entryPoint.calls), static_cast<unsigned long long>(entryPoint.failures),
+                    static_cast<unsigned long long>(entryPoint.pixels), static_cast<unsigned long long>(entryPoint.bytesAllocated),
+                    static_cast<unsigned long long>(entryPoint.totalMicroseconds));
+                json += buffer;
+
+                AppendJsonArray(&json, "scalingModes", entryPoint.scalingModes, k_ScalingModeCount);
+                AppendJsonArray(&json, "latencyHistogram", entryPoint.latencyHistogram, k_LatencyBucketCount);
+                json += "}";
+            }
+            json += "}";
+            return json;
+        }
+
+    private:
+        struct Counters
+        {
+            std::atomic<uint64_t> calls;
+            std::atomic<uint64_t> failures;
+            std::atomic<uint64_t> pixels;
+            std::atomic<uint64_t> bytesAllocated;
+            std::atomic<uint64_t> totalMicroseconds;
+            std::atomic<uint64_t> scalingModes[k_ScalingModeCount];
+            std::atomic<uint64_t> latencyHistogram[k_LatencyBucketCount];
+        };
+
+        static size_t GetLatencyBucket(uint64_t microseconds)
+        {
+            size_t bucket = 0;
+            while (microseconds != 0 && bucket < k_LatencyBucketCount - 1)
+            {
+                microseconds >>= 1;
+                bucket++;
+            }
+            return bucket;
+        }
+
+        static void AppendJsonArray(std::string* pJson, const char* pszName, const uint64_t* pValues, size_t count)
+        {
+            *pJson += ",\"";
+            *pJson += pszName;
+            *pJson += "\":[";
+            for (size_t i = 0; i < count; i++)
+            {
+                if (i != 0)
+                {
+                    *pJson += ",";
+                }
+                *pJson += std::to_string(pValues[i]);
+            }
+            *pJson += "]";
+        }
+
+        Counters m_entryPoints[k_EntryPointCount];
+        std::atomic<bool> m_fEnabled;
+    };
+
+} // namespace
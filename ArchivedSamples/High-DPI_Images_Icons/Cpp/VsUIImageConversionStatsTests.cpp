@@ -0,0 +1,253 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Tests of CImageConversionStats: only the outermost scope of each thread is
+// recorded, disabled scopes don't count in the nesting, the latencies land in
+// the buckets of their power of two, and the JSON format of the snapshots.
+// Every test uses its own instance, so the shared one stays disabled.
+//-----------------------------------------------------------------------------
+#include "VsUIImageConversionStats.h"
+
+#include <string>
+#include <thread>
+
+#include "VsUITests.h"
+
+using namespace VsUI;
+
+namespace
+{
+    typedef CImageConversionStats::EntryPoint EntryPoint;
+
+    const CImageConversionStats::EntryPointSnapshot& GetEntryPoint(const CImageConversionStats::Snapshot& snapshot, EntryPoint entryPoint)
+    {
+        return snapshot.entryPoints[static_cast<size_t>(entryPoint)];
+    }
+
+    uint64_t GetCalls(const CImageConversionStats& stats, EntryPoint entryPoint)
+    {
+        return GetEntryPoint(stats.GetSnapshot(), entryPoint).calls;
+    }
+
+    // Returns the histogram bucket a single conversion of the given latency is counted in, or -1 if it's not counted in exactly one
+    int GetRecordedBucket(uint64_t microseconds)
+    {
+        CImageConversionStats stats;
+        stats.Record(EntryPoint::Icon, true, -1, 0, 0, microseconds);
+
+        CImageConversionStats::Snapshot snapshot = stats.GetSnapshot();
+        const CImageConversionStats::EntryPointSnapshot& icon = GetEntryPoint(snapshot, EntryPoint::Icon);
+        int recordedBucket = -1;
+        for (size_t bucket = 0; bucket < CImageConversionStats::k_LatencyBucketCount; bucket++)
+        {
+            if (icon.latencyHistogram[bucket] == 1 && recordedBucket == -1)
+            {
+                recordedBucket = static_cast<int>(bucket);
+            }
+            else if (icon.latencyHistogram[bucket] != 0)
+            {
+                return -1;
+            }
+        }
+        return recordedBucket;
+    }
+
+    std::string Zeros(size_t count)
+    {
+        std::string zeros;
+        for (size_t i = 0; i < count; i++)
+        {
+            zeros += (i == 0) ? "0" : ",0";
+        }
+        return zeros;
+    }
+}
+
+VSUI_TEST(ScopesRecordTheirResult)
+{
+    CImageConversionStats stats;
+    stats.Enable(true);
+    {
+        CImageConversionStats::CScope scope(EntryPoint::Bitmap, stats);
+        VSUI_CHECK(scope.IsEnabled());
+        scope.SetResult(2, 100, 400);
+    }
+    {
+        // No result is a failure
+        CImageConversionStats::CScope scope(EntryPoint::Bitmap, stats);
+    }
+    {
+        // Scaling modes out of range aren't counted
+        CImageConversionStats::CScope scope(EntryPoint::Bitmap, stats);
+        scope.SetResult(static_cast<int>(CImageConversionStats::k_ScalingModeCount), 10, 40);
+    }
+
+    CImageConversionStats::Snapshot snapshot = stats.GetSnapshot();
+    const CImageConversionStats::EntryPointSnapshot& bitmap = GetEntryPoint(snapshot, EntryPoint::Bitmap);
+    VSUI_CHECK_EQUAL(3u, bitmap.calls);
+    VSUI_CHECK_EQUAL(1u, bitmap.failures);
+    VSUI_CHECK_EQUAL(110u, bitmap.pixels);
+    VSUI_CHECK_EQUAL(440u, bitmap.bytesAllocated);
+    uint64_t scalingModes = 0;
+    uint64_t latencies = 0;
+    for (uint64_t count : bitmap.scalingModes)
+    {
+        scalingModes += count;
+    }
+    for (uint64_t count : bitmap.latencyHistogram)
+    {
+        latencies += count;
+    }
+    VSUI_CHECK_EQUAL(1u, bitmap.scalingModes[2]);
+    VSUI_CHECK_EQUAL(1u, scalingModes);
+    VSUI_CHECK_EQUAL(3u, latencies);
+    VSUI_CHECK_EQUAL(0u, GetEntryPoint(snapshot, EntryPoint::GdiplusImage).calls);
+
+    stats.Reset();
+    VSUI_CHECK_EQUAL(0u, GetCalls(stats, EntryPoint::Bitmap));
+}
+
+VSUI_TEST(OnlyTheOutermostScopeIsRecorded)
+{
+    CImageConversionStats stats;
+    CImageConversionStats otherStats;
+    stats.Enable(true);
+    otherStats.Enable(true);
+    {
+        CImageConversionStats::CScope outer(EntryPoint::Bitmap, stats);
+        {
+            // The HBITMAP conversion going through a GdiplusImage, even when measured in other counters
+            CImageConversionStats::CScope inner(EntryPoint::GdiplusImage, stats);
+            CImageConversionStats::CScope otherInner(EntryPoint::GdiplusImage, otherStats);
+            VSUI_CHECK(!inner.IsEnabled());
+            VSUI_CHECK(!otherInner.IsEnabled());
+            inner.SetResult(0, 100, 400);
+        }
+        outer.SetResult(1, 200, 800);
+    }
+
+    CImageConversionStats::Snapshot snapshot = stats.GetSnapshot();
+    VSUI_CHECK_EQUAL(1u, GetEntryPoint(snapshot, EntryPoint::Bitmap).calls);
+    VSUI_CHECK_EQUAL(200u, GetEntryPoint(snapshot, EntryPoint::Bitmap).pixels);
+    VSUI_CHECK_EQUAL(0u, GetEntryPoint(snapshot, EntryPoint::GdiplusImage).calls);
+    VSUI_CHECK_EQUAL(0u, GetCalls(otherStats, EntryPoint::GdiplusImage));
+
+    // Once the outer scope is done, the next scope is recorded again
+    {
+        CImageConversionStats::CScope scope(EntryPoint::GdiplusImage, stats);
+        VSUI_CHECK(scope.IsEnabled());
+    }
+    VSUI_CHECK_EQUAL(1u, GetCalls(stats, EntryPoint::GdiplusImage));
+}
+
+VSUI_TEST(ScopesNestPerThread)
+{
+    CImageConversionStats stats;
+    stats.Enable(true);
+    {
+        CImageConversionStats::CScope outer(EntryPoint::Bitmap, stats);
+        std::thread otherThread([&stats]
+        {
+            CImageConversionStats::CScope scope(EntryPoint::Icon, stats);
+        });
+        otherThread.join();
+    }
+
+    VSUI_CHECK_EQUAL(1u, GetCalls(stats, EntryPoint::Bitmap));
+    VSUI_CHECK_EQUAL(1u, GetCalls(stats, EntryPoint::Icon));
+}
+
+VSUI_TEST(DisabledScopesDontNest)
+{
+    CImageConversionStats disabledStats;
+    CImageConversionStats stats;
+    stats.Enable(true);
+    {
+        CImageConversionStats::CScope disabled(EntryPoint::Bitmap, disabledStats);
+        VSUI_CHECK(!disabled.IsEnabled());
+        {
+            CImageConversionStats::CScope scope(EntryPoint::GdiplusImage, stats);
+            VSUI_CHECK(scope.IsEnabled());
+        }
+
+        // Enabling the recording while the disabled scope is alive doesn't make it count when it ends
+        disabledStats.Enable(true);
+    }
+    VSUI_CHECK_EQUAL(0u, GetCalls(disabledStats, EntryPoint::Bitmap));
+    VSUI_CHECK_EQUAL(1u, GetCalls(stats, EntryPoint::GdiplusImage));
+
+    // A scope created enabled is recorded and leaves the nesting even if the recording is disabled meanwhile
+    {
+        CImageConversionStats::CScope scope(EntryPoint::Icon, stats);
+        stats.Enable(false);
+    }
+    VSUI_CHECK_EQUAL(1u, GetCalls(stats, EntryPoint::Icon));
+    stats.Enable(true);
+    {
+        CImageConversionStats::CScope scope(EntryPoint::Icon, stats);
+        VSUI_CHECK(scope.IsEnabled());
+    }
+    VSUI_CHECK_EQUAL(2u, GetCalls(stats, EntryPoint::Icon));
+}
+
+VSUI_TEST(LatenciesAreCountedInTheBucketOfTheirPowerOfTwo)
+{
+    // Bucket 0 counts the conversions under 1us, bucket i those in [2^(i-1), 2^i) us
+    VSUI_CHECK_EQUAL(0, GetRecordedBucket(0));
+    VSUI_CHECK_EQUAL(1, GetRecordedBucket(1));
+    for (int power = 1; power < 22; power++)
+    {
+        uint64_t microseconds = 1ULL << power;
+        if (!VSUI_CHECK_EQUAL(power + 1, GetRecordedBucket(microseconds)) ||
+            !VSUI_CHECK_EQUAL(power, GetRecordedBucket(microseconds - 1)) ||
+            !VSUI_CHECK_EQUAL(power + 1, GetRecordedBucket(2 * microseconds - 1)))
+        {
+            fprintf(stderr, "    2^%d us\n", power);
+            return;
+        }
+    }
+
+    // The last bucket counts all the longer conversions
+    const int lastBucket = static_cast<int>(CImageConversionStats::k_LatencyBucketCount) - 1;
+    VSUI_CHECK_EQUAL(lastBucket - 1, GetRecordedBucket((1ULL << 22) - 1));
+    VSUI_CHECK_EQUAL(lastBucket, GetRecordedBucket(1ULL << 22));
+    VSUI_CHECK_EQUAL(lastBucket, GetRecordedBucket(1ULL << 23));
+    VSUI_CHECK_EQUAL(lastBucket, GetRecordedBucket(1ULL << 40));
+    VSUI_CHECK_EQUAL(lastBucket, GetRecordedBucket(~0ULL));
+}
+
+VSUI_TEST(SnapshotsAreFormattedAsJson)
+{
+    CImageConversionStats stats;
+    stats.Record(EntryPoint::GdiplusImage, true, 1, 2304, 9216, 3);
+    stats.Record(EntryPoint::GdiplusImage, false, -1, 0, 0, 0);
+    stats.Record(EntryPoint::Icon, true, 6, 1024, 4224, 40);
+
+    std::string expected = "{"
+        "\"GdiplusImage\":{\"calls\":2,\"failures\":1,\"pixels\":2304,\"bytesAllocated\":9216,\"totalMicroseconds\":3,"
+            "\"scalingModes\":[0,1,0,0,0,0,0],\"latencyHistogram\":[1,0,1," + Zeros(21) + "]},"
+        "\"HBITMAP\":{\"calls\":0,\"failures\":0,\"pixels\":0,\"bytesAllocated\":0,\"totalMicroseconds\":0,"
+            "\"scalingModes\":[" + Zeros(7) + "],\"latencyHistogram\":[" + Zeros(24) + "]},"
+        "\"HIMAGELIST\":{\"calls\":0,\"failures\":0,\"pixels\":0,\"bytesAllocated\":0,\"totalMicroseconds\":0,"
+            "\"scalingModes\":[" + Zeros(7) + "],\"latencyHistogram\":[" + Zeros(24) + "]},"
+        "\"HICON\":{\"calls\":1,\"failures\":0,\"pixels\":1024,\"bytesAllocated\":4224,\"totalMicroseconds\":40,"
+            "\"scalingModes\":[0,0,0,0,0,0,1],\"latencyHistogram\":[" + Zeros(6) + ",1," + Zeros(17) + "]}"
+        "}";
+
+    std::string json = CImageConversionStats::FormatJson(stats.GetSnapshot());
+    if (!VSUI_CHECK(json == expected))
+    {
+        fprintf(stderr, "    expected %s\n    actual   %s\n", expected.c_str(), json.c_str());
+    }
+
+    // Counters past 32 bits are written in full
+    stats.Reset();
+    stats.Record(EntryPoint::Bitmap, true, -1, 1ULL << 40, 0, 0);
+    VSUI_CHECK(CImageConversionStats::FormatJson(stats.GetSnapshot()).find("\"pixels\":1099511627776") != std::string::npos);
+}
+
+VSUI_TEST_MAIN()
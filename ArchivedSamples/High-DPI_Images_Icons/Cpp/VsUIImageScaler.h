@@ -0,0 +1,790 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Portable scaler for 32bpp ARGB images
+// Implements the interpolation modes CDpiHelper offers through GDI+ (nearest
+// neighbor, bilinear and bicubic, in normal and high quality flavors), plus the
+// unscaled-with-border placement, without depending on Windows or GDI+.
+// The results reproduce Graphics::Clear(background) followed by DrawImage with
+// the half-pixel source offset CDpiHelper uses:
+// - pixel centers are mapped so the image edges line up exactly, and samples
+//   falling outside the source are clamped to the edge pixels;
+// - filtering is done on premultiplied colors, and the result is composed on the
+//   background color and stored with straight (non-premultiplied) alpha, or
+//   kept premultiplied when scaling from a premultiplied source.
+// Nearest neighbor picks the source pixel containing the destination pixel center.
+// Filtered results are within 1 unit per premultiplied channel of the exact
+// filter (taps of each pixel computed in double precision, rounded once), as
+// checked by VsUIImageScalerTests at 125% to 250% and when shrinking. GDI+ has
+// its own kernels and rounding, which aren't documented and can't be run by
+// the portable tests, so the results aren't bit-exact with GDI+ and no bound
+// against it is claimed; straight alpha results of nearly transparent pixels
+// can differ more, as unpremultiplying amplifies the rounding.
+// Filtering is separable and polyphase: the fixed-point weights of each pair of
+// sizes are computed once per period of the scale ratio, and cached. The
+// premultiplied source can be shared by several scalings of the same image.
+// The temporary buffers come from the scratch arena of the scaling thread, so
+// scaling images in a row doesn't allocate memory once the arena has grown.
+//-----------------------------------------------------------------------------
+#pragma once
+
+#include "VsUIPixelKernels.h"
+#include "VsUIScratchArena.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <tuple>
+#include <vector>
+
+namespace VsUI
+{
+    class CImageScaler
+    {
+    public:
+        enum class Filter
+        {
+            NearestNeighbor,
+            Bilinear,            // Triangle filter over the 2x2 nearest source pixels
+            Bicubic,             // Cubic convolution (a = -0.5) over the 4x4 nearest source pixels
+            HighQualityBilinear, // Same as Bilinear when enlarging; the filter is widened to cover all source pixels when shrinking
+            HighQualityBicubic,  // Same as Bicubic when enlarging; the filter is widened to cover all source pixels when shrinking
+        };
+
+        // Representation of the alpha channel of the scaled pixels
+        enum class AlphaFormat
+        {
+            Straight,            // Colors are not multiplied by alpha (GDI+ PixelFormat32bppARGB)
+            Premultiplied,       // Colors are multiplied by alpha (GDI+ PixelFormat32bppPARGB, AlphaBlend with AC_SRC_ALPHA)
+        };
+
+        // 32bpp ARGB pixels owned by the caller. The stride is in bytes, and is negative for bottom-up buffers.
+        struct PixelBuffer
+        {
+            uint32_t* pBits;
+            int width;
+            int height;
+            ptrdiff_t stride;
+
+            uint32_t* Row(int y) const
+            {
+                return reinterpret_cast<uint32_t*>(reinterpret_cast<unsigned char*>(pBits) + y * stride);
+            }
+
+            // Returns the buffer of the columns [x, x + count), e.g. one cell of an image strip
+            PixelBuffer Columns(int x, int count) const
+            {
+                PixelBuffer columns = { pBits + x, count, height, stride };
+                return columns;
+            }
+        };
+
+        // Scales the source image to cover the whole destination image.
+        // Returns false if the buffers are invalid or the scratch memory could not be allocated.
+        static bool Scale(const PixelBuffer& source, const PixelBuffer& destination, Filter filter, uint32_t background)
+        {
+            if (!IsValid(source) || !IsValid(destination))
+                return false;
+
+            try
+            {
+                if (filter == Filter::NearestNeighbor)
+                {
+                    ScaleNearestNeighbor(source, destination, background);
+                    return true;
+                }
+
+                std::shared_ptr<const FilterTaps> spHorizontalTaps = GetFilterTaps(source.width, destination.width, filter);
+                PremultipliedSource premultiplied;
+                PremultiplyRows(source, spHorizontalTaps->padBefore, spHorizontalTaps->padAfter, &premultiplied);
+                return ScaleFiltered(premultiplied, destination, filter, background, AlphaFormat::Straight);
+            }
+            catch (const std::bad_alloc&)
+            {
+                return false;
+            }
+        }
+
+        // Source image premultiplied once, to be scaled to several sizes (e.g. the device images of one logical image
+        // for several DPI values). Each row is extended with copies of its edge pixels. The pixels are scratch memory,
+        // so the source is meant to be short lived.
+        struct PremultipliedSource
+        {
+            TScratchBuffer<uint32_t> pixels;
+            int width;
+            int height;
+            int padBefore;
+            int padAfter;
+
+            const uint32_t* Row(int y) const
+            {
+                return pixels.data() + static_cast<size_t>(y) * (padBefore + width + padAfter) + padBefore;
+            }
+
+            uint32_t* Row(int y)
+            {
+                return pixels.data() + static_cast<size_t>(y) * (padBefore + width + padAfter) + padBefore;
+            }
+
+            // The pixels without the padding, e.g. for GDI+ to write the source converted to PixelFormat32bppPARGB
+            PixelBuffer Pixels()
+            {
+                PixelBuffer buffer = { pixels.data() + padBefore, width, height, static_cast<ptrdiff_t>(padBefore + width + padAfter) * 4 };
+                return buffer;
+            }
+        };
+
+        // Premultiplies the source for ScalePremultiplied, with enough padding for scaling it to each of the destinations with the
+        // filter of the same index. Destinations scaled with NearestNeighbor don't use the premultiplied source, and are ignored.
+        // Returns false if the buffers are invalid or we run out of memory.
+        static bool PremultiplySource(const PixelBuffer& source, const PixelBuffer* pDestinations, const Filter* pFilters, size_t count, PremultipliedSource* pPremultiplied)
+        {
+            if (!IsValid(source))
+                return false;
+
+            try
+            {
+                int padBefore = 0;
+                int padAfter = 0;
+                if (!GetSourcePadding(source.width, pDestinations, pFilters, count, &padBefore, &padAfter))
+                    return false;
+
+                PremultiplyRows(source, padBefore, padAfter, pPremultiplied);
+                return true;
+            }
+            catch (const std::bad_alloc&)
+            {
+                return false;
+            }
+        }
+
+        // Allocates a premultiplied source of the given size, padded like PremultiplySource, for pixels that are premultiplied by the caller:
+        // the caller writes them in Pixels(), then calls PadPremultipliedSource. Returns false if the buffers are invalid or we run out of memory.
+        static bool AllocatePremultipliedSource(int width, int height, const PixelBuffer* pDestinations, const Filter* pFilters, size_t count, PremultipliedSource* pPremultiplied)
+        {
+            if (width <= 0 || height <= 0)
+                return false;
+
+            try
+            {
+                int padBefore = 0;
+                int padAfter = 0;
+                if (!GetSourcePadding(width, pDestinations, pFilters, count, &padBefore, &padAfter))
+                    return false;
+
+                AllocateRows(width, height, padBefore, padAfter, pPremultiplied);
+                return true;
+            }
+            catch (const std::bad_alloc&)
+            {
+                return false;
+            }
+        }
+
+        // Extends each row of the premultiplied source with copies of its edge pixels, once the caller has written the pixels
+        static void PadPremultipliedSource(PremultipliedSource* pPremultiplied)
+        {
+            for (int y = 0; y < pPremultiplied->height; y++)
+            {
+                PadRow(pPremultiplied, y);
+            }
+        }
+
+        // Scales the premultiplied source to cover the whole destination image, with the same results as Scale for straight results.
+        // Premultiplied results skip the conversion back to straight alpha. The background is a straight alpha color in both cases.
+        // The premultiplied source is only read, so several destinations can be scaled from it at the same time on different threads.
+        static bool ScalePremultiplied(const PremultipliedSource& premultiplied, const PixelBuffer& destination, Filter filter, uint32_t background, AlphaFormat resultFormat = AlphaFormat::Straight)
+        {
+            if (!IsValid(destination) || filter == Filter::NearestNeighbor)
+                return false;
+
+            try
+            {
+                return ScaleFiltered(premultiplied, destination, filter, background, resultFormat);
+            }
+            catch (const std::bad_alloc&)
+            {
+                return false;
+            }
+        }
+
+        // Draws the source image unscaled, centered in the destination, and fills the border with the background color
+        static bool DrawCentered(const PixelBuffer& source, const PixelBuffer& destination, uint32_t background)
+        {
+            if (!IsValid(source) || !IsValid(destination))
+                return false;
+
+            // Same rounding as the destination rectangle offset used with GDI+
+            int offsetX = (destination.width - source.width) / 2;
+            int offsetY = (destination.height - source.height) / 2;
+
+            for (int y = 0; y < destination.height; y++)
+            {
+                uint32_t* pDestinationRow = destination.Row(y);
+                int sourceY = y - offsetY;
+                for (int x = 0; x < destination.width; x++)
+                {
+                    int sourceX = x - offsetX;
+                    if (sourceY >= 0 && sourceY < source.height && sourceX >= 0 && sourceX < source.width)
+                    {
+                        pDestinationRow[x] = ComposeStraight(source.Row(sourceY)[sourceX], background);
+                    }
+                    else
+                    {
+                        pDestinationRow[x] = background;
+                    }
+                }
+            }
+
+            return true;
+        }
+
+    protected:
+        // Fixed point precision of the filter weights
+        static const int k_WeightBits = 14;
+        static const int k_WeightOne = 1 << k_WeightBits;
+
+        // Filter taps for one dimension. The taps repeat with a period of `phases` destination pixels: the filter
+        // centers of destination pixels i and i + phases are exactly sourceStep source pixels apart (e.g. for 150%,
+        // every 3 destination pixels map to 2 source pixels), so only one period of weights is stored.
+        // Destination pixel n * phases + r reads `taps` source pixels starting at first[r] + n * sourceStep, with
+        // weights[r * taps + k]. The weights of each pixel add up to k_WeightOne, and taps is even so the SIMD
+        // loops can process taps in pairs (the padding weights are 0).
+        // Indices may fall outside the source, which is then extended with its edge pixels; padBefore and padAfter
+        // are the number of such pixels needed on each side.
+        struct FilterTaps
+        {
+            int taps;
+            int phases;
+            int sourceStep;
+            int padBefore;
+            int padAfter;
+            std::vector<int> first;
+            std::vector<int16_t> weights;
+
+            int First(int destinationPixel) const
+            {
+                return first[destinationPixel % phases] + (destinationPixel / phases) * sourceStep;
+            }
+
+            const int16_t* Weights(int destinationPixel) const
+            {
+                return &weights[static_cast<size_t>(destinationPixel % phases) * taps];
+            }
+        };
+
+        static bool IsValid(const PixelBuffer& buffer)
+        {
+            return buffer.pBits != nullptr && buffer.width > 0 && buffer.height > 0;
+        }
+
+        static bool IsHighQuality(Filter filter)
+        {
+            return filter == Filter::HighQualityBilinear || filter == Filter::HighQualityBicubic;
+        }
+
+        static bool IsBicubic(Filter filter)
+        {
+            return filter == Filter::Bicubic || filter == Filter::HighQualityBicubic;
+        }
+
+        static double FilterRadius(Filter filter)
+        {
+            return IsBicubic(filter) ? 2.0 : 1.0;
+        }
+
+        static double FilterWeight(Filter filter, double t)
+        {
+            t = std::fabs(t);
+            if (IsBicubic(filter))
+            {
+                // Keys cubic convolution with a = -0.5 (Catmull-Rom)
+                const double a = -0.5;
+                if (t < 1.0)
+                    return ((a + 2.0) * t - (a + 3.0)) * t * t + 1.0;
+                if (t < 2.0)
+                    return ((a * t - 5.0 * a) * t + 8.0 * a) * t - 4.0 * a;
+                return 0.0;
+            }
+
+            return (t < 1.0) ? 1.0 - t : 0.0;
+        }
+
+        // Returns the filter taps mapping sourceSize pixels to destinationSize pixels. The taps only depend on the sizes and the
+        // filter, so they are computed once and shared by all the images scaled between the same sizes.
+        static std::shared_ptr<const FilterTaps> GetFilterTaps(int sourceSize, int destinationSize, Filter filter)
+        {
+            typedef std::tuple<int, int, Filter> FilterTapsKey;
+            static std::mutex s_lock;
+            static std::map<FilterTapsKey, std::shared_ptr<const FilterTaps>> s_filterTaps;
+
+            FilterTapsKey key(sourceSize, destinationSize, filter);
+            {
+                std::lock_guard<std::mutex> lock(s_lock);
+                auto iter = s_filterTaps.find(key);
+                if (iter != s_filterTaps.end())
+                    return iter->second;
+            }
+
+            std::shared_ptr<FilterTaps> spTaps = std::make_shared<FilterTaps>();
+            ComputeFilterTaps(sourceSize, destinationSize, filter, spTaps.get());
+
+            std::lock_guard<std::mutex> lock(s_lock);
+            // Icons come in a handful of sizes; if many different sizes show up, start over rather than grow unbounded
+            if (s_filterTaps.size() >= k_MaxCachedFilterTaps)
+                s_filterTaps.clear();
+            s_filterTaps[key] = spTaps;
+            return spTaps;
+        }
+
+        // Enough for the icon sizes scaled to the DPI of several monitors with each filter, so bulk scaling doesn't recompute taps
+        static const size_t k_MaxCachedFilterTaps = 256;
+
+        // Computes the filter taps mapping sourceSize pixels to destinationSize pixels
+        static void ComputeFilterTaps(int sourceSize, int destinationSize, Filter filter, FilterTaps* pTaps)
+        {
+            double scale = static_cast<double>(destinationSize) / sourceSize;
+
+            // When shrinking, the high quality modes stretch the filter so every source pixel contributes to the result
+            double filterScale = (IsHighQuality(filter) && scale < 1.0) ? 1.0 / scale : 1.0;
+            double support = FilterRadius(filter) * filterScale;
+
+            // The filter centers repeat (shifted by sourceStep pixels) every `phases` destination pixels
+            int divisor = GreatestCommonDivisor(sourceSize, destinationSize);
+            int phases = destinationSize / divisor;
+            pTaps->phases = phases;
+            pTaps->sourceStep = sourceSize / divisor;
+
+            // Range of source pixels under the filter for each phase
+            std::vector<int> low(phases);
+            std::vector<int> high(phases);
+            int maxCount = 1;
+            for (int r = 0; r < phases; r++)
+            {
+                double center = FilterCenter(r, sourceSize, destinationSize);
+                low[r] = static_cast<int>(std::ceil(center - support - 0.5));
+                high[r] = static_cast<int>(std::floor(center + support - 0.5));
+                if (high[r] - low[r] + 1 > maxCount)
+                    maxCount = high[r] - low[r] + 1;
+            }
+
+            int taps = (maxCount + 1) & ~1;
+            pTaps->taps = taps;
+            pTaps->first = low;
+            pTaps->weights.assign(static_cast<size_t>(phases) * taps, 0);
+
+            for (int r = 0; r < phases; r++)
+            {
+                double center = FilterCenter(r, sourceSize, destinationSize);
+
+                double total = 0.0;
+                for (int j = low[r]; j <= high[r]; j++)
+                {
+                    total += FilterWeight(filter, (j + 0.5 - center) / filterScale);
+                }
+
+                // Normalize to fixed point and give the rounding error to the largest weight, so the weights add up to exactly one
+                int16_t* pWeights = &pTaps->weights[static_cast<size_t>(r) * taps];
+                int fixedTotal = 0;
+                int largest = 0;
+                for (int k = 0; k <= high[r] - low[r]; k++)
+                {
+                    double weight = FilterWeight(filter, (low[r] + k + 0.5 - center) / filterScale);
+                    pWeights[k] = static_cast<int16_t>(std::floor(weight / total * k_WeightOne + 0.5));
+                    fixedTotal += pWeights[k];
+                    if (pWeights[k] > pWeights[largest])
+                        largest = k;
+                }
+                pWeights[largest] = static_cast<int16_t>(pWeights[largest] + k_WeightOne - fixedTotal);
+            }
+
+            int lastFirst = pTaps->First(destinationSize - 1);
+            pTaps->padBefore = (pTaps->first[0] < 0) ? -pTaps->first[0] : 0;
+            pTaps->padAfter = (lastFirst + taps > sourceSize) ? lastFirst + taps - sourceSize : 0;
+        }
+
+        // Position of the center of destination pixel i in source coordinates (source pixel j covers [j, j + 1))
+        static double FilterCenter(int destinationPixel, int sourceSize, int destinationSize)
+        {
+            return (2.0 * destinationPixel + 1.0) * sourceSize / (2.0 * destinationSize);
+        }
+
+        static int GreatestCommonDivisor(int a, int b)
+        {
+            while (b != 0)
+            {
+                int remainder = a % b;
+                a = b;
+                b = remainder;
+            }
+            return a;
+        }
+
+        static void ScaleNearestNeighbor(const PixelBuffer& source, const PixelBuffer& destination, uint32_t background)
+        {
+            // Exact multiples of the source size (200%, 300%, 400% DPI) replicate the pixels without any index lookups
+            if (destination.width % source.width == 0 && destination.height % source.height == 0)
+            {
+                ScaleNearestNeighborIntegral(source, destination, destination.width / source.width, destination.height / source.height, background);
+                return;
+            }
+
+            // Destination pixel i samples the source pixel containing the center of i: floor((i + 0.5) * sourceSize / destinationSize)
+            TScratchBuffer<int> sourceX;
+            if (!sourceX.Allocate(destination.width))
+                throw std::bad_alloc();
+            for (int x = 0; x < destination.width; x++)
+            {
+                sourceX[x] = NearestSourcePixel(x, source.width, destination.width);
+            }
+
+            int previousSourceY = -1;
+            for (int y = 0; y < destination.height; y++)
+            {
+                int sourceY = NearestSourcePixel(y, source.height, destination.height);
+                uint32_t* pDestinationRow = destination.Row(y);
+
+                // Rows sampling the same source row as the previous one are plain copies
+                if (sourceY == previousSourceY)
+                {
+                    memcpy(pDestinationRow, destination.Row(y - 1), destination.width * sizeof(uint32_t));
+                    continue;
+                }
+
+                const uint32_t* pSourceRow = source.Row(sourceY);
+                for (int x = 0; x < destination.width; x++)
+                {
+                    pDestinationRow[x] = ComposeStraight(pSourceRow[sourceX[x]], background);
+                }
+                previousSourceY = sourceY;
+            }
+        }
+
+        // Nearest neighbor scaling by integer factors: each source row is composed once, widened with
+        // CPixelKernels::ReplicatePixels into the first of its destination rows, and that row is copied factorY - 1 times
+        static void ScaleNearestNeighborIntegral(const PixelBuffer& source, const PixelBuffer& destination, int factorX, int factorY, uint32_t background)
+        {
+            TScratchBuffer<uint32_t> composedRow;
+            if (!composedRow.Allocate(source.width))
+                throw std::bad_alloc();
+            for (int sourceY = 0; sourceY < source.height; sourceY++)
+            {
+                const uint32_t* pSourceRow = source.Row(sourceY);
+                for (int x = 0; x < source.width; x++)
+                {
+                    composedRow[x] = ComposeStraight(pSourceRow[x], background);
+                }
+
+                uint32_t* pFirstRow = destination.Row(sourceY * factorY);
+                CPixelKernels::ReplicatePixels(composedRow.data(), source.width, factorX, pFirstRow);
+                for (int repeat = 1; repeat < factorY; repeat++)
+                {
+                    memcpy(destination.Row(sourceY * factorY + repeat), pFirstRow, destination.width * sizeof(uint32_t));
+                }
+            }
+        }
+
+        static int NearestSourcePixel(int destinationPixel, int sourceSize, int destinationSize)
+        {
+            int sourcePixel = static_cast<int>((static_cast<int64_t>(2 * destinationPixel + 1) * sourceSize) / (2 * static_cast<int64_t>(destinationSize)));
+            return (sourcePixel < sourceSize) ? sourcePixel : sourceSize - 1;
+        }
+
+        // Returns the largest padding needed by the horizontal taps of the destinations scaled with a filter, or false if one of them is invalid
+        static bool GetSourcePadding(int sourceWidth, const PixelBuffer* pDestinations, const Filter* pFilters, size_t count, int* pPadBefore, int* pPadAfter)
+        {
+            *pPadBefore = 0;
+            *pPadAfter = 0;
+            for (size_t i = 0; i < count; i++)
+            {
+                if (pFilters[i] == Filter::NearestNeighbor)
+                    continue;
+                if (!IsValid(pDestinations[i]))
+                    return false;
+
+                std::shared_ptr<const FilterTaps> spHorizontalTaps = GetFilterTaps(sourceWidth, pDestinations[i].width, pFilters[i]);
+                *pPadBefore = std::max(*pPadBefore, spHorizontalTaps->padBefore);
+                *pPadAfter = std::max(*pPadAfter, spHorizontalTaps->padAfter);
+            }
+
+            return true;
+        }
+
+        static void AllocateRows(int width, int height, int padBefore, int padAfter, PremultipliedSource* pPremultiplied)
+        {
+            if (!pPremultiplied->pixels.Allocate((static_cast<size_t>(padBefore) + width + padAfter) * height))
+                throw std::bad_alloc();
+            pPremultiplied->width = width;
+            pPremultiplied->height = height;
+            pPremultiplied->padBefore = padBefore;
+            pPremultiplied->padAfter = padAfter;
+        }
+
+        // Fills the padding of the row with copies of its edge pixels
+        static void PadRow(PremultipliedSource* pPremultiplied, int y)
+        {
+            uint32_t* pPremultipliedRow = pPremultiplied->Row(y);
+            std::fill(pPremultipliedRow - pPremultiplied->padBefore, pPremultipliedRow, pPremultipliedRow[0]);
+            std::fill(pPremultipliedRow + pPremultiplied->width, pPremultipliedRow + pPremultiplied->width + pPremultiplied->padAfter, pPremultipliedRow[pPremultiplied->width - 1]);
+        }
+
+        // Premultiplies the source pixels, extending each row with padBefore and padAfter copies of its edge pixels so that the
+        // horizontal filter taps never need clamping
+        static void PremultiplyRows(const PixelBuffer& source, int padBefore, int padAfter, PremultipliedSource* pPremultiplied)
+        {
+            AllocateRows(source.width, source.height, padBefore, padAfter, pPremultiplied);
+
+            for (int y = 0; y < source.height; y++)
+            {
+                const uint32_t* pSourceRow = source.Row(y);
+                uint32_t* pPremultipliedRow = pPremultiplied->Row(y);
+                for (int x = 0; x < source.width; x++)
+                {
+                    pPremultipliedRow[x] = Premultiply(pSourceRow[x]);
+                }
+                PadRow(pPremultiplied, y);
+            }
+        }
+
+        // Two-pass separable scaling. The horizontal pass filters the premultiplied source rows into an intermediate image of
+        // destination width and source height; the vertical pass filters its columns into the destination.
+        static bool ScaleFiltered(const PremultipliedSource& source, const PixelBuffer& destination, Filter filter, uint32_t background, AlphaFormat resultFormat)
+        {
+            std::shared_ptr<const FilterTaps> spHorizontalTaps = GetFilterTaps(source.width, destination.width, filter);
+            std::shared_ptr<const FilterTaps> spVerticalTaps = GetFilterTaps(source.height, destination.height, filter);
+            const FilterTaps& horizontalTaps = *spHorizontalTaps;
+            const FilterTaps& verticalTaps = *spVerticalTaps;
+            if (source.padBefore < horizontalTaps.padBefore || source.padAfter < horizontalTaps.padAfter)
+                return false;
+
+            // Horizontal pass
+            ptrdiff_t intermediateStride = static_cast<ptrdiff_t>(destination.width) * 4;
+            TScratchBuffer<int16_t> intermediate;
+            if (!intermediate.Allocate(static_cast<size_t>(source.height) * intermediateStride))
+                throw std::bad_alloc();
+            for (int y = 0; y < source.height; y++)
+            {
+                const uint32_t* pPremultiplied = source.Row(y);
+                int16_t* pIntermediateRow = &intermediate[static_cast<size_t>(y) * intermediateStride];
+                for (int x = 0; x < destination.width; x++)
+                {
+                    ConvolveRow(pPremultiplied + horizontalTaps.First(x), horizontalTaps.Weights(x), horizontalTaps.taps, pIntermediateRow + 4 * x);
+                }
+            }
+
+            // Vertical pass. Rows outside the source are clamped to the edge rows, then the filtered row is composed on the background
+            TScratchBuffer<const int16_t*> tapRows;
+            if (!tapRows.Allocate(verticalTaps.taps))
+                throw std::bad_alloc();
+            uint32_t premultipliedBackground = Premultiply(background);
+            for (int y = 0; y < destination.height; y++)
+            {
+                int first = verticalTaps.First(y);
+                for (int k = 0; k < verticalTaps.taps; k++)
+                {
+                    int row = std::min(std::max(first + k, 0), source.height - 1);
+                    tapRows[k] = &intermediate[static_cast<size_t>(row) * intermediateStride];
+                }
+
+                uint32_t* pDestinationRow = destination.Row(y);
+                ConvolveColumns(tapRows.data(), verticalTaps.Weights(y), verticalTaps.taps, destination.width, pDestinationRow);
+
+                for (int x = 0; x < destination.width; x++)
+                {
+                    uint32_t pixel = pDestinationRow[x];
+                    if ((pixel >> 24) == 255)
+                        continue;
+
+                    // Where nothing is drawn the background is left untouched, as with GDI+
+                    pixel = ComposePremultiplied(pixel, premultipliedBackground);
+                    if (resultFormat == AlphaFormat::Premultiplied)
+                    {
+                        pDestinationRow[x] = pixel;
+                    }
+                    else
+                    {
+                        pDestinationRow[x] = ((pixel >> 24) == 0) ? background : Unpremultiply(pixel);
+                    }
+                }
+            }
+
+            return true;
+        }
+
+        // Fractional bits kept in the intermediate results between the two passes. Cubic filters overshoot by less than 30%,
+        // so premultiplied channels stay within the int16 range.
+        static const int k_IntermediateBits = 6;
+
+        // Applies the horizontal filter weights to taps consecutive premultiplied pixels; the B, G, R, A results are not clamped
+        static void ConvolveRow(const uint32_t* pPixels, const int16_t* pWeights, int taps, int16_t* pResult)
+        {
+            const int shift = k_WeightBits - k_IntermediateBits;
+
+#if defined(VSUI_PIXELS_SSE2)
+            // Interleave the channels of two pixels as (B0, B1, G0, G1, R0, R1, A0, A1) so one madd applies both of their weights
+            const __m128i vZero = _mm_setzero_si128();
+            __m128i vSum = _mm_set1_epi32(1 << (shift - 1));
+            for (int k = 0; k < taps; k += 2)
+            {
+                __m128i vPair = _mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int>(pPixels[k])), _mm_cvtsi32_si128(static_cast<int>(pPixels[k + 1])));
+                __m128i vChannels = _mm_unpacklo_epi8(vPair, vZero);
+                __m128i vWeights = _mm_set1_epi32(static_cast<int>((static_cast<uint32_t>(static_cast<uint16_t>(pWeights[k + 1])) << 16) | static_cast<uint16_t>(pWeights[k])));
+                vSum = _mm_add_epi32(vSum, _mm_madd_epi16(vChannels, vWeights));
+            }
+
+            vSum = _mm_srai_epi32(vSum, shift);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(pResult), _mm_packs_epi32(vSum, vSum));
+#else
+            int sum[4] = { 1 << (shift - 1), 1 << (shift - 1), 1 << (shift - 1), 1 << (shift - 1) };
+            for (int k = 0; k < taps; k++)
+            {
+                uint32_t pixel = pPixels[k];
+                int weight = pWeights[k];
+                sum[0] += weight * static_cast<int>(pixel & 0xFF);
+                sum[1] += weight * static_cast<int>((pixel >> 8) & 0xFF);
+                sum[2] += weight * static_cast<int>((pixel >> 16) & 0xFF);
+                sum[3] += weight * static_cast<int>(pixel >> 24);
+            }
+
+            for (int c = 0; c < 4; c++)
+            {
+                pResult[c] = static_cast<int16_t>(sum[c] >> shift);
+            }
+#endif
+        }
+
+        // Applies the vertical filter weights to the taps intermediate rows and writes the premultiplied destination row.
+        // The channels are clamped to [0, 255] and the colors to the alpha value (cubic filters can overshoot).
+        static void ConvolveColumns(const int16_t* const* pTapRows, const int16_t* pWeights, int taps, int width, uint32_t* pDestinationRow)
+        {
+            const int shift = k_WeightBits + k_IntermediateBits;
+            int x = 0;
+
+#if defined(VSUI_PIXELS_SSE2)
+            // Two pixels (8 channels) at a time; rows are processed in pairs, interleaved so one madd applies both of their weights
+            for (; x + 2 <= width; x += 2)
+            {
+                __m128i vSumLow = _mm_set1_epi32(1 << (shift - 1));
+                __m128i vSumHigh = vSumLow;
+                for (int k = 0; k < taps; k += 2)
+                {
+                    __m128i vRow0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pTapRows[k] + 4 * x));
+                    __m128i vRow1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pTapRows[k + 1] + 4 * x));
+                    __m128i vWeights = _mm_set1_epi32(static_cast<int>((static_cast<uint32_t>(static_cast<uint16_t>(pWeights[k + 1])) << 16) | static_cast<uint16_t>(pWeights[k])));
+                    vSumLow = _mm_add_epi32(vSumLow, _mm_madd_epi16(_mm_unpacklo_epi16(vRow0, vRow1), vWeights));
+                    vSumHigh = _mm_add_epi32(vSumHigh, _mm_madd_epi16(_mm_unpackhi_epi16(vRow0, vRow1), vWeights));
+                }
+
+                // Saturate to bytes, then clamp the colors to the alpha of their pixel
+                __m128i vChannels = _mm_packs_epi32(_mm_srai_epi32(vSumLow, shift), _mm_srai_epi32(vSumHigh, shift));
+                __m128i vPixels = _mm_packus_epi16(vChannels, vChannels);
+                __m128i vAlpha = _mm_srli_epi32(vPixels, 24);
+                vAlpha = _mm_or_si128(vAlpha, _mm_slli_epi32(vAlpha, 8));
+                vAlpha = _mm_or_si128(vAlpha, _mm_slli_epi32(vAlpha, 16));
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(pDestinationRow + x), _mm_min_epu8(vPixels, vAlpha));
+            }
+#endif
+
+            for (; x < width; x++)
+            {
+                int sum[4] = { 1 << (shift - 1), 1 << (shift - 1), 1 << (shift - 1), 1 << (shift - 1) };
+                for (int k = 0; k < taps; k++)
+                {
+                    const int16_t* pPixel = pTapRows[k] + 4 * x;
+                    int weight = pWeights[k];
+                    for (int c = 0; c < 4; c++)
+                    {
+                        sum[c] += weight * pPixel[c];
+                    }
+                }
+
+                int alpha = ClampChannel(sum[3] >> shift, 255);
+                uint32_t result = static_cast<uint32_t>(alpha) << 24;
+                for (int c = 0; c < 3; c++)
+                {
+                    result |= static_cast<uint32_t>(ClampChannel(sum[c] >> shift, alpha)) << (8 * c);
+                }
+                pDestinationRow[x] = result;
+            }
+        }
+
+        static int ClampChannel(int value, int maxValue)
+        {
+            return (value < 0) ? 0 : ((value > maxValue) ? maxValue : value);
+        }
+
+        // Divides by 255 with rounding, for values in [0, 255 * 255]
+        static uint32_t Div255(uint32_t value)
+        {
+            value += 128;
+            return (value + (value >> 8)) >> 8;
+        }
+
+        static uint32_t Premultiply(uint32_t pixel)
+        {
+            uint32_t alpha = pixel >> 24;
+            if (alpha == 255)
+                return pixel;
+            if (alpha == 0)
+                return 0;
+
+            return (alpha << 24) |
+                   (Div255(((pixel >> 16) & 0xFF) * alpha) << 16) |
+                   (Div255(((pixel >> 8) & 0xFF) * alpha) << 8) |
+                   Div255((pixel & 0xFF) * alpha);
+        }
+
+        static uint32_t Unpremultiply(uint32_t pixel)
+        {
+            uint32_t alpha = pixel >> 24;
+            if (alpha == 255)
+                return pixel;
+            if (alpha == 0)
+                return 0;
+
+            uint32_t result = alpha << 24;
+            for (int shift = 0; shift < 24; shift += 8)
+            {
+                uint32_t channel = (((pixel >> shift) & 0xFF) * 255 + alpha / 2) / alpha;
+                result |= ((channel > 255) ? 255 : channel) << shift;
+            }
+            return result;
+        }
+
+        // Source-over composition of premultiplied pixels
+        static uint32_t ComposePremultiplied(uint32_t pixel, uint32_t premultipliedBackground)
+        {
+            uint32_t inverseAlpha = 255 - (pixel >> 24);
+            if (premultipliedBackground == 0 || inverseAlpha == 0)
+                return pixel;
+
+            uint32_t result = 0;
+            for (int shift = 0; shift < 32; shift += 8)
+            {
+                uint32_t channel = ((pixel >> shift) & 0xFF) + Div255(((premultipliedBackground >> shift) & 0xFF) * inverseAlpha);
+                result |= ((channel > 255) ? 255 : channel) << shift;
+            }
+            return result;
+        }
+
+        // Source-over composition of straight alpha pixels. Opaque pixels, and any visible pixel on a transparent background, are copied unchanged.
+        static uint32_t ComposeStraight(uint32_t pixel, uint32_t background)
+        {
+            uint32_t alpha = pixel >> 24;
+            if (alpha == 0)
+                return background;
+            if (alpha == 255 || (background >> 24) == 0)
+                return pixel;
+
+            return Unpremultiply(ComposePremultiplied(Premultiply(pixel), Premultiply(background)));
+        }
+    };
+
+} // namespace VsUI
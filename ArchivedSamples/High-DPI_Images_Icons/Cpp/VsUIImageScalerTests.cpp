@@ -0,0 +1,583 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Tests of CImageScaler: the identity at 100%, the source pixel picked by
+// nearest neighbor, the unscaled placement of BorderOnly, the clamping of the
+// samples at the edges, constant images, the composition on the background,
+// and the premultiplied sources and results. The nearest neighbor mapping is
+// also checked against the one GDI+ used for CDpiHelper before the native
+// scaler (DrawImage with the source rectangle shifted by half a pixel), and
+// the polyphase filtering against exact filtering with per-pixel taps.
+//-----------------------------------------------------------------------------
+#include "VsUIImageScaler.h"
+#include "VsUIMulDiv.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "VsUITests.h"
+
+using namespace VsUI;
+
+namespace
+{
+    const CImageScaler::Filter k_Filters[] =
+    {
+        CImageScaler::Filter::NearestNeighbor, CImageScaler::Filter::Bilinear, CImageScaler::Filter::Bicubic,
+        CImageScaler::Filter::HighQualityBilinear, CImageScaler::Filter::HighQualityBicubic,
+    };
+
+    const CImageScaler::Filter k_FilteredFilters[] =
+    {
+        CImageScaler::Filter::Bilinear, CImageScaler::Filter::Bicubic,
+        CImageScaler::Filter::HighQualityBilinear, CImageScaler::Filter::HighQualityBicubic,
+    };
+
+    // Pixels of a width x height image, owning its buffer
+    class CImage
+    {
+    public:
+        CImage(int width, int height, uint32_t color = 0) :
+            m_width(width),
+            m_height(height),
+            m_pixels(static_cast<size_t>(width) * height, color)
+        {
+        }
+
+        CImageScaler::PixelBuffer GetBuffer()
+        {
+            CImageScaler::PixelBuffer buffer = { m_pixels.data(), m_width, m_height, static_cast<ptrdiff_t>(m_width) * 4 };
+            return buffer;
+        }
+
+        uint32_t& At(int x, int y)
+        {
+            return m_pixels[static_cast<size_t>(y) * m_width + x];
+        }
+
+        const std::vector<uint32_t>& GetPixels() const
+        {
+            return m_pixels;
+        }
+
+        bool IsConstant(uint32_t color) const
+        {
+            for (uint32_t pixel : m_pixels)
+            {
+                if (pixel != color)
+                    return false;
+            }
+            return true;
+        }
+
+    private:
+        int m_width;
+        int m_height;
+        std::vector<uint32_t> m_pixels;
+    };
+
+    // Opaque random pixels, and transparent black ones (which every filter keeps as they are at 100%)
+    CImage MakeImage(int width, int height, std::mt19937& random)
+    {
+        CImage image(width, height);
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                uint32_t r = random();
+                image.At(x, y) = (r % 8 == 0) ? 0 : (r | 0xFF000000);
+            }
+        }
+        return image;
+    }
+
+    // Exposes the source pixel picked by nearest neighbor
+    class CTestScaler : public CImageScaler
+    {
+    public:
+        using CImageScaler::NearestSourcePixel;
+    };
+
+    // Source pixel picked by GDI+ for destination pixel i, computed in single precision like GDI+ does: the center of i mapped in the
+    // source rectangle starting at -0.5 (where GDI+ puts the centers of the pixels at integer coordinates), rounded to the nearest pixel
+    int GdiplusNearestSourcePixel(int destinationPixel, int sourceSize, int destinationSize)
+    {
+        float scale = static_cast<float>(sourceSize) / static_cast<float>(destinationSize);
+        float sourceX = -0.5f + (static_cast<float>(destinationPixel) + 0.5f) * scale;
+        int sourcePixel = static_cast<int>(floorf(sourceX + 0.5f));
+        return (sourcePixel < 0) ? 0 : (sourcePixel < sourceSize) ? sourcePixel : sourceSize - 1;
+    }
+
+    // Filtering in double precision with the taps of each destination pixel computed directly, and the samples outside the source
+    // clamped to the edge pixels. Gives the premultiplied result of the exact filter, only rounded once.
+    class CExactScaler : public CImageScaler
+    {
+    public:
+        static std::vector<uint32_t> ScalePremultiplied(CImage& source, int sourceWidth, int sourceHeight, int width, int height, Filter filter)
+        {
+            std::vector<double> intermediate(static_cast<size_t>(sourceHeight) * width * 4);
+            for (int x = 0; x < width; x++)
+            {
+                std::vector<int> pixels;
+                std::vector<double> weights = GetTaps(x, sourceWidth, width, filter, &pixels);
+                for (int y = 0; y < sourceHeight; y++)
+                {
+                    for (size_t k = 0; k < weights.size(); k++)
+                    {
+                        uint32_t pixel = Premultiply(source.At(pixels[k], y));
+                        for (int c = 0; c < 4; c++)
+                        {
+                            intermediate[(static_cast<size_t>(y) * width + x) * 4 + c] += weights[k] * ((pixel >> (8 * c)) & 0xFF);
+                        }
+                    }
+                }
+            }
+
+            std::vector<uint32_t> result(static_cast<size_t>(width) * height);
+            for (int y = 0; y < height; y++)
+            {
+                std::vector<int> rows;
+                std::vector<double> weights = GetTaps(y, sourceHeight, height, filter, &rows);
+                for (int x = 0; x < width; x++)
+                {
+                    int channels[4];
+                    for (int c = 0; c < 4; c++)
+                    {
+                        double sum = 0.0;
+                        for (size_t k = 0; k < weights.size(); k++)
+                        {
+                            sum += weights[k] * intermediate[(static_cast<size_t>(rows[k]) * width + x) * 4 + c];
+                        }
+                        channels[c] = static_cast<int>(std::floor(sum + 0.5));
+                    }
+
+                    int alpha = ClampChannel(channels[3], 255);
+                    uint32_t pixel = static_cast<uint32_t>(alpha) << 24;
+                    for (int c = 0; c < 3; c++)
+                    {
+                        pixel |= static_cast<uint32_t>(ClampChannel(channels[c], alpha)) << (8 * c);
+                    }
+                    result[static_cast<size_t>(y) * width + x] = pixel;
+                }
+            }
+            return result;
+        }
+
+    private:
+        static std::vector<double> GetTaps(int destinationPixel, int sourceSize, int destinationSize, Filter filter, std::vector<int>* pPixels)
+        {
+            double scale = static_cast<double>(destinationSize) / sourceSize;
+            double filterScale = (IsHighQuality(filter) && scale < 1.0) ? 1.0 / scale : 1.0;
+            double support = FilterRadius(filter) * filterScale;
+            double center = FilterCenter(destinationPixel, sourceSize, destinationSize);
+
+            std::vector<double> weights;
+            double total = 0.0;
+            for (int j = static_cast<int>(std::ceil(center - support - 0.5)); j <= static_cast<int>(std::floor(center + support - 0.5)); j++)
+            {
+                weights.push_back(FilterWeight(filter, (j + 0.5 - center) / filterScale));
+                pPixels->push_back(std::min(std::max(j, 0), sourceSize - 1));
+                total += weights.back();
+            }
+
+            for (double& weight : weights)
+            {
+                weight /= total;
+            }
+            return weights;
+        }
+    };
+
+    CImage Scale(CImage& source, int width, int height, CImageScaler::Filter filter, uint32_t background)
+    {
+        CImage destination(width, height, 0x12345678);
+        VSUI_CHECK(CImageScaler::Scale(source.GetBuffer(), destination.GetBuffer(), filter, background));
+        return destination;
+    }
+}
+
+VSUI_TEST(HundredPercentIsTheIdentity)
+{
+    std::mt19937 random(1);
+    for (int size : { 1, 2, 3, 16, 17, 32 })
+    {
+        CImage source = MakeImage(size, size + 3, random);
+        for (CImageScaler::Filter filter : k_Filters)
+        {
+            VSUI_CHECK(Scale(source, size, size + 3, filter, 0).GetPixels() == source.GetPixels());
+        }
+    }
+}
+
+VSUI_TEST(NearestNeighborPicksThePixelUnderTheCenter)
+{
+    // Destination pixel i samples the source pixel containing its center: floor((i + 0.5) * sourceSize / destinationSize)
+    const int sizes[][2] = { { 16, 20 }, { 16, 24 }, { 16, 28 }, { 16, 32 }, { 16, 40 }, { 16, 48 }, { 7, 13 }, { 13, 7 }, { 32, 16 }, { 5, 1 } };
+    for (const auto& size : sizes)
+    {
+        int sourceSize = size[0];
+        int destinationSize = size[1];
+        CImage source(sourceSize, sourceSize + 1);
+        for (int y = 0; y < sourceSize + 1; y++)
+        {
+            for (int x = 0; x < sourceSize; x++)
+            {
+                source.At(x, y) = 0xFF000000 | static_cast<uint32_t>(y << 12 | x);
+            }
+        }
+
+        CImage destination = Scale(source, destinationSize, destinationSize + 2, CImageScaler::Filter::NearestNeighbor, 0);
+        for (int y = 0; y < destinationSize + 2; y++)
+        {
+            for (int x = 0; x < destinationSize; x++)
+            {
+                int sourceX = (2 * x + 1) * sourceSize / (2 * destinationSize);
+                int sourceY = (2 * y + 1) * (sourceSize + 1) / (2 * (destinationSize + 2));
+                if (!VSUI_CHECK_EQUAL(source.At(sourceX, sourceY), destination.At(x, y)))
+                {
+                    fprintf(stderr, "    %d to %d, pixel (%d, %d)\n", sourceSize, destinationSize, x, y);
+                    return;
+                }
+            }
+        }
+    }
+}
+
+VSUI_TEST(NearestNeighborMatchesTheGdiplusMapping)
+{
+    // Every DPI from 125% to 400% in steps of 25%, and logical sizes from 1 to 256. The mappings only differ where the center of the
+    // destination pixel falls exactly between two source pixels: the integer mapping always picks the second one, while the
+    // single precision mapping sometimes rounds down to the first one.
+    int ties = 0;
+    int tiesRoundedDown = 0;
+    for (int dpi = 120; dpi <= 384; dpi += 24)
+    {
+        for (int sourceSize = 1; sourceSize <= 256; sourceSize++)
+        {
+            int destinationSize = MulDivReference(sourceSize, dpi, 96);
+            for (int i = 0; i < destinationSize; i++)
+            {
+                int expected = GdiplusNearestSourcePixel(i, sourceSize, destinationSize);
+                int actual = CTestScaler::NearestSourcePixel(i, sourceSize, destinationSize);
+                bool fTie = (static_cast<int64_t>(2 * i + 1) * sourceSize) % (2 * destinationSize) == 0;
+                if (fTie)
+                {
+                    ties++;
+                    if (expected == actual - 1)
+                    {
+                        tiesRoundedDown++;
+                        continue;
+                    }
+                }
+
+                if (!VSUI_CHECK_EQUAL(expected, actual))
+                {
+                    fprintf(stderr, "    %d dpi, %d to %d, pixel %d\n", dpi, sourceSize, destinationSize, i);
+                    return;
+                }
+            }
+        }
+    }
+
+    VSUI_CHECK(tiesRoundedDown * 1000 < ties);
+}
+
+VSUI_TEST(PolyphaseFilteringMatchesTheExactFilter)
+{
+    // The fixed-point weights and intermediate results keep every premultiplied channel within 1 of the exact filter, for the
+    // common DPI factors and for shrinking (where the high quality filters are stretched), with sizes sharing few factors with them
+    const int k_Tolerance = 1;
+    std::mt19937 random(5);
+    for (int percent : { 125, 150, 175, 250, 75, 50 })
+    {
+        for (int size : { 1, 3, 7, 15, 17, 31, 33, 47 })
+        {
+            int destinationSize = MulDivReference(size, percent, 100);
+            if (destinationSize == 0)
+                continue;
+
+            // Random pixels of every opacity, including transparent ones with colors
+            CImage source(size, size + 2);
+            for (int y = 0; y < size + 2; y++)
+            {
+                for (int x = 0; x < size; x++)
+                {
+                    uint32_t r = random();
+                    source.At(x, y) = (r % 4 == 0) ? (r & 0x00FFFFFF) : (r % 4 == 1) ? r : (r | 0xFF000000);
+                }
+            }
+
+            int destinationHeight = MulDivReference(size + 2, percent, 100);
+            for (CImageScaler::Filter filter : k_FilteredFilters)
+            {
+                CImage destination(destinationSize, destinationHeight);
+                CImageScaler::PixelBuffer destinationBuffer = destination.GetBuffer();
+                CImageScaler::PremultipliedSource premultiplied;
+                VSUI_CHECK(CImageScaler::PremultiplySource(source.GetBuffer(), &destinationBuffer, &filter, 1, &premultiplied));
+                VSUI_CHECK(CImageScaler::ScalePremultiplied(premultiplied, destinationBuffer, filter, 0, CImageScaler::AlphaFormat::Premultiplied));
+
+                std::vector<uint32_t> expected = CExactScaler::ScalePremultiplied(source, size, size + 2, destinationSize, destinationHeight, filter);
+                int largestDifference = 0;
+                for (size_t i = 0; i < expected.size(); i++)
+                {
+                    for (int c = 0; c < 32; c += 8)
+                    {
+                        int difference = static_cast<int>((destination.GetPixels()[i] >> c) & 0xFF) - static_cast<int>((expected[i] >> c) & 0xFF);
+                        largestDifference = std::max(largestDifference, std::abs(difference));
+                    }
+                }
+
+                if (!VSUI_CHECK(largestDifference <= k_Tolerance))
+                {
+                    fprintf(stderr, "    filter %d, %d%%, size %d: difference %d\n", static_cast<int>(filter), percent, size, largestDifference);
+                    return;
+                }
+            }
+        }
+    }
+}
+
+VSUI_TEST(DrawCenteredKeepsTheImageUnscaled)
+{
+    std::mt19937 random(2);
+    CImage source = MakeImage(5, 4, random);
+    source.At(1, 1) = 0x80FFFFFF;
+    const uint32_t background = 0xFF000000;
+
+    // Odd borders round toward the top left, like the destination rectangle offset used with GDI+
+    CImage destination(10, 9, 0x12345678);
+    VSUI_CHECK(CImageScaler::DrawCentered(source.GetBuffer(), destination.GetBuffer(), background));
+    for (int y = 0; y < 9; y++)
+    {
+        for (int x = 0; x < 10; x++)
+        {
+            bool fInside = x >= 2 && x < 7 && y >= 2 && y < 6;
+            uint32_t expected = fInside ? source.At(x - 2, y - 2) : background;
+            if (fInside && (expected >> 24) == 0)
+            {
+                expected = background;
+            }
+            else if (fInside && x == 3 && y == 3)
+            {
+                expected = 0xFF808080;
+            }
+            VSUI_CHECK_EQUAL(expected, destination.At(x, y));
+        }
+    }
+
+    // A destination smaller than the source shows its middle
+    CImage cropped(3, 2);
+    VSUI_CHECK(CImageScaler::DrawCentered(source.GetBuffer(), cropped.GetBuffer(), 0));
+    for (int y = 0; y < 2; y++)
+    {
+        for (int x = 0; x < 3; x++)
+        {
+            VSUI_CHECK_EQUAL(source.At(x + 1, y + 1), cropped.At(x, y));
+        }
+    }
+}
+
+VSUI_TEST(SinglePixelSourcesAreClampedEverywhere)
+{
+    for (uint32_t color : { 0xFF3366CCu, 0x80FFFFFFu })
+    {
+        CImage source(1, 1, color);
+        for (CImageScaler::Filter filter : k_Filters)
+        {
+            for (int size : { 1, 2, 3, 5, 20 })
+            {
+                VSUI_CHECK(Scale(source, size, size, filter, 0).IsConstant(color));
+            }
+        }
+    }
+}
+
+VSUI_TEST(SingleColumnSourcesAreClampedAtTheEdges)
+{
+    // Every destination row is the scaled column; when enlarging by 2, the first and last rows of the bilinear filters
+    // sample half a pixel outside the source, which is clamped to the edge pixels
+    std::mt19937 random(3);
+    CImage source(1, 8);
+    for (int y = 0; y < 8; y++)
+    {
+        source.At(0, y) = random() | 0xFF000000;
+    }
+
+    for (CImageScaler::Filter filter : k_Filters)
+    {
+        for (int width : { 1, 2, 5 })
+        {
+            CImage destination = Scale(source, width, 16, filter, 0);
+            for (int y = 0; y < 16; y++)
+            {
+                for (int x = 1; x < width; x++)
+                {
+                    VSUI_CHECK_EQUAL(destination.At(0, y), destination.At(x, y));
+                }
+            }
+
+            if (filter != CImageScaler::Filter::Bicubic && filter != CImageScaler::Filter::HighQualityBicubic)
+            {
+                VSUI_CHECK_EQUAL(source.At(0, 0), destination.At(0, 0));
+                VSUI_CHECK_EQUAL(source.At(0, 7), destination.At(0, 15));
+            }
+        }
+    }
+
+    // The same in the other direction
+    CImage row(8, 1);
+    for (int x = 0; x < 8; x++)
+    {
+        row.At(x, 0) = source.At(0, x);
+    }
+    CImage destination = Scale(row, 16, 3, CImageScaler::Filter::Bilinear, 0);
+    for (int y = 0; y < 3; y++)
+    {
+        VSUI_CHECK_EQUAL(row.At(0, 0), destination.At(0, y));
+        VSUI_CHECK_EQUAL(row.At(7, 0), destination.At(15, y));
+    }
+}
+
+VSUI_TEST(ConstantImagesStayConstant)
+{
+    // The weights of every destination pixel add up to exactly one, so the filters don't change a constant image,
+    // even where the cubic filters overshoot
+    for (uint32_t color : { 0xFF000000u, 0xFFFFFFFFu, 0xFF3366CCu })
+    {
+        CImage source(16, 16, color);
+        for (CImageScaler::Filter filter : k_FilteredFilters)
+        {
+            for (int size : { 20, 24, 28, 32, 40, 48, 64, 12, 8, 3 })
+            {
+                VSUI_CHECK(Scale(source, size, size + 1, filter, 0).IsConstant(color));
+            }
+        }
+    }
+
+    // Translucent colors come back after premultiplying and unpremultiplying
+    CImage translucent(16, 16, 0x80FFFFFF);
+    for (CImageScaler::Filter filter : k_FilteredFilters)
+    {
+        VSUI_CHECK(Scale(translucent, 24, 24, filter, 0).IsConstant(0x80FFFFFF));
+    }
+}
+
+VSUI_TEST(PixelsAreComposedOnTheBackground)
+{
+    CImage source(4, 4, 0x80FFFFFF);
+    source.At(0, 0) = 0x00123456;
+    source.At(1, 0) = 0xFF00FF00;
+
+    // Half transparent white on opaque black gives opaque gray; transparent pixels take the background, opaque ones are kept
+    CImage nearest = Scale(source, 8, 8, CImageScaler::Filter::NearestNeighbor, 0xFF000000);
+    VSUI_CHECK_EQUAL(0xFF000000u, nearest.At(0, 0));
+    VSUI_CHECK_EQUAL(0xFF00FF00u, nearest.At(2, 1));
+    VSUI_CHECK_EQUAL(0xFF808080u, nearest.At(7, 7));
+
+    CImage bilinear = Scale(source, 8, 8, CImageScaler::Filter::Bilinear, 0xFF000000);
+    VSUI_CHECK_EQUAL(0xFF808080u, bilinear.At(7, 7));
+    VSUI_CHECK_EQUAL(0xFFu, bilinear.At(3, 3) >> 24);
+
+    // On a transparent background, visible pixels keep their color, and where nothing is drawn the background is left as is
+    CImage onTransparent = Scale(source, 8, 8, CImageScaler::Filter::NearestNeighbor, 0x00ABCDEF);
+    VSUI_CHECK_EQUAL(0x00ABCDEFu, onTransparent.At(0, 0));
+    VSUI_CHECK_EQUAL(0x80FFFFFFu, onTransparent.At(7, 7));
+
+    CImage transparent(4, 4, 0x00123456);
+    for (CImageScaler::Filter filter : k_Filters)
+    {
+        VSUI_CHECK(Scale(transparent, 6, 6, filter, 0x00ABCDEF).IsConstant(0x00ABCDEF));
+    }
+}
+
+VSUI_TEST(PremultipliedSourceGivesTheSameResults)
+{
+    std::mt19937 random(4);
+    CImage source = MakeImage(16, 16, random);
+    source.At(3, 3) = 0x80FF8000;
+    source.At(4, 3) = 0x01FFFFFF;
+
+    CImage destinations[] = { CImage(20, 20), CImage(24, 24), CImage(12, 12), CImage(40, 40) };
+    CImageScaler::PixelBuffer destinationBuffers[4];
+    for (int i = 0; i < 4; i++)
+    {
+        destinationBuffers[i] = destinations[i].GetBuffer();
+    }
+
+    for (CImageScaler::Filter filter : k_FilteredFilters)
+    {
+        CImageScaler::Filter filters[] = { filter, filter, filter, filter };
+        CImageScaler::PremultipliedSource premultiplied;
+        if (!VSUI_CHECK(CImageScaler::PremultiplySource(source.GetBuffer(), destinationBuffers, filters, 4, &premultiplied)))
+            return;
+
+        // A source premultiplied by the caller, padded by PadPremultipliedSource
+        CImageScaler::PremultipliedSource callerPremultiplied;
+        if (!VSUI_CHECK(CImageScaler::AllocatePremultipliedSource(16, 16, destinationBuffers, filters, 4, &callerPremultiplied)))
+            return;
+        for (int y = 0; y < 16; y++)
+        {
+            std::copy(premultiplied.Row(y), premultiplied.Row(y) + 16, callerPremultiplied.Row(y));
+        }
+        CImageScaler::PadPremultipliedSource(&callerPremultiplied);
+
+        for (int i = 0; i < 4; i++)
+        {
+            int size = destinationBuffers[i].width;
+            CImage expected = Scale(source, size, size, filter, 0xFF204060);
+
+            CImage result(size, size);
+            VSUI_CHECK(CImageScaler::ScalePremultiplied(premultiplied, result.GetBuffer(), filter, 0xFF204060));
+            VSUI_CHECK(result.GetPixels() == expected.GetPixels());
+
+            CImage callerResult(size, size);
+            VSUI_CHECK(CImageScaler::ScalePremultiplied(callerPremultiplied, callerResult.GetBuffer(), filter, 0xFF204060));
+            VSUI_CHECK(callerResult.GetPixels() == expected.GetPixels());
+        }
+    }
+}
+
+VSUI_TEST(PremultipliedResultsSkipUnpremultiplying)
+{
+    CImage source(8, 8, 0x80FFFFFF);
+    CImage destination(12, 12);
+    CImageScaler::PixelBuffer destinationBuffer = destination.GetBuffer();
+    CImageScaler::Filter filter = CImageScaler::Filter::Bicubic;
+
+    CImageScaler::PremultipliedSource premultiplied;
+    VSUI_CHECK(CImageScaler::PremultiplySource(source.GetBuffer(), &destinationBuffer, &filter, 1, &premultiplied));
+    VSUI_CHECK(CImageScaler::ScalePremultiplied(premultiplied, destinationBuffer, filter, 0, CImageScaler::AlphaFormat::Premultiplied));
+    VSUI_CHECK(destination.IsConstant(0x80808080));
+
+    // Composed on an opaque background, the result is opaque, so both formats are the same
+    VSUI_CHECK(CImageScaler::ScalePremultiplied(premultiplied, destinationBuffer, filter, 0xFF000000, CImageScaler::AlphaFormat::Premultiplied));
+    VSUI_CHECK(destination.IsConstant(0xFF808080));
+
+    // Nearest neighbor doesn't use the premultiplied source
+    VSUI_CHECK(!CImageScaler::ScalePremultiplied(premultiplied, destinationBuffer, CImageScaler::Filter::NearestNeighbor, 0));
+}
+
+VSUI_TEST(InvalidBuffersAreRejected)
+{
+    CImage image(4, 4);
+    CImageScaler::PixelBuffer valid = image.GetBuffer();
+    CImageScaler::PixelBuffer empty = { image.GetBuffer().pBits, 0, 4, 16 };
+    CImageScaler::PixelBuffer null = { nullptr, 4, 4, 16 };
+
+    for (CImageScaler::Filter filter : k_Filters)
+    {
+        VSUI_CHECK(!CImageScaler::Scale(empty, valid, filter, 0));
+        VSUI_CHECK(!CImageScaler::Scale(valid, null, filter, 0));
+    }
+    VSUI_CHECK(!CImageScaler::DrawCentered(null, valid, 0));
+    VSUI_CHECK(!CImageScaler::DrawCentered(valid, empty, 0));
+}
+
+VSUI_TEST_MAIN()
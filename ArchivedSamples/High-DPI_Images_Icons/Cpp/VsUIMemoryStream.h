@@ -0,0 +1,119 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Read-only stream over memory owned by someone else (e.g. a module resource)
+// Implements the position and bounds logic of IStream Read/Seek/Stat without
+// copying the data, and without depending on Windows or COM.
+// Like IStream, seeking past the end is allowed and reads there return no data.
+//-----------------------------------------------------------------------------
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace VsUI
+{
+    class CReadOnlyMemoryStream
+    {
+    public:
+        // Same values as STREAM_SEEK_SET, STREAM_SEEK_CUR and STREAM_SEEK_END
+        enum class SeekOrigin
+        {
+            Begin   = 0,
+            Current = 1,
+            End     = 2,
+        };
+
+        CReadOnlyMemoryStream(const void* pData, uint64_t size) :
+            m_pData(static_cast<const unsigned char*>(pData)), m_size(size), m_position(0)
+        {
+        }
+
+        const void* GetData() const
+        {
+            return m_pData;
+        }
+
+        uint64_t GetSize() const
+        {
+            return m_size;
+        }
+
+        uint64_t GetPosition() const
+        {
+            return m_position;
+        }
+
+        // Copies up to cb bytes from the current position and advances it. Returns the number of bytes copied.
+        size_t Read(void* pBuffer, size_t cb)
+        {
+            size_t cbRead = static_cast<size_t>(Remaining(cb));
+            if (cbRead != 0)
+            {
+                memcpy(pBuffer, m_pData + m_position, cbRead);
+                m_position += cbRead;
+            }
+            return cbRead;
+        }
+
+        // Returns the data at the current position and advances it by up to cb bytes, without copying; *pcbAvailable gets the number of bytes skipped
+        const void* Skip(uint64_t cb, uint64_t* pcbAvailable)
+        {
+            const void* pCurrent = m_pData + (m_position < m_size ? m_position : m_size);
+            *pcbAvailable = Remaining(cb);
+            m_position += *pcbAvailable;
+            return pCurrent;
+        }
+
+        // Moves the current position. Returns false, without moving, if the new position would be negative or overflow.
+        bool Seek(int64_t offset, SeekOrigin origin, uint64_t* pNewPosition)
+        {
+            uint64_t base = 0;
+            switch (origin)
+            {
+            case SeekOrigin::Begin:
+                base = 0;
+                break;
+            case SeekOrigin::Current:
+                base = m_position;
+                break;
+            case SeekOrigin::End:
+                base = m_size;
+                break;
+            default:
+                return false;
+            }
+
+            if (offset < 0 ? (static_cast<uint64_t>(-(offset + 1)) + 1 > base) : (static_cast<uint64_t>(offset) > UINT64_MAX - base))
+                return false;
+
+            m_position = base + static_cast<uint64_t>(offset);
+            if (pNewPosition != nullptr)
+            {
+                *pNewPosition = m_position;
+            }
+            return true;
+        }
+
+    private:
+        // Number of bytes, up to cb, between the current position and the end of the data
+        uint64_t Remaining(uint64_t cb) const
+        {
+            if (m_position >= m_size)
+                return 0;
+
+            uint64_t remaining = m_size - m_position;
+            return cb < remaining ? cb : remaining;
+        }
+
+        const unsigned char* m_pData;
+        uint64_t m_size;
+        uint64_t m_position;
+    };
+
+} // namespace
@@ -0,0 +1,164 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Tests of CReadOnlyMemoryStream: reads, seeks and the bounds of both
+//-----------------------------------------------------------------------------
+#include "VsUIMemoryStream.h"
+
+#include <cstring>
+
+#include "VsUITests.h"
+
+using namespace VsUI;
+
+namespace
+{
+    typedef CReadOnlyMemoryStream::SeekOrigin SeekOrigin;
+
+    const char k_Data[] = "abcdefghi";
+    const uint64_t k_DataSize = 9;
+}
+
+VSUI_TEST(ReadAdvancesThePosition)
+{
+    CReadOnlyMemoryStream stream(k_Data, k_DataSize);
+    char buffer[4] = {};
+
+    VSUI_CHECK_EQUAL(4u, stream.Read(buffer, 4));
+    VSUI_CHECK(memcmp(buffer, "abcd", 4) == 0);
+    VSUI_CHECK_EQUAL(4u, stream.GetPosition());
+
+    VSUI_CHECK_EQUAL(4u, stream.Read(buffer, 4));
+    VSUI_CHECK(memcmp(buffer, "efgh", 4) == 0);
+    VSUI_CHECK_EQUAL(8u, stream.GetPosition());
+}
+
+VSUI_TEST(ReadStopsAtTheEnd)
+{
+    CReadOnlyMemoryStream stream(k_Data, k_DataSize);
+    char buffer[20] = {};
+
+    VSUI_CHECK_EQUAL(9u, stream.Read(buffer, sizeof(buffer)));
+    VSUI_CHECK(memcmp(buffer, k_Data, 9) == 0);
+    VSUI_CHECK_EQUAL(k_DataSize, stream.GetPosition());
+    VSUI_CHECK_EQUAL(0u, stream.Read(buffer, 1));
+    VSUI_CHECK_EQUAL(k_DataSize, stream.GetPosition());
+}
+
+VSUI_TEST(ReadOfEmptyStreamReturnsNothing)
+{
+    CReadOnlyMemoryStream stream(nullptr, 0);
+    char buffer[1] = {};
+
+    VSUI_CHECK_EQUAL(0u, stream.Read(buffer, 1));
+    VSUI_CHECK_EQUAL(0u, stream.GetPosition());
+}
+
+VSUI_TEST(SeekFromEachOrigin)
+{
+    CReadOnlyMemoryStream stream(k_Data, k_DataSize);
+    uint64_t position = 0;
+
+    VSUI_CHECK(stream.Seek(3, SeekOrigin::Begin, &position));
+    VSUI_CHECK_EQUAL(3u, position);
+    VSUI_CHECK(stream.Seek(-2, SeekOrigin::Current, &position));
+    VSUI_CHECK_EQUAL(1u, position);
+    VSUI_CHECK(stream.Seek(-1, SeekOrigin::End, &position));
+    VSUI_CHECK_EQUAL(8u, position);
+
+    char c = 0;
+    VSUI_CHECK_EQUAL(1u, stream.Read(&c, 1));
+    VSUI_CHECK_EQUAL('i', c);
+
+    // The new position is optional, like for IStream::Seek
+    VSUI_CHECK(stream.Seek(0, SeekOrigin::Begin, nullptr));
+    VSUI_CHECK_EQUAL(0u, stream.GetPosition());
+}
+
+VSUI_TEST(SeekBeforeTheBeginningFails)
+{
+    CReadOnlyMemoryStream stream(k_Data, k_DataSize);
+    uint64_t position = 42;
+
+    VSUI_CHECK(stream.Seek(4, SeekOrigin::Begin, nullptr));
+    VSUI_CHECK(!stream.Seek(-1, SeekOrigin::Begin, &position));
+    VSUI_CHECK(!stream.Seek(-5, SeekOrigin::Current, &position));
+    VSUI_CHECK(!stream.Seek(-10, SeekOrigin::End, &position));
+    VSUI_CHECK(!stream.Seek(INT64_MIN, SeekOrigin::Current, &position));
+
+    // Failed seeks don't move the stream or write the new position
+    VSUI_CHECK_EQUAL(4u, stream.GetPosition());
+    VSUI_CHECK_EQUAL(42u, position);
+
+    VSUI_CHECK(stream.Seek(-4, SeekOrigin::Current, &position));
+    VSUI_CHECK_EQUAL(0u, position);
+}
+
+VSUI_TEST(SeekPastTheEndIsAllowed)
+{
+    CReadOnlyMemoryStream stream(k_Data, k_DataSize);
+    uint64_t position = 0;
+    char buffer[4] = {};
+
+    VSUI_CHECK(stream.Seek(100, SeekOrigin::Begin, &position));
+    VSUI_CHECK_EQUAL(100u, position);
+    VSUI_CHECK_EQUAL(0u, stream.Read(buffer, sizeof(buffer)));
+    VSUI_CHECK_EQUAL(100u, stream.GetPosition());
+
+    VSUI_CHECK(stream.Seek(-100, SeekOrigin::Current, &position));
+    VSUI_CHECK_EQUAL(0u, position);
+}
+
+VSUI_TEST(SeekOverflowFails)
+{
+    CReadOnlyMemoryStream stream(k_Data, k_DataSize);
+    uint64_t position = 0;
+
+    VSUI_CHECK(stream.Seek(INT64_MAX, SeekOrigin::Begin, &position));
+    VSUI_CHECK(stream.Seek(INT64_MAX, SeekOrigin::Current, &position));
+    VSUI_CHECK_EQUAL(static_cast<uint64_t>(INT64_MAX) * 2, position);
+    VSUI_CHECK(stream.Seek(1, SeekOrigin::Current, &position));
+    VSUI_CHECK_EQUAL(UINT64_MAX, position);
+    VSUI_CHECK(!stream.Seek(1, SeekOrigin::Current, &position));
+    VSUI_CHECK_EQUAL(UINT64_MAX, stream.GetPosition());
+}
+
+VSUI_TEST(SeekWithInvalidOriginFails)
+{
+    CReadOnlyMemoryStream stream(k_Data, k_DataSize);
+    VSUI_CHECK(!stream.Seek(0, static_cast<SeekOrigin>(3), nullptr));
+}
+
+VSUI_TEST(SkipReturnsTheDataWithoutCopying)
+{
+    CReadOnlyMemoryStream stream(k_Data, k_DataSize);
+    uint64_t available = 0;
+
+    VSUI_CHECK(stream.Skip(5, &available) == k_Data);
+    VSUI_CHECK_EQUAL(5u, available);
+    VSUI_CHECK_EQUAL(5u, stream.GetPosition());
+
+    VSUI_CHECK(stream.Skip(10, &available) == k_Data + 5);
+    VSUI_CHECK_EQUAL(4u, available);
+    VSUI_CHECK_EQUAL(k_DataSize, stream.GetPosition());
+
+    VSUI_CHECK(stream.Skip(1, &available) == k_Data + k_DataSize);
+    VSUI_CHECK_EQUAL(0u, available);
+}
+
+VSUI_TEST(SkipPastTheEndReturnsTheEnd)
+{
+    CReadOnlyMemoryStream stream(k_Data, k_DataSize);
+    uint64_t available = 1;
+
+    VSUI_CHECK(stream.Seek(20, SeekOrigin::Begin, nullptr));
+    VSUI_CHECK(stream.Skip(4, &available) == k_Data + k_DataSize);
+    VSUI_CHECK_EQUAL(0u, available);
+    VSUI_CHECK_EQUAL(20u, stream.GetPosition());
+}
+
+VSUI_TEST_MAIN()
@@ -0,0 +1,219 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Unit conversion factors with the exact results of the Win32 MulDiv
+// MulDiv(x, numerator, denominator) multiplies in 64 bits, rounds half away
+// from zero, and returns -1 when the result doesn't fit in an int or the
+// denominator is 0. Converting with it costs a 64-bit division per value.
+// CMulDivFactor precomputes the factor for a fixed numerator and denominator,
+// so converting a value costs a multiplication and no division, with the
+// same results as MulDiv for every int value. TMulDivConstant does the same for factors
+// known at compile time (e.g. 96dpi to 144dpi), as constant expressions.
+// Arrays of coordinates (POINT, SIZE and RECT arrays) are converted with SSE2
+// when available, still with the same results as MulDiv for every value.
+// Doesn't depend on Windows.
+//-----------------------------------------------------------------------------
+#pragma once
+
+#include <climits>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#if defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define VSUI_MULDIV_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace VsUI
+{
+    // Same results as the Win32 MulDiv. Used for the factors CMulDivFactor can't divide exactly, and as the reference for the others.
+    inline int MulDivReference(int x, int numerator, int denominator)
+    {
+        if (denominator == 0)
+            return -1;
+
+        int64_t multiplicand = x;
+        int64_t divisor = denominator;
+        if (divisor < 0)
+        {
+            multiplicand = -multiplicand;
+            divisor = -divisor;
+        }
+
+        // Rounds half away from zero: the division truncates towards zero
+        int64_t product = multiplicand * numerator;
+        int64_t result = ((multiplicand < 0) != (numerator < 0)) ? (product - divisor / 2) / divisor : (product + divisor / 2) / divisor;
+        if (result > INT_MAX || result < -INT_MAX)
+            return -1;
+
+        return static_cast<int>(result);
+    }
+
+    namespace MulDivDetail
+    {
+        constexpr int GreatestCommonDivisor(int a, int b)
+        {
+            return b == 0 ? a : GreatestCommonDivisor(b, a % b);
+        }
+
+        constexpr int64_t RoundedQuotient(int64_t magnitude, int numerator, int denominator)
+        {
+            return (magnitude * numerator + denominator / 2) / denominator;
+        }
+
+        constexpr int CheckedResult(int64_t result)
+        {
+            return (result > INT_MAX || result < -INT_MAX) ? -1 : static_cast<int>(result);
+        }
+    }
+
+    // Converts with the factor To/From known at compile time, e.g. TMulDivConstant<96, 144>::Apply(x) == MulDiv(x, 144, 96).
+    // The factor is reduced first, so the common DPI factors (5/4, 3/2, 2) compile to a multiplication and a shift.
+    template <int From, int To>
+    struct TMulDivConstant
+    {
+        static_assert(From > 0 && To > 0, "DPI values must be positive");
+
+        static const int k_Numerator = To / MulDivDetail::GreatestCommonDivisor(To, From);
+        static const int k_Denominator = From / MulDivDetail::GreatestCommonDivisor(To, From);
+
+        // Reducing the factor doesn't change the rounding: the fraction part of x * To / From is a multiple of 1/k_Denominator, and is
+        // at least half exactly when it's at least (k_Denominator / 2) / k_Denominator, for even and odd denominators alike.
+        static constexpr int Apply(int x)
+        {
+            return MulDivDetail::CheckedResult(x < 0 ?
+                -MulDivDetail::RoundedQuotient(-static_cast<int64_t>(x), k_Numerator, k_Denominator) :
+                MulDivDetail::RoundedQuotient(x, k_Numerator, k_Denominator));
+        }
+    };
+
+    // The conversions between the default logical DPI and the most common device DPI values
+    typedef TMulDivConstant<96, 120> Dpi96To120;
+    typedef TMulDivConstant<96, 144> Dpi96To144;
+    typedef TMulDivConstant<96, 192> Dpi96To192;
+    typedef TMulDivConstant<120, 96> Dpi120To96;
+    typedef TMulDivConstant<144, 96> Dpi144To96;
+    typedef TMulDivConstant<192, 96> Dpi192To96;
+
+    // Converts values with the factor numerator/denominator, with the same results as MulDiv(x, numerator, denominator)
+    class CMulDivFactor
+    {
+    public:
+        // Numerators and denominators up to this value are converted with a multiplication; others fall back to MulDivReference
+        static const int k_MaxExactValue = 0xFFFF;
+
+        CMulDivFactor()
+        {
+            Initialize(1, 1);
+        }
+
+        CMulDivFactor(int numerator, int denominator)
+        {
+            Initialize(numerator, denominator);
+        }
+
+        int GetNumerator() const
+        {
+            return m_numerator;
+        }
+
+        int GetDenominator() const
+        {
+            return m_denominator;
+        }
+
+        // Returns numerator/denominator as a floating point factor, or 0 if the denominator is 0
+        double GetScale() const
+        {
+            return m_scale;
+        }
+
+        int Apply(int x) const
+        {
+            if (!m_fExact)
+                return MulDivReference(x, m_numerator, m_denominator);
+
+            double rounded = std::fabs(x * m_scale) + k_RoundingOffset;
+            if (rounded >= k_Overflow)
+                return -1;
+
+            int magnitude = static_cast<int>(rounded);
+            return x < 0 ? -magnitude : magnitude;
+        }
+
+        // Converts pairCount pairs of 32-bit values, applying xFactor to the first value of each pair and yFactor to the second one.
+        // POINT and SIZE arrays are arrays of (x, y) pairs, and RECT arrays are arrays of (left, top) and (right, bottom) pairs.
+        template <typename T>
+        static void ApplyToPairs(T* pValues, size_t pairCount, const CMulDivFactor& xFactor, const CMulDivFactor& yFactor)
+        {
+            static_assert(std::is_integral<T>::value && std::is_signed<T>::value && sizeof(T) == 4, "The values must be 32-bit signed integers");
+
+            size_t i = 0;
+#if defined(VSUI_MULDIV_SSE2)
+            if (xFactor.m_fExact && yFactor.m_fExact)
+            {
+                // Two pairs at a time: the same computation as Apply, with the sign of the values put back at the end
+                const __m128d vScales = _mm_set_pd(yFactor.m_scale, xFactor.m_scale);
+                for (; i + 2 <= pairCount; i += 2)
+                {
+                    __m128i vValues = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pValues + 2 * i));
+                    __m128i vFirstOverflow, vSecondOverflow;
+                    __m128i vFirst = ApplyToMagnitudes(_mm_cvtepi32_pd(vValues), vScales, &vFirstOverflow);
+                    __m128i vSecond = ApplyToMagnitudes(_mm_cvtepi32_pd(_mm_shuffle_epi32(vValues, _MM_SHUFFLE(3, 2, 3, 2))), vScales, &vSecondOverflow);
+
+                    // Negates the results of the negative values, then sets the results that overflow to -1 (all the bits set)
+                    __m128i vSigns = _mm_srai_epi32(vValues, 31);
+                    __m128i vResults = _mm_sub_epi32(_mm_xor_si128(_mm_unpacklo_epi64(vFirst, vSecond), vSigns), vSigns);
+                    vResults = _mm_or_si128(vResults, _mm_unpacklo_epi64(vFirstOverflow, vSecondOverflow));
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(pValues + 2 * i), vResults);
+                }
+            }
+#endif
+            for (; i < pairCount; i++)
+            {
+                pValues[2 * i] = static_cast<T>(xFactor.Apply(static_cast<int>(pValues[2 * i])));
+                pValues[2 * i + 1] = static_cast<T>(yFactor.Apply(static_cast<int>(pValues[2 * i + 1])));
+            }
+        }
+
+    private:
+        // Why multiplying by the factor in double precision gives the same results as MulDiv, for numerators and denominators up to
+        // 0xFFFF: the product of |x| < 2^32 with the rounded factor is within 2^-20 of |x| * numerator / denominator, while a quotient
+        // that isn't exactly halfway between two integers is at least 1/(2 * denominator) > 2^-17 from it. Adding 1/2 + 2^-18 before
+        // truncating rounds the quotients that are exactly halfway (or just below, due to the rounding errors) away from zero, without
+        // rounding up any quotient that is really below halfway. The same holds for the comparison with 2^31 that detects overflows.
+        static constexpr double k_RoundingOffset = 0.5 + 1.0 / (1 << 18);
+        static constexpr double k_Overflow = 2147483648.0;
+
+        void Initialize(int numerator, int denominator)
+        {
+            m_numerator = numerator;
+            m_denominator = denominator;
+            m_scale = denominator != 0 ? static_cast<double>(numerator) / denominator : 0.0;
+            m_fExact = (numerator > 0 && numerator <= k_MaxExactValue && denominator > 0 && denominator <= k_MaxExactValue);
+        }
+
+#if defined(VSUI_MULDIV_SSE2)
+        // Returns the rounded magnitudes of the two converted values in the low 64 bits, and in *pOverflow the mask of the values that overflow
+        static __m128i ApplyToMagnitudes(__m128d vValues, __m128d vScales, __m128i* pOverflow)
+        {
+            __m128d vRounded = _mm_add_pd(_mm_andnot_pd(_mm_set1_pd(-0.0), _mm_mul_pd(vValues, vScales)), _mm_set1_pd(k_RoundingOffset));
+            __m128d vOverflow = _mm_cmpge_pd(vRounded, _mm_set1_pd(k_Overflow));
+            *pOverflow = _mm_shuffle_epi32(_mm_castpd_si128(vOverflow), _MM_SHUFFLE(2, 0, 2, 0));
+            return _mm_cvttpd_epi32(vRounded);
+        }
+#endif
+
+        int m_numerator;
+        int m_denominator;
+        double m_scale;
+        bool m_fExact;
+    };
+
+} // namespace
@@ -0,0 +1,288 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Property tests of CMulDivFactor and TMulDivConstant against MulDivReference
+// The factors must give the same result as MulDiv for every value: the tests
+// cover the values around 0, the extremes of the int range, the quotients
+// exactly halfway between two integers, and random values, for the common
+// DPI factors and for random factors. ApplyToPairs is checked the same way,
+// including the array tails and unaligned arrays around its SSE2 path.
+//-----------------------------------------------------------------------------
+#include "VsUIMulDiv.h"
+
+#include <random>
+#include <vector>
+
+#include "VsUITests.h"
+
+using namespace VsUI;
+
+static_assert(Dpi96To120::k_Numerator == 5 && Dpi96To120::k_Denominator == 4, "The factors must be reduced");
+static_assert(Dpi96To144::Apply(3) == 5 && Dpi96To144::Apply(-3) == -5, "Halfway quotients must round away from zero");
+static_assert(Dpi96To192::Apply(INT_MAX) == -1, "Overflows must return -1");
+
+namespace
+{
+    struct Factor
+    {
+        int numerator;
+        int denominator;
+    };
+
+    // DPI conversions both ways, and the limits of the factors converted without division
+    const Factor k_Factors[] =
+    {
+        { 120, 96 }, { 144, 96 }, { 168, 96 }, { 192, 96 }, { 288, 96 },
+        { 96, 120 }, { 96, 144 }, { 96, 192 }, { 96, 72 }, { 72, 96 }, { 96, 96 },
+        { 1, 1 }, { 7, 3 }, { 3, 7 }, { 250, 100 },
+        { 1, 65535 }, { 65535, 1 }, { 65535, 65534 }, { 65534, 3 }, { 65535, 65535 },
+    };
+
+    // Factors CMulDivFactor can't convert with a multiplication, converted with MulDivReference
+    const Factor k_InexactFactors[] =
+    {
+        { 0, 96 }, { -144, 96 }, { 144, -96 }, { 144, 0 }, { 65536, 3 }, { 3, 65536 }, { INT_MAX, INT_MAX - 1 },
+    };
+
+    const int k_ExtremeValues[] =
+    {
+        INT_MIN, INT_MIN + 1, INT_MIN + 2, INT_MAX, INT_MAX - 1, INT_MAX - 2,
+        1073741823, 1073741824, -1073741824, -1073741825, 1431655765, -1431655765, 715827882, -715827883,
+    };
+
+    const int k_DenseRange = 1 << 16;
+    const int k_RandomValueCount = 1 << 18;
+
+    // Checks the factor for the values [-k_DenseRange, k_DenseRange], the extreme values, halfway quotients, and random values
+    bool CheckFactor(const CMulDivFactor& factor, std::mt19937& random)
+    {
+        int numerator = factor.GetNumerator();
+        int denominator = factor.GetDenominator();
+        auto check = [&](int x)
+        {
+            return VSUI_CHECK_EQUAL(MulDivReference(x, numerator, denominator), factor.Apply(x));
+        };
+
+        for (int x = -k_DenseRange; x <= k_DenseRange; x++)
+        {
+            if (!check(x))
+                return false;
+        }
+
+        for (int x : k_ExtremeValues)
+        {
+            if (!check(x))
+                return false;
+        }
+
+        // x * numerator / denominator is halfway between two integers when x * numerator % denominator == denominator / 2 (odd denominators have none)
+        if (denominator > 0 && denominator <= CMulDivFactor::k_MaxExactValue && denominator % 2 == 0)
+        {
+            for (int i = 0; i < 256; i++)
+            {
+                int x = static_cast<int>(random() % (1u << 30));
+                int64_t remainder = static_cast<int64_t>(x) * numerator % denominator;
+                for (int64_t step = 0; step < denominator && remainder != denominator / 2; step++)
+                {
+                    x++;
+                    remainder = (remainder + numerator) % denominator;
+                }
+                if (!check(x) || !check(-x))
+                    return false;
+            }
+        }
+
+        for (int i = 0; i < k_RandomValueCount; i++)
+        {
+            if (!check(static_cast<int>(random())))
+                return false;
+        }
+
+        return true;
+    }
+
+    // Mix of random 32-bit values, small coordinates, and values of every magnitude
+    std::vector<int> MakeValues(size_t count, std::mt19937& random)
+    {
+        std::vector<int> values(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            uint32_t r = random();
+            switch (i % 3)
+            {
+            case 0:
+                values[i] = static_cast<int>(r);
+                break;
+            case 1:
+                values[i] = static_cast<int>(r % 200001) - 100000;
+                break;
+            default:
+                values[i] = static_cast<int>(r >> (r % 32));
+                values[i] = (r & 1) != 0 ? -values[i] : values[i];
+                break;
+            }
+        }
+        return values;
+    }
+
+    // Converts values[first, first + 2 * pairCount) with ApplyToPairs and checks every value, and that the values around them are untouched
+    bool CheckPairs(const std::vector<int>& values, size_t first, size_t pairCount, const Factor& x, const Factor& y)
+    {
+        std::vector<int> converted = values;
+        CMulDivFactor::ApplyToPairs(converted.data() + first, pairCount, CMulDivFactor(x.numerator, x.denominator), CMulDivFactor(y.numerator, y.denominator));
+
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            int expected = values[i];
+            if (i >= first && i < first + 2 * pairCount)
+            {
+                const Factor& factor = (i - first) % 2 == 0 ? x : y;
+                expected = MulDivReference(values[i], factor.numerator, factor.denominator);
+            }
+            if (!VSUI_CHECK_EQUAL(expected, converted[i]))
+                return false;
+        }
+        return true;
+    }
+}
+
+VSUI_TEST(FactorsMatchMulDiv)
+{
+    std::mt19937 random(1);
+    for (const Factor& factor : k_Factors)
+    {
+        CheckFactor(CMulDivFactor(factor.numerator, factor.denominator), random);
+    }
+}
+
+VSUI_TEST(InexactFactorsMatchMulDiv)
+{
+    std::mt19937 random(2);
+    for (const Factor& factor : k_InexactFactors)
+    {
+        CheckFactor(CMulDivFactor(factor.numerator, factor.denominator), random);
+    }
+}
+
+VSUI_TEST(RandomFactorsMatchMulDiv)
+{
+    std::mt19937 random(3);
+    for (int i = 0; i < 1 << 20; i++)
+    {
+        int numerator = 1 + static_cast<int>(random() % CMulDivFactor::k_MaxExactValue);
+        int denominator = 1 + static_cast<int>(random() % CMulDivFactor::k_MaxExactValue);
+        int x = static_cast<int>(random());
+        if (!VSUI_CHECK_EQUAL(MulDivReference(x, numerator, denominator), CMulDivFactor(numerator, denominator).Apply(x)))
+            break;
+    }
+}
+
+VSUI_TEST(DefaultFactorIsIdentity)
+{
+    CMulDivFactor factor;
+    VSUI_CHECK_EQUAL(1, factor.GetNumerator());
+    VSUI_CHECK_EQUAL(1, factor.GetDenominator());
+    VSUI_CHECK_EQUAL(1.0, factor.GetScale());
+    for (int x : k_ExtremeValues)
+    {
+        VSUI_CHECK_EQUAL(MulDivReference(x, 1, 1), factor.Apply(x));
+    }
+}
+
+VSUI_TEST(ZeroDenominatorReturnsMinusOne)
+{
+    CMulDivFactor factor(144, 0);
+    VSUI_CHECK_EQUAL(0.0, factor.GetScale());
+    VSUI_CHECK_EQUAL(-1, factor.Apply(0));
+    VSUI_CHECK_EQUAL(-1, factor.Apply(100));
+}
+
+VSUI_TEST(ConstantsMatchMulDiv)
+{
+    auto check = [](int x)
+    {
+        return VSUI_CHECK_EQUAL(MulDivReference(x, 120, 96), Dpi96To120::Apply(x)) &&
+            VSUI_CHECK_EQUAL(MulDivReference(x, 144, 96), Dpi96To144::Apply(x)) &&
+            VSUI_CHECK_EQUAL(MulDivReference(x, 192, 96), Dpi96To192::Apply(x)) &&
+            VSUI_CHECK_EQUAL(MulDivReference(x, 96, 120), Dpi120To96::Apply(x)) &&
+            VSUI_CHECK_EQUAL(MulDivReference(x, 96, 144), Dpi144To96::Apply(x)) &&
+            VSUI_CHECK_EQUAL(MulDivReference(x, 96, 192), Dpi192To96::Apply(x)) &&
+            VSUI_CHECK_EQUAL(MulDivReference(x, 168, 96), (TMulDivConstant<96, 168>::Apply(x))) &&
+            VSUI_CHECK_EQUAL(MulDivReference(x, 7, 3), (TMulDivConstant<3, 7>::Apply(x)));
+    };
+
+    for (int x = -k_DenseRange; x <= k_DenseRange; x++)
+    {
+        if (!check(x))
+            return;
+    }
+
+    for (int x : k_ExtremeValues)
+    {
+        if (!check(x))
+            return;
+    }
+
+    std::mt19937 random(4);
+    for (int i = 0; i < k_RandomValueCount; i++)
+    {
+        if (!check(static_cast<int>(random())))
+            return;
+    }
+}
+
+VSUI_TEST(ApplyToPairsMatchesMulDiv)
+{
+    std::mt19937 random(5);
+    std::vector<int> values = MakeValues(4098, random);
+    for (const Factor& x : k_Factors)
+    {
+        for (const Factor& y : k_Factors)
+        {
+            // Both the aligned and the unaligned arrays, with all the values converted by the SSE2 loop
+            if (!CheckPairs(values, 0, 2048, x, y) || !CheckPairs(values, 1, 2048, x, y))
+                return;
+        }
+    }
+}
+
+VSUI_TEST(ApplyToPairsConvertsTheTail)
+{
+    // Odd pair counts leave the last pair to the scalar loop; the values past the array must not be touched
+    std::mt19937 random(6);
+    std::vector<int> values = MakeValues(20, random);
+    Factor x = { 144, 96 };
+    Factor y = { 96, 120 };
+    for (size_t pairCount = 0; pairCount <= 9; pairCount++)
+    {
+        CheckPairs(values, 1, pairCount, x, y);
+    }
+}
+
+VSUI_TEST(ApplyToPairsWithInexactFactors)
+{
+    std::mt19937 random(7);
+    std::vector<int> values = MakeValues(1026, random);
+    Factor exact = { 144, 96 };
+    for (const Factor& inexact : k_InexactFactors)
+    {
+        if (!CheckPairs(values, 0, 513, exact, inexact) || !CheckPairs(values, 0, 513, inexact, exact))
+            return;
+    }
+}
+
+VSUI_TEST(ApplyToPairsWithOverflows)
+{
+    std::vector<int> values(k_ExtremeValues, k_ExtremeValues + sizeof(k_ExtremeValues) / sizeof(k_ExtremeValues[0]));
+    for (const Factor& x : k_Factors)
+    {
+        if (!CheckPairs(values, 0, values.size() / 2, x, x))
+            return;
+    }
+}
+
+VSUI_TEST_MAIN()
@@ -0,0 +1,440 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// On-disk cache of device images scaled from resources, so later runs of the
+// process skip decoding and scaling the images they already scaled
+// Each image is a file in the cache directory, named after a hash of the
+// module path, the resource id, the DPI values, the scaling mode and the
+// background. The file starts with a little-endian header (which repeats the
+// whole key, the module stamp and the algorithm version) followed by the
+// 32bpp ARGB pixels, top-down and 16-byte aligned, so the file can also be
+// mapped and used in place. Opening a file validates the header, the file
+// size and a hash of the pixels; files written for an older build of the
+// module or an older version of the scaler are rejected and replaced by the
+// next Store. Files are written to a temporary name and renamed, so readers
+// never see partial files.
+// Doesn't depend on Windows (paths are wide strings on Windows only).
+//-----------------------------------------------------------------------------
+#pragma once
+
+#include "VsUIScaledImageCache.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace VsUI
+{
+    class CPersistentImageCache
+    {
+    public:
+#ifdef _WIN32
+        typedef std::wstring PathString;
+#else
+        typedef std::string PathString;
+#endif
+
+        // Increment when the scaled images change (e.g. a new filter implementation), so the images cached by older versions are not used
+        static const uint32_t k_AlgorithmVersion = 1;
+        // Images larger than this in either dimension are neither stored nor loaded
+        static const int k_MaxImageSize = 4096;
+
+        struct Key
+        {
+            std::string moduleIdentity;  // Identifies the module the resource is loaded from, e.g. its path
+            uint64_t moduleStamp;        // Changes when the module is rebuilt, e.g. its link timestamp and size, or a hash of the file
+            uint32_t resourceId;
+            int logicalDpiX;
+            int logicalDpiY;
+            int deviceDpiX;
+            int deviceDpiY;
+            int scalingMode;             // Actual scaling mode (never the Default mode)
+            uint32_t background;
+        };
+
+        // The cache directory must exist. Files are only created in it when images are stored.
+        explicit CPersistentImageCache(const PathString& directory) :
+            m_directory(directory)
+        {
+        }
+
+        const PathString& GetDirectory() const
+        {
+            return m_directory;
+        }
+
+        // Returns the path of the file caching the image of the key. Keys differing only by module stamp share the file.
+        PathString GetFilePath(const Key& key) const
+        {
+            uint64_t hash = HashFileKey(key);
+
+            PathString path = m_directory;
+            if (!path.empty() && path.back() != '/' && path.back() != '\\')
+            {
+                path += '/';
+            }
+            for (int shift = 60; shift >= 0; shift -= 4)
+            {
+                path += static_cast<typename PathString::value_type>("0123456789abcdef"[(hash >> shift) & 0xF]);
+            }
+            for (const char* pszExtension = ".vsdi"; *pszExtension != '\0'; pszExtension++)
+            {
+                path += static_cast<typename PathString::value_type>(*pszExtension);
+            }
+            return path;
+        }
+
+        // Returns the cached image for the key, or nullptr if it's not cached, was cached for another build of the module or another version
+        // of the scaler, or the file is damaged.
+        std::shared_ptr<const CScaledImageCache::Image> Load(const Key& key) const
+        {
+            CFile file(OpenFile(GetFilePath(key), false));
+            if (file.Get() == nullptr)
+                return nullptr;
+
+            uint8_t header[k_FixedHeaderSize];
+            if (fread(header, 1, sizeof(header), file.Get()) != sizeof(header))
+                return nullptr;
+
+            FileHeader fileHeader;
+            if (!ParseHeader(header, &fileHeader) || !MatchesKey(fileHeader, key))
+                return nullptr;
+
+            // The module identity follows the fixed header: compare it too, in case two modules hash the same
+            if (fileHeader.identityLength != key.moduleIdentity.size())
+                return nullptr;
+
+            std::string identity(fileHeader.identityLength, '\0');
+            if (fileHeader.identityLength != 0 && fread(&identity[0], 1, identity.size(), file.Get()) != identity.size())
+                return nullptr;
+            if (identity != key.moduleIdentity)
+                return nullptr;
+
+            size_t pixelCount = static_cast<size_t>(fileHeader.width) * fileHeader.height;
+            if (fseek(file.Get(), 0, SEEK_END) != 0 || ftell(file.Get()) != static_cast<long>(fileHeader.pixelsOffset + pixelCount * sizeof(uint32_t)))
+                return nullptr;
+            if (fseek(file.Get(), static_cast<long>(fileHeader.pixelsOffset), SEEK_SET) != 0)
+                return nullptr;
+
+            std::shared_ptr<CScaledImageCache::Image> spImage;
+            try
+            {
+                spImage = std::make_shared<CScaledImageCache::Image>();
+                spImage->pixels.resize(pixelCount);
+            }
+            catch (const std::bad_alloc&)
+            {
+                return nullptr;
+            }
+
+            spImage->width = fileHeader.width;
+            spImage->height = fileHeader.height;
+            if (pixelCount != 0 && fread(spImage->pixels.data(), sizeof(uint32_t), pixelCount, file.Get()) != pixelCount)
+                return nullptr;
+
+            // The pixels are stored little-endian, which is the memory order on all our targets
+            if (CScaledImageCache::HashPixels(spImage->pixels.data(), spImage->width, spImage->height, static_cast<ptrdiff_t>(spImage->width) * 4) != fileHeader.pixelsHash)
+                return nullptr;
+
+            return spImage;
+        }
+
+        // Writes the image for the key, replacing the file cached for the key if any. Returns false if the file couldn't be written.
+        bool Store(const Key& key, const CScaledImageCache::Image& image) const
+        {
+            if (image.width < 0 || image.width > k_MaxImageSize || image.height < 0 || image.height > k_MaxImageSize ||
+                image.pixels.size() != static_cast<size_t>(image.width) * image.height)
+                return false;
+
+            std::vector<uint8_t> header;
+            try
+            {
+                BuildHeader(key, image, &header);
+            }
+            catch (const std::bad_alloc&)
+            {
+                return false;
+            }
+
+            PathString path = GetFilePath(key);
+            PathString temporaryPath = path + GetTemporarySuffix();
+            {
+                CFile file(OpenFile(temporaryPath, true));
+                if (file.Get() == nullptr)
+                    return false;
+
+                bool fWritten = fwrite(header.data(), 1, header.size(), file.Get()) == header.size() &&
+                    (image.pixels.empty() || fwrite(image.pixels.data(), sizeof(uint32_t), image.pixels.size(), file.Get()) == image.pixels.size());
+                if (!file.Close() || !fWritten)
+                {
+                    RemoveFile(temporaryPath);
+                    return false;
+                }
+            }
+
+            // On Windows, rename doesn't replace an existing file
+            if (RenameFile(temporaryPath, path))
+                return true;
+
+            RemoveFile(path);
+            if (RenameFile(temporaryPath, path))
+                return true;
+
+            RemoveFile(temporaryPath);
+            return false;
+        }
+
+        // Removes the file cached for the key, if any
+        void Remove(const Key& key) const
+        {
+            RemoveFile(GetFilePath(key));
+        }
+
+    private:
+        static const uint32_t k_Magic = 0x49445356;  // "VSDI"
+        static const uint32_t k_FormatVersion = 1;
+        static const size_t k_FixedHeaderSize = 88;
+        static const size_t k_PixelsAlignment = 16;
+
+        struct FileHeader
+        {
+            uint32_t algorithmVersion;
+            uint32_t pixelsOffset;
+            uint64_t moduleStamp;
+            uint32_t resourceId;
+            int logicalDpiX;
+            int logicalDpiY;
+            int deviceDpiX;
+            int deviceDpiY;
+            int scalingMode;
+            uint32_t background;
+            int width;
+            int height;
+            uint32_t identityLength;
+            uint64_t pixelsHash;
+        };
+
+        // Closes the file when destroyed
+        class CFile
+        {
+        public:
+            explicit CFile(FILE* pFile) :
+                m_pFile(pFile)
+            {
+            }
+
+            ~CFile()
+            {
+                Close();
+            }
+
+            FILE* Get() const
+            {
+                return m_pFile;
+            }
+
+            // Returns false if the buffered data couldn't be written
+            bool Close()
+            {
+                bool fClosed = (m_pFile == nullptr) || (fclose(m_pFile) == 0);
+                m_pFile = nullptr;
+                return fClosed;
+            }
+
+        private:
+            CFile(const CFile&);
+            CFile& operator=(const CFile&);
+
+            FILE* m_pFile;
+        };
+
+        static uint64_t HashFileKey(const Key& key)
+        {
+            // The module stamp and the algorithm version are left out, so a stale file is replaced by the next Store instead of staying around
+            uint64_t hash = k_HashOffset;
+            for (char ch : key.moduleIdentity)
+            {
+                hash = HashValue(hash, static_cast<uint8_t>(ch));
+            }
+            hash = HashValue(hash, key.resourceId);
+            hash = HashValue(hash, static_cast<uint32_t>(key.logicalDpiX) | (static_cast<uint64_t>(static_cast<uint32_t>(key.logicalDpiY)) << 32));
+            hash = HashValue(hash, static_cast<uint32_t>(key.deviceDpiX) | (static_cast<uint64_t>(static_cast<uint32_t>(key.deviceDpiY)) << 32));
+            hash = HashValue(hash, static_cast<uint32_t>(key.scalingMode) | (static_cast<uint64_t>(key.background) << 32));
+            return hash;
+        }
+
+        static void BuildHeader(const Key& key, const CScaledImageCache::Image& image, std::vector<uint8_t>* pHeader)
+        {
+            size_t pixelsOffset = (k_FixedHeaderSize + key.moduleIdentity.size() + k_PixelsAlignment - 1) & ~(k_PixelsAlignment - 1);
+            pHeader->assign(pixelsOffset, 0);
+
+            uint8_t* p = pHeader->data();
+            Write32(p, k_Magic);
+            Write32(p + 4, k_FormatVersion);
+            Write32(p + 8, k_AlgorithmVersion);
+            Write32(p + 12, static_cast<uint32_t>(pixelsOffset));
+            Write64(p + 16, key.moduleStamp);
+            Write32(p + 24, key.resourceId);
+            Write32(p + 28, static_cast<uint32_t>(key.logicalDpiX));
+            Write32(p + 32, static_cast<uint32_t>(key.logicalDpiY));
+            Write32(p + 36, static_cast<uint32_t>(key.deviceDpiX));
+            Write32(p + 40, static_cast<uint32_t>(key.deviceDpiY));
+            Write32(p + 44, static_cast<uint32_t>(key.scalingMode));
+            Write32(p + 48, key.background);
+            Write32(p + 52, static_cast<uint32_t>(image.width));
+            Write32(p + 56, static_cast<uint32_t>(image.height));
+            Write32(p + 60, static_cast<uint32_t>(key.moduleIdentity.size()));
+            Write64(p + 64, CScaledImageCache::HashPixels(image.pixels.data(), image.width, image.height, static_cast<ptrdiff_t>(image.width) * 4));
+            Write64(p + 72, HashHeader(p));
+            // Bytes 80 to 87 are reserved
+            if (!key.moduleIdentity.empty())
+            {
+                memcpy(p + k_FixedHeaderSize, key.moduleIdentity.data(), key.moduleIdentity.size());
+            }
+        }
+
+        static bool ParseHeader(const uint8_t* p, FileHeader* pHeader)
+        {
+            if (Read32(p) != k_Magic || Read32(p + 4) != k_FormatVersion || Read64(p + 72) != HashHeader(p))
+                return false;
+
+            pHeader->algorithmVersion = Read32(p + 8);
+            pHeader->pixelsOffset = Read32(p + 12);
+            pHeader->moduleStamp = Read64(p + 16);
+            pHeader->resourceId = Read32(p + 24);
+            pHeader->logicalDpiX = static_cast<int>(Read32(p + 28));
+            pHeader->logicalDpiY = static_cast<int>(Read32(p + 32));
+            pHeader->deviceDpiX = static_cast<int>(Read32(p + 36));
+            pHeader->deviceDpiY = static_cast<int>(Read32(p + 40));
+            pHeader->scalingMode = static_cast<int>(Read32(p + 44));
+            pHeader->background = Read32(p + 48);
+            pHeader->width = static_cast<int>(Read32(p + 52));
+            pHeader->height = static_cast<int>(Read32(p + 56));
+            pHeader->identityLength = Read32(p + 60);
+            pHeader->pixelsHash = Read64(p + 64);
+
+            return pHeader->width >= 0 && pHeader->width <= k_MaxImageSize && pHeader->height >= 0 && pHeader->height <= k_MaxImageSize &&
+                pHeader->pixelsOffset % k_PixelsAlignment == 0 && pHeader->pixelsOffset >= k_FixedHeaderSize + static_cast<uint64_t>(pHeader->identityLength);
+        }
+
+        static bool MatchesKey(const FileHeader& header, const Key& key)
+        {
+            return header.algorithmVersion == k_AlgorithmVersion && header.moduleStamp == key.moduleStamp && header.resourceId == key.resourceId &&
+                header.logicalDpiX == key.logicalDpiX && header.logicalDpiY == key.logicalDpiY &&
+                header.deviceDpiX == key.deviceDpiX && header.deviceDpiY == key.deviceDpiY &&
+                header.scalingMode == key.scalingMode && header.background == key.background;
+        }
+
+        // Hash of the first 72 bytes of the header
+        static uint64_t HashHeader(const uint8_t* p)
+        {
+            uint64_t hash = k_HashOffset;
+            for (size_t offset = 0; offset < 72; offset += 8)
+            {
+                hash = HashValue(hash, Read64(p + offset));
+            }
+            return hash;
+        }
+
+        // Unique among the threads and processes writing the same file
+        static PathString GetTemporarySuffix()
+        {
+            static std::atomic<uint32_t> s_counter(0);
+            uint64_t unique = HashValue(HashValue(k_HashOffset, static_cast<uint64_t>(std::chrono::high_resolution_clock::now().time_since_epoch().count())),
+                std::hash<std::thread::id>()(std::this_thread::get_id()) ^ (static_cast<uint64_t>(s_counter++) << 32));
+
+            PathString suffix(1, '.');
+            for (int shift = 60; shift >= 0; shift -= 4)
+            {
+                suffix += static_cast<typename PathString::value_type>("0123456789abcdef"[(unique >> shift) & 0xF]);
+            }
+            for (const char* pszExtension = ".tmp"; *pszExtension != '\0'; pszExtension++)
+            {
+                suffix += static_cast<typename PathString::value_type>(*pszExtension);
+            }
+            return suffix;
+        }
+
+#ifdef _WIN32
+        static FILE* OpenFile(const PathString& path, bool fWrite)
+        {
+            FILE* pFile = nullptr;
+            return (_wfopen_s(&pFile, path.c_str(), fWrite ? L"wb" : L"rb") == 0) ? pFile : nullptr;
+        }
+
+        static bool RenameFile(const PathString& from, const PathString& to)
+        {
+            return _wrename(from.c_str(), to.c_str()) == 0;
+        }
+
+        static void RemoveFile(const PathString& path)
+        {
+            _wremove(path.c_str());
+        }
+#else
+        static FILE* OpenFile(const PathString& path, bool fWrite)
+        {
+            return fopen(path.c_str(), fWrite ? "wb" : "rb");
+        }
+
+        static bool RenameFile(const PathString& from, const PathString& to)
+        {
+            return rename(from.c_str(), to.c_str()) == 0;
+        }
+
+        static void RemoveFile(const PathString& path)
+        {
+            remove(path.c_str());
+        }
+#endif
+
+        static void Write32(uint8_t* p, uint32_t value)
+        {
+            for (int i = 0; i < 4; i++)
+            {
+                p[i] = static_cast<uint8_t>(value >> (8 * i));
+            }
+        }
+
+        static void Write64(uint8_t* p, uint64_t value)
+        {
+            Write32(p, static_cast<uint32_t>(value));
+            Write32(p + 4, static_cast<uint32_t>(value >> 32));
+        }
+
+        static uint32_t Read32(const uint8_t* p)
+        {
+            return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) | (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+        }
+
+        static uint64_t Read64(const uint8_t* p)
+        {
+            return Read32(p) | (static_cast<uint64_t>(Read32(p + 4)) << 32);
+        }
+
+        // Same hash as CScaledImageCache
+        static const uint64_t k_HashOffset = 14695981039346656037ULL;
+        static const uint64_t k_HashMultiplier = 0x9E3779B97F4A7C15ULL;
+
+        static uint64_t HashValue(uint64_t hash, uint64_t value)
+        {
+            hash = (hash ^ value) * k_HashMultiplier;
+            return hash ^ (hash >> 32);
+        }
+
+        PathString m_directory;
+    };
+
+} // namespace
@@ -0,0 +1,302 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Tests of CPersistentImageCache: round trips, files rejected for a stale
+// module stamp or another key, and damaged (corrupt or truncated) files
+// The cache directory is a new temporary directory, removed at the end of
+// each test. Uses the POSIX file system API.
+//-----------------------------------------------------------------------------
+#include "VsUIPersistentImageCache.h"
+
+#include <dirent.h>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "VsUITests.h"
+
+using namespace VsUI;
+
+namespace
+{
+    // Temporary cache directory, removed with its files when destroyed
+    class CTemporaryDirectory
+    {
+    public:
+        CTemporaryDirectory()
+        {
+            const char* pszTemp = getenv("TMPDIR");
+            std::string pattern = std::string(pszTemp != nullptr ? pszTemp : "/tmp") + "/VsUIPersistentImageCacheXXXXXX";
+            std::vector<char> path(pattern.begin(), pattern.end());
+            path.push_back('\0');
+            if (mkdtemp(path.data()) != nullptr)
+            {
+                m_path = path.data();
+            }
+        }
+
+        ~CTemporaryDirectory()
+        {
+            if (m_path.empty())
+                return;
+
+            for (const std::string& name : GetFileNames())
+            {
+                remove((m_path + "/" + name).c_str());
+            }
+            rmdir(m_path.c_str());
+        }
+
+        const std::string& GetPath() const
+        {
+            return m_path;
+        }
+
+        std::vector<std::string> GetFileNames() const
+        {
+            std::vector<std::string> names;
+            DIR* pDirectory = opendir(m_path.c_str());
+            if (pDirectory == nullptr)
+                return names;
+
+            while (dirent* pEntry = readdir(pDirectory))
+            {
+                std::string name = pEntry->d_name;
+                if (name != "." && name != "..")
+                {
+                    names.push_back(name);
+                }
+            }
+            closedir(pDirectory);
+            return names;
+        }
+
+    private:
+        std::string m_path;
+    };
+
+    std::vector<uint8_t> ReadFile(const std::string& path)
+    {
+        std::vector<uint8_t> bytes;
+        FILE* pFile = fopen(path.c_str(), "rb");
+        if (pFile == nullptr)
+            return bytes;
+
+        int ch;
+        while ((ch = fgetc(pFile)) != EOF)
+        {
+            bytes.push_back(static_cast<uint8_t>(ch));
+        }
+        fclose(pFile);
+        return bytes;
+    }
+
+    bool WriteFile(const std::string& path, const std::vector<uint8_t>& bytes)
+    {
+        FILE* pFile = fopen(path.c_str(), "wb");
+        if (pFile == nullptr)
+            return false;
+
+        bool fWritten = bytes.empty() || fwrite(bytes.data(), 1, bytes.size(), pFile) == bytes.size();
+        return fclose(pFile) == 0 && fWritten;
+    }
+
+    CPersistentImageCache::Key MakeKey()
+    {
+        CPersistentImageCache::Key key = { "/opt/vs/modules/images.so", 0x1111, 101, 96, 96, 144, 144, 6, 0 };
+        return key;
+    }
+
+    CScaledImageCache::Image MakeImage(int width, int height)
+    {
+        CScaledImageCache::Image image;
+        image.width = width;
+        image.height = height;
+        for (int i = 0; i < width * height; i++)
+        {
+            image.pixels.push_back(0xFF000000u | static_cast<uint32_t>(i * 12345));
+        }
+        return image;
+    }
+}
+
+VSUI_TEST(StoredImagesAreLoaded)
+{
+    CTemporaryDirectory directory;
+    if (!VSUI_CHECK(!directory.GetPath().empty()))
+        return;
+
+    CPersistentImageCache cache(directory.GetPath());
+    CPersistentImageCache::Key key = MakeKey();
+    CScaledImageCache::Image image = MakeImage(7, 5);
+
+    VSUI_CHECK(!cache.Load(key));
+    VSUI_CHECK(cache.Store(key, image));
+
+    std::shared_ptr<const CScaledImageCache::Image> spLoaded = cache.Load(key);
+    if (!VSUI_CHECK(spLoaded != nullptr))
+        return;
+    VSUI_CHECK_EQUAL(7, spLoaded->width);
+    VSUI_CHECK_EQUAL(5, spLoaded->height);
+    VSUI_CHECK(spLoaded->pixels == image.pixels);
+
+    // The pixels are 16-byte aligned in the file, so it can be mapped and used in place
+    std::vector<uint8_t> bytes = ReadFile(cache.GetFilePath(key));
+    VSUI_CHECK(bytes.size() > 16);
+    VSUI_CHECK_EQUAL(0, (bytes[12] | (bytes[13] << 8)) % 16);
+
+    // The temporary file was renamed
+    VSUI_CHECK_EQUAL(1u, directory.GetFileNames().size());
+}
+
+VSUI_TEST(EmptyImagesAreStored)
+{
+    CTemporaryDirectory directory;
+    CPersistentImageCache cache(directory.GetPath());
+    CPersistentImageCache::Key key = MakeKey();
+
+    VSUI_CHECK(cache.Store(key, MakeImage(0, 0)));
+    std::shared_ptr<const CScaledImageCache::Image> spLoaded = cache.Load(key);
+    VSUI_CHECK(spLoaded != nullptr && spLoaded->pixels.empty());
+}
+
+VSUI_TEST(InvalidImagesAreNotStored)
+{
+    CTemporaryDirectory directory;
+    CPersistentImageCache cache(directory.GetPath());
+    CPersistentImageCache::Key key = MakeKey();
+
+    CScaledImageCache::Image missingPixels = MakeImage(3, 3);
+    missingPixels.pixels.pop_back();
+    VSUI_CHECK(!cache.Store(key, missingPixels));
+    VSUI_CHECK(!cache.Store(key, MakeImage(CPersistentImageCache::k_MaxImageSize + 1, 1)));
+    VSUI_CHECK(directory.GetFileNames().empty());
+}
+
+VSUI_TEST(StaleModuleStampIsRejected)
+{
+    CTemporaryDirectory directory;
+    CPersistentImageCache cache(directory.GetPath());
+    CPersistentImageCache::Key key = MakeKey();
+    VSUI_CHECK(cache.Store(key, MakeImage(4, 4)));
+
+    // A rebuilt module uses the same file, so the stale image is replaced by the next Store
+    CPersistentImageCache::Key rebuilt = key;
+    rebuilt.moduleStamp = 0x2222;
+    VSUI_CHECK(cache.GetFilePath(rebuilt) == cache.GetFilePath(key));
+    VSUI_CHECK(!cache.Load(rebuilt));
+
+    VSUI_CHECK(cache.Store(rebuilt, MakeImage(4, 4)));
+    VSUI_CHECK(cache.Load(rebuilt) != nullptr);
+    VSUI_CHECK(!cache.Load(key));
+    VSUI_CHECK_EQUAL(1u, directory.GetFileNames().size());
+}
+
+VSUI_TEST(OtherKeysAreNotLoaded)
+{
+    CTemporaryDirectory directory;
+    CPersistentImageCache cache(directory.GetPath());
+    CPersistentImageCache::Key key = MakeKey();
+    VSUI_CHECK(cache.Store(key, MakeImage(4, 4)));
+
+    CPersistentImageCache::Key otherDpi = key;
+    otherDpi.deviceDpiX = 120;
+    otherDpi.deviceDpiY = 120;
+    VSUI_CHECK(cache.GetFilePath(otherDpi) != cache.GetFilePath(key));
+    VSUI_CHECK(!cache.Load(otherDpi));
+
+    CPersistentImageCache::Key otherMode = key;
+    otherMode.scalingMode = 3;
+    VSUI_CHECK(!cache.Load(otherMode));
+
+    CPersistentImageCache::Key otherBackground = key;
+    otherBackground.background = 0xFFFF00FF;
+    VSUI_CHECK(!cache.Load(otherBackground));
+
+    CPersistentImageCache::Key otherModule = key;
+    otherModule.moduleIdentity = "/opt/vs/modules/other.so";
+    VSUI_CHECK(!cache.Load(otherModule));
+}
+
+VSUI_TEST(CorruptFilesAreRejected)
+{
+    CTemporaryDirectory directory;
+    CPersistentImageCache cache(directory.GetPath());
+    CPersistentImageCache::Key key = MakeKey();
+    VSUI_CHECK(cache.Store(key, MakeImage(8, 8)));
+
+    std::string path = cache.GetFilePath(key);
+    std::vector<uint8_t> original = ReadFile(path);
+
+    // A pixel, the header, and the module identity following the header
+    const size_t offsets[] = { original.size() - 3, 30, 90 };
+    for (size_t offset : offsets)
+    {
+        std::vector<uint8_t> corrupt = original;
+        corrupt[offset] ^= 0x42;
+        VSUI_CHECK(WriteFile(path, corrupt));
+        if (!VSUI_CHECK(!cache.Load(key)))
+        {
+            fprintf(stderr, "    corrupt byte at offset %d was not detected\n", static_cast<int>(offset));
+        }
+    }
+
+    // Storing the image again repairs the file
+    VSUI_CHECK(cache.Store(key, MakeImage(8, 8)));
+    VSUI_CHECK(cache.Load(key) != nullptr);
+}
+
+VSUI_TEST(TruncatedFilesAreRejected)
+{
+    CTemporaryDirectory directory;
+    CPersistentImageCache cache(directory.GetPath());
+    CPersistentImageCache::Key key = MakeKey();
+    VSUI_CHECK(cache.Store(key, MakeImage(8, 8)));
+
+    std::string path = cache.GetFilePath(key);
+    std::vector<uint8_t> original = ReadFile(path);
+
+    // In the header, in the module identity, at the start of the pixels, and one byte short
+    const size_t sizes[] = { 0, 40, 100, 128, original.size() - 1 };
+    for (size_t size : sizes)
+    {
+        VSUI_CHECK(WriteFile(path, std::vector<uint8_t>(original.begin(), original.begin() + size)));
+        if (!VSUI_CHECK(!cache.Load(key)))
+        {
+            fprintf(stderr, "    file truncated to %d bytes was not detected\n", static_cast<int>(size));
+        }
+    }
+
+    // Extra bytes at the end are rejected too
+    std::vector<uint8_t> extended = original;
+    extended.push_back(0);
+    VSUI_CHECK(WriteFile(path, extended));
+    VSUI_CHECK(!cache.Load(key));
+}
+
+VSUI_TEST(RemoveDeletesTheFile)
+{
+    CTemporaryDirectory directory;
+    CPersistentImageCache cache(directory.GetPath());
+    CPersistentImageCache::Key key = MakeKey();
+    VSUI_CHECK(cache.Store(key, MakeImage(4, 4)));
+
+    cache.Remove(key);
+    VSUI_CHECK(!cache.Load(key));
+    VSUI_CHECK(directory.GetFileNames().empty());
+
+    // Removing a key that isn't cached does nothing
+    cache.Remove(key);
+}
+
+VSUI_TEST(StoreFailsWithoutTheDirectory)
+{
+    CPersistentImageCache cache("/nonexistent/VsUIPersistentImageCache");
+    VSUI_CHECK(!cache.Store(MakeKey(), MakeImage(4, 4)));
+    VSUI_CHECK(!cache.Load(MakeKey()));
+}
+
+VSUI_TEST_MAIN()
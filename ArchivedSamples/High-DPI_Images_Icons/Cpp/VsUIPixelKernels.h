@@ -0,0 +1,423 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Portable pixel loops over 32bpp ARGB buffers
+// The kernels in this header don't depend on Windows or GDI+, so they can be
+// built and measured on any platform. GdiplusImage and CDpiHelper call them on
+// the bits of locked Gdiplus::Bitmap objects and DIB sections.
+// A pixel is a 32-bit value laid out as 0xAARRGGBB (same as Gdiplus::ARGB).
+//-----------------------------------------------------------------------------
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// The SIMD paths are picked at compile time from the target architecture.
+// AVX2 is only used when the compiler targets it (/arch:AVX2 or -mavx2).
+#if defined(__AVX2__)
+#define VSUI_PIXELS_AVX2
+#endif
+#if defined(_M_X64) || defined(_M_AMD64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define VSUI_PIXELS_SSE2
+#endif
+#if defined(_M_ARM64) || defined(__ARM_NEON)
+#define VSUI_PIXELS_NEON
+#endif
+
+#if defined(VSUI_PIXELS_AVX2)
+#include <immintrin.h>
+#elif defined(VSUI_PIXELS_SSE2)
+#include <emmintrin.h>
+#elif defined(VSUI_PIXELS_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace VsUI
+{
+    class CPixelKernels
+    {
+    public:
+        // Calls rowProcessor(pRow, width) for each row of a 32bpp buffer.
+        // The stride is in bytes, and is negative for bottom-up buffers.
+        template <typename TPixel, typename TRowProcessor>
+        static void ForEachRow(void* pScan0, ptrdiff_t stride, unsigned int width, unsigned int height, TRowProcessor&& rowProcessor)
+        {
+            static_assert(sizeof(TPixel) == 4, "Pixel kernels only support 32bpp pixels");
+
+            unsigned char* pRow = static_cast<unsigned char*>(pScan0);
+            for (unsigned int y = 0; y < height; y++, pRow += stride)
+            {
+                rowProcessor(reinterpret_cast<TPixel*>(pRow), width);
+            }
+        }
+
+        // Calls pixelProcessor(pPixel) for each pixel of a row. The processor is a template
+        // argument rather than a std::function so the call can be inlined and the loop vectorized.
+        template <typename TPixel, typename TPixelProcessor>
+        static void ForEachPixel(TPixel* pRow, unsigned int width, TPixelProcessor&& pixelProcessor)
+        {
+            for (unsigned int x = 0; x < width; x++)
+            {
+                pixelProcessor(pRow + x);
+            }
+        }
+
+        // Calls pixelProcessor(pPixel) for each pixel of a 32bpp buffer.
+        template <typename TPixel, typename TPixelProcessor>
+        static void ForEachPixel(void* pScan0, ptrdiff_t stride, unsigned int width, unsigned int height, TPixelProcessor&& pixelProcessor)
+        {
+            ForEachRow<TPixel>(pScan0, stride, width, height, [&](TPixel* pRow, unsigned int rowWidth)
+            {
+                ForEachPixel(pRow, rowWidth, pixelProcessor);
+            });
+        }
+
+        // Maximum number of key colors ReplaceKeyColors can look for in one pass
+        static const unsigned int k_MaxKeyColors = 4;
+
+        // Replaces every pixel of the row that matches one of the key colors with the replacement color.
+        // Returns a mask of the keys found in the row: bit i is set if pKeyColors[i] matched at least one pixel.
+        template <typename TPixel>
+        static unsigned int ReplaceKeyColors(TPixel* pRow, unsigned int width, const TPixel* pKeyColors, unsigned int keyCount, TPixel replacement)
+        {
+            static_assert(sizeof(TPixel) == 4, "Pixel kernels only support 32bpp pixels");
+
+            uint32_t keys[k_MaxKeyColors];
+            if (keyCount > k_MaxKeyColors)
+                keyCount = k_MaxKeyColors;
+            for (unsigned int k = 0; k < keyCount; k++)
+                keys[k] = static_cast<uint32_t>(pKeyColors[k]);
+
+            return ReplaceKeyColorsCore(reinterpret_cast<uint32_t*>(pRow), width, keys, keyCount, static_cast<uint32_t>(replacement));
+        }
+
+        // Replaces the pixels of the row that are not fully opaque with the background color, then applies
+        // the and/or masks to every pixel (e.g. to force or clear the alpha byte for the output pixel format).
+        template <typename TPixel>
+        static void ReplaceNonOpaquePixels(TPixel* pRow, unsigned int width, TPixel background, TPixel andMask, TPixel orMask)
+        {
+            static_assert(sizeof(TPixel) == 4, "Pixel kernels only support 32bpp pixels");
+            MaskPixelsCore(reinterpret_cast<uint32_t*>(pRow), width, true /*fReplaceNonOpaque*/, static_cast<uint32_t>(background), static_cast<uint32_t>(andMask), static_cast<uint32_t>(orMask));
+        }
+
+        // Applies the and/or masks to every pixel of the row
+        template <typename TPixel>
+        static void MaskPixels(TPixel* pRow, unsigned int width, TPixel andMask, TPixel orMask)
+        {
+            static_assert(sizeof(TPixel) == 4, "Pixel kernels only support 32bpp pixels");
+            MaskPixelsCore(reinterpret_cast<uint32_t*>(pRow), width, false /*fReplaceNonOpaque*/, 0, static_cast<uint32_t>(andMask), static_cast<uint32_t>(orMask));
+        }
+
+        // Writes each of the sourceWidth pixels factor times in a row to pDestination, which must hold sourceWidth * factor pixels
+        template <typename TPixel>
+        static void ReplicatePixels(const TPixel* pSource, unsigned int sourceWidth, unsigned int factor, TPixel* pDestination)
+        {
+            static_assert(sizeof(TPixel) == 4, "Pixel kernels only support 32bpp pixels");
+            ReplicatePixelsCore(reinterpret_cast<const uint32_t*>(pSource), sourceWidth, factor, reinterpret_cast<uint32_t*>(pDestination));
+        }
+
+    private:
+        static const uint32_t k_AlphaMask = 0xFF000000;
+
+        static void ReplicatePixelsCore(const uint32_t* pSource, unsigned int sourceWidth, unsigned int factor, uint32_t* pDestination)
+        {
+            unsigned int x = 0;
+
+            if (factor == 1)
+            {
+                memcpy(pDestination, pSource, sourceWidth * sizeof(uint32_t));
+                return;
+            }
+
+#if defined(VSUI_PIXELS_AVX2)
+            // 8 source pixels become factor vectors; lane l of vector j takes source pixel (8 * j + l) / factor
+            if (factor <= 8)
+            {
+                __m256i vIndices[8];
+                for (unsigned int j = 0; j < factor; j++)
+                {
+                    vIndices[j] = _mm256_setr_epi32(
+                        static_cast<int>((8 * j + 0) / factor), static_cast<int>((8 * j + 1) / factor),
+                        static_cast<int>((8 * j + 2) / factor), static_cast<int>((8 * j + 3) / factor),
+                        static_cast<int>((8 * j + 4) / factor), static_cast<int>((8 * j + 5) / factor),
+                        static_cast<int>((8 * j + 6) / factor), static_cast<int>((8 * j + 7) / factor));
+                }
+
+                for (; x + 8 <= sourceWidth; x += 8)
+                {
+                    __m256i vPixels = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(pSource + x));
+                    __m256i* pBlock = reinterpret_cast<__m256i*>(pDestination + x * factor);
+                    for (unsigned int j = 0; j < factor; j++)
+                    {
+                        _mm256_storeu_si256(pBlock + j, _mm256_permutevar8x32_epi32(vPixels, vIndices[j]));
+                    }
+                }
+            }
+#elif defined(VSUI_PIXELS_SSE2)
+            // 4 source pixels become factor vectors, for the common 200%, 300% and 400% factors
+            if (factor >= 2 && factor <= 4)
+            {
+                for (; x + 4 <= sourceWidth; x += 4)
+                {
+                    __m128i vPixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pSource + x));
+                    __m128i* pBlock = reinterpret_cast<__m128i*>(pDestination + x * factor);
+                    if (factor == 2)
+                    {
+                        _mm_storeu_si128(pBlock + 0, _mm_unpacklo_epi32(vPixels, vPixels));
+                        _mm_storeu_si128(pBlock + 1, _mm_unpackhi_epi32(vPixels, vPixels));
+                    }
+                    else if (factor == 3)
+                    {
+                        _mm_storeu_si128(pBlock + 0, _mm_shuffle_epi32(vPixels, _MM_SHUFFLE(1, 0, 0, 0)));
+                        _mm_storeu_si128(pBlock + 1, _mm_shuffle_epi32(vPixels, _MM_SHUFFLE(2, 2, 1, 1)));
+                        _mm_storeu_si128(pBlock + 2, _mm_shuffle_epi32(vPixels, _MM_SHUFFLE(3, 3, 3, 2)));
+                    }
+                    else
+                    {
+                        _mm_storeu_si128(pBlock + 0, _mm_shuffle_epi32(vPixels, _MM_SHUFFLE(0, 0, 0, 0)));
+                        _mm_storeu_si128(pBlock + 1, _mm_shuffle_epi32(vPixels, _MM_SHUFFLE(1, 1, 1, 1)));
+                        _mm_storeu_si128(pBlock + 2, _mm_shuffle_epi32(vPixels, _MM_SHUFFLE(2, 2, 2, 2)));
+                        _mm_storeu_si128(pBlock + 3, _mm_shuffle_epi32(vPixels, _MM_SHUFFLE(3, 3, 3, 3)));
+                    }
+                }
+            }
+#elif defined(VSUI_PIXELS_NEON)
+            // The interleaving stores write each lane of the same vector 2, 3 or 4 times in a row
+            if (factor >= 2 && factor <= 4)
+            {
+                for (; x + 4 <= sourceWidth; x += 4)
+                {
+                    uint32x4_t vPixels = vld1q_u32(pSource + x);
+                    uint32_t* pBlock = pDestination + x * factor;
+                    if (factor == 2)
+                    {
+                        uint32x4x2_t vPairs = { { vPixels, vPixels } };
+                        vst2q_u32(pBlock, vPairs);
+                    }
+                    else if (factor == 3)
+                    {
+                        uint32x4x3_t vTriples = { { vPixels, vPixels, vPixels } };
+                        vst3q_u32(pBlock, vTriples);
+                    }
+                    else
+                    {
+                        uint32x4x4_t vQuads = { { vPixels, vPixels, vPixels, vPixels } };
+                        vst4q_u32(pBlock, vQuads);
+                    }
+                }
+            }
+#endif
+
+            for (; x < sourceWidth; x++)
+            {
+                uint32_t pixel = pSource[x];
+                uint32_t* pBlock = pDestination + x * factor;
+                for (unsigned int j = 0; j < factor; j++)
+                {
+                    pBlock[j] = pixel;
+                }
+            }
+        }
+
+        static void MaskPixelsCore(uint32_t* pRow, unsigned int width, bool fReplaceNonOpaque, uint32_t background, uint32_t andMask, uint32_t orMask)
+        {
+            unsigned int x = 0;
+
+#if defined(VSUI_PIXELS_AVX2)
+            const __m256i vAlphaMask = _mm256_set1_epi32(static_cast<int>(k_AlphaMask));
+            const __m256i vBackground = _mm256_set1_epi32(static_cast<int>(background));
+            const __m256i vAndMask = _mm256_set1_epi32(static_cast<int>(andMask));
+            const __m256i vOrMask = _mm256_set1_epi32(static_cast<int>(orMask));
+            for (; x + 8 <= width; x += 8)
+            {
+                __m256i* pBlock = reinterpret_cast<__m256i*>(pRow + x);
+                __m256i vPixels = _mm256_loadu_si256(pBlock);
+                if (fReplaceNonOpaque)
+                {
+                    __m256i vOpaque = _mm256_cmpeq_epi32(_mm256_and_si256(vPixels, vAlphaMask), vAlphaMask);
+                    vPixels = _mm256_blendv_epi8(vBackground, vPixels, vOpaque);
+                }
+                _mm256_storeu_si256(pBlock, _mm256_or_si256(_mm256_and_si256(vPixels, vAndMask), vOrMask));
+            }
+#elif defined(VSUI_PIXELS_SSE2)
+            const __m128i vAlphaMask = _mm_set1_epi32(static_cast<int>(k_AlphaMask));
+            const __m128i vBackground = _mm_set1_epi32(static_cast<int>(background));
+            const __m128i vAndMask = _mm_set1_epi32(static_cast<int>(andMask));
+            const __m128i vOrMask = _mm_set1_epi32(static_cast<int>(orMask));
+            for (; x + 4 <= width; x += 4)
+            {
+                __m128i* pBlock = reinterpret_cast<__m128i*>(pRow + x);
+                __m128i vPixels = _mm_loadu_si128(pBlock);
+                if (fReplaceNonOpaque)
+                {
+                    __m128i vOpaque = _mm_cmpeq_epi32(_mm_and_si128(vPixels, vAlphaMask), vAlphaMask);
+                    vPixels = _mm_or_si128(_mm_and_si128(vOpaque, vPixels), _mm_andnot_si128(vOpaque, vBackground));
+                }
+                _mm_storeu_si128(pBlock, _mm_or_si128(_mm_and_si128(vPixels, vAndMask), vOrMask));
+            }
+#elif defined(VSUI_PIXELS_NEON)
+            const uint32x4_t vAlphaMask = vdupq_n_u32(k_AlphaMask);
+            const uint32x4_t vBackground = vdupq_n_u32(background);
+            const uint32x4_t vAndMask = vdupq_n_u32(andMask);
+            const uint32x4_t vOrMask = vdupq_n_u32(orMask);
+            for (; x + 4 <= width; x += 4)
+            {
+                uint32x4_t vPixels = vld1q_u32(pRow + x);
+                if (fReplaceNonOpaque)
+                {
+                    uint32x4_t vOpaque = vceqq_u32(vandq_u32(vPixels, vAlphaMask), vAlphaMask);
+                    vPixels = vbslq_u32(vOpaque, vPixels, vBackground);
+                }
+                vst1q_u32(pRow + x, vorrq_u32(vandq_u32(vPixels, vAndMask), vOrMask));
+            }
+#endif
+
+            for (; x < width; x++)
+            {
+                uint32_t pixel = pRow[x];
+                if (fReplaceNonOpaque && (pixel & k_AlphaMask) != k_AlphaMask)
+                {
+                    pixel = background;
+                }
+                pRow[x] = (pixel & andMask) | orMask;
+            }
+        }
+
+        static unsigned int ReplaceKeyColorsCore(uint32_t* pRow, unsigned int width, const uint32_t* pKeys, unsigned int keyCount, uint32_t replacement)
+        {
+            unsigned int foundKeys = 0;
+            unsigned int x = 0;
+
+#if defined(VSUI_PIXELS_AVX2)
+            // 8 pixels at a time. Blocks without any key are not written back.
+            const __m256i vReplacement = _mm256_set1_epi32(static_cast<int>(replacement));
+            __m256i vKeys[k_MaxKeyColors];
+            __m256i vFound[k_MaxKeyColors];
+            for (unsigned int k = 0; k < keyCount; k++)
+            {
+                vKeys[k] = _mm256_set1_epi32(static_cast<int>(pKeys[k]));
+                vFound[k] = _mm256_setzero_si256();
+            }
+
+            for (; x + 8 <= width; x += 8)
+            {
+                __m256i* pBlock = reinterpret_cast<__m256i*>(pRow + x);
+                __m256i vPixels = _mm256_loadu_si256(pBlock);
+                __m256i vMatch = _mm256_setzero_si256();
+                for (unsigned int k = 0; k < keyCount; k++)
+                {
+                    __m256i vKeyMatch = _mm256_cmpeq_epi32(vPixels, vKeys[k]);
+                    vFound[k] = _mm256_or_si256(vFound[k], vKeyMatch);
+                    vMatch = _mm256_or_si256(vMatch, vKeyMatch);
+                }
+
+                if (!_mm256_testz_si256(vMatch, vMatch))
+                {
+                    _mm256_storeu_si256(pBlock, _mm256_blendv_epi8(vPixels, vReplacement, vMatch));
+                }
+            }
+
+            for (unsigned int k = 0; k < keyCount; k++)
+            {
+                if (!_mm256_testz_si256(vFound[k], vFound[k]))
+                    foundKeys |= 1u << k;
+            }
+#elif defined(VSUI_PIXELS_SSE2)
+            // 4 pixels at a time. Blocks without any key are not written back.
+            const __m128i vReplacement = _mm_set1_epi32(static_cast<int>(replacement));
+            __m128i vKeys[k_MaxKeyColors];
+            __m128i vFound[k_MaxKeyColors];
+            for (unsigned int k = 0; k < keyCount; k++)
+            {
+                vKeys[k] = _mm_set1_epi32(static_cast<int>(pKeys[k]));
+                vFound[k] = _mm_setzero_si128();
+            }
+
+            for (; x + 4 <= width; x += 4)
+            {
+                __m128i* pBlock = reinterpret_cast<__m128i*>(pRow + x);
+                __m128i vPixels = _mm_loadu_si128(pBlock);
+                __m128i vMatch = _mm_setzero_si128();
+                for (unsigned int k = 0; k < keyCount; k++)
+                {
+                    __m128i vKeyMatch = _mm_cmpeq_epi32(vPixels, vKeys[k]);
+                    vFound[k] = _mm_or_si128(vFound[k], vKeyMatch);
+                    vMatch = _mm_or_si128(vMatch, vKeyMatch);
+                }
+
+                if (_mm_movemask_epi8(vMatch) != 0)
+                {
+                    _mm_storeu_si128(pBlock, _mm_or_si128(_mm_andnot_si128(vMatch, vPixels), _mm_and_si128(vMatch, vReplacement)));
+                }
+            }
+
+            for (unsigned int k = 0; k < keyCount; k++)
+            {
+                if (_mm_movemask_epi8(vFound[k]) != 0)
+                    foundKeys |= 1u << k;
+            }
+#elif defined(VSUI_PIXELS_NEON)
+            // 4 pixels at a time. Blocks without any key are not written back.
+            const uint32x4_t vReplacement = vdupq_n_u32(replacement);
+            uint32x4_t vKeys[k_MaxKeyColors];
+            uint32x4_t vFound[k_MaxKeyColors];
+            for (unsigned int k = 0; k < keyCount; k++)
+            {
+                vKeys[k] = vdupq_n_u32(pKeys[k]);
+                vFound[k] = vdupq_n_u32(0);
+            }
+
+            for (; x + 4 <= width; x += 4)
+            {
+                uint32x4_t vPixels = vld1q_u32(pRow + x);
+                uint32x4_t vMatch = vdupq_n_u32(0);
+                for (unsigned int k = 0; k < keyCount; k++)
+                {
+                    uint32x4_t vKeyMatch = vceqq_u32(vPixels, vKeys[k]);
+                    vFound[k] = vorrq_u32(vFound[k], vKeyMatch);
+                    vMatch = vorrq_u32(vMatch, vKeyMatch);
+                }
+
+                uint32x2_t vMatchHalves = vorr_u32(vget_low_u32(vMatch), vget_high_u32(vMatch));
+                if ((vget_lane_u32(vMatchHalves, 0) | vget_lane_u32(vMatchHalves, 1)) != 0)
+                {
+                    vst1q_u32(pRow + x, vbslq_u32(vMatch, vReplacement, vPixels));
+                }
+            }
+
+            for (unsigned int k = 0; k < keyCount; k++)
+            {
+                uint32x2_t vFoundHalves = vorr_u32(vget_low_u32(vFound[k]), vget_high_u32(vFound[k]));
+                if ((vget_lane_u32(vFoundHalves, 0) | vget_lane_u32(vFoundHalves, 1)) != 0)
+                    foundKeys |= 1u << k;
+            }
+#endif
+
+            // Scalar loop for the remaining pixels (or the whole row when no SIMD is available). Like the SIMD loops, it
+            // reports every key equal to the pixel, so the mask doesn't depend on the width when keys are repeated.
+            for (; x < width; x++)
+            {
+                unsigned int matchingKeys = 0;
+                for (unsigned int k = 0; k < keyCount; k++)
+                {
+                    if (pRow[x] == pKeys[k])
+                        matchingKeys |= 1u << k;
+                }
+
+                if (matchingKeys != 0)
+                {
+                    pRow[x] = replacement;
+                    foundKeys |= matchingKeys;
+                }
+            }
+
+            return foundKeys;
+        }
+    };
+
+} // namespace VsUI
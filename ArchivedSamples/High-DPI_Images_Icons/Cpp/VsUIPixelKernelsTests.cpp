@@ -0,0 +1,279 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Tests of CPixelKernels against scalar reference loops
+// The rows are 0 to 33 pixels wide, so the SIMD paths (4 or 8 pixels at a
+// time) are checked with every length of scalar tail, and start one pixel
+// into their buffer so the unaligned loads and stores are covered too.
+// Guard pixels around each row must be left untouched.
+//-----------------------------------------------------------------------------
+#include "VsUIPixelKernels.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "VsUITests.h"
+
+using namespace VsUI;
+
+namespace
+{
+    const unsigned int k_MaxWidth = 33;
+    const uint32_t k_Guard = 0xDEADBEEF;
+    const uint32_t k_Magenta = 0xFFFF00FF;
+    const uint32_t k_NearGreen = 0xFF00FE00;
+
+    // Row of width pixels starting one pixel into a buffer, with guard pixels on both sides
+    class CGuardedRow
+    {
+    public:
+        CGuardedRow(const std::vector<uint32_t>& pixels) :
+            m_buffer(pixels.size() + 2, k_Guard)
+        {
+            std::copy(pixels.begin(), pixels.end(), m_buffer.begin() + 1);
+        }
+
+        uint32_t* GetPixels()
+        {
+            return m_buffer.data() + 1;
+        }
+
+        std::vector<uint32_t> GetRow() const
+        {
+            return std::vector<uint32_t>(m_buffer.begin() + 1, m_buffer.end() - 1);
+        }
+
+        bool AreGuardsIntact() const
+        {
+            return m_buffer.front() == k_Guard && m_buffer.back() == k_Guard;
+        }
+
+    private:
+        std::vector<uint32_t> m_buffer;
+    };
+
+    // Random pixels of every kind: opaque, transparent, translucent, and about one in four of the given colors
+    std::vector<uint32_t> MakeRow(unsigned int width, std::mt19937& random, const uint32_t* pColors, unsigned int colorCount)
+    {
+        std::vector<uint32_t> pixels(width);
+        for (uint32_t& pixel : pixels)
+        {
+            uint32_t r = random();
+            switch (r % 8)
+            {
+            case 0:
+            case 1:
+                pixel = colorCount != 0 ? pColors[(r >> 8) % colorCount] : r;
+                break;
+            case 2:
+                pixel = r & 0x00FFFFFF;
+                break;
+            case 3:
+                pixel = r & 0x7FFFFFFF;
+                break;
+            default:
+                pixel = r | 0xFF000000;
+                break;
+            }
+        }
+        return pixels;
+    }
+
+    unsigned int ReplaceKeyColorsReference(std::vector<uint32_t>& pixels, const uint32_t* pKeys, unsigned int keyCount, uint32_t replacement)
+    {
+        unsigned int foundKeys = 0;
+        for (uint32_t& pixel : pixels)
+        {
+            bool fMatch = false;
+            for (unsigned int k = 0; k < keyCount; k++)
+            {
+                if (pixel == pKeys[k])
+                {
+                    foundKeys |= 1u << k;
+                    fMatch = true;
+                }
+            }
+            if (fMatch)
+            {
+                pixel = replacement;
+            }
+        }
+        return foundKeys;
+    }
+
+    void MaskPixelsReference(std::vector<uint32_t>& pixels, bool fReplaceNonOpaque, uint32_t background, uint32_t andMask, uint32_t orMask)
+    {
+        for (uint32_t& pixel : pixels)
+        {
+            if (fReplaceNonOpaque && (pixel >> 24) != 0xFF)
+            {
+                pixel = background;
+            }
+            pixel = (pixel & andMask) | orMask;
+        }
+    }
+}
+
+VSUI_TEST(ReplaceKeyColorsMatchesTheReference)
+{
+    const uint32_t keys[] = { k_Magenta, k_NearGreen, 0xFF808080, 0x00000000 };
+    std::mt19937 random(1);
+    for (unsigned int keyCount = 0; keyCount <= CPixelKernels::k_MaxKeyColors; keyCount++)
+    {
+        for (unsigned int width = 0; width <= k_MaxWidth; width++)
+        {
+            for (int iteration = 0; iteration < 20; iteration++)
+            {
+                std::vector<uint32_t> expected = MakeRow(width, random, keys, CPixelKernels::k_MaxKeyColors);
+                CGuardedRow row(expected);
+
+                unsigned int expectedKeys = ReplaceKeyColorsReference(expected, keys, keyCount, 0x00FFFFFF);
+                unsigned int foundKeys = CPixelKernels::ReplaceKeyColors(row.GetPixels(), width, keys, keyCount, 0x00FFFFFFu);
+                if (!VSUI_CHECK_EQUAL(expectedKeys, foundKeys) || !VSUI_CHECK(row.GetRow() == expected) || !VSUI_CHECK(row.AreGuardsIntact()))
+                {
+                    fprintf(stderr, "    %u keys, width %u\n", keyCount, width);
+                    return;
+                }
+            }
+        }
+    }
+}
+
+VSUI_TEST(ReplaceKeyColorsReportsRepeatedKeysAtAnyWidth)
+{
+    // Every key equal to a pixel is reported, whether the pixel is in a SIMD block or in the scalar tail
+    const uint32_t keys[] = { k_Magenta, k_Magenta };
+    for (unsigned int width = 1; width <= k_MaxWidth; width++)
+    {
+        std::vector<uint32_t> pixels(width, k_Magenta);
+        VSUI_CHECK_EQUAL(3u, CPixelKernels::ReplaceKeyColors(pixels.data(), width, keys, 2, 0u));
+        VSUI_CHECK(pixels == std::vector<uint32_t>(width, 0u));
+    }
+}
+
+VSUI_TEST(ReplaceKeyColorsIgnoresKeysPastTheMaximum)
+{
+    const uint32_t keys[] = { 1, 2, 3, 4, 5 };
+    std::vector<uint32_t> pixels = { 1, 2, 3, 4, 5, 1, 2, 3, 4, 5 };
+    VSUI_CHECK_EQUAL(0xFu, CPixelKernels::ReplaceKeyColors(pixels.data(), static_cast<unsigned int>(pixels.size()), keys, 5, 0u));
+    VSUI_CHECK((pixels == std::vector<uint32_t>{ 0, 0, 0, 0, 5, 0, 0, 0, 0, 5 }));
+}
+
+VSUI_TEST(ReplacementEqualToAKeyIsNotReplacedAgain)
+{
+    // The replacement is written once; it isn't matched against the keys that follow
+    const uint32_t keys[] = { 1, 2 };
+    for (unsigned int width = 1; width <= k_MaxWidth; width++)
+    {
+        std::vector<uint32_t> pixels(width, 1);
+        VSUI_CHECK_EQUAL(1u, CPixelKernels::ReplaceKeyColors(pixels.data(), width, keys, 2, 2u));
+        VSUI_CHECK(pixels == std::vector<uint32_t>(width, 2u));
+    }
+}
+
+VSUI_TEST(ReplaceNonOpaquePixelsMatchesTheReference)
+{
+    struct Masks
+    {
+        uint32_t background;
+        uint32_t andMask;
+        uint32_t orMask;
+    };
+    const Masks masks[] =
+    {
+        { 0x00000000, 0xFFFFFFFF, 0x00000000 },
+        { 0xFFF6F6F6, 0x00FFFFFF, 0xFF000000 },
+        { 0x12345678, 0x00FFFFFF, 0x00000000 },
+    };
+
+    std::mt19937 random(2);
+    for (const Masks& mask : masks)
+    {
+        for (unsigned int width = 0; width <= k_MaxWidth; width++)
+        {
+            for (int iteration = 0; iteration < 20; iteration++)
+            {
+                std::vector<uint32_t> expected = MakeRow(width, random, nullptr, 0);
+                CGuardedRow row(expected);
+
+                MaskPixelsReference(expected, true, mask.background, mask.andMask, mask.orMask);
+                CPixelKernels::ReplaceNonOpaquePixels(row.GetPixels(), width, mask.background, mask.andMask, mask.orMask);
+                if (!VSUI_CHECK(row.GetRow() == expected) || !VSUI_CHECK(row.AreGuardsIntact()))
+                {
+                    fprintf(stderr, "    width %u\n", width);
+                    return;
+                }
+            }
+        }
+    }
+}
+
+VSUI_TEST(MaskPixelsMatchesTheReference)
+{
+    std::mt19937 random(3);
+    for (unsigned int width = 0; width <= k_MaxWidth; width++)
+    {
+        for (int iteration = 0; iteration < 20; iteration++)
+        {
+            uint32_t andMask = random();
+            uint32_t orMask = random() & ~andMask;
+            std::vector<uint32_t> expected = MakeRow(width, random, nullptr, 0);
+            CGuardedRow row(expected);
+
+            MaskPixelsReference(expected, false, 0, andMask, orMask);
+            CPixelKernels::MaskPixels(row.GetPixels(), width, andMask, orMask);
+            if (!VSUI_CHECK(row.GetRow() == expected) || !VSUI_CHECK(row.AreGuardsIntact()))
+            {
+                fprintf(stderr, "    width %u\n", width);
+                return;
+            }
+        }
+    }
+}
+
+VSUI_TEST(ReplicatePixelsMatchesTheReference)
+{
+    std::mt19937 random(4);
+    for (unsigned int factor = 1; factor <= 8; factor++)
+    {
+        for (unsigned int width = 0; width <= k_MaxWidth; width++)
+        {
+            std::vector<uint32_t> source = MakeRow(width, random, nullptr, 0);
+            std::vector<uint32_t> expected;
+            for (uint32_t pixel : source)
+            {
+                expected.insert(expected.end(), factor, pixel);
+            }
+
+            CGuardedRow destination(std::vector<uint32_t>(static_cast<size_t>(width) * factor, 0));
+            CPixelKernels::ReplicatePixels(source.data(), width, factor, destination.GetPixels());
+            if (!VSUI_CHECK(destination.GetRow() == expected) || !VSUI_CHECK(destination.AreGuardsIntact()))
+            {
+                fprintf(stderr, "    factor %u, width %u\n", factor, width);
+                return;
+            }
+        }
+    }
+}
+
+VSUI_TEST(ForEachRowFollowsNegativeStrides)
+{
+    // Bottom-up buffer: the first row is the last one in memory
+    std::vector<uint32_t> pixels(3 * 4, 0);
+    ptrdiff_t stride = -static_cast<ptrdiff_t>(4 * sizeof(uint32_t));
+    uint32_t rowIndex = 0;
+    CPixelKernels::ForEachRow<uint32_t>(pixels.data() + 2 * 4, stride, 3, 3, [&](uint32_t* pRow, unsigned int width)
+    {
+        CPixelKernels::ForEachPixel(pRow, width, [&](uint32_t* pPixel) { *pPixel = rowIndex + 1; });
+        rowIndex++;
+    });
+
+    VSUI_CHECK((pixels == std::vector<uint32_t>{ 3, 3, 3, 0, 2, 2, 2, 0, 1, 1, 1, 0 }));
+}
+
+VSUI_TEST_MAIN()
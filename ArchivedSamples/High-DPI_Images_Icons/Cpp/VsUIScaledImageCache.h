@@ -0,0 +1,350 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Process-wide cache of images scaled from logical to device units
+// Entries are keyed by the identity of the logical image (the module and
+// resource it was loaded from, or a hash of its pixels), the DPI values and
+// the actual scaling mode and background color used to scale it. Images
+// identified by their content keep a copy of their logical pixels, compared
+// on every hit, so two images with the same hash never share an entry. The scaled
+// 32bpp ARGB pixels are immutable once cached, and are handed out as shared
+// pointers so any number of windows can use them without copying.
+// The least recently used entries are evicted when the total size of the
+// cached pixels exceeds the byte budget.
+// Thread safe; doesn't depend on Windows or GDI+.
+//-----------------------------------------------------------------------------
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <vector>
+
+namespace VsUI
+{
+    class CScaledImageCache
+    {
+    public:
+        struct Key
+        {
+            const void* pModule;     // Module the logical image was loaded from, or nullptr if the image is identified by its content
+            uint32_t resourceId;     // Resource the logical image was loaded from, or 0
+            uint64_t contentHash;    // Hash of the logical image pixels (see HashPixels), or 0 for resource images
+            uint32_t pixelFormat;    // Pixel format of the scaled image
+            int logicalWidth;
+            int logicalHeight;
+            int deviceDpiX;
+            int deviceDpiY;
+            int logicalDpiX;
+            int logicalDpiY;
+            int scalingMode;         // Actual scaling mode (never the Default mode)
+            uint32_t background;
+
+            bool operator==(const Key& other) const
+            {
+                return pModule == other.pModule && resourceId == other.resourceId && contentHash == other.contentHash &&
+                    pixelFormat == other.pixelFormat && logicalWidth == other.logicalWidth && logicalHeight == other.logicalHeight &&
+                    deviceDpiX == other.deviceDpiX && deviceDpiY == other.deviceDpiY &&
+                    logicalDpiX == other.logicalDpiX && logicalDpiY == other.logicalDpiY &&
+                    scalingMode == other.scalingMode && background == other.background;
+            }
+        };
+
+        struct KeyHash
+        {
+            size_t operator()(const Key& key) const
+            {
+                uint64_t hash = k_HashOffset;
+                hash = HashValue(hash, reinterpret_cast<uintptr_t>(key.pModule));
+                hash = HashValue(hash, key.resourceId);
+                hash = HashValue(hash, key.contentHash);
+                hash = HashValue(hash, key.pixelFormat);
+                hash = HashValue(hash, static_cast<uint32_t>(key.logicalWidth) | (static_cast<uint64_t>(static_cast<uint32_t>(key.logicalHeight)) << 32));
+                hash = HashValue(hash, static_cast<uint32_t>(key.deviceDpiX) | (static_cast<uint64_t>(static_cast<uint32_t>(key.deviceDpiY)) << 32));
+                hash = HashValue(hash, static_cast<uint32_t>(key.logicalDpiX) | (static_cast<uint64_t>(static_cast<uint32_t>(key.logicalDpiY)) << 32));
+                hash = HashValue(hash, static_cast<uint32_t>(key.scalingMode) | (static_cast<uint64_t>(key.background) << 32));
+                return static_cast<size_t>(hash);
+            }
+        };
+
+        // Scaled 32bpp ARGB image, with rows of width pixels stored top-down
+        struct Image
+        {
+            int width;
+            int height;
+            std::vector<uint32_t> pixels;
+
+            size_t SizeInBytes() const
+            {
+                return pixels.size() * sizeof(uint32_t);
+            }
+        };
+
+        // Logical 32bpp pixels of an image identified by its content. The stride is in bytes.
+        struct LogicalPixels
+        {
+            const uint32_t* pBits;
+            int width;
+            int height;
+            ptrdiff_t stride;
+        };
+
+        struct Statistics
+        {
+            uint64_t hits;
+            uint64_t misses;
+            uint64_t evictions;
+            size_t entries;
+            size_t bytes;
+            size_t byteBudget;
+        };
+
+        static const size_t k_DefaultByteBudget = 16 * 1024 * 1024;
+
+        explicit CScaledImageCache(size_t byteBudget = k_DefaultByteBudget) :
+            m_byteBudget(byteBudget), m_bytes(0), m_hits(0), m_misses(0), m_evictions(0)
+        {
+        }
+
+        // Returns the cache shared by all the DPI helpers in the process
+        static CScaledImageCache& GetInstance()
+        {
+            static CScaledImageCache s_instance;
+            return s_instance;
+        }
+
+        // Returns the cached image for the key and marks it as the most recently used, or nullptr if it's not cached. Images identified
+        // by their content (key.pModule is nullptr) are only found with the same logical pixels; a hash collision is a miss.
+        std::shared_ptr<const Image> Find(const Key& key, const LogicalPixels* pLogicalPixels = nullptr)
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+
+            auto mapIter = m_index.find(key);
+            if (mapIter == m_index.end() || !HasLogicalPixels(*mapIter->second, pLogicalPixels))
+            {
+                m_misses++;
+                return nullptr;
+            }
+
+            m_hits++;
+            m_entries.splice(m_entries.begin(), m_entries, mapIter->second);
+            return mapIter->second->spImage;
+        }
+
+        // Adds the image to the cache and returns the cached image for the key. If another thread cached an image for the same key
+        // first, that image is returned. Images identified by their content are cached with a copy of their logical pixels, which
+        // must be given and count against the byte budget. Images that don't fit in the byte budget, or whose key is cached for
+        // other logical pixels, are returned without being cached.
+        std::shared_ptr<const Image> Insert(const Key& key, std::shared_ptr<const Image> spImage, const LogicalPixels* pLogicalPixels = nullptr)
+        {
+            if (!spImage)
+                return nullptr;
+
+            bool fContentImage = (key.pModule == nullptr);
+            if (fContentImage && (pLogicalPixels == nullptr || pLogicalPixels->width != key.logicalWidth || pLogicalPixels->height != key.logicalHeight))
+                return spImage;
+
+            std::lock_guard<std::mutex> lock(m_lock);
+
+            auto mapIter = m_index.find(key);
+            if (mapIter != m_index.end())
+            {
+                if (!HasLogicalPixels(*mapIter->second, pLogicalPixels))
+                    return spImage;
+
+                m_entries.splice(m_entries.begin(), m_entries, mapIter->second);
+                return mapIter->second->spImage;
+            }
+
+            size_t size = spImage->SizeInBytes() + (fContentImage ? static_cast<size_t>(key.logicalWidth) * key.logicalHeight * sizeof(uint32_t) : 0);
+            if (size > m_byteBudget)
+                return spImage;
+
+            // Caching is only an optimization: if memory is short, just return the image
+            bool fAdded = false;
+            try
+            {
+                m_entries.push_front(Entry());
+                fAdded = true;
+                Entry& entry = m_entries.front();
+                entry.key = key;
+                entry.spImage = spImage;
+                if (fContentImage)
+                {
+                    entry.logicalPixels.resize(static_cast<size_t>(key.logicalWidth) * key.logicalHeight);
+                    for (int y = 0; y < key.logicalHeight; y++)
+                    {
+                        memcpy(&entry.logicalPixels[static_cast<size_t>(y) * key.logicalWidth], GetRow(*pLogicalPixels, y), key.logicalWidth * sizeof(uint32_t));
+                    }
+                }
+                m_index[key] = m_entries.begin();
+            }
+            catch (const std::bad_alloc&)
+            {
+                if (fAdded)
+                    m_entries.pop_front();
+                return spImage;
+            }
+
+            m_bytes += size;
+            EvictToBudget(m_byteBudget);
+            return spImage;
+        }
+
+        // Changes the maximum size of the cached pixels, evicting the least recently used images if necessary
+        void SetByteBudget(size_t byteBudget)
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_byteBudget = byteBudget;
+            EvictToBudget(m_byteBudget);
+        }
+
+        // Removes the images loaded from the resources of the module (e.g. before it's unloaded, since another module loaded at the
+        // same address would otherwise find them). Images still used by callers stay alive until they are released.
+        void RemoveModule(const void* pModule)
+        {
+            if (pModule == nullptr)
+                return;
+
+            std::lock_guard<std::mutex> lock(m_lock);
+            for (auto entryIter = m_entries.begin(); entryIter != m_entries.end();)
+            {
+                if (entryIter->key.pModule == pModule)
+                {
+                    m_bytes -= entryIter->SizeInBytes();
+                    m_index.erase(entryIter->key);
+                    entryIter = m_entries.erase(entryIter);
+                }
+                else
+                {
+                    ++entryIter;
+                }
+            }
+        }
+
+        // Removes all the images from the cache. Images still used by callers stay alive until they are released.
+        void Clear()
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_index.clear();
+            m_entries.clear();
+            m_bytes = 0;
+        }
+
+        Statistics GetStatistics() const
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            Statistics statistics = { m_hits, m_misses, m_evictions, m_entries.size(), m_bytes, m_byteBudget };
+            return statistics;
+        }
+
+        void ResetStatistics()
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_hits = 0;
+            m_misses = 0;
+            m_evictions = 0;
+        }
+
+        // Hashes the pixels of a 32bpp image, two pixels at a time. The stride is in bytes.
+        static uint64_t HashPixels(const uint32_t* pBits, int width, int height, ptrdiff_t stride)
+        {
+            uint64_t hash = k_HashOffset;
+            for (int y = 0; y < height; y++)
+            {
+                const uint32_t* pRow = reinterpret_cast<const uint32_t*>(reinterpret_cast<const unsigned char*>(pBits) + y * stride);
+                int x = 0;
+                for (; x + 2 <= width; x += 2)
+                {
+                    hash = HashValue(hash, pRow[x] | (static_cast<uint64_t>(pRow[x + 1]) << 32));
+                }
+                if (x < width)
+                {
+                    hash = HashValue(hash, pRow[x]);
+                }
+            }
+            return hash;
+        }
+
+    private:
+        struct Entry
+        {
+            Key key;
+            std::shared_ptr<const Image> spImage;
+            std::vector<uint32_t> logicalPixels;     // Copy of the logical pixels of the images identified by their content, rows of key.logicalWidth pixels
+
+            size_t SizeInBytes() const
+            {
+                return spImage->SizeInBytes() + logicalPixels.size() * sizeof(uint32_t);
+            }
+        };
+
+        static const uint64_t k_HashOffset = 14695981039346656037ULL;
+        static const uint64_t k_HashMultiplier = 0x9E3779B97F4A7C15ULL;
+
+        // Multiply and fold the high bits back, so every bit of the value affects all the bits of the hash
+        static uint64_t HashValue(uint64_t hash, uint64_t value)
+        {
+            hash = (hash ^ value) * k_HashMultiplier;
+            return hash ^ (hash >> 32);
+        }
+
+        static const uint32_t* GetRow(const LogicalPixels& pixels, int y)
+        {
+            return reinterpret_cast<const uint32_t*>(reinterpret_cast<const unsigned char*>(pixels.pBits) + y * pixels.stride);
+        }
+
+        // Returns true if the entry is the image of the logical pixels. Images loaded from resources are identified by their key alone.
+        static bool HasLogicalPixels(const Entry& entry, const LogicalPixels* pLogicalPixels)
+        {
+            if (entry.key.pModule != nullptr)
+                return true;
+
+            int width = entry.key.logicalWidth;
+            int height = entry.key.logicalHeight;
+            if (pLogicalPixels == nullptr || pLogicalPixels->width != width || pLogicalPixels->height != height)
+                return false;
+
+            for (int y = 0; y < height; y++)
+            {
+                if (memcmp(&entry.logicalPixels[static_cast<size_t>(y) * width], GetRow(*pLogicalPixels, y), width * sizeof(uint32_t)) != 0)
+                    return false;
+            }
+
+            return true;
+        }
+
+        // Must be called with the lock held
+        void EvictToBudget(size_t byteBudget)
+        {
+            while (m_bytes > byteBudget && !m_entries.empty())
+            {
+                const Entry& entry = m_entries.back();
+                m_bytes -= entry.SizeInBytes();
+                m_index.erase(entry.key);
+                m_entries.pop_back();
+                m_evictions++;
+            }
+        }
+
+        mutable std::mutex m_lock;
+        // Most recently used entries first
+        std::list<Entry> m_entries;
+        std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> m_index;
+        size_t m_byteBudget;
+        size_t m_bytes;
+        uint64_t m_hits;
+        uint64_t m_misses;
+        uint64_t m_evictions;
+    };
+
+} // namespace
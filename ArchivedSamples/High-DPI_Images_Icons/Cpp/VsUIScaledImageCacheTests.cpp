@@ -0,0 +1,304 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Tests of CScaledImageCache: the least recently used eviction within the
+// byte budget, the counters, the removal of the images of an unloaded module,
+// and the comparison of the logical pixels of the images identified by their
+// content, so hash collisions are misses.
+//-----------------------------------------------------------------------------
+#include "VsUIScaledImageCache.h"
+
+#include <algorithm>
+#include <vector>
+
+#include "VsUITests.h"
+
+using namespace VsUI;
+
+namespace
+{
+    std::shared_ptr<const CScaledImageCache::Image> MakeImage(int size)
+    {
+        auto spImage = std::make_shared<CScaledImageCache::Image>();
+        spImage->width = size;
+        spImage->height = size;
+        spImage->pixels.resize(static_cast<size_t>(size) * size);
+        return spImage;
+    }
+
+    CScaledImageCache::Key MakeKey(const void* pModule, uint32_t resourceId, uint64_t contentHash)
+    {
+        CScaledImageCache::Key key = {};
+        key.pModule = pModule;
+        key.resourceId = resourceId;
+        key.contentHash = contentHash;
+        key.logicalWidth = 16;
+        key.logicalHeight = 16;
+        key.deviceDpiX = 144;
+        key.deviceDpiY = 144;
+        key.logicalDpiX = 96;
+        key.logicalDpiY = 96;
+        return key;
+    }
+
+    // 16x16 logical pixels, matching the keys of MakeKey
+    std::vector<uint32_t> MakeLogicalPixels(uint32_t seed)
+    {
+        std::vector<uint32_t> pixels(16 * 16);
+        for (size_t i = 0; i < pixels.size(); i++)
+        {
+            pixels[i] = seed * 0x01000193u + static_cast<uint32_t>(i);
+        }
+        return pixels;
+    }
+
+    CScaledImageCache::LogicalPixels View(const std::vector<uint32_t>& pixels, int width = 16)
+    {
+        CScaledImageCache::LogicalPixels view = { pixels.data(), width, static_cast<int>(pixels.size()) / width, static_cast<ptrdiff_t>(width) * 4 };
+        return view;
+    }
+
+    // Size of the 16x16 device images cached for the resource keys
+    const size_t k_ImageBytes = 16 * 16 * 4;
+}
+
+VSUI_TEST(RemoveModuleRemovesOnlyItsImages)
+{
+    CScaledImageCache cache;
+    int module = 0;
+    int otherModule = 0;
+    cache.Insert(MakeKey(&module, 1, 0), MakeImage(24));
+    cache.Insert(MakeKey(&module, 2, 0), MakeImage(24));
+    cache.Insert(MakeKey(&otherModule, 1, 0), MakeImage(24));
+    std::vector<uint32_t> logicalPixels = MakeLogicalPixels(1);
+    CScaledImageCache::LogicalPixels view = View(logicalPixels);
+    cache.Insert(MakeKey(nullptr, 0, 0x1234), MakeImage(32), &view);
+
+    cache.RemoveModule(&module);
+
+    CScaledImageCache::Statistics statistics = cache.GetStatistics();
+    VSUI_CHECK_EQUAL(2u, statistics.entries);
+    VSUI_CHECK_EQUAL((24u * 24 + 32 * 32 + 16 * 16) * 4, statistics.bytes);
+    VSUI_CHECK(!cache.Find(MakeKey(&module, 1, 0)));
+    VSUI_CHECK(!cache.Find(MakeKey(&module, 2, 0)));
+    VSUI_CHECK(cache.Find(MakeKey(&otherModule, 1, 0)) != nullptr);
+    VSUI_CHECK(cache.Find(MakeKey(nullptr, 0, 0x1234), &view) != nullptr);
+
+    // Another module loaded at the same address gets its own images
+    cache.Insert(MakeKey(&module, 1, 0), MakeImage(16));
+    VSUI_CHECK_EQUAL(16, cache.Find(MakeKey(&module, 1, 0))->width);
+}
+
+VSUI_TEST(RemoveNullModuleKeepsTheContentImages)
+{
+    CScaledImageCache cache;
+    std::vector<uint32_t> logicalPixels = MakeLogicalPixels(1);
+    CScaledImageCache::LogicalPixels view = View(logicalPixels);
+    cache.Insert(MakeKey(nullptr, 0, 0x1234), MakeImage(16), &view);
+
+    cache.RemoveModule(nullptr);
+    VSUI_CHECK_EQUAL(1u, cache.GetStatistics().entries);
+}
+
+VSUI_TEST(RemovedImagesStayAliveForTheirUsers)
+{
+    CScaledImageCache cache;
+    int module = 0;
+    std::shared_ptr<const CScaledImageCache::Image> spImage = cache.Insert(MakeKey(&module, 1, 0), MakeImage(16));
+
+    cache.RemoveModule(&module);
+    VSUI_CHECK_EQUAL(0u, cache.GetStatistics().bytes);
+    VSUI_CHECK_EQUAL(256u, spImage->pixels.size());
+}
+
+VSUI_TEST(LeastRecentlyUsedImagesAreEvictedFirst)
+{
+    CScaledImageCache cache(3 * k_ImageBytes);
+    int module = 0;
+    cache.Insert(MakeKey(&module, 1, 0), MakeImage(16));
+    cache.Insert(MakeKey(&module, 2, 0), MakeImage(16));
+    cache.Insert(MakeKey(&module, 3, 0), MakeImage(16));
+
+    // Finding the first image makes the second one the least recently used
+    VSUI_CHECK(cache.Find(MakeKey(&module, 1, 0)) != nullptr);
+    cache.Insert(MakeKey(&module, 4, 0), MakeImage(16));
+    VSUI_CHECK(!cache.Find(MakeKey(&module, 2, 0)));
+
+    // Inserting an image that is already cached uses it too
+    cache.Insert(MakeKey(&module, 3, 0), MakeImage(16));
+    cache.Insert(MakeKey(&module, 5, 0), MakeImage(16));
+    VSUI_CHECK(!cache.Find(MakeKey(&module, 1, 0)));
+    VSUI_CHECK(cache.Find(MakeKey(&module, 3, 0)) != nullptr);
+    VSUI_CHECK(cache.Find(MakeKey(&module, 4, 0)) != nullptr);
+    VSUI_CHECK(cache.Find(MakeKey(&module, 5, 0)) != nullptr);
+
+    CScaledImageCache::Statistics statistics = cache.GetStatistics();
+    VSUI_CHECK_EQUAL(3u, statistics.entries);
+    VSUI_CHECK_EQUAL(3 * k_ImageBytes, statistics.bytes);
+    VSUI_CHECK_EQUAL(2u, statistics.evictions);
+}
+
+VSUI_TEST(SetByteBudgetEvictsTheLeastRecentlyUsedImages)
+{
+    CScaledImageCache cache(4 * k_ImageBytes);
+    int module = 0;
+    for (uint32_t resourceId = 1; resourceId <= 4; resourceId++)
+    {
+        cache.Insert(MakeKey(&module, resourceId, 0), MakeImage(16));
+    }
+    VSUI_CHECK(cache.Find(MakeKey(&module, 1, 0)) != nullptr);
+
+    // A budget between two sizes keeps the images that fit
+    cache.SetByteBudget(2 * k_ImageBytes + 1);
+    CScaledImageCache::Statistics statistics = cache.GetStatistics();
+    VSUI_CHECK_EQUAL(2u, statistics.entries);
+    VSUI_CHECK_EQUAL(2 * k_ImageBytes, statistics.bytes);
+    VSUI_CHECK_EQUAL(2 * k_ImageBytes + 1, statistics.byteBudget);
+    VSUI_CHECK_EQUAL(2u, statistics.evictions);
+    VSUI_CHECK(cache.Find(MakeKey(&module, 1, 0)) != nullptr);
+    VSUI_CHECK(cache.Find(MakeKey(&module, 4, 0)) != nullptr);
+
+    // A larger budget doesn't bring anything back, and an empty budget removes everything
+    cache.SetByteBudget(4 * k_ImageBytes);
+    VSUI_CHECK_EQUAL(2u, cache.GetStatistics().entries);
+    cache.SetByteBudget(0);
+    VSUI_CHECK_EQUAL(0u, cache.GetStatistics().entries);
+    VSUI_CHECK_EQUAL(0u, cache.GetStatistics().bytes);
+    VSUI_CHECK_EQUAL(4u, cache.GetStatistics().evictions);
+}
+
+VSUI_TEST(ImagesLargerThanTheBudgetAreNotCached)
+{
+    CScaledImageCache cache(2 * k_ImageBytes);
+    int module = 0;
+    cache.Insert(MakeKey(&module, 1, 0), MakeImage(16));
+
+    // The image is returned, and the cached images are kept
+    std::shared_ptr<const CScaledImageCache::Image> spImage = MakeImage(24);
+    VSUI_CHECK(cache.Insert(MakeKey(&module, 2, 0), spImage) == spImage);
+    VSUI_CHECK(!cache.Find(MakeKey(&module, 2, 0)));
+    VSUI_CHECK(cache.Find(MakeKey(&module, 1, 0)) != nullptr);
+
+    // The logical pixels count for the images identified by their content
+    std::vector<uint32_t> logicalPixels = MakeLogicalPixels(1);
+    CScaledImageCache::LogicalPixels view = View(logicalPixels);
+    cache.Insert(MakeKey(nullptr, 0, 0x1234), MakeImage(16), &view);
+    VSUI_CHECK(cache.Find(MakeKey(nullptr, 0, 0x1234), &view) != nullptr);
+    cache.Insert(MakeKey(nullptr, 0, 0x5678), MakeImage(20), &view);
+    VSUI_CHECK(!cache.Find(MakeKey(nullptr, 0, 0x5678), &view));
+
+    CScaledImageCache::Statistics statistics = cache.GetStatistics();
+    VSUI_CHECK_EQUAL(1u, statistics.entries);
+    VSUI_CHECK_EQUAL(2 * k_ImageBytes, statistics.bytes);
+    VSUI_CHECK_EQUAL(1u, statistics.evictions);
+}
+
+VSUI_TEST(CountersCountHitsMissesAndEvictions)
+{
+    CScaledImageCache cache(k_ImageBytes);
+    int module = 0;
+    VSUI_CHECK(!cache.Find(MakeKey(&module, 1, 0)));
+    cache.Insert(MakeKey(&module, 1, 0), MakeImage(16));
+    VSUI_CHECK(cache.Find(MakeKey(&module, 1, 0)) != nullptr);
+    VSUI_CHECK(cache.Find(MakeKey(&module, 1, 0)) != nullptr);
+    cache.Insert(MakeKey(&module, 2, 0), MakeImage(16));
+    VSUI_CHECK(!cache.Find(MakeKey(&module, 1, 0)));
+
+    CScaledImageCache::Statistics statistics = cache.GetStatistics();
+    VSUI_CHECK_EQUAL(2u, statistics.hits);
+    VSUI_CHECK_EQUAL(2u, statistics.misses);
+    VSUI_CHECK_EQUAL(1u, statistics.evictions);
+    VSUI_CHECK_EQUAL(k_ImageBytes, statistics.byteBudget);
+
+    // Inserting an image that is already cached isn't a hit, and resetting keeps the images
+    cache.Insert(MakeKey(&module, 2, 0), MakeImage(16));
+    VSUI_CHECK_EQUAL(2u, cache.GetStatistics().hits);
+    cache.ResetStatistics();
+    statistics = cache.GetStatistics();
+    VSUI_CHECK_EQUAL(0u, statistics.hits);
+    VSUI_CHECK_EQUAL(0u, statistics.misses);
+    VSUI_CHECK_EQUAL(0u, statistics.evictions);
+    VSUI_CHECK_EQUAL(1u, statistics.entries);
+}
+
+VSUI_TEST(InsertReturnsTheCachedImage)
+{
+    CScaledImageCache cache;
+    int module = 0;
+    std::shared_ptr<const CScaledImageCache::Image> spFirstImage = MakeImage(16);
+    VSUI_CHECK(cache.Insert(MakeKey(&module, 1, 0), spFirstImage) == spFirstImage);
+
+    // Another thread scaled the same image: everyone shares the first one
+    VSUI_CHECK(cache.Insert(MakeKey(&module, 1, 0), MakeImage(16)) == spFirstImage);
+    VSUI_CHECK(cache.Find(MakeKey(&module, 1, 0)) == spFirstImage);
+    VSUI_CHECK_EQUAL(1u, cache.GetStatistics().entries);
+    VSUI_CHECK_EQUAL(k_ImageBytes, cache.GetStatistics().bytes);
+
+    VSUI_CHECK(!cache.Insert(MakeKey(&module, 2, 0), nullptr));
+    VSUI_CHECK_EQUAL(1u, cache.GetStatistics().entries);
+}
+
+VSUI_TEST(ContentImagesAreFoundOnlyWithTheirLogicalPixels)
+{
+    CScaledImageCache cache;
+    std::vector<uint32_t> logicalPixels = MakeLogicalPixels(1);
+    CScaledImageCache::LogicalPixels view = View(logicalPixels);
+    std::shared_ptr<const CScaledImageCache::Image> spImage = MakeImage(24);
+    cache.Insert(MakeKey(nullptr, 0, 0x1234), spImage, &view);
+    VSUI_CHECK_EQUAL((24u * 24 + 16 * 16) * 4, cache.GetStatistics().bytes);
+
+    // The cache keeps a copy of the logical pixels, and compares them with a stride
+    std::vector<uint32_t> paddedPixels(16 * 20);
+    for (int y = 0; y < 16; y++)
+    {
+        std::copy(logicalPixels.begin() + y * 16, logicalPixels.begin() + (y + 1) * 16, paddedPixels.begin() + y * 20);
+    }
+    CScaledImageCache::LogicalPixels paddedView = { paddedPixels.data(), 16, 16, 20 * 4 };
+    logicalPixels = MakeLogicalPixels(2);
+    VSUI_CHECK(cache.Find(MakeKey(nullptr, 0, 0x1234), &paddedView) == spImage);
+
+    // Other pixels with the same hash, one pixel off, no pixels, or another size are misses
+    std::vector<uint32_t> collidingPixels = MakeLogicalPixels(2);
+    CScaledImageCache::LogicalPixels collidingView = View(collidingPixels);
+    VSUI_CHECK(!cache.Find(MakeKey(nullptr, 0, 0x1234), &collidingView));
+    paddedPixels[15 * 20 + 15] ^= 1;
+    VSUI_CHECK(!cache.Find(MakeKey(nullptr, 0, 0x1234), &paddedView));
+    VSUI_CHECK(!cache.Find(MakeKey(nullptr, 0, 0x1234)));
+    CScaledImageCache::LogicalPixels narrowView = View(collidingPixels, 8);
+    VSUI_CHECK(!cache.Find(MakeKey(nullptr, 0, 0x1234), &narrowView));
+
+    CScaledImageCache::Statistics statistics = cache.GetStatistics();
+    VSUI_CHECK_EQUAL(1u, statistics.hits);
+    VSUI_CHECK_EQUAL(4u, statistics.misses);
+}
+
+VSUI_TEST(CollidingContentImagesAreNotCached)
+{
+    CScaledImageCache cache;
+    std::vector<uint32_t> logicalPixels = MakeLogicalPixels(1);
+    CScaledImageCache::LogicalPixels view = View(logicalPixels);
+    std::shared_ptr<const CScaledImageCache::Image> spImage = MakeImage(24);
+    cache.Insert(MakeKey(nullptr, 0, 0x1234), spImage, &view);
+
+    // The colliding image is returned to its caller, and the cached image stays
+    std::vector<uint32_t> collidingPixels = MakeLogicalPixels(2);
+    CScaledImageCache::LogicalPixels collidingView = View(collidingPixels);
+    std::shared_ptr<const CScaledImageCache::Image> spCollidingImage = MakeImage(24);
+    VSUI_CHECK(cache.Insert(MakeKey(nullptr, 0, 0x1234), spCollidingImage, &collidingView) == spCollidingImage);
+    VSUI_CHECK(cache.Find(MakeKey(nullptr, 0, 0x1234), &view) == spImage);
+    VSUI_CHECK(!cache.Find(MakeKey(nullptr, 0, 0x1234), &collidingView));
+    VSUI_CHECK_EQUAL(1u, cache.GetStatistics().entries);
+
+    // Content images are only cached with logical pixels of the key size
+    std::shared_ptr<const CScaledImageCache::Image> spOtherImage = MakeImage(24);
+    VSUI_CHECK(cache.Insert(MakeKey(nullptr, 0, 0x5678), spOtherImage) == spOtherImage);
+    CScaledImageCache::LogicalPixels narrowView = View(collidingPixels, 8);
+    VSUI_CHECK(cache.Insert(MakeKey(nullptr, 0, 0x5678), spOtherImage, &narrowView) == spOtherImage);
+    VSUI_CHECK_EQUAL(1u, cache.GetStatistics().entries);
+}
+
+VSUI_TEST_MAIN()
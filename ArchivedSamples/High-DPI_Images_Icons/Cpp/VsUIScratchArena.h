@@ -0,0 +1,280 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Per-thread cache of the scratch memory of the image conversions
+// Scaling an image needs a few temporary pixel buffers (the premultiplied
+// source, the intermediate rows of the separable filters, the expanded source
+// bitmap...). TScratchBuffer takes its memory from the arena of the current
+// thread and gives it back when destroyed, so converting many images in a row
+// reuses the same blocks instead of allocating them for every image.
+// The blocks grow to the largest recent requests. Every k_TrimInterval
+// requests, cached blocks much larger than anything requested in the last two
+// intervals are freed, so one huge image doesn't pin its memory forever.
+// Blocks move between the arena and the buffers, so a buffer may be destroyed
+// on any thread (its block then goes to the arena of that thread).
+// Doesn't depend on Windows.
+//-----------------------------------------------------------------------------
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace VsUI
+{
+    class CScratchArena
+    {
+    public:
+        // Memory owned by whoever holds it: the arena cache, or a scratch buffer
+        struct Block
+        {
+            std::unique_ptr<unsigned char[]> spBytes;
+            size_t capacity;
+
+            Block() : capacity(0)
+            {
+            }
+
+            Block(Block&& other) : spBytes(std::move(other.spBytes)), capacity(other.capacity)
+            {
+                other.capacity = 0;
+            }
+
+            Block& operator=(Block&& other)
+            {
+                spBytes = std::move(other.spBytes);
+                capacity = other.capacity;
+                other.capacity = 0;
+                return *this;
+            }
+        };
+
+        // Number of blocks kept per thread: a conversion uses a few scratch buffers at a time
+        static const size_t k_CachedBlockCount = 8;
+        // Blocks larger than this are freed when returned instead of being cached
+        static const size_t k_MaxCachedBytes = 64 * 1024 * 1024;
+        // Number of requests between trims. Converting an image takes a few blocks, so two intervals span hundreds of images.
+        static const unsigned int k_TrimInterval = 1024;
+
+        CScratchArena() :
+            m_largestRecentRequest(0), m_largestPreviousRequest(0), m_requestsSinceTrim(0)
+        {
+        }
+
+        // Returns the arena of the calling thread
+        static CScratchArena& GetForCurrentThread()
+        {
+            thread_local CScratchArena t_arena;
+            return t_arena;
+        }
+
+        // Returns a block of at least cb bytes, cached or newly allocated. Returns an empty block if we run out of memory.
+        Block Take(size_t cb)
+        {
+            if (cb > m_largestRecentRequest)
+            {
+                m_largestRecentRequest = cb;
+            }
+            if (++m_requestsSinceTrim >= k_TrimInterval)
+            {
+                TrimToRecentRequests();
+            }
+
+            // The smallest cached block that is large enough
+            Block* pBest = nullptr;
+            for (Block& block : m_blocks)
+            {
+                if (block.capacity >= cb && (pBest == nullptr || block.capacity < pBest->capacity))
+                {
+                    pBest = &block;
+                }
+            }
+            if (pBest != nullptr)
+                return std::move(*pBest);
+
+            // Round up so slightly larger requests (e.g. the next image size) still fit
+            size_t capacity = (cb + k_Granularity - 1) & ~(k_Granularity - 1);
+            Block block;
+            block.spBytes.reset(new (std::nothrow) unsigned char[capacity]);
+            if (block.spBytes.get() != nullptr)
+            {
+                block.capacity = capacity;
+            }
+            return block;
+        }
+
+        // Caches the block for the next requests, replacing a smaller cached block if the cache is full
+        void Return(Block&& block)
+        {
+            if (block.capacity == 0 || block.capacity > k_MaxCachedBytes)
+                return;
+
+            Block* pSmallest = &m_blocks[0];
+            for (Block& cachedBlock : m_blocks)
+            {
+                if (cachedBlock.capacity < pSmallest->capacity)
+                {
+                    pSmallest = &cachedBlock;
+                }
+            }
+
+            if (pSmallest->capacity < block.capacity)
+            {
+                *pSmallest = std::move(block);
+            }
+        }
+
+        // Frees all the cached blocks, e.g. when the thread won't convert images for a while
+        void Trim()
+        {
+            for (Block& block : m_blocks)
+            {
+                block = Block();
+            }
+            m_largestRecentRequest = 0;
+            m_largestPreviousRequest = 0;
+            m_requestsSinceTrim = 0;
+        }
+
+        size_t GetCachedBytes() const
+        {
+            size_t cb = 0;
+            for (const Block& block : m_blocks)
+            {
+                cb += block.capacity;
+            }
+            return cb;
+        }
+
+    private:
+        static const size_t k_Granularity = 4096;
+
+        // Frees the cached blocks more than twice as large as the largest request of the last two intervals
+        void TrimToRecentRequests()
+        {
+            size_t largestRequest = (m_largestRecentRequest > m_largestPreviousRequest) ? m_largestRecentRequest : m_largestPreviousRequest;
+            for (Block& block : m_blocks)
+            {
+                if (block.capacity > 2 * largestRequest + k_Granularity)
+                {
+                    block = Block();
+                }
+            }
+            m_largestPreviousRequest = m_largestRecentRequest;
+            m_largestRecentRequest = 0;
+            m_requestsSinceTrim = 0;
+        }
+
+        Block m_blocks[k_CachedBlockCount];
+        // Largest requests of the current and the previous trim intervals
+        size_t m_largestRecentRequest;
+        size_t m_largestPreviousRequest;
+        unsigned int m_requestsSinceTrim;
+    };
+
+    // Array of count uninitialized T taken from the scratch arena of the current thread, and given back when destroyed
+    template <typename T>
+    class TScratchBuffer
+    {
+        static_assert(std::is_trivially_destructible<T>::value && std::is_trivially_copyable<T>::value, "Scratch buffers only hold plain data");
+
+    public:
+        TScratchBuffer() :
+            m_count(0)
+        {
+        }
+
+        TScratchBuffer(TScratchBuffer&& other) :
+            m_block(std::move(other.m_block)), m_count(other.m_count)
+        {
+            other.m_count = 0;
+        }
+
+        TScratchBuffer& operator=(TScratchBuffer&& other)
+        {
+            if (this != &other)
+            {
+                Release();
+                m_block = std::move(other.m_block);
+                m_count = other.m_count;
+                other.m_count = 0;
+            }
+            return *this;
+        }
+
+        ~TScratchBuffer()
+        {
+            Release();
+        }
+
+        // Makes room for count elements, keeping the current block if it is large enough. The contents are not preserved.
+        // Returns false if we run out of memory.
+        bool Allocate(size_t count)
+        {
+            if (count > SIZE_MAX / sizeof(T))
+                return false;
+
+            size_t cb = count * sizeof(T);
+            if (cb > m_block.capacity)
+            {
+                Release();
+                m_block = CScratchArena::GetForCurrentThread().Take(cb);
+                if (m_block.capacity < cb)
+                    return false;
+            }
+
+            m_count = count;
+            return true;
+        }
+
+        void Release()
+        {
+            if (m_block.capacity != 0)
+            {
+                CScratchArena::GetForCurrentThread().Return(std::move(m_block));
+            }
+            m_block = CScratchArena::Block();
+            m_count = 0;
+        }
+
+        T* data()
+        {
+            return reinterpret_cast<T*>(m_block.spBytes.get());
+        }
+
+        const T* data() const
+        {
+            return reinterpret_cast<const T*>(m_block.spBytes.get());
+        }
+
+        size_t size() const
+        {
+            return m_count;
+        }
+
+        T& operator[](size_t index)
+        {
+            return data()[index];
+        }
+
+        const T& operator[](size_t index) const
+        {
+            return data()[index];
+        }
+
+    private:
+        TScratchBuffer(const TScratchBuffer&);
+        TScratchBuffer& operator=(const TScratchBuffer&);
+
+        CScratchArena::Block m_block;
+        size_t m_count;
+    };
+
+} // namespace
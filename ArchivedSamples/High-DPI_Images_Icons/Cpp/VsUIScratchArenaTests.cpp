@@ -0,0 +1,304 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Tests of CScratchArena and TScratchBuffer
+// The global operator new is replaced to count the heap allocations, so the
+// tests can check that scaling images in a row doesn't allocate once the
+// arena holds blocks large enough for them.
+//-----------------------------------------------------------------------------
+#include "VsUIScratchArena.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "VsUIImageScaler.h"
+#include "VsUITests.h"
+
+using namespace VsUI;
+
+namespace
+{
+    std::atomic<long> s_allocations(0);
+
+    void* CountedAllocate(size_t cb)
+    {
+        s_allocations++;
+        return malloc(cb != 0 ? cb : 1);
+    }
+
+    long GetAllocations()
+    {
+        return s_allocations.load();
+    }
+}
+
+void* operator new(size_t cb)
+{
+    void* p = CountedAllocate(cb);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t cb)
+{
+    void* p = CountedAllocate(cb);
+    if (p == nullptr)
+        throw std::bad_alloc();
+    return p;
+}
+
+void* operator new(size_t cb, const std::nothrow_t&) noexcept
+{
+    return CountedAllocate(cb);
+}
+
+void* operator new[](size_t cb, const std::nothrow_t&) noexcept
+{
+    return CountedAllocate(cb);
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    free(p);
+}
+
+VSUI_TEST(ScalingInARowDoesNotAllocate)
+{
+    // Every scaling mode, for every icon size and display scale factor
+    const int sizes[] = { 16, 20, 24, 32, 48, 64, 128, 256 };
+    const int percents[] = { 100, 125, 150, 175, 200, 250, 300, 400 };
+    const CImageScaler::Filter filters[] =
+    {
+        CImageScaler::Filter::NearestNeighbor, CImageScaler::Filter::Bilinear, CImageScaler::Filter::Bicubic,
+        CImageScaler::Filter::HighQualityBilinear, CImageScaler::Filter::HighQualityBicubic,
+    };
+
+    std::mt19937 random(1);
+    std::vector<std::vector<uint32_t>> sources;
+    std::vector<std::vector<uint32_t>> destinations;
+    for (int size : sizes)
+    {
+        sources.emplace_back(static_cast<size_t>(size) * size);
+        for (uint32_t& pixel : sources.back())
+        {
+            pixel = random();
+        }
+        for (int percent : percents)
+        {
+            int deviceSize = size * percent / 100;
+            destinations.emplace_back(static_cast<size_t>(deviceSize) * deviceSize);
+        }
+    }
+
+    auto scaleAll = [&]
+    {
+        size_t destination = 0;
+        for (size_t i = 0; i < sources.size(); i++)
+        {
+            for (int percent : percents)
+            {
+                int size = sizes[i];
+                int deviceSize = size * percent / 100;
+                CImageScaler::PixelBuffer sourceBuffer = { sources[i].data(), size, size, static_cast<ptrdiff_t>(size) * 4 };
+                CImageScaler::PixelBuffer destinationBuffer = { destinations[destination++].data(), deviceSize, deviceSize, static_cast<ptrdiff_t>(deviceSize) * 4 };
+                for (CImageScaler::Filter filter : filters)
+                {
+                    VSUI_CHECK(CImageScaler::Scale(sourceBuffer, destinationBuffer, filter, 0));
+                }
+                VSUI_CHECK(CImageScaler::DrawCentered(sourceBuffer, destinationBuffer, 0));
+            }
+        }
+    };
+
+    // The first passes fill the arena and the filter taps cache of the scaler
+    scaleAll();
+    scaleAll();
+
+    // A pass takes about a thousand scratch blocks, so the passes go through several trim intervals of the arena
+    long allocations = GetAllocations();
+    for (int pass = 0; pass < 8; pass++)
+    {
+        scaleAll();
+    }
+    VSUI_CHECK_EQUAL(0, GetAllocations() - allocations);
+
+    CScratchArena::GetForCurrentThread().Trim();
+}
+
+VSUI_TEST(BufferReusesTheReturnedBlock)
+{
+    CScratchArena& arena = CScratchArena::GetForCurrentThread();
+    arena.Trim();
+
+    const uint32_t* pFirst = nullptr;
+    {
+        TScratchBuffer<uint32_t> buffer;
+        VSUI_CHECK(buffer.Allocate(1000));
+        VSUI_CHECK_EQUAL(1000u, buffer.size());
+        pFirst = buffer.data();
+    }
+    VSUI_CHECK(arena.GetCachedBytes() >= 1000 * sizeof(uint32_t));
+
+    long allocations = GetAllocations();
+    {
+        TScratchBuffer<uint32_t> buffer;
+        VSUI_CHECK(buffer.Allocate(900));
+        VSUI_CHECK(buffer.data() == pFirst);
+    }
+    VSUI_CHECK_EQUAL(0, GetAllocations() - allocations);
+
+    arena.Trim();
+}
+
+VSUI_TEST(TakeReturnsTheSmallestBlockLargeEnough)
+{
+    CScratchArena& arena = CScratchArena::GetForCurrentThread();
+    arena.Trim();
+
+    CScratchArena::Block small = arena.Take(4096);
+    CScratchArena::Block large = arena.Take(64 * 1024);
+    const unsigned char* pSmall = small.spBytes.get();
+    const unsigned char* pLarge = large.spBytes.get();
+    arena.Return(std::move(large));
+    arena.Return(std::move(small));
+
+    CScratchArena::Block block = arena.Take(100);
+    VSUI_CHECK(block.spBytes.get() == pSmall);
+    arena.Return(std::move(block));
+
+    block = arena.Take(8192);
+    VSUI_CHECK(block.spBytes.get() == pLarge);
+    arena.Return(std::move(block));
+
+    arena.Trim();
+}
+
+VSUI_TEST(FullArenaKeepsTheLargestBlocks)
+{
+    CScratchArena& arena = CScratchArena::GetForCurrentThread();
+    arena.Trim();
+
+    for (size_t i = 1; i <= CScratchArena::k_CachedBlockCount + 2; i++)
+    {
+        arena.Return(arena.Take(i * 4096));
+    }
+
+    // The blocks of 3 to 10 pages replaced the blocks of 1 and 2 pages
+    size_t expected = 0;
+    for (size_t i = 3; i <= CScratchArena::k_CachedBlockCount + 2; i++)
+    {
+        expected += i * 4096;
+    }
+    VSUI_CHECK_EQUAL(expected, arena.GetCachedBytes());
+
+    arena.Trim();
+    VSUI_CHECK_EQUAL(0u, arena.GetCachedBytes());
+}
+
+VSUI_TEST(HugeBlocksAreNotCached)
+{
+    CScratchArena& arena = CScratchArena::GetForCurrentThread();
+    arena.Trim();
+
+    arena.Return(arena.Take(CScratchArena::k_MaxCachedBytes + 1));
+    VSUI_CHECK_EQUAL(0u, arena.GetCachedBytes());
+}
+
+VSUI_TEST(StaleLargeBlocksAreTrimmed)
+{
+    // One huge image, then many small ones: the huge block is freed after two trim intervals
+    CScratchArena& arena = CScratchArena::GetForCurrentThread();
+    arena.Trim();
+
+    {
+        TScratchBuffer<uint32_t> huge;
+        VSUI_CHECK(huge.Allocate(8 * 1024 * 1024));
+    }
+    VSUI_CHECK(arena.GetCachedBytes() >= 32 * 1024 * 1024);
+
+    for (unsigned int i = 0; i < 3 * CScratchArena::k_TrimInterval; i++)
+    {
+        TScratchBuffer<uint32_t> small;
+        VSUI_CHECK(small.Allocate(1000));
+    }
+    VSUI_CHECK(arena.GetCachedBytes() < 64 * 1024);
+
+    arena.Trim();
+}
+
+VSUI_TEST(AllocationFailureIsReported)
+{
+    TScratchBuffer<char> buffer;
+    VSUI_CHECK(!buffer.Allocate(static_cast<size_t>(1) << (sizeof(size_t) * 8 - 2)));
+    VSUI_CHECK_EQUAL(0u, buffer.size());
+
+    TScratchBuffer<uint32_t> overflowing;
+    VSUI_CHECK(!overflowing.Allocate(SIZE_MAX / 2));
+    VSUI_CHECK_EQUAL(0u, overflowing.size());
+}
+
+VSUI_TEST(MovedBufferOwnsTheBlock)
+{
+    TScratchBuffer<int> buffer;
+    VSUI_CHECK(buffer.Allocate(10));
+    int* pData = buffer.data();
+
+    TScratchBuffer<int> moved(std::move(buffer));
+    VSUI_CHECK_EQUAL(0u, buffer.size());
+    VSUI_CHECK(buffer.data() == nullptr);
+    VSUI_CHECK_EQUAL(10u, moved.size());
+    VSUI_CHECK(moved.data() == pData);
+
+    TScratchBuffer<int> assigned;
+    assigned = std::move(moved);
+    VSUI_CHECK_EQUAL(10u, assigned.size());
+    VSUI_CHECK(assigned.data() == pData);
+
+    CScratchArena::GetForCurrentThread().Trim();
+}
+
+VSUI_TEST(BufferDestroyedOnAnotherThreadGoesToItsArena)
+{
+    CScratchArena::GetForCurrentThread().Trim();
+
+    TScratchBuffer<uint32_t> buffer;
+    VSUI_CHECK(buffer.Allocate(1000));
+
+    size_t otherThreadCachedBytes = 0;
+    std::thread otherThread([&]
+    {
+        TScratchBuffer<uint32_t> received(std::move(buffer));
+        received.Release();
+        otherThreadCachedBytes = CScratchArena::GetForCurrentThread().GetCachedBytes();
+    });
+    otherThread.join();
+
+    VSUI_CHECK(otherThreadCachedBytes >= 1000 * sizeof(uint32_t));
+    VSUI_CHECK_EQUAL(0u, CScratchArena::GetForCurrentThread().GetCachedBytes());
+}
+
+VSUI_TEST_MAIN()
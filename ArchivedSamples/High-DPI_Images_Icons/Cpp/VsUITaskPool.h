@@ -0,0 +1,274 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Work-stealing thread pool for the pixel work of batch image conversions
+// ParallelFor splits the index range in one contiguous range per thread. Each
+// thread takes small chunks from the front of its own range, and when it runs
+// out of work it steals the back half of the range of another thread, so
+// images of very different sizes still keep all the threads busy.
+// The calling thread takes part in the work, so anything that must stay on
+// the calling thread (e.g. creating GDI handles) is done before or after the
+// ParallelFor call. Which thread processes an index is not deterministic, so
+// the work done for each index must not depend on the work done for others.
+// Doesn't depend on Windows.
+//-----------------------------------------------------------------------------
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace VsUI
+{
+    class CTaskPool
+    {
+    public:
+        explicit CTaskPool(unsigned int workerCount) :
+            m_queues(new Queue[workerCount + 1]), m_threadCount(workerCount + 1), m_chunkSize(1), m_stop(false),
+            m_generation(0), m_participants(0), m_activeWorkers(0), m_pfnInvoke(nullptr), m_pBody(nullptr)
+        {
+            for (unsigned int i = 0; i < workerCount; i++)
+            {
+                m_workers.emplace_back([this, i] { WorkerLoop(i + 1); });
+            }
+        }
+
+        ~CTaskPool()
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_stop = true;
+            }
+            m_wake.notify_all();
+
+            for (auto& worker : m_workers)
+            {
+                worker.join();
+            }
+        }
+
+        // Returns the pool shared by the process, with one thread per processor (counting the calling thread).
+        // The pool is never destroyed: its idle threads are simply terminated with the process, which avoids joining
+        // them while a DLL is being unloaded.
+        static CTaskPool& GetInstance()
+        {
+            static CTaskPool* s_pInstance = new CTaskPool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+            return *s_pInstance;
+        }
+
+        // Number of threads doing the work of ParallelFor, including the calling thread
+        unsigned int GetThreadCount() const
+        {
+            return m_threadCount;
+        }
+
+        // Calls body(index) for every index in [0, count) and returns when all the calls are done.
+        // maxThreads limits the number of threads used (0 uses all of them). The body must not throw.
+        // The calls are made on the calling thread only when the pool is already running another ParallelFor, when called
+        // from the body of a ParallelFor (of any pool), or when there is nothing to parallelize.
+        template <typename TBody>
+        void ParallelFor(size_t count, TBody&& body, unsigned int maxThreads = 0)
+        {
+            unsigned int threads = m_threadCount;
+            if (maxThreads != 0 && maxThreads < threads)
+                threads = maxThreads;
+            if (count < threads)
+                threads = static_cast<unsigned int>(count);
+
+            // A nested call must not try to lock m_runLock again on the calling thread, which already owns it
+            bool& fInParallelFor = IsInParallelFor();
+            std::unique_lock<std::mutex> runLock(m_runLock, std::defer_lock);
+            if (threads <= 1 || fInParallelFor || !runLock.try_lock())
+            {
+                for (size_t index = 0; index < count; index++)
+                {
+                    body(index);
+                }
+                return;
+            }
+
+            typedef typename std::remove_reference<TBody>::type TBodyType;
+            fInParallelFor = true;
+            Run(count, threads, &InvokeBody<TBodyType>, const_cast<void*>(static_cast<const void*>(&body)));
+            fInParallelFor = false;
+        }
+
+    private:
+        // Range of indices left to a thread
+        struct Queue
+        {
+            std::mutex lock;
+            size_t begin;
+            size_t end;
+            // Keeps the queues of different threads in different cache lines
+            char padding[64];
+
+            Queue() : begin(0), end(0)
+            {
+            }
+        };
+
+        // Number of chunks each thread range is taken in, to balance the load without taking the queue lock for every index
+        static const size_t k_ChunksPerRange = 8;
+
+        // True on the threads running the bodies of a ParallelFor: the pool threads, and the calling thread during the call
+        static bool& IsInParallelFor()
+        {
+            thread_local bool t_fInParallelFor = false;
+            return t_fInParallelFor;
+        }
+
+        template <typename TBody>
+        static void InvokeBody(void* pBody, size_t index)
+        {
+            (*static_cast<TBody*>(pBody))(index);
+        }
+
+        void Run(size_t count, unsigned int threads, void (*pfnInvoke)(void*, size_t), void* pBody)
+        {
+            // No worker is running, so the queues can be set without locking; the generation change below publishes them
+            size_t rangeSize = (count + threads - 1) / threads;
+            m_chunkSize = std::max<size_t>(1, rangeSize / k_ChunksPerRange);
+            for (unsigned int i = 0; i < threads; i++)
+            {
+                m_queues[i].begin = std::min(count, i * rangeSize);
+                m_queues[i].end = std::min(count, (i + 1) * rangeSize);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_lock);
+                m_pfnInvoke = pfnInvoke;
+                m_pBody = pBody;
+                m_participants = threads;
+                m_activeWorkers = threads - 1;
+                m_generation++;
+            }
+            m_wake.notify_all();
+
+            ProcessQueues(0, threads);
+
+            // Wait for the workers to finish, so none of them uses the body after we return
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_done.wait(lock, [this] { return m_activeWorkers == 0; });
+        }
+
+        void WorkerLoop(unsigned int self)
+        {
+            IsInParallelFor() = true;
+
+            uint64_t lastGeneration = 0;
+            for (;;)
+            {
+                unsigned int participants = 0;
+                {
+                    std::unique_lock<std::mutex> lock(m_lock);
+                    m_wake.wait(lock, [&] { return m_stop || m_generation != lastGeneration; });
+                    if (m_stop)
+                        return;
+
+                    lastGeneration = m_generation;
+                    participants = m_participants;
+                }
+
+                if (self >= participants)
+                    continue;
+
+                ProcessQueues(self, participants);
+
+                std::lock_guard<std::mutex> lock(m_lock);
+                if (--m_activeWorkers == 0)
+                {
+                    m_done.notify_one();
+                }
+            }
+        }
+
+        void ProcessQueues(unsigned int self, unsigned int participants)
+        {
+            size_t first = 0;
+            size_t last = 0;
+            while (TakeChunk(self, &first, &last) || StealRange(self, participants))
+            {
+                for (size_t index = first; index < last; index++)
+                {
+                    m_pfnInvoke(m_pBody, index);
+                }
+                first = last = 0;
+            }
+        }
+
+        // Takes the next chunk from the front of the thread's own range
+        bool TakeChunk(unsigned int self, size_t* pFirst, size_t* pLast)
+        {
+            Queue& queue = m_queues[self];
+            std::lock_guard<std::mutex> lock(queue.lock);
+            if (queue.begin == queue.end)
+                return false;
+
+            *pFirst = queue.begin;
+            *pLast = std::min(queue.end, queue.begin + m_chunkSize);
+            queue.begin = *pLast;
+            return true;
+        }
+
+        // Moves the back half of another thread's range to the thread's own range. Returns false when there is nothing left to steal.
+        // Work is only ever moved to the range of a thread that is still running, so no index is left behind when a thread gives up.
+        bool StealRange(unsigned int self, unsigned int participants)
+        {
+            for (unsigned int i = 1; i < participants; i++)
+            {
+                Queue& victim = m_queues[(self + i) % participants];
+                size_t first = 0;
+                size_t last = 0;
+                {
+                    std::lock_guard<std::mutex> lock(victim.lock);
+                    size_t remaining = victim.end - victim.begin;
+                    if (remaining == 0)
+                        continue;
+
+                    last = victim.end;
+                    first = last - (remaining + 1) / 2;
+                    victim.end = first;
+                }
+
+                Queue& queue = m_queues[self];
+                std::lock_guard<std::mutex> lock(queue.lock);
+                queue.begin = first;
+                queue.end = last;
+                return true;
+            }
+
+            return false;
+        }
+
+        std::unique_ptr<Queue[]> m_queues;
+        std::vector<std::thread> m_workers;
+        const unsigned int m_threadCount;
+        size_t m_chunkSize;
+
+        // Serializes the ParallelFor calls using the pool threads
+        std::mutex m_runLock;
+
+        // Protects the job description below, and the worker wake up and completion
+        std::mutex m_lock;
+        std::condition_variable m_wake;
+        std::condition_variable m_done;
+        bool m_stop;
+        uint64_t m_generation;
+        unsigned int m_participants;
+        unsigned int m_activeWorkers;
+        void (*m_pfnInvoke)(void*, size_t);
+        void* m_pBody;
+    };
+
+} // namespace
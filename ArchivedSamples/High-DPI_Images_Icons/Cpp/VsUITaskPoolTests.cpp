@@ -0,0 +1,215 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Tests of CTaskPool: every index is processed exactly once whatever the
+// number of threads, and the calls that can't use the pool threads (nested
+// calls, concurrent calls, single threads) run the bodies on the calling thread.
+// The bodies only update atomics; the checks are made once ParallelFor returns.
+//-----------------------------------------------------------------------------
+#include "VsUITaskPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "VsUITests.h"
+
+using namespace VsUI;
+
+namespace
+{
+    // Records the threads running the bodies of a ParallelFor call
+    class CThreadSet
+    {
+    public:
+        void Add()
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_threads.insert(std::this_thread::get_id());
+        }
+
+        size_t GetCount() const
+        {
+            return m_threads.size();
+        }
+
+        bool IsOnlyCallingThread() const
+        {
+            return m_threads.size() == 1 && *m_threads.begin() == std::this_thread::get_id();
+        }
+
+    private:
+        std::mutex m_lock;
+        std::set<std::thread::id> m_threads;
+    };
+
+    // Waits for the flag without depending on the number of processors
+    void WaitFor(const std::atomic<bool>& flag)
+    {
+        while (!flag.load())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+VSUI_TEST(EveryIndexRunsExactlyOnce)
+{
+    for (unsigned int workers : { 0u, 1u, 3u, 7u })
+    {
+        CTaskPool pool(workers);
+        VSUI_CHECK_EQUAL(workers + 1, pool.GetThreadCount());
+
+        for (size_t count : { 0, 1, 2, 3, 7, 8, 9, 64, 1000 })
+        {
+            for (unsigned int maxThreads : { 0u, 1u, 2u, 5u, 100u })
+            {
+                std::vector<std::atomic<int>> calls(count);
+                for (auto& call : calls)
+                {
+                    call.store(0);
+                }
+
+                CThreadSet threads;
+                pool.ParallelFor(count, [&](size_t index)
+                {
+                    calls[index]++;
+                    threads.Add();
+                }, maxThreads);
+
+                for (size_t index = 0; index < count; index++)
+                {
+                    if (!VSUI_CHECK_EQUAL(1, calls[index].load()))
+                    {
+                        fprintf(stderr, "    %u workers, count %u, maxThreads %u, index %u\n", workers, static_cast<unsigned int>(count),
+                            maxThreads, static_cast<unsigned int>(index));
+                        return;
+                    }
+                }
+
+                // maxThreads and count both limit the number of threads used
+                size_t maxUsed = (maxThreads != 0 && maxThreads < workers + 1) ? maxThreads : workers + 1;
+                VSUI_CHECK(threads.GetCount() <= std::min(maxUsed, count));
+                if (maxThreads == 1 && count != 0)
+                {
+                    VSUI_CHECK(threads.IsOnlyCallingThread());
+                }
+            }
+        }
+    }
+}
+
+VSUI_TEST(FewerIndicesThanThreadsRunOnePerThreadAtMost)
+{
+    CTaskPool pool(7);
+    for (size_t count = 1; count < pool.GetThreadCount(); count++)
+    {
+        std::vector<std::atomic<int>> calls(count);
+        for (auto& call : calls)
+        {
+            call.store(0);
+        }
+
+        CThreadSet threads;
+        pool.ParallelFor(count, [&](size_t index)
+        {
+            calls[index]++;
+            threads.Add();
+        });
+
+        for (auto& call : calls)
+        {
+            VSUI_CHECK_EQUAL(1, call.load());
+        }
+        VSUI_CHECK(threads.GetCount() <= count);
+    }
+
+    // A single index never leaves the calling thread
+    CThreadSet threads;
+    pool.ParallelFor(1, [&](size_t) { threads.Add(); });
+    VSUI_CHECK(threads.IsOnlyCallingThread());
+}
+
+VSUI_TEST(NestedCallsRunOnTheThreadOfTheBody)
+{
+    CTaskPool pool(3);
+    CTaskPool otherPool(3);
+    const size_t count = 16;
+    std::atomic<int> innerCalls(0);
+    std::atomic<int> innerCallsOnOtherThreads(0);
+
+    pool.ParallelFor(count, [&](size_t)
+    {
+        std::thread::id outerThread = std::this_thread::get_id();
+        auto body = [&](size_t)
+        {
+            innerCalls++;
+            if (std::this_thread::get_id() != outerThread)
+            {
+                innerCallsOnOtherThreads++;
+            }
+        };
+
+        // The same pool, and another pool whose threads are idle
+        pool.ParallelFor(count, body);
+        otherPool.ParallelFor(count, body);
+    });
+
+    VSUI_CHECK_EQUAL(static_cast<int>(2 * count * count), innerCalls.load());
+    VSUI_CHECK_EQUAL(0, innerCallsOnOtherThreads.load());
+}
+
+VSUI_TEST(ConcurrentCallersFallBackToSerial)
+{
+    CTaskPool pool(3);
+    std::atomic<bool> fRunning(false);
+    std::atomic<bool> fRelease(false);
+
+    // The first caller keeps the pool busy until the second call is done
+    std::thread firstCaller([&]
+    {
+        pool.ParallelFor(8, [&](size_t)
+        {
+            fRunning = true;
+            WaitFor(fRelease);
+        });
+    });
+    WaitFor(fRunning);
+
+    std::vector<std::atomic<int>> calls(100);
+    for (auto& call : calls)
+    {
+        call.store(0);
+    }
+    CThreadSet threads;
+    pool.ParallelFor(calls.size(), [&](size_t index)
+    {
+        calls[index]++;
+        threads.Add();
+    });
+
+    fRelease = true;
+    firstCaller.join();
+
+    for (auto& call : calls)
+    {
+        VSUI_CHECK_EQUAL(1, call.load());
+    }
+    VSUI_CHECK(threads.IsOnlyCallingThread());
+}
+
+VSUI_TEST(SharedPoolUsesOneThreadPerProcessor)
+{
+    VSUI_CHECK_EQUAL(std::max(1u, std::thread::hardware_concurrency()), CTaskPool::GetInstance().GetThreadCount());
+    VSUI_CHECK(&CTaskPool::GetInstance() == &CTaskPool::GetInstance());
+}
+
+VSUI_TEST_MAIN()
@@ -0,0 +1,122 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Minimal test harness for the tests of the portable VsUI headers
+// A test file declares its tests with VSUI_TEST and ends with
+// VSUI_TEST_MAIN(). A failed check is reported with its file and line, and
+// the test goes on, so a run reports all the failures at once. The checks
+// don't use assert, so they also run in release builds.
+// Doesn't depend on Windows.
+//-----------------------------------------------------------------------------
+#pragma once
+
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace VsUI
+{
+namespace Tests
+{
+    struct TestCase
+    {
+        const char* name;
+        void (*pfnTest)();
+    };
+
+    class CTestRunner
+    {
+    public:
+        static CTestRunner& GetInstance()
+        {
+            static CTestRunner s_instance;
+            return s_instance;
+        }
+
+        void Register(const char* name, void (*pfnTest)())
+        {
+            TestCase test = { name, pfnTest };
+            m_tests.push_back(test);
+        }
+
+        void ReportFailure(const char* file, int line, const std::string& message)
+        {
+            // Property tests loop over many values; only the first failures of a test are worth printing
+            if (m_testFailures++ < k_MaxReportedFailures)
+            {
+                fprintf(stderr, "%s(%d): check failed: %s\n", file, line, message.c_str());
+            }
+        }
+
+        int RunAll()
+        {
+            int failedTests = 0;
+            for (const TestCase& test : m_tests)
+            {
+                m_testFailures = 0;
+                test.pfnTest();
+                printf("[%s] %s\n", m_testFailures == 0 ? "  OK  " : " FAIL ", test.name);
+                if (m_testFailures != 0)
+                    failedTests++;
+            }
+
+            printf("%d of %d tests failed\n", failedTests, static_cast<int>(m_tests.size()));
+            return failedTests == 0 ? 0 : 1;
+        }
+
+    private:
+        static const int k_MaxReportedFailures = 10;
+
+        CTestRunner() : m_testFailures(0)
+        {
+        }
+
+        std::vector<TestCase> m_tests;
+        int m_testFailures;
+    };
+
+    struct CTestRegistration
+    {
+        CTestRegistration(const char* name, void (*pfnTest)())
+        {
+            CTestRunner::GetInstance().Register(name, pfnTest);
+        }
+    };
+
+    template <typename TExpected, typename TActual>
+    bool CheckEqual(const TExpected& expected, const TActual& actual, const char* expression, const char* file, int line)
+    {
+        if (expected == actual)
+            return true;
+
+        std::ostringstream message;
+        message << expression << " (expected " << expected << ", actual " << actual << ")";
+        CTestRunner::GetInstance().ReportFailure(file, line, message.str());
+        return false;
+    }
+
+} // namespace
+} // namespace
+
+#define VSUI_TEST(name) \
+    static void name(); \
+    static VsUI::Tests::CTestRegistration s_##name##Registration(#name, &name); \
+    static void name()
+
+#define VSUI_TEST_MAIN() \
+    int main() \
+    { \
+        return VsUI::Tests::CTestRunner::GetInstance().RunAll(); \
+    }
+
+// Both evaluate to the result of the check, so a loop can stop at its first failure
+#define VSUI_CHECK(condition) \
+    ((condition) ? true : (VsUI::Tests::CTestRunner::GetInstance().ReportFailure(__FILE__, __LINE__, #condition), false))
+
+#define VSUI_CHECK_EQUAL(expected, actual) \
+    VsUI::Tests::CheckEqual((expected), (actual), #actual, __FILE__, __LINE__)
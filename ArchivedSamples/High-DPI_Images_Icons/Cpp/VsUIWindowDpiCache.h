@@ -0,0 +1,130 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Cache of the DPI of windows, for the unit conversions that look up the DPI
+// of a window every time they are called
+// Windows are identified by the 32 significant bits of their handle (window
+// handles are shared between 32 and 64-bit processes, so they always fit in
+// 32 bits). Each cache slot is a single 64-bit atomic holding the window and
+// its DPI, so lookups from any thread don't take a lock.
+// The owner of the windows must invalidate the cache when the DPI of a window
+// changes (WM_DPICHANGED, or a new parent with a different DPI) and when a
+// window is destroyed, since its handle may be reused by a new window.
+// Doesn't depend on Windows: the DPI of a window is provided by the caller.
+//-----------------------------------------------------------------------------
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace VsUI
+{
+    class CWindowDpiCache
+    {
+    public:
+        CWindowDpiCache() :
+            m_fEnabled(false), m_invalidations(0)
+        {
+            for (auto& entry : m_entries)
+            {
+                entry.store(0, std::memory_order_relaxed);
+            }
+        }
+
+        // Returns the cache shared by the process
+        static CWindowDpiCache& GetInstance()
+        {
+            static CWindowDpiCache s_instance;
+            return s_instance;
+        }
+
+        // The cache starts disabled. Disabling it also removes all the cached values.
+        void Enable(bool fEnable)
+        {
+            m_fEnabled.store(fEnable);
+            if (!fEnable)
+            {
+                InvalidateAll();
+            }
+        }
+
+        bool IsEnabled() const
+        {
+            return m_fEnabled.load(std::memory_order_relaxed);
+        }
+
+        // Returns the DPI of the window, calling getDpi() to get it when it's not cached or when the cache is disabled.
+        // getDpi returns the DPI of the window, or 0 if it fails; failures are not cached.
+        template <typename TGetDpi>
+        unsigned int GetDpi(uint32_t window, TGetDpi&& getDpi)
+        {
+            if (window == 0 || !IsEnabled())
+                return getDpi();
+
+            std::atomic<uint64_t>& entry = m_entries[GetSlot(window)];
+            uint64_t value = entry.load(std::memory_order_acquire);
+            if (static_cast<uint32_t>(value >> 32) == window)
+                return static_cast<unsigned int>(value);
+
+            // Read the invalidation count before getting the DPI: if the DPI changes while we get it, the window is invalidated
+            // after the count is incremented, so we either see the new count below, or the invalidation removes the value we add.
+            uint32_t invalidations = m_invalidations.load();
+            unsigned int dpi = getDpi();
+            if (dpi == 0)
+                return dpi;
+
+            uint64_t newValue = (static_cast<uint64_t>(window) << 32) | dpi;
+            entry.store(newValue);
+            if (m_invalidations.load() != invalidations)
+            {
+                entry.compare_exchange_strong(newValue, 0);
+            }
+
+            return dpi;
+        }
+
+        // Removes the cached DPI of the window (e.g. when the window is destroyed)
+        void Invalidate(uint32_t window)
+        {
+            m_invalidations++;
+
+            std::atomic<uint64_t>& entry = m_entries[GetSlot(window)];
+            uint64_t value = entry.load();
+            while (static_cast<uint32_t>(value >> 32) == window && !entry.compare_exchange_weak(value, 0))
+            {
+            }
+        }
+
+        // Removes all the cached values (e.g. when the DPI of a window changes, which changes the DPI of its child windows too)
+        void InvalidateAll()
+        {
+            m_invalidations++;
+
+            for (auto& entry : m_entries)
+            {
+                entry.store(0);
+            }
+        }
+
+    private:
+        // Number of windows cached; more windows than this still work, but evict each other
+        static const uint32_t k_SlotBits = 8;
+        static const uint32_t k_SlotCount = 1u << k_SlotBits;
+
+        static uint32_t GetSlot(uint32_t window)
+        {
+            // Window handles are multiples of 2 or 4, so mix the bits before taking the slot from the top bits
+            return (window * 0x9E3779B1u) >> (32 - k_SlotBits);
+        }
+
+        // Each entry has the window in the high 32 bits and its DPI in the low 32 bits, or 0 when empty
+        std::atomic<uint64_t> m_entries[k_SlotCount];
+        std::atomic<bool> m_fEnabled;
+        std::atomic<uint32_t> m_invalidations;
+    };
+
+} // namespace
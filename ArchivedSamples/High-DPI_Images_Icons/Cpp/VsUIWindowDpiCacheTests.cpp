@@ -0,0 +1,275 @@
+//Copyright (c) Microsoft.  All rights reserved.
+// Licensed under the MIT license. See LICENSE file in the project root for full license information.
+//-----------------------------------------------------------------------
+// </copyright>
+// <summary>Assembly info.</summary>
+
+//-----------------------------------------------------------------------------
+// Tests of CWindowDpiCache: what is cached, and the invalidation of the
+// cached values, including invalidations racing with lookups
+//-----------------------------------------------------------------------------
+#include "VsUIWindowDpiCache.h"
+
+#include <thread>
+#include <vector>
+
+#include "VsUITests.h"
+
+using namespace VsUI;
+
+namespace
+{
+    // DPI of fake windows, whose handles are multiples of 4, and the number of times it was asked for
+    class CFakeWindows
+    {
+    public:
+        static const uint32_t k_WindowCount = 4096;
+
+        CFakeWindows() : m_calls(0)
+        {
+            SetAllDpi(96);
+        }
+
+        void SetDpi(uint32_t window, unsigned int dpi)
+        {
+            m_dpi[window / 4 % k_WindowCount].store(dpi);
+        }
+
+        void SetAllDpi(unsigned int dpi)
+        {
+            for (auto& windowDpi : m_dpi)
+            {
+                windowDpi.store(dpi);
+            }
+        }
+
+        unsigned int GetDpi(CWindowDpiCache& cache, uint32_t window)
+        {
+            return cache.GetDpi(window, [this, window]
+            {
+                m_calls++;
+                return m_dpi[window / 4 % k_WindowCount].load();
+            });
+        }
+
+        long GetCalls() const
+        {
+            return m_calls.load();
+        }
+
+    private:
+        std::atomic<unsigned int> m_dpi[k_WindowCount];
+        std::atomic<long> m_calls;
+    };
+
+    // Window handles are multiples of 4
+    const uint32_t k_Window = 0x10004;
+    const uint32_t k_OtherWindow = 0x10008;
+}
+
+VSUI_TEST(DisabledCacheGetsTheDpiEveryTime)
+{
+    CWindowDpiCache cache;
+    CFakeWindows windows;
+
+    VSUI_CHECK(!cache.IsEnabled());
+    VSUI_CHECK_EQUAL(96u, windows.GetDpi(cache, k_Window));
+    VSUI_CHECK_EQUAL(96u, windows.GetDpi(cache, k_Window));
+    VSUI_CHECK_EQUAL(2, windows.GetCalls());
+}
+
+VSUI_TEST(EnabledCacheGetsTheDpiOnce)
+{
+    CWindowDpiCache cache;
+    CFakeWindows windows;
+    cache.Enable(true);
+
+    VSUI_CHECK(cache.IsEnabled());
+    VSUI_CHECK_EQUAL(96u, windows.GetDpi(cache, k_Window));
+    windows.SetDpi(k_Window, 144);
+    VSUI_CHECK_EQUAL(96u, windows.GetDpi(cache, k_Window));
+    VSUI_CHECK_EQUAL(1, windows.GetCalls());
+}
+
+VSUI_TEST(InvalidateRemovesOnlyTheWindow)
+{
+    CWindowDpiCache cache;
+    CFakeWindows windows;
+    cache.Enable(true);
+    windows.GetDpi(cache, k_Window);
+    windows.GetDpi(cache, k_OtherWindow);
+
+    windows.SetDpi(k_Window, 144);
+    windows.SetDpi(k_OtherWindow, 144);
+    cache.Invalidate(k_Window);
+
+    VSUI_CHECK_EQUAL(144u, windows.GetDpi(cache, k_Window));
+    VSUI_CHECK_EQUAL(96u, windows.GetDpi(cache, k_OtherWindow));
+    VSUI_CHECK_EQUAL(3, windows.GetCalls());
+}
+
+VSUI_TEST(InvalidateOfUncachedWindowKeepsTheOthers)
+{
+    CWindowDpiCache cache;
+    CFakeWindows windows;
+    cache.Enable(true);
+    windows.GetDpi(cache, k_Window);
+
+    cache.Invalidate(k_OtherWindow);
+    VSUI_CHECK_EQUAL(96u, windows.GetDpi(cache, k_Window));
+    VSUI_CHECK_EQUAL(1, windows.GetCalls());
+}
+
+VSUI_TEST(InvalidateAllRemovesEveryWindow)
+{
+    CWindowDpiCache cache;
+    CFakeWindows windows;
+    cache.Enable(true);
+    for (uint32_t window = 4; window <= 64; window += 4)
+    {
+        windows.GetDpi(cache, window);
+    }
+
+    windows.SetAllDpi(192);
+    cache.InvalidateAll();
+    for (uint32_t window = 4; window <= 64; window += 4)
+    {
+        VSUI_CHECK_EQUAL(192u, windows.GetDpi(cache, window));
+    }
+    VSUI_CHECK_EQUAL(32, windows.GetCalls());
+}
+
+VSUI_TEST(DisablingRemovesEveryWindow)
+{
+    CWindowDpiCache cache;
+    CFakeWindows windows;
+    cache.Enable(true);
+    windows.GetDpi(cache, k_Window);
+
+    windows.SetDpi(k_Window, 120);
+    cache.Enable(false);
+    cache.Enable(true);
+    VSUI_CHECK_EQUAL(120u, windows.GetDpi(cache, k_Window));
+    VSUI_CHECK_EQUAL(2, windows.GetCalls());
+}
+
+VSUI_TEST(FailuresAreNotCached)
+{
+    CWindowDpiCache cache;
+    CFakeWindows windows;
+    cache.Enable(true);
+
+    windows.SetDpi(k_Window, 0);
+    VSUI_CHECK_EQUAL(0u, windows.GetDpi(cache, k_Window));
+    windows.SetDpi(k_Window, 120);
+    VSUI_CHECK_EQUAL(120u, windows.GetDpi(cache, k_Window));
+    VSUI_CHECK_EQUAL(120u, windows.GetDpi(cache, k_Window));
+    VSUI_CHECK_EQUAL(2, windows.GetCalls());
+}
+
+VSUI_TEST(NullWindowIsNotCached)
+{
+    CWindowDpiCache cache;
+    CFakeWindows windows;
+    cache.Enable(true);
+
+    windows.GetDpi(cache, 0);
+    windows.GetDpi(cache, 0);
+    VSUI_CHECK_EQUAL(2, windows.GetCalls());
+}
+
+VSUI_TEST(WindowsSharingASlotGetTheirOwnDpi)
+{
+    // More windows than slots: they evict each other, but each lookup still returns the DPI of its window
+    CWindowDpiCache cache;
+    CFakeWindows windows;
+    cache.Enable(true);
+    for (uint32_t window = 4; window < 4 * CFakeWindows::k_WindowCount; window += 4)
+    {
+        windows.SetDpi(window, 96 + window % 1000);
+    }
+
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (uint32_t window = 4; window < 4 * CFakeWindows::k_WindowCount; window += 4)
+        {
+            if (!VSUI_CHECK_EQUAL(96 + window % 1000, windows.GetDpi(cache, window)))
+                return;
+        }
+    }
+}
+
+VSUI_TEST(InvalidationDuringLookupIsNotLost)
+{
+    // The DPI changes, and the window is invalidated, while the cache is getting the old DPI: the old DPI must not stay cached
+    CWindowDpiCache cache;
+    cache.Enable(true);
+
+    unsigned int dpi = cache.GetDpi(k_Window, [&]
+    {
+        cache.Invalidate(k_Window);
+        return 96u;
+    });
+    VSUI_CHECK_EQUAL(96u, dpi);
+    VSUI_CHECK_EQUAL(144u, cache.GetDpi(k_Window, [] { return 144u; }));
+
+    dpi = cache.GetDpi(k_OtherWindow, [&]
+    {
+        cache.InvalidateAll();
+        return 96u;
+    });
+    VSUI_CHECK_EQUAL(96u, dpi);
+    VSUI_CHECK_EQUAL(192u, cache.GetDpi(k_OtherWindow, [] { return 192u; }));
+}
+
+VSUI_TEST(ConcurrentLookupsSeeInvalidations)
+{
+    // Readers keep looking up windows while the DPI changes: once a change is invalidated, every lookup returns the new DPI
+    CWindowDpiCache cache;
+    CFakeWindows windows;
+    cache.Enable(true);
+
+    std::atomic<bool> fStop(false);
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; i++)
+    {
+        readers.emplace_back([&]
+        {
+            while (!fStop.load())
+            {
+                for (uint32_t window = 4; window < 2400; window += 4)
+                {
+                    windows.GetDpi(cache, window);
+                }
+            }
+        });
+    }
+
+    for (unsigned int round = 0; round < 200; round++)
+    {
+        unsigned int dpi = 96 + round;
+        windows.SetAllDpi(dpi);
+        cache.InvalidateAll();
+        for (uint32_t window = 4; window < 2400; window += 4)
+        {
+            if (!VSUI_CHECK_EQUAL(dpi, windows.GetDpi(cache, window)))
+                break;
+        }
+    }
+
+    for (uint32_t round = 0; round < 2000; round++)
+    {
+        uint32_t window = 4 * (1 + round % 599);
+        windows.SetDpi(window, 1000 + round);
+        cache.Invalidate(window);
+        VSUI_CHECK_EQUAL(1000 + round, windows.GetDpi(cache, window));
+    }
+
+    fStop.store(true);
+    for (auto& reader : readers)
+    {
+        reader.join();
+    }
+}
+
+VSUI_TEST_MAIN()
@@ -8,6 +8,9 @@
 #include "WinDef.h"
 #include "WinUser.h"
 
+#include "VsUIMulDiv.h"
+#include "VsUIWindowDpiCache.h"
+
 #pragma region Registry path defines
 
 // Defines for the .NET setup registry key used to determine if the current version has the required
@@ -98,7 +101,7 @@ namespace VsUI
                 return S_OK;
             }
 
-            UINT dpi = s_pGetDFW(hwnd);
+            UINT dpi = CWindowDpiCache::GetInstance().GetDpi(HandleToULong(hwnd), [hwnd] { return s_pGetDFW(hwnd); });
             if (dpi == 0)
                 return HRESULT_FROM_WIN32(GetLastError());
 
@@ -109,6 +112,34 @@ namespace VsUI
 
         #pragma endregion Get DPI methods
 
+        #pragma region Window DPI cache methods
+
+        // Turns on (or off) caching the DPI of the windows passed to GetDpiForWindow and to the
+        // conversion methods. The cache is off by default, since it's only correct if the windows
+        // notify it of their DPI changes: when it's on, OnWindowDpiChanged must be called for
+        // WM_DPICHANGED and WM_DPICHANGED_AFTERPARENT and after changing the parent of a window,
+        // and OnWindowDestroyed for WM_NCDESTROY.
+        static void EnableWindowDpiCache(bool enable)
+        {
+            CWindowDpiCache::GetInstance().Enable(enable);
+        }
+
+        // Removes the cached DPI values after the DPI of a window changed. The DPI of the child
+        // windows changes with their parent, so all the cached values are removed.
+        static void OnWindowDpiChanged()
+        {
+            CWindowDpiCache::GetInstance().InvalidateAll();
+        }
+
+        // Removes the cached DPI of a destroyed window, so a new window getting the same handle
+        // doesn't get its DPI.
+        static void OnWindowDestroyed(_In_ HWND hwnd)
+        {
+            CWindowDpiCache::GetInstance().Invalidate(HandleToULong(hwnd));
+        }
+
+        #pragma endregion Window DPI cache methods
+
         #pragma region Device to logical conversion methods
 
         // Converts a POINT from device units to logical units.
@@ -141,6 +172,24 @@ namespace VsUI
             return ConvertUnits(hwnd, ConversionDirection::DeviceToLogical, Orientation::Vertical, pValue);
         }
 
+        // Converts an array of POINTs from device units to logical units, with the same results as converting them one at a time.
+        static HRESULT DeviceToLogicalPoints(_In_ HWND hwnd, _Inout_updates_(count) POINT *pPoints, size_t count)
+        {
+            return ConvertPairs(hwnd, ConversionDirection::DeviceToLogical, reinterpret_cast<LONG*>(pPoints), count);
+        }
+
+        // Converts an array of RECTs from device units to logical units, with the same results as converting them one at a time.
+        static HRESULT DeviceToLogicalRects(_In_ HWND hwnd, _Inout_updates_(count) RECT *pRects, size_t count)
+        {
+            return ConvertPairs(hwnd, ConversionDirection::DeviceToLogical, reinterpret_cast<LONG*>(pRects), 2 * count);
+        }
+
+        // Converts an array of SIZEs from device units to logical units, with the same results as converting them one at a time.
+        static HRESULT DeviceToLogicalSizes(_In_ HWND hwnd, _Inout_updates_(count) SIZE *pSizes, size_t count)
+        {
+            return ConvertPairs(hwnd, ConversionDirection::DeviceToLogical, reinterpret_cast<LONG*>(pSizes), count);
+        }
+
         #pragma endregion Device to logical conversion methods
 
         #pragma region Logical to device conversion methods
@@ -175,6 +224,24 @@ namespace VsUI
             return ConvertUnits(hwnd, ConversionDirection::LogicalToDevice, Orientation::Vertical, pValue);
         }
 
+        // Converts an array of POINTs from logical units to device units, with the same results as converting them one at a time.
+        static HRESULT LogicalToDevicePoints(_In_ HWND hwnd, _Inout_updates_(count) POINT *pPoints, size_t count)
+        {
+            return ConvertPairs(hwnd, ConversionDirection::LogicalToDevice, reinterpret_cast<LONG*>(pPoints), count);
+        }
+
+        // Converts an array of RECTs from logical units to device units, with the same results as converting them one at a time.
+        static HRESULT LogicalToDeviceRects(_In_ HWND hwnd, _Inout_updates_(count) RECT *pRects, size_t count)
+        {
+            return ConvertPairs(hwnd, ConversionDirection::LogicalToDevice, reinterpret_cast<LONG*>(pRects), 2 * count);
+        }
+
+        // Converts an array of SIZEs from logical units to device units, with the same results as converting them one at a time.
+        static HRESULT LogicalToDeviceSizes(_In_ HWND hwnd, _Inout_updates_(count) SIZE *pSizes, size_t count)
+        {
+            return ConvertPairs(hwnd, ConversionDirection::LogicalToDevice, reinterpret_cast<LONG*>(pSizes), count);
+        }
+
         #pragma endregion Logical to device conversion methods
 
         #pragma region DPI awareness methods
@@ -473,24 +540,60 @@ namespace VsUI
             return hr;
         }
 
-        // This method implicitly casts both input values to doubles. (Normally they'd be an int
-        // and UINT respectively.) This is done to prevent truncating the intermediate value that
-        // results from the multiplication operation if it would normally exceed the max value of
-        // an int.
-        static int ScaleValue(double originalValue, double dpi, ConversionDirection conversion)
+        // Converts the given array of (x, y) pairs between device and logical units based on the DPI
+        // of the given HWND. The values are converted with SIMD instructions when possible, with
+        // the same results as ScaleValue.
+        static HRESULT ConvertPairs(_In_ HWND hwnd, ConversionDirection conversion, _Inout_updates_(2 * pairCount) LONG *pValues, size_t pairCount)
+        {
+            if (pValues == nullptr)
+                return E_POINTER;
+
+            HRESULT hr = S_OK;
+
+            UINT dpiX, dpiY;
+            if (SUCCEEDED(hr = GetDpiForWindow(hwnd, &dpiX, &dpiY)))
+            {
+                CMulDivFactor::ApplyToPairs(pValues, pairCount, GetScaleFactor(dpiX, conversion), GetScaleFactor(dpiY, conversion));
+            }
+
+            return hr;
+        }
+
+        static CMulDivFactor GetScaleFactor(UINT dpi, ConversionDirection conversion)
         {
             if (conversion == ConversionDirection::DeviceToLogical)
-                return Round((originalValue * k_DefaultLogicalDpi) / dpi);
+                return CMulDivFactor(k_DefaultLogicalDpi, (int)dpi);
             else
-                return Round((originalValue * dpi) / k_DefaultLogicalDpi);
+                return CMulDivFactor((int)dpi, k_DefaultLogicalDpi);
         }
 
-        static int Round(double value)
+        // Rounds like MulDiv. The conversions for the common DPI values divide by constants, which
+        // compile to multiplications and shifts, and the others use 64-bit integer math so the
+        // intermediate value of the multiplication doesn't overflow.
+        static int ScaleValue(int originalValue, UINT dpi, ConversionDirection conversion)
         {
-            if (value >= 0)
-                return (int)(value + 0.5);
+            if (conversion == ConversionDirection::DeviceToLogical)
+            {
+                switch (dpi)
+                {
+                case 96:  return originalValue;
+                case 120: return Dpi120To96::Apply(originalValue);
+                case 144: return Dpi144To96::Apply(originalValue);
+                case 192: return Dpi192To96::Apply(originalValue);
+                default:  return MulDivReference(originalValue, k_DefaultLogicalDpi, (int)dpi);
+                }
+            }
             else
-                return (int)(value - 0.5);
+            {
+                switch (dpi)
+                {
+                case 96:  return originalValue;
+                case 120: return Dpi96To120::Apply(originalValue);
+                case 144: return Dpi96To144::Apply(originalValue);
+                case 192: return Dpi96To192::Apply(originalValue);
+                default:  return MulDivReference(originalValue, (int)dpi, k_DefaultLogicalDpi);
+                }
+            }
         }
 
         #pragma endregion Unit conversion helpers